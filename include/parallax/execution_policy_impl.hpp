@@ -5,9 +5,17 @@
 #include "parallax/lambda_compiler.hpp"
 #include "parallax/kernel_launcher.hpp"
 #include "parallax/vulkan_backend.hpp"
+#include "parallax/hybrid_split.hpp"
+#include "parallax/host_pool.hpp"
+#include "parallax/kernel_table.hpp"
+#include "parallax/staging.hpp"
+#include <parallax/runtime.h>
 #include <algorithm>
+#include <chrono>
 #include <execution>
-#include <unordered_set>
+#include <future>
+#include <iterator>
+#include <utility>
 #include <iostream>
 #include "parallax/kernel_launcher.hpp"
 
@@ -16,6 +24,139 @@ namespace parallax {
 // Implementation of template methods for ExecutionPolicyImpl
 // This header bridges the Compiler module and Runtime module
 
+// Every CPU path below (launch failure, no launcher, no GPU reduction, small ranges)
+// runs on the HostPool work-stealing pool rather than std::execution::seq, so a call
+// that does not offload still gets par-class throughput. Ranges shorter than
+// PARALLAX_GPU_MIN_ELEMS (default 4096) are decided for the host up front: below that
+// the launch + sync round trip costs more than the whole range does on the pool.
+inline size_t offload_min_elems() {
+    static const size_t n = [] {
+        const char* v = std::getenv("PARALLAX_GPU_MIN_ELEMS");
+        return v ? static_cast<size_t>(std::strtoull(v, nullptr, 10)) : size_t(4096);
+    }();
+    return n;
+}
+
+// One compiler for every instantiation below: its LLVM context serializes compiles,
+// and the kernels it produces are shared through KernelTable.
+inline LambdaCompiler& jit_compiler() {
+    static LambdaCompiler compiler;
+    return compiler;
+}
+
+// One device reduction of n elements at data into *out. Runtimes whose
+// parallax_reduce reports a status (bool, or an int that is 0 on success) let the
+// caller finish a failed call on the host; a void one is taken to have succeeded.
+template<typename T>
+bool device_reduce(parallax_kernel_t kernel, void* data, size_t n, T* out) {
+    using Status = decltype(parallax_reduce(kernel, data, n, sizeof(T), out));
+    if constexpr (std::is_void_v<Status>) {
+        parallax_reduce(kernel, data, n, sizeof(T), out);
+        return true;
+    } else if constexpr (std::is_same_v<Status, bool>) {
+        return parallax_reduce(kernel, data, n, sizeof(T), out);
+    } else {
+        return parallax_reduce(kernel, data, n, sizeof(T), out) == 0;
+    }
+}
+
+// Staged offload of a non-contiguous range (see staging.hpp): chunks are gathered into
+// arena buffers, launch(buffer, n) runs the kernel `name` on each buffer in place, and
+// results are scattered back. A chunk whose launch fails or throws, and every chunk
+// after it, runs on the host pool instead; the chunks before it are already written
+// back and are not applied again.
+template<typename Iterator, typename UnaryFunction, typename Launch>
+void staged_for_each(const std::string& name, Iterator first, Iterator last, size_t count,
+                     UnaryFunction f, Launch launch) {
+    using T = typename std::iterator_traits<Iterator>::value_type;
+    const size_t chunk = staging_chunk_elems();
+    const size_t nchunks = (count + chunk - 1) / chunk;
+    StagingBuffers bufs(chunk * sizeof(T), 2);
+    if (!bufs.ok()) {
+        host_for_each(first, last, f);
+        return;
+    }
+    auto len = [&](size_t k) { return std::min(chunk, count - k * chunk); };
+    Iterator gather_it = first, scatter_it = first;
+    size_t done = run_staged(nchunks,
+        [&](size_t k, unsigned slot) {
+            T* p = static_cast<T*>(bufs.slot(slot));
+            for (size_t i = 0, n = len(k); i < n; ++i, ++gather_it) p[i] = *gather_it;
+        },
+        [&](size_t k, unsigned slot) { return launch(bufs.slot(slot), len(k)); },
+        [&](size_t k, unsigned slot) {
+            const T* p = static_cast<const T*>(bufs.slot(slot));
+            for (size_t i = 0, n = len(k); i < n; ++i, ++scatter_it) *scatter_it = p[i];
+        });
+    if (done < nchunks) {
+        std::cerr << "Parallax JIT: staged launch failed for " << name << " at chunk " << done
+                  << " of " << nchunks << "; finishing on CPU" << std::endl;
+        host_for_each(scatter_it, last, f);
+    }
+}
+
+// staged_for_each for transform: the input is gathered, launch(in, out, n) writes a
+// separate output slot, and that slot is scattered through d_first.
+template<typename InputIt, typename OutputIt, typename UnaryOperation, typename Launch>
+OutputIt staged_transform(const std::string& name, InputIt first, InputIt last, OutputIt d_first,
+                          size_t count, UnaryOperation op, Launch launch) {
+    using In = typename std::iterator_traits<InputIt>::value_type;
+    using Out = std::decay_t<std::invoke_result_t<UnaryOperation&, In>>;
+    const size_t chunk = staging_chunk_elems();
+    const size_t nchunks = (count + chunk - 1) / chunk;
+    StagingBuffers in(chunk * sizeof(In), 2), out(chunk * sizeof(Out), 2);
+    if (!in.ok() || !out.ok()) return host_transform(first, last, d_first, op);
+    auto len = [&](size_t k) { return std::min(chunk, count - k * chunk); };
+    InputIt gather_it = first;
+    OutputIt scatter_it = d_first;
+    size_t done = run_staged(nchunks,
+        [&](size_t k, unsigned slot) {
+            In* p = static_cast<In*>(in.slot(slot));
+            for (size_t i = 0, n = len(k); i < n; ++i, ++gather_it) p[i] = *gather_it;
+        },
+        [&](size_t k, unsigned slot) { return launch(in.slot(slot), out.slot(slot), len(k)); },
+        [&](size_t k, unsigned slot) {
+            const Out* p = static_cast<const Out*>(out.slot(slot));
+            for (size_t i = 0, n = len(k); i < n; ++i, ++scatter_it) *scatter_it = p[i];
+        });
+    if (done < nchunks) {
+        std::cerr << "Parallax JIT: staged launch failed for " << name << " at chunk " << done
+                  << " of " << nchunks << "; finishing on CPU" << std::endl;
+        return host_transform(std::next(first, done * chunk), last, scatter_it, op);
+    }
+    return scatter_it;
+}
+
+// Staged reduce: reduce(buffer, n, &partial) reduces each gathered chunk to one
+// partial on the device; the partials of the chunks that completed and init are
+// combined on the host, and the chunks from the first failed one on are reduced on
+// the host pool.
+template<typename InputIt, typename T, typename BinaryOperation, typename Reduce>
+T staged_reduce(const std::string& name, InputIt first, InputIt last, size_t count,
+                T init, BinaryOperation op, Reduce reduce) {
+    const size_t chunk = staging_chunk_elems();
+    const size_t nchunks = (count + chunk - 1) / chunk;
+    StagingBuffers bufs(chunk * sizeof(T), 2);
+    if (!bufs.ok()) return host_reduce(first, last, init, op);
+    auto len = [&](size_t k) { return std::min(chunk, count - k * chunk); };
+    std::vector<T> partials(nchunks);
+    InputIt gather_it = first;
+    size_t done = run_staged(nchunks,
+        [&](size_t k, unsigned slot) {
+            T* p = static_cast<T*>(bufs.slot(slot));
+            for (size_t i = 0, n = len(k); i < n; ++i, ++gather_it) p[i] = *gather_it;
+        },
+        [&](size_t k, unsigned slot) { return reduce(bufs.slot(slot), len(k), &partials[k]); },
+        [](size_t, unsigned) {});
+    for (size_t k = 0; k < done; ++k) init = op(init, partials[k]);
+    if (done < nchunks) {
+        std::cerr << "Parallax JIT: staged reduce failed for " << name << " at chunk " << done
+                  << " of " << nchunks << "; finishing on CPU" << std::endl;
+        return host_reduce(std::next(first, done * chunk), last, init, op);
+    }
+    return init;
+}
+
 template<typename Iterator, typename UnaryFunction>
 void ExecutionPolicyImpl::for_each_impl(Iterator first, Iterator last, UnaryFunction f) {
     // Access runtime components via global instance or singleton logic if needed
@@ -37,17 +178,29 @@ void ExecutionPolicyImpl::for_each_impl(Iterator first, Iterator last, UnaryFunc
     // No, that's messy.
     
     // Let's rely on the LambdaCompiler directly here.
-    
-    static LambdaCompiler compiler;
-    static std::unordered_map<std::string, std::vector<uint32_t>> cache;
+    // Kernels live in the shared KernelTable: calls from many host threads look them
+    // up by integer key, and each is compiled and loaded once.
+
+    if (static_cast<size_t>(std::distance(first, last)) < offload_min_elems()) {
+        host_for_each(first, last, f);
+        return;
+    }
     
     try {
         // 1. Compile
-        std::string name = compiler.get_kernel_name(f);
-        if (cache.find(name) == cache.end()) {
-            std::cerr << "Parallax JIT: Compiling " << name << "..." << std::endl;
-            cache[name] = compiler.compile(f);
+        LambdaCompiler& compiler = jit_compiler();
+        KernelTable::Entry& kernel = KernelTable::instance().get(compiler.get_kernel_key(f));
+        std::call_once(kernel.compiled, [&] {
+            kernel.name = compiler.get_kernel_name(f);
+            std::cerr << "Parallax JIT: Compiling " << kernel.name << "..." << std::endl;
+            kernel.spirv = compiler.compile(f);
+        });
+        // No embedded body, or captures that cannot be baked in: stay on the host.
+        if (kernel.spirv.empty()) {
+            host_for_each(first, last, f);
+            return;
         }
+        const std::string& name = kernel.name;
         
         // 2. Launch
         // Access global launcher defined in execution_policy.cpp
@@ -62,11 +215,23 @@ void ExecutionPolicyImpl::for_each_impl(Iterator first, Iterator last, UnaryFunc
             // Current load_kernel: pipelines_[name] = data; (overwrites?)
             // We should only load if not present in launcher.
             // But we don't have is_loaded API. Calling load_kernel is safe (just re-creates pipeline).
-            // Optimization: Track loaded state locally.
-            static std::unordered_set<std::string> loaded_kernels;
-            if (loaded_kernels.find(name) == loaded_kernels.end()) {
-                g_global_launcher_ptr->load_kernel(name, cache[name].data(), cache[name].size() * 4);
-                loaded_kernels.insert(name);
+            // Optimization: the table entry tracks the loaded state.
+            std::call_once(kernel.loaded, [&] {
+                g_global_launcher_ptr->load_kernel(name, kernel.spirv.data(), kernel.spirv.size() * 4);
+            });
+
+            // Not contiguous (deque, list, strided views): no pointer to hand the kernel.
+            if constexpr (!std::contiguous_iterator<Iterator>) {
+                if (staging_enabled())
+                    staged_for_each(name, first, last, static_cast<size_t>(std::distance(first, last)), f,
+                        [&](void* buf, size_t n) {
+                            bool ok = g_global_launcher_ptr->launch(name, buf, n);
+                            if (ok) g_global_launcher_ptr->sync();
+                            return ok;
+                        });
+                else
+                    host_for_each(first, last, f);
+                return;
             }
             
             // Assume input is contiguous and 'first' is a pointer
@@ -74,7 +239,22 @@ void ExecutionPolicyImpl::for_each_impl(Iterator first, Iterator last, UnaryFunc
             // Ideally we check if it's a pointer to unified memory.
             auto* data_ptr = &(*first);
             size_t count = std::distance(first, last);
-            
+
+            // Hybrid co-execution: GPU slice [0, g) on its own thread, CPU slice
+            // [g, count) on the host pool, concurrently; the measured rates steer the
+            // next call's split for this kernel.
+            auto& hybrid = HybridSplitController::instance();
+            if (hybrid.should_split(count)) {
+                hybrid.co_execute(name, count,
+                    [&](size_t g) {
+                        bool ok = g_global_launcher_ptr->launch(name, (void*)data_ptr, g);
+                        if (ok) g_global_launcher_ptr->sync();
+                        return ok;
+                    },
+                    [&](size_t b, size_t e) { host_for_each(std::next(first, b), std::next(first, e), f); });
+                return;
+            }
+
             if (g_global_launcher_ptr->launch(name, (void*)data_ptr, count)) {
                 g_global_launcher_ptr->sync(); // Ensure synchronous completion for ISO compliance
                 return; // GPU execution successful
@@ -84,11 +264,11 @@ void ExecutionPolicyImpl::for_each_impl(Iterator first, Iterator last, UnaryFunc
         }
         
         // Fallback to CPU if launch failed or launcher not available
-        std::for_each(std::execution::seq, first, last, f);
+        host_for_each(first, last, f);
         
     } catch (const std::exception& e) {
         std::cerr << "GPU Execution Failed: " << e.what() << std::endl;
-        std::for_each(std::execution::seq, first, last, f);
+        host_for_each(first, last, f);
     }
 }
 
@@ -96,33 +276,67 @@ template<typename InputIt, typename OutputIt, typename UnaryOperation>
 OutputIt ExecutionPolicyImpl::transform_impl(InputIt first, InputIt last,
                                              OutputIt d_first,
                                              UnaryOperation unary_op) {
-    static LambdaCompiler compiler;
-    static std::unordered_map<std::string, std::vector<uint32_t>> cache;
-    static std::unordered_set<std::string> loaded_kernels;
+    if (static_cast<size_t>(std::distance(first, last)) < offload_min_elems())
+        return host_transform(first, last, d_first, unary_op);
     
     try {
         // 1. Compile with 2 arguments (input, output)
-        std::string name = compiler.get_kernel_name(unary_op, 2);
-        if (cache.find(name) == cache.end()) {
-            cache[name] = compiler.compile(unary_op, 2);
-        }
+        LambdaCompiler& compiler = jit_compiler();
+        KernelTable::Entry& kernel =
+            KernelTable::instance().get(compiler.get_kernel_key(unary_op, 2));
+        std::call_once(kernel.compiled, [&] {
+            kernel.name = compiler.get_kernel_name(unary_op, 2);
+            kernel.spirv = compiler.compile(unary_op, 2);
+        });
+        if (kernel.spirv.empty())
+            return host_transform(first, last, d_first, unary_op);
+        const std::string& name = kernel.name;
         
         // 2. Launch
         extern KernelLauncher* g_global_launcher_ptr;
         
         if (g_global_launcher_ptr) {
-            if (loaded_kernels.find(name) == loaded_kernels.end()) {
-                g_global_launcher_ptr->load_kernel(name, cache[name].data(), cache[name].size() * 4);
-                loaded_kernels.insert(name);
+            std::call_once(kernel.loaded, [&] {
+                g_global_launcher_ptr->load_kernel(name, kernel.spirv.data(), kernel.spirv.size() * 4);
+            });
+
+            // Either side not contiguous: stage both through arena buffers (see for_each_impl).
+            if constexpr (!std::contiguous_iterator<InputIt> || !std::contiguous_iterator<OutputIt>) {
+                if (!staging_enabled()) return host_transform(first, last, d_first, unary_op);
+                return staged_transform(name, first, last, d_first,
+                    static_cast<size_t>(std::distance(first, last)), unary_op,
+                    [&](void* in, void* out, size_t n) {
+                        bool ok = g_global_launcher_ptr->launch_transform(name, in, out, n);
+                        if (ok) g_global_launcher_ptr->sync();
+                        return ok;
+                    });
             }
             
             auto* in_ptr = &(*first);
             auto* out_ptr = &(*d_first);
             size_t count = std::distance(first, last);
-            
+
+            // Hybrid co-execution (see for_each_impl): in[0, g) -> out[0, g) on the GPU,
+            // the tail on host threads.
+            auto& hybrid = HybridSplitController::instance();
+            if (hybrid.should_split(count)) {
+                hybrid.co_execute(name, count,
+                    [&](size_t g) {
+                        bool ok = g_global_launcher_ptr->launch_transform(name, (void*)in_ptr,
+                                                                          (void*)out_ptr, g);
+                        if (ok) g_global_launcher_ptr->sync();
+                        return ok;
+                    },
+                    [&](size_t b, size_t e) {
+                        host_transform(std::next(first, b), std::next(first, e), std::next(d_first, b),
+                                       unary_op);
+                    });
+                return std::next(d_first, count);
+            }
+
             if (g_global_launcher_ptr->launch_transform(name, (void*)in_ptr, (void*)out_ptr, count)) {
                 g_global_launcher_ptr->sync(); // Ensure synchronous completion for ISO compliance
-                return d_first + count; // GPU execution successful
+                return std::next(d_first, count); // GPU execution successful
             }
         }
         
@@ -131,14 +345,71 @@ OutputIt ExecutionPolicyImpl::transform_impl(InputIt first, InputIt last,
     }
     
     // Fallback
-    return std::transform(std::execution::seq, first, last, d_first, unary_op);
+    return host_transform(first, last, d_first, unary_op);
 }
 
 template<typename InputIt, typename T, typename BinaryOperation>
 T ExecutionPolicyImpl::reduce_impl(InputIt first, InputIt last, T init, BinaryOperation binary_op) {
-    // Reduction requires specialized GPU logic (atomics/shuffles)
-    // For now, we fallback to CPU seq to maintain results parity
-    return std::reduce(std::execution::seq, first, last, init, binary_op);
+    // The reduce skeleton runs over the range in place and yields one value; init is
+    // combined on the host (reduce permits any association/order). It covers ranges of T
+    // where T is a 32/64-bit int or float: contiguous ones directly, others staged when
+    // PARALLAX_STAGING is set. The rest reduce on the host pool.
+    using Elem = typename std::iterator_traits<InputIt>::value_type;
+    size_t count = static_cast<size_t>(std::distance(first, last));
+    if constexpr (!std::is_same_v<Elem, T>) {
+        return host_reduce(first, last, init, binary_op);
+    } else {
+        extern KernelLauncher* g_global_launcher_ptr;
+        if (count < offload_min_elems() || !g_global_launcher_ptr)
+            return host_reduce(first, last, init, binary_op);
+        if (!std::contiguous_iterator<InputIt> && !staging_enabled())
+            return host_reduce(first, last, init, binary_op);
+        try {
+            // One kernel per (element type, op): '+' needs no body, other ops are JIT-
+            // compiled from their embedded bitcode and inlined at each combine step.
+            LambdaCompiler& compiler = jit_compiler();
+            KernelTable::Entry& kernel =
+                KernelTable::instance().get(compiler.get_reduce_key<T>(binary_op));
+            std::call_once(kernel.compiled, [&] {
+                kernel.name = compiler.get_reduce_name<T>(binary_op);
+                kernel.spirv = compiler.compile_reduce<T>(binary_op);
+            });
+            if (kernel.spirv.empty())
+                return host_reduce(first, last, init, binary_op);
+            std::call_once(kernel.loaded, [&] {
+                kernel.handle = parallax_kernel_load(kernel.spirv.data(), kernel.spirv.size());
+            });
+            if (!kernel.handle) {
+                std::cerr << "Parallax JIT: " << kernel.name << " did not load" << std::endl;
+                return host_reduce(first, last, init, binary_op);
+            }
+            if constexpr (!std::contiguous_iterator<InputIt>) {
+                const auto k = static_cast<parallax_kernel_t>(kernel.handle);
+                return staged_reduce(kernel.name, first, last, count, init, binary_op,
+                    [k](void* buf, size_t n, T* partial) { return device_reduce(k, buf, n, partial); });
+            } else {
+                const auto k = static_cast<parallax_kernel_t>(kernel.handle);
+                // Hybrid co-execution (see for_each_impl): the GPU reduces [0, g) while
+                // the host pool folds the tail into init; the two partials meet in binary_op.
+                auto& hybrid = HybridSplitController::instance();
+                if (hybrid.should_split(count))
+                    return hybrid.co_reduce(kernel.name, count, init, binary_op,
+                        [&](size_t g, T* partial) {
+                            return device_reduce(k, (void*)std::to_address(first), g, partial);
+                        },
+                        [&](size_t b, size_t e, T acc) {
+                            return host_reduce(std::next(first, b), std::next(first, e), acc, binary_op);
+                        });
+                T partial{};
+                if (device_reduce(k, (void*)std::to_address(first), count, &partial))
+                    return binary_op(init, partial);
+                std::cerr << "Parallax JIT: " << kernel.name << " failed; reducing on CPU" << std::endl;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "GPU Reduce Failed: " << e.what() << std::endl;
+        }
+        return host_reduce(first, last, init, binary_op);
+    }
 }
 
 } // namespace parallax
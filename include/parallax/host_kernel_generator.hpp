@@ -0,0 +1,66 @@
+#ifndef PARALLAX_HOST_KERNEL_GENERATOR_HPP
+#define PARALLAX_HOST_KERNEL_GENERATOR_HPP
+
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Type.h>
+#include <memory>
+#include <string>
+
+namespace parallax {
+
+// Host-native kernels from the SAME extracted IR the SPIR-V path consumes. For each
+// funnel kernel body (LambdaIRGenerator's __parallax_kernel_body) we build a loop
+// over the range that calls the body per element, inline it, and run the -O3
+// pipeline against the host TargetMachine so the loop vectorizer sees the whole
+// callable. All loops of a TU go into ONE relocatable object; the plugin registers
+// each under its funnel key so the runtime can pick it for small N, device-less
+// hosts, or the CPU half of a hybrid split.
+//
+// Every host kernel has the C signature
+//     void fn(void* in, void* out, unsigned long long n, const void* captures);
+// with the device kernel's semantics:
+//   for_each (void body)  : body(&in[i], caps...)            (out unused)
+//   transform             : out[i] = body(in[i] | &in[i], caps...)
+//   predicate_count       : ((int*)out)[i] = body(...) ? 1 : 0
+//   predicate_flags       : ((T*)out)[i] = body(...) ? 1 : 0 (negate: ? 0 : 1)
+// and captures read from the same packed block the device's captures uniform uses
+// (each leaf at its natural alignment, minimum 4 bytes; pointers as 8-byte addresses).
+class HostKernelGenerator {
+public:
+    struct Mode {
+        bool predicate_count = false;
+        bool predicate_flags = false;
+        bool predicate_negate = false;
+    };
+
+    HostKernelGenerator();
+    ~HostKernelGenerator();
+
+    // Add a host loop named 'symbol' around 'body' (cloned; the caller's module is not
+    // modified). elem_bytes is sizeof(T) for the input stride; flags_elem is T's LLVM
+    // type, used for the flags output. Returns false if the body's shape has no host
+    // loop form (e.g. a by-value aggregate parameter), leaving nothing added.
+    bool add_kernel(llvm::Function* body, const std::string& symbol, unsigned elem_bytes,
+                    llvm::Type* flags_elem, Mode mode);
+
+    bool empty() const { return !module_ || kernel_count_ == 0; }
+
+    // Optimize all added loops at -O3 for the host target and write one object file.
+    // CPU defaults to the triple's generic baseline (portable binaries); set
+    // PARALLAX_HOST_CPU (e.g. "native", "x86-64-v3") to target a specific machine.
+    bool emit_object(const std::string& path);
+
+private:
+    // Own context: bodies come from the caller's IR generator, whose context may be
+    // destroyed before this generator is; each loop is moved over as bitcode.
+    // Declared before module_ so the module is destroyed first.
+    std::unique_ptr<llvm::LLVMContext> ctx_;
+    std::unique_ptr<llvm::Module> module_;  // accumulates every host loop of the TU
+    unsigned kernel_count_ = 0;
+};
+
+} // namespace parallax
+
+#endif // PARALLAX_HOST_KERNEL_GENERATOR_HPP
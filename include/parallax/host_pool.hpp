@@ -0,0 +1,254 @@
+#ifndef PARALLAX_HOST_POOL_HPP
+#define PARALLAX_HOST_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <execution>
+#include <iterator>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace parallax {
+
+// Host fallback pool. When a callable does not lower to SPIR-V, no Vulkan device
+// exists, or a launch fails, the ISO-correct fallback used to be std::execution::seq,
+// so a failed offload lost ALL parallelism. HostPool is a chunked work-stealing
+// pool: the range is cut into chunks, each participant (the workers plus the calling
+// thread) starts on a contiguous block of chunks, and a participant that runs dry
+// steals the back half of another's remaining block. Inside a chunk the host_*
+// helpers below run a plain in-order loop: they stand in for `par` calls, whose
+// callables may take locks, which unseq would make undefined. The compiler can still
+// vectorize a loop whose body it can see is safe. This gives par throughput without
+// relying on the standard library having a parallel backend (libstdc++ without TBB
+// runs par serially).
+//
+// PARALLAX_HOST_THREADS overrides the participant count (default: hardware threads).
+// Nested use from inside a chunk runs inline; concurrent callers take turns.
+class HostPool {
+public:
+    static HostPool& instance() {
+        static HostPool pool;
+        return pool;
+    }
+
+    // Participants in a parallel_for (workers + the calling thread).
+    size_t concurrency() const { return workers_.size() + 1; }
+
+    // Run body(begin, end) over a partition of [0, n). Chunks are at least min_grain
+    // elements; the first exception thrown by any chunk is rethrown here after all
+    // participants have stopped.
+    template<typename Body>
+    void parallel_for(size_t n, Body&& body, size_t min_grain = 1024) {
+        if (n == 0) return;
+        const size_t P = concurrency();
+        const size_t grain = std::max(min_grain, n / (P * 8) + 1);
+        if (P == 1 || n <= grain || in_worker()) { body(size_t(0), n); return; }
+
+        using B = std::remove_reference_t<Body>;
+        Job job;
+        job.n = n;
+        job.grain = grain;
+        job.ctx = const_cast<void*>(static_cast<const void*>(std::addressof(body)));
+        job.invoke = [](void* ctx, size_t b, size_t e) { (*static_cast<B*>(ctx))(b, e); };
+        job.ranges = std::vector<Range>(P);
+        const size_t chunks = (n + grain - 1) / grain;
+        for (size_t p = 0; p < P; ++p) {
+            job.ranges[p].next = chunks * p / P;
+            job.ranges[p].end = chunks * (p + 1) / P;
+        }
+        job.pending.store(workers_.size());
+
+        std::lock_guard<std::mutex> turn(submit_mutex_);
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            job_ = &job;
+            ++generation_;
+        }
+        wake_.notify_all();
+        participate(job, P - 1);  // the caller owns the last block
+        {
+            std::unique_lock<std::mutex> lk(mutex_);
+            done_.wait(lk, [&] { return job.pending.load() == 0; });
+            job_ = nullptr;
+        }
+        if (job.error) std::rethrow_exception(job.error);
+    }
+
+    ~HostPool() {
+        {
+            std::lock_guard<std::mutex> lk(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& t : workers_) t.join();
+    }
+
+private:
+    struct Range {
+        std::mutex m;
+        size_t next = 0, end = 0;  // chunk indices [next, end)
+    };
+    struct Job {
+        size_t n = 0, grain = 0;
+        void* ctx = nullptr;
+        void (*invoke)(void*, size_t, size_t) = nullptr;
+        std::vector<Range> ranges;
+        std::atomic<size_t> pending{0};  // workers that have not finished this job
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    HostPool() {
+        size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        if (const char* t = std::getenv("PARALLAX_HOST_THREADS"))
+            threads = std::max<size_t>(1, std::strtoull(t, nullptr, 10));
+        for (size_t i = 0; i + 1 < threads; ++i)
+            workers_.emplace_back([this, i] { worker_main(i); });
+    }
+
+    static bool& in_worker() {
+        thread_local bool flag = false;
+        return flag;
+    }
+
+    void worker_main(size_t idx) {
+        in_worker() = true;
+        unsigned long long seen = 0;
+        for (;;) {
+            Job* job;
+            {
+                std::unique_lock<std::mutex> lk(mutex_);
+                wake_.wait(lk, [&] { return stop_ || generation_ != seen; });
+                if (stop_) return;
+                seen = generation_;
+                job = job_;
+            }
+            participate(*job, idx);
+            if (job->pending.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lk(mutex_);
+                done_.notify_all();
+            }
+        }
+    }
+
+    // Drain our own block front-to-back; when it is empty, steal the back half of
+    // the first non-empty victim block (round-robin from our neighbour).
+    void participate(Job& job, size_t self) {
+        const size_t P = job.ranges.size();
+        bool was_worker = in_worker();
+        in_worker() = true;  // nested parallel_for inside a chunk runs inline
+        for (;;) {
+            size_t chunk;
+            bool have = false;
+            {
+                Range& own = job.ranges[self];
+                std::lock_guard<std::mutex> lk(own.m);
+                if (own.next < own.end) { chunk = own.next++; have = true; }
+            }
+            if (!have) {
+                for (size_t k = 1; k < P && !have; ++k) {
+                    Range& victim = job.ranges[(self + k) % P];
+                    size_t lo, hi;
+                    {
+                        std::lock_guard<std::mutex> lk(victim.m);
+                        if (victim.next >= victim.end) continue;
+                        // Back half; a single remaining chunk is taken whole (lo == next).
+                        hi = victim.end;
+                        lo = victim.next + (victim.end - victim.next) / 2;
+                        victim.end = lo;
+                    }
+                    Range& own = job.ranges[self];
+                    std::lock_guard<std::mutex> lk(own.m);
+                    own.next = lo + 1;
+                    own.end = hi;
+                    chunk = lo;
+                    have = true;
+                }
+                if (!have) break;
+            }
+            size_t b = chunk * job.grain, e = std::min(job.n, b + job.grain);
+            try {
+                job.invoke(job.ctx, b, e);
+            } catch (...) {
+                std::lock_guard<std::mutex> lk(job.error_mutex);
+                if (!job.error) job.error = std::current_exception();
+            }
+        }
+        in_worker() = was_worker;
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_, done_;
+    std::mutex submit_mutex_;
+    Job* job_ = nullptr;
+    unsigned long long generation_ = 0;
+    bool stop_ = false;
+};
+
+// Host algorithms over the pool. Random-access ranges are chunked on HostPool with a
+// sequential body per chunk; other iterator categories use the standard library's par
+// directly.
+
+template<typename It, typename F>
+void host_for_each(It first, It last, F f) {
+    using Cat = typename std::iterator_traits<It>::iterator_category;
+    if constexpr (std::is_base_of_v<std::random_access_iterator_tag, Cat>) {
+        HostPool::instance().parallel_for(static_cast<size_t>(last - first),
+            [&](size_t b, size_t e) { std::for_each(first + b, first + e, f); });
+    } else {
+        std::for_each(std::execution::par, first, last, f);
+    }
+}
+
+template<typename InputIt, typename OutputIt, typename UnaryOperation>
+OutputIt host_transform(InputIt first, InputIt last, OutputIt d_first, UnaryOperation op) {
+    using InCat = typename std::iterator_traits<InputIt>::iterator_category;
+    using OutCat = typename std::iterator_traits<OutputIt>::iterator_category;
+    if constexpr (std::is_base_of_v<std::random_access_iterator_tag, InCat> &&
+                  std::is_base_of_v<std::random_access_iterator_tag, OutCat>) {
+        size_t n = static_cast<size_t>(last - first);
+        HostPool::instance().parallel_for(n, [&](size_t b, size_t e) {
+            std::transform(first + b, first + e, d_first + b, op);
+        });
+        return d_first + n;
+    } else {
+        return std::transform(std::execution::par, first, last, d_first, op);
+    }
+}
+
+// Each 4096-element block folds its own elements (seeded with its first element, so op needs no
+// identity); the per-chunk partials are then folded into init on the caller.
+template<typename InputIt, typename T, typename BinaryOperation>
+T host_reduce(InputIt first, InputIt last, T init, BinaryOperation op) {
+    using Cat = typename std::iterator_traits<InputIt>::iterator_category;
+    if constexpr (std::is_base_of_v<std::random_access_iterator_tag, Cat>) {
+        size_t n = static_cast<size_t>(last - first);
+        const size_t block = 4096;
+        std::vector<std::optional<T>> partials((n + block - 1) / block);
+        HostPool::instance().parallel_for(partials.size(), [&](size_t bb, size_t be) {
+            for (size_t k = bb; k < be; ++k) {
+                size_t b = k * block, e = std::min(n, b + block);
+                T acc = static_cast<T>(first[b]);
+                partials[k] = std::reduce(first + b + 1, first + e, acc, op);
+            }
+        }, /*min_grain=*/1);
+        for (auto& p : partials)
+            if (p) init = op(init, *p);
+        return init;
+    } else {
+        return std::reduce(std::execution::par, first, last, init, op);
+    }
+}
+
+} // namespace parallax
+
+#endif // PARALLAX_HOST_POOL_HPP
@@ -0,0 +1,174 @@
+#ifndef PARALLAX_HYBRID_SPLIT_HPP
+#define PARALLAX_HYBRID_SPLIT_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace parallax {
+
+// Hybrid CPU+GPU co-execution: one range is split so a GPU slice [0, g) runs the
+// SPIR-V kernel while a CPU slice [g, n) runs the callable on host threads, at the
+// same time. The split is learned per kernel key from measured throughput: after
+// each co-executed call the GPU fraction moves toward gpu_rate / (gpu_rate +
+// cpu_rate), the point at which both slices finish together. On lavapipe (where the
+// "GPU" is itself CPU threads) and on APUs sharing one memory bus this converges to
+// whatever mix actually saturates the machine, rather than a fixed guess.
+//
+// Opt-in: PARALLAX_HYBRID=1. PARALLAX_HYBRID_MIN (elements, default 65536) keeps
+// small ranges on a single device, where the split's fixed costs would dominate.
+// PARALLAX_HYBRID_GPU_FRACTION seeds the initial fraction (default 0.5).
+//
+// A failed GPU slice takes the key off the device for a back-off of 2, 4, ... 1024
+// calls (doubling per consecutive failure); the call after that retries at the
+// fraction the key had before the first failure.
+class HybridSplitController {
+public:
+    static HybridSplitController& instance() {
+        static HybridSplitController ctl;
+        return ctl;
+    }
+
+    bool enabled() const { return enabled_; }
+
+    // Whether a range of n elements is worth splitting at all.
+    bool should_split(size_t n) const { return enabled_ && n >= min_elems_; }
+
+    // GPU slice length for a range of n elements under kernel 'key'; 0 while the key
+    // is backing off after a failed slice.
+    size_t gpu_count(const std::string& key, size_t n) {
+        double f;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            KeyState& s = state(key);
+            if (s.hold) {
+                if (--s.hold == 0) s.gpu_fraction = s.resume_fraction;
+                return 0;
+            }
+            f = s.gpu_fraction;
+        }
+        return std::min(n, static_cast<size_t>(static_cast<double>(n) * f));
+    }
+
+    // Feed back one co-executed call. A device that got no work (or failed) leaves
+    // its rate estimate unchanged; a failed GPU slice passes gpu_ok=false and starts
+    // the key's back-off so it stops paying for a broken dispatch for a while.
+    void record(const std::string& key, size_t gpu_elems, double gpu_seconds,
+                size_t cpu_elems, double cpu_seconds, bool gpu_ok = true) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        KeyState& s = state(key);
+        if (!gpu_ok) {
+            if (s.failures++ == 0) s.resume_fraction = s.gpu_fraction;
+            s.hold = 1u << std::min(s.failures, 10u);
+            s.gpu_fraction = kMinFraction;
+            return;
+        }
+        if (gpu_elems) s.failures = 0;
+        if (gpu_elems && gpu_seconds > 0.0)
+            s.gpu_rate = blend(s.gpu_rate, static_cast<double>(gpu_elems) / gpu_seconds);
+        if (cpu_elems && cpu_seconds > 0.0)
+            s.cpu_rate = blend(s.cpu_rate, static_cast<double>(cpu_elems) / cpu_seconds);
+        if (s.gpu_rate > 0.0 && s.cpu_rate > 0.0) {
+            double target = s.gpu_rate / (s.gpu_rate + s.cpu_rate);
+            s.gpu_fraction = std::clamp(kAlpha * target + (1.0 - kAlpha) * s.gpu_fraction,
+                                        kMinFraction, kMaxFraction);
+        }
+    }
+
+    // One co-executed call over n elements: gpu(g) runs [0, g) on the device on its
+    // own thread (true on success) while host(g, n) runs the tail on the calling
+    // thread. A slice that fails or throws is redone by host(0, g) once the device
+    // thread has finished, so every element is applied exactly once.
+    template<typename Gpu, typename Host>
+    void co_execute(const std::string& key, size_t n, Gpu gpu, Host host) {
+        using clock = std::chrono::steady_clock;
+        const size_t g = gpu_count(key, n);
+        auto dev = std::async(std::launch::async, [&]() {
+            auto t0 = clock::now();
+            bool ok = false;
+            try {
+                ok = g == 0 || gpu(g);
+            } catch (const std::exception& e) {
+                std::cerr << "Parallax JIT: GPU slice threw for " << key << ": " << e.what() << std::endl;
+            } catch (...) {
+                std::cerr << "Parallax JIT: GPU slice threw for " << key << std::endl;
+            }
+            return std::make_pair(ok, std::chrono::duration<double>(clock::now() - t0).count());
+        });
+        auto t0 = clock::now();
+        host(g, n);
+        double cpu_s = std::chrono::duration<double>(clock::now() - t0).count();
+        auto [gpu_ok, gpu_s] = dev.get();
+        if (!gpu_ok) {
+            std::cerr << "Parallax JIT: GPU slice failed for " << key << "; finishing on CPU" << std::endl;
+            host(size_t(0), g);
+        }
+        record(key, g, gpu_s, n - g, cpu_s, gpu_ok);
+    }
+
+    // co_execute for a reduction: gpu(g, &partial) reduces [0, g) on the device while
+    // host(b, e, acc) folds a slice into a running value that starts at init. The
+    // device partial is combined with op only if its slice succeeded; otherwise
+    // host(0, g) has already folded those elements in.
+    template<typename T, typename Op, typename Gpu, typename Host>
+    T co_reduce(const std::string& key, size_t n, T init, Op op, Gpu gpu, Host host) {
+        T partial{};
+        bool gpu_ok = false;
+        co_execute(key, n,
+            [&](size_t g) { return gpu_ok = gpu(g, &partial); },
+            [&](size_t b, size_t e) { init = host(b, e, init); });
+        return gpu_ok ? op(init, partial) : init;
+    }
+
+private:
+    struct KeyState {
+        double gpu_fraction;
+        double gpu_rate = 0.0;  // elements/second, smoothed
+        double cpu_rate = 0.0;
+        double resume_fraction = 0.0;  // fraction before the current failure streak
+        unsigned failures = 0;         // consecutive failed GPU slices
+        unsigned hold = 0;             // calls left in the back-off
+    };
+
+    // Keep both devices in play: a fraction pinned at 0 or 1 could never re-measure
+    // the idle device after conditions change (thermal limits, other processes).
+    static constexpr double kMinFraction = 0.05;
+    static constexpr double kMaxFraction = 0.95;
+    static constexpr double kAlpha = 0.5;  // smoothing for rates and the fraction
+
+    HybridSplitController() {
+        enabled_ = std::getenv("PARALLAX_HYBRID") != nullptr;
+        if (const char* m = std::getenv("PARALLAX_HYBRID_MIN"))
+            min_elems_ = static_cast<size_t>(std::strtoull(m, nullptr, 10));
+        if (const char* f = std::getenv("PARALLAX_HYBRID_GPU_FRACTION"))
+            initial_fraction_ = std::clamp(std::strtod(f, nullptr), kMinFraction, kMaxFraction);
+    }
+
+    static double blend(double old_rate, double sample) {
+        return old_rate > 0.0 ? kAlpha * sample + (1.0 - kAlpha) * old_rate : sample;
+    }
+
+    KeyState& state(const std::string& key) {
+        auto it = states_.find(key);
+        if (it == states_.end())
+            it = states_.emplace(key, KeyState{initial_fraction_}).first;
+        return it->second;
+    }
+
+    bool enabled_ = false;
+    size_t min_elems_ = 65536;
+    double initial_fraction_ = 0.5;
+    std::mutex mutex_;
+    std::unordered_map<std::string, KeyState> states_;
+};
+
+} // namespace parallax
+
+#endif // PARALLAX_HYBRID_SPLIT_HPP
@@ -0,0 +1,85 @@
+#ifndef PARALLAX_KERNEL_TABLE_HPP
+#define PARALLAX_KERNEL_TABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace parallax {
+
+// Process-wide table of JIT kernels, shared by every thread that calls into
+// ExecutionPolicyImpl. Entries are keyed by LambdaCompiler::get_kernel_key, a 64-bit
+// value computed from the functor's type (and baked-in captures) without building a
+// string. The table is cut into 64 shards with one shared_mutex each. The steady state
+// is a shared-lock probe of one shard, so callers only contend when they land on the
+// same shard while another thread inserts into it.
+//
+// Entries are never erased, so the reference get() returns stays valid for the life
+// of the process. Each entry is compiled once and loaded into the launcher once
+// (std::call_once), by whichever thread gets there first; the others wait for it.
+class KernelTable {
+public:
+    struct Entry {
+        std::string name;             // launcher pipeline / hybrid-split key
+        std::vector<uint32_t> spirv;  // empty: the functor runs on the host
+        void* handle = nullptr;       // runtime kernel handle, for entry points that take one
+        std::once_flag compiled;
+        std::once_flag loaded;
+    };
+
+    static KernelTable& instance() {
+        static KernelTable table;
+        return table;
+    }
+
+    // The entry for key, inserted empty on first sight.
+    Entry& get(uint64_t key) {
+        Shard& s = shards_[shard_of(key)];
+        {
+            std::shared_lock<std::shared_mutex> lock(s.mutex);
+            auto it = s.entries.find(key);
+            if (it != s.entries.end()) return *it->second;
+        }
+        std::unique_lock<std::shared_mutex> lock(s.mutex);
+        auto& slot = s.entries[key];
+        if (!slot) slot = std::make_unique<Entry>();
+        return *slot;
+    }
+
+    size_t size() const {
+        size_t n = 0;
+        for (const Shard& s : shards_) {
+            std::shared_lock<std::shared_mutex> lock(s.mutex);
+            n += s.entries.size();
+        }
+        return n;
+    }
+
+private:
+    static constexpr size_t kShards = 64;
+
+    // One cache line per shard so readers of neighbouring shards do not share one.
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<uint64_t, std::unique_ptr<Entry>> entries;
+    };
+
+    // Keys are hashes already; the multiply spreads typeid hash_codes that differ
+    // only in their low bits (same-arity functors) across the top-bit shard index.
+    static size_t shard_of(uint64_t key) {
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> 58);
+    }
+
+    KernelTable() = default;
+
+    Shard shards_[kShards];
+};
+
+} // namespace parallax
+
+#endif // PARALLAX_KERNEL_TABLE_HPP
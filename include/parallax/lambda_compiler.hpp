@@ -3,13 +3,17 @@
 
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Function.h>
-#include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
 #include "parallax/spirv_generator.hpp"
 #include <vector>
 #include <cstdint>
+#include <cstddef>
 #include <string>
 #include <typeinfo>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <type_traits>
 #include <functional>
 #include <memory>
 #include <iostream>
@@ -26,131 +30,258 @@ struct LambdaMetadata {
     std::string return_type;
 };
 
-// Lambda compiler - converts C++ lambdas to GPU kernels
+// Lambda compiler - converts C++ lambdas to GPU kernels at first call.
+//
+// The body comes from the plugin: built with PARALLAX_EMBED_BITCODE=1, every funnel
+// functor's extracted LLVM module is embedded in the object and registered at static
+// init under the functor's typeid name (parallax_bitcode_register). compile() parses
+// it, replaces each scalar capture with the value it holds in THIS closure, and lowers
+// the specialized body through SPIRVGenerator, so one functor type yields one kernel
+// per distinct set of capture values (constant-folded, unlike the ahead-of-time
+// kernel that reads them from the captures block). get_kernel_name folds the capture
+// values into the name, which is the key callers cache kernels under.
+//
+// A functor with no embedded body, or one that captures a pointer or reference (this
+// launch path has no relocation bases), compiles to an empty vector: run it on the host.
+// So does a functor type past PARALLAX_JIT_MAX_SPECIALIZATIONS distinct capture sets
+// (default 64), which keeps a capture that changes every call from growing the kernel
+// cache without bound.
 class LambdaCompiler {
 public:
     LambdaCompiler();
     ~LambdaCompiler();
-    
-    // Compile lambda to SPIR-V
+
+    // Compile lambda to SPIR-V (arg_count 1: for_each, in place; 2: transform, in/out)
     template<typename Lambda>
     std::vector<uint32_t> compile(Lambda&& lambda, int arg_count = 1);
-    
+
     // Get metadata for lambda
     template<typename Lambda>
     LambdaMetadata get_metadata(Lambda&& lambda, int arg_count = 1);
-    
-    // Generate kernel name from lambda
+
+    // Generate kernel name from lambda: type, arity and (when specialized) captures
     template<typename Lambda>
     std::string get_kernel_name(Lambda&& lambda, int arg_count = 1);
-    
-private:
-    std::unique_ptr<llvm::LLVMContext> context_;
-    
-    // Generate LLVM IR for lambda
+
+    // The same identity as get_kernel_name as one integer, for per-call cache lookups
+    // that should not build a string (see KernelTable).
     template<typename Lambda>
-    llvm::Function* generate_ir(Lambda&& lambda, llvm::Module& module, int arg_count);
-    
-    // Extract lambda body and create GPU kernel
+    uint64_t get_kernel_key(Lambda&& lambda, int arg_count = 1);
+
+    // Reduction of T by op on the reduce skeleton (SPIRVGenerator::generate_reduce_kernel).
+    // std::plus needs no body; any other op is its embedded body with the captures baked
+    // in, called at each combine step. Empty when T has no skeleton element kind or the
+    // op has no usable body.
+    template<typename T, typename BinaryOp>
+    std::vector<uint32_t> compile_reduce(const BinaryOp& op);
+
+    template<typename T, typename BinaryOp>
+    std::string get_reduce_name(const BinaryOp& op);
+
+    template<typename T, typename BinaryOp>
+    uint64_t get_reduce_key(const BinaryOp& op);
+
+    // Registry behind parallax_bitcode_register: typeid name -> element type + bitcode.
+    static void register_bitcode(const char* type_name, const char* elem_type,
+                                 const void* data, size_t size);
+
+private:
+    // One scalar capture leaf: where it sits in the closure.
+    struct CaptureLeaf {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    struct EmbeddedBitcode {
+        std::string elem_type;   // C++ element type, e.g. "float"
+        std::string bitcode;
+        std::atomic<int> specializable{-1};  // -1 unknown, 0 captures a pointer / malformed, 1 yes
+        std::atomic<unsigned> specializations{0};  // kernels compiled from this body
+        std::once_flag leaves_once;
+        bool leaves_ok = false;
+        std::vector<CaptureLeaf> leaves;  // see capture_leaves
+    };
+    static std::unordered_map<std::string, std::unique_ptr<EmbeddedBitcode>>& bitcode_registry();
+    static EmbeddedBitcode* find_bitcode(const char* type_name);
+
+    // The body's capture leaves in argument order, each at its DataLayout offset along
+    // its path through the closure type the plugin recorded. Computed once per body;
+    // null (and bc marked unspecializable) when a leaf is not a plain scalar.
+    static const std::vector<CaptureLeaf>* capture_leaves(EmbeddedBitcode& bc);
+
+    // Distinct capture sets a functor type may be specialized for.
+    static unsigned max_specializations();
+
+    // Count one more kernel against bc's budget; false (and logged) once it is spent.
+    // Called under compile_mutex_.
+    static bool claim_specialization(EmbeddedBitcode& bc, const std::string& name);
+
+    // FNV-1a of the closure's leaf values (padding excluded): the capture-constant part
+    // of the cache key.
+    static uint64_t closure_hash(const EmbeddedBitcode& bc, const void* closure, size_t size);
+
+    // Parse bc into `module` and clone its body as `kernel_<name>` with only the first
+    // data_params parameters, every capture replaced by its value in `closure`.
+    // Null (and bc marked unspecializable) when a capture is not a plain scalar.
+    llvm::Function* specialize(EmbeddedBitcode& bc, const std::string& name,
+                               const void* closure, size_t closure_size,
+                               unsigned data_params, std::unique_ptr<llvm::Module>& module);
+
+    // Parse bc, bake the closure's captures in and lower the body under `name`.
+    std::vector<uint32_t> compile_embedded(EmbeddedBitcode& bc, const std::string& name,
+                                           const void* closure, size_t closure_size,
+                                           int arg_count);
+
+    // The reduce skeleton for element kind `elem` (a SPIRVGenerator::ReduceElemType),
+    // combining with bc's specialized op, or '+' when bc is null.
+    std::vector<uint32_t> compile_reduce_embedded(EmbeddedBitcode* bc, const std::string& name,
+                                                  const void* closure, size_t closure_size,
+                                                  int elem);
+
+    // Skeleton element kind of T, or -1 when the reduce skeletons do not cover it.
+    template<typename T>
+    static constexpr int reduce_elem() {
+        using E = SPIRVGenerator::ReduceElemType;
+        if constexpr (std::is_same_v<T, float>) return static_cast<int>(E::F32);
+        else if constexpr (std::is_same_v<T, double>) return static_cast<int>(E::F64);
+        else if constexpr (std::is_integral_v<T> && !std::is_same_v<T, bool> && sizeof(T) == 4)
+            return static_cast<int>(E::I32);
+        else if constexpr (std::is_integral_v<T> && sizeof(T) == 8) return static_cast<int>(E::I64);
+        else return -1;
+    }
+
+    template<typename T, typename BinaryOp>
+    static constexpr bool is_plus_v =
+        std::is_same_v<BinaryOp, std::plus<T>> || std::is_same_v<BinaryOp, std::plus<>>;
+
+    // The embedded body whose capture values are part of this functor's kernel
+    // identity; null when they are not (nothing to bake, or the body cannot be
+    // specialized or has used up its specializations).
     template<typename Lambda>
-    void create_kernel_wrapper(Lambda&& lambda, llvm::IRBuilder<>& builder,
-                               llvm::Function* kernel_func, int arg_count);
+    static const EmbeddedBitcode* captures_baked(const char* type_name);
+
+    std::unique_ptr<llvm::LLVMContext> context_;
+    std::mutex compile_mutex_;  // context_ is single-threaded; compiles from many callers take turns
 };
 
 // Template implementations
 
 template<typename Lambda>
 std::vector<uint32_t> LambdaCompiler::compile(Lambda&& lambda, int arg_count) {
-    // Get kernel name
+    using Closure = std::decay_t<Lambda>;
     std::string kernel_name = get_kernel_name(lambda, arg_count);
-    
-    // Create LLVM module
-    llvm::Module module(kernel_name, *context_);
-    
-    // Generate IR for lambda
-    auto* func = generate_ir(std::forward<Lambda>(lambda), module, arg_count);
-    
-    // Debug: Print IR
-    std::cerr << "LLVM IR for Lambda Helper (" << kernel_name << "):" << std::endl;
-    func->print(llvm::errs());
-    std::cerr << std::endl;
-
-    // Convert IR to SPIR-V using the robust lambda path
-    SPIRVGenerator spirv_gen;
-    spirv_gen.set_target_vulkan_version(1, 3);
-    
-    std::vector<std::string> params(arg_count, "float&");
-    return spirv_gen.generate_from_lambda(func, params);
+    EmbeddedBitcode* bc = find_bitcode(typeid(Closure).name());
+    if (!bc) {
+        std::cerr << "Parallax JIT: no embedded body for " << kernel_name
+                  << " (build with PARALLAX_EMBED_BITCODE=1); host path" << std::endl;
+        return {};
+    }
+    if (bc->specializable == 0 || !std::is_trivially_copyable_v<Closure>) {
+        bc->specializable = 0;
+        return {};
+    }
+    return compile_embedded(*bc, kernel_name, static_cast<const void*>(&lambda),
+                            sizeof(Closure), arg_count);
 }
 
 template<typename Lambda>
 LambdaMetadata LambdaCompiler::get_metadata(Lambda&& lambda, int arg_count) {
+    using Closure = std::decay_t<Lambda>;
     LambdaMetadata meta;
-    meta.signature = typeid(lambda).name();
-    meta.hash = typeid(lambda).hash_code() ^ (static_cast<size_t>(arg_count) << 32);
-    
-    meta.has_captures = true; // Assume captures for MVP
-    
-    for(int i=0; i<arg_count; ++i) meta.parameter_types.push_back("float&");
-    meta.return_type = "void";
-    
+    meta.signature = typeid(Closure).name();
+    meta.hash = typeid(Closure).hash_code() ^ (static_cast<size_t>(arg_count) << 32);
+    meta.has_captures = !std::is_empty_v<Closure>;
+
+    const EmbeddedBitcode* bc = find_bitcode(meta.signature.c_str());
+    const std::string elem = bc ? bc->elem_type : std::string("float");
+    if (arg_count == 2) {
+        meta.parameter_types.push_back(elem);
+        meta.return_type = elem;
+    } else {
+        for (int i = 0; i < arg_count; ++i) meta.parameter_types.push_back(elem + "&");
+        meta.return_type = "void";
+    }
     return meta;
 }
 
 template<typename Lambda>
-std::string LambdaCompiler::get_kernel_name(Lambda&& lambda, int arg_count) {
-    auto meta = get_metadata(std::forward<Lambda>(lambda), arg_count);
-    return "lambda_helper_" + std::to_string(meta.hash);
+const LambdaCompiler::EmbeddedBitcode* LambdaCompiler::captures_baked(const char* type_name) {
+    if constexpr (std::is_empty_v<Lambda> || !std::is_trivially_copyable_v<Lambda>) {
+        return nullptr;
+    } else {
+        // Bodies register during static init, so once found a body is cached per
+        // functor type and the registry lock stays off the per-call path. A miss is
+        // not cached: a library loaded later may still register the body.
+        static std::atomic<EmbeddedBitcode*> cached{nullptr};
+        EmbeddedBitcode* bc = cached.load(std::memory_order_acquire);
+        if (!bc && (bc = find_bitcode(type_name))) cached.store(bc, std::memory_order_release);
+        if (!bc || bc->specializable == 0 || !capture_leaves(*bc) ||
+            bc->specializations >= max_specializations())
+            return nullptr;
+        return bc;
+    }
 }
 
 template<typename Lambda>
-llvm::Function* LambdaCompiler::generate_ir(Lambda&& lambda, llvm::Module& module, int arg_count) {
-    llvm::IRBuilder<> builder(*context_);
-    
-    auto* ptr_type = llvm::PointerType::get(builder.getContext(), 0);
-    auto* void_type = llvm::Type::getVoidTy(*context_);
-    
-    std::vector<llvm::Type*> param_types(arg_count, ptr_type);
-    auto* func_type = llvm::FunctionType::get(void_type, param_types, false);
-    
-    auto* func = llvm::Function::Create(func_type, llvm::Function::ExternalLinkage,
-                                       get_kernel_name(lambda, arg_count), &module);
-    
-    auto* entry = llvm::BasicBlock::Create(*context_, "entry", func);
-    builder.SetInsertPoint(entry);
-    
-    create_kernel_wrapper(std::forward<Lambda>(lambda), builder, func, arg_count);
-    
-    return func;
+std::string LambdaCompiler::get_kernel_name(Lambda&& lambda, int arg_count) {
+    using Closure = std::decay_t<Lambda>;
+    auto meta = get_metadata(lambda, arg_count);
+    std::string name = "lambda_helper_" + std::to_string(meta.hash);
+    // Captured values are baked into the kernel, so they are part of its identity.
+    if (const EmbeddedBitcode* bc = captures_baked<Closure>(meta.signature.c_str()))
+        name += "_" + std::to_string(closure_hash(*bc, &lambda, sizeof(Closure)));
+    return name;
 }
 
 template<typename Lambda>
-void LambdaCompiler::create_kernel_wrapper(Lambda&& lambda, llvm::IRBuilder<>& builder,
-                                           llvm::Function* kernel_func, int arg_count) {
-    auto args = kernel_func->arg_begin();
-    
-    if (arg_count == 1) {
-        auto* element_ptr = &(*args);
-        auto* value = builder.CreateLoad(builder.getFloatTy(), element_ptr, "value");
-        // MVP: x = x * 2.0 + 1.0 (to match auto_lambda_bench for_each)
-        auto* mul = builder.CreateFMul(value, llvm::ConstantFP::get(builder.getFloatTy(), 2.0), "mul");
-        auto* res = builder.CreateFAdd(mul, llvm::ConstantFP::get(builder.getFloatTy(), 1.0), "res");
-        builder.CreateStore(res, element_ptr);
-    } else if (arg_count == 2) {
-        auto* in_ptr = &(*args++);
-        auto* out_ptr = &(*args);
-        auto* value = builder.CreateLoad(builder.getFloatTy(), in_ptr, "value");
-        // MVP: return sqrt(x) * 2.0 (to match auto_lambda_bench transform)
-        // We use intrinsic for sqrt
-        auto* sqrt_func = llvm::Intrinsic::getDeclaration(kernel_func->getParent(), llvm::Intrinsic::sqrt, {builder.getFloatTy()});
-        auto* sqrt_val = builder.CreateCall(sqrt_func, {value}, "sqrt");
-        auto* res = builder.CreateFMul(sqrt_val, llvm::ConstantFP::get(builder.getFloatTy(), 2.0), "res");
-        builder.CreateStore(res, out_ptr);
+uint64_t LambdaCompiler::get_kernel_key(Lambda&& lambda, int arg_count) {
+    using Closure = std::decay_t<Lambda>;
+    static const uint64_t type_hash = typeid(Closure).hash_code();  // hashes the name string
+    uint64_t key = type_hash ^ (static_cast<uint64_t>(arg_count) << 32);
+    if (const EmbeddedBitcode* bc = captures_baked<Closure>(typeid(Closure).name()))
+        key = (key ^ closure_hash(*bc, &lambda, sizeof(Closure))) * 1099511628211ull;
+    return key;
+}
+
+template<typename T, typename BinaryOp>
+std::vector<uint32_t> LambdaCompiler::compile_reduce(const BinaryOp& op) {
+    constexpr int elem = reduce_elem<T>();
+    if constexpr (elem < 0) {
+        return {};
+    } else {
+        std::string name = get_reduce_name<T>(op);
+        if constexpr (is_plus_v<T, BinaryOp>) {
+            return compile_reduce_embedded(nullptr, name, nullptr, 0, elem);
+        } else {
+            EmbeddedBitcode* bc = find_bitcode(typeid(BinaryOp).name());
+            if (!bc || bc->specializable == 0 || !std::is_trivially_copyable_v<BinaryOp>) {
+                std::cerr << "Parallax JIT: no usable body for " << name << "; host path" << std::endl;
+                return {};
+            }
+            return compile_reduce_embedded(bc, name, static_cast<const void*>(&op),
+                                           sizeof(BinaryOp), elem);
+        }
     }
-    
-    builder.CreateRetVoid();
+}
+
+template<typename T, typename BinaryOp>
+std::string LambdaCompiler::get_reduce_name(const BinaryOp& op) {
+    if constexpr (is_plus_v<T, BinaryOp>)
+        return std::string("reduce_plus_") + typeid(T).name();
+    else
+        return std::string("reduce_") + typeid(T).name() + "_" + get_kernel_name(op, 2);
+}
+
+template<typename T, typename BinaryOp>
+uint64_t LambdaCompiler::get_reduce_key(const BinaryOp& op) {
+    static const uint64_t elem_hash = typeid(T).hash_code();
+    uint64_t key = is_plus_v<T, BinaryOp> ? 0 : get_kernel_key(op, 2);
+    return ((key ^ elem_hash) * 1099511628211ull) ^ 0x7265647563650000ull;  // "reduce"
 }
 
 } // namespace parallax
 
+extern "C" void parallax_bitcode_register(const char* type_name, const char* elem_type,
+                                          const void* data, unsigned long long size);
+
 #endif // PARALLAX_LAMBDA_COMPILER_HPP
@@ -0,0 +1,574 @@
+#ifndef PARALLAX_SENDER_HPP
+#define PARALLAX_SENDER_HPP
+
+#include "parallax/execution_policy_impl.hpp"
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Launch batch hooks (see the plugin's graph/batch prelude). Null when the linked
+// runtime has no batch support.
+extern "C" {
+__attribute__((weak)) void parallax_batch_begin(const char*, unsigned int, const unsigned int*);
+__attribute__((weak)) void parallax_batch_end(const char*);
+}
+
+namespace parallax {
+
+extern KernelLauncher* g_global_launcher_ptr;
+
+// Sender/receiver front end in the shape of std::execution (P2300), for chains of
+// device work that should not round-trip to the host between steps:
+//
+//     namespace ex = parallax::exec;
+//     auto s = ex::transfer_just(ex::gpu, v)     // std::span over v, on the device
+//            | ex::bulk(v.size(), [](float& x) { x *= 2; })
+//            | ex::then([](float x) { return x + 1; })
+//            | ex::reduce(0.0f, std::plus<>{});
+//     auto [sum] = *ex::sync_wait(std::move(s));  // or: float sum = co_await std::move(s);
+//
+// Senders are lazy: nothing runs until sync_wait or co_await. Device steps go through
+// the same JIT kernels, KernelTable entries and launcher as ExecutionPolicyImpl, but a
+// bulk or then step launches without waiting. With the runtime's batch hooks the steps
+// are submitted as one batch, each depending on the one before it, and the chain waits
+// once: before the first step that reads the data on the host (reduce, a whole-value
+// then, a host-scheduled step) or at the end. A batch covers only the launching steps
+// up to that wait, and every running chain opens its batches under a key of its own.
+// Without the hooks nothing orders two submissions, so each launch waits for itself as
+// ExecutionPolicyImpl's do.
+//
+// The standard library has no <execution> senders yet, so this is a self-contained
+// subset over the value kinds Parallax can offload: a std::span over a contiguous
+// range, a scalar, or nothing (std::monostate, after schedule).
+namespace exec {
+
+struct gpu_scheduler {
+    static constexpr bool on_device = true;
+    bool operator==(const gpu_scheduler&) const = default;
+};
+
+struct host_scheduler {
+    static constexpr bool on_device = false;
+    bool operator==(const host_scheduler&) const = default;
+};
+
+inline constexpr gpu_scheduler gpu{};
+inline constexpr host_scheduler host{};
+
+template<typename S>
+concept scheduler = std::is_same_v<S, gpu_scheduler> || std::is_same_v<S, host_scheduler>;
+
+// What device steps load kernels on and launch through. ExecutionPolicyImpl's launcher
+// unless another is installed with set_chain_device, e.g. one over the runtime's C
+// launch entry points for a program that owns no KernelLauncher.
+class chain_device {
+public:
+    virtual ~chain_device() = default;
+    virtual bool ready() = 0;
+    virtual void load(const std::string& name, const std::vector<uint32_t>& spirv) = 0;
+    virtual bool launch(const std::string& name, void* data, size_t n, size_t elem_size) = 0;
+    virtual bool launch_transform(const std::string& name, void* in, void* out, size_t n,
+                                  size_t elem_size) = 0;
+    virtual void sync() = 0;
+};
+
+namespace detail {
+
+class launcher_device final : public chain_device {
+public:
+    bool ready() override { return g_global_launcher_ptr != nullptr; }
+    void load(const std::string& name, const std::vector<uint32_t>& spirv) override {
+        g_global_launcher_ptr->load_kernel(name, spirv.data(), spirv.size() * 4);
+    }
+    bool launch(const std::string& name, void* data, size_t n, size_t) override {
+        return g_global_launcher_ptr->launch(name, data, n);
+    }
+    bool launch_transform(const std::string& name, void* in, void* out, size_t n, size_t) override {
+        return g_global_launcher_ptr->launch_transform(name, in, out, n);
+    }
+    void sync() override {
+        if (g_global_launcher_ptr) g_global_launcher_ptr->sync();
+    }
+};
+
+inline std::atomic<chain_device*>& installed_device() {
+    static std::atomic<chain_device*> dev{nullptr};
+    return dev;
+}
+
+inline chain_device& current_device() {
+    static launcher_device launcher;
+    chain_device* dev = installed_device().load(std::memory_order_acquire);
+    return dev ? *dev : launcher;
+}
+
+} // namespace detail
+
+// Install dev for every chain started afterwards; null restores the launcher. dev must
+// outlive those chains.
+inline void set_chain_device(chain_device* dev) {
+    detail::installed_device().store(dev, std::memory_order_release);
+}
+
+namespace detail {
+
+template<typename V> struct is_span : std::false_type {};
+template<typename T> struct is_span<std::span<T>> : std::true_type {};
+
+// The value a step hands on: borrowed contiguous ranges (lvalue containers, spans)
+// become a std::span so device steps see one pointer + length; anything else is
+// passed by value.
+template<typename R>
+auto lift(R&& r) {
+    using D = std::remove_cvref_t<R>;
+    if constexpr (std::ranges::contiguous_range<R> && std::ranges::sized_range<R> &&
+                  std::ranges::borrowed_range<R>) {
+        using T = std::remove_reference_t<std::ranges::range_reference_t<R>>;
+        return std::span<T>(std::ranges::data(r), std::ranges::size(r));
+    } else {
+        return D(std::forward<R>(r));
+    }
+}
+
+// Bit `step` of a chain's launch plan: set when that counted step is a bulk or then
+// that can launch without waiting (reduce and host steps drain instead). Steps past
+// the 64th are left out of every batch.
+constexpr uint64_t launch_bit(unsigned step, bool launches) {
+    return launches && step < 64 ? uint64_t(1) << step : 0;
+}
+
+// Device work one running chain has issued and not yet waited for. `launches` is the
+// chain's launch plan, so a batch opened at step k is sized to the launching steps
+// from k up to the next step that drains. Each chain_state opens its batches under its
+// own key, so chains running on different threads never share one.
+class chain_state {
+public:
+    explicit chain_state(uint64_t launches)
+        : launches_(launches), key_("parallax::exec#" + std::to_string(next_id())) {}
+    ~chain_state() { drain(); }
+    chain_state(const chain_state&) = delete;
+    chain_state& operator=(const chain_state&) = delete;
+
+    bool on_device() const { return on_device_; }
+    void set_scheduler(bool on_device) { on_device_ = on_device; }
+
+    // Every counted step calls this first, whether it launches or not.
+    void next_stage() { ++stage_; }
+
+    // Before a launch: open a batch over this step and the launching steps right after
+    // it, each depending on the previous one. Batches are limited to 32 steps by the
+    // dependency mask width. A step that falls back to the host drains, which closes a
+    // batch before all of its steps were submitted; batch_end is a full barrier either
+    // way.
+    void before_launch() {
+        if (batched_ || !parallax_batch_begin) return;
+        unsigned n = 0;
+        for (unsigned i = stage_ - 1; i < 64 && (launches_ >> i & 1); ++i) ++n;
+        if (n == 0 || n > 32) return;
+        deps_.assign(n, 0u);
+        for (unsigned i = 1; i < n; ++i) deps_[i] = 1u << (i - 1);
+        parallax_batch_begin(key_.c_str(), n, deps_.data());
+        batched_ = true;
+    }
+
+    void after_launch(chain_device& dev) {
+        if (batched_) {
+            pending_ = &dev;
+        } else {
+            dev.sync();
+        }
+    }
+
+    // The chain's one wait: close the batch and sync everything it submitted.
+    void drain() {
+        if (batched_) {
+            parallax_batch_end(key_.c_str());
+            batched_ = false;
+        }
+        if (pending_) pending_->sync();
+        pending_ = nullptr;
+    }
+
+private:
+    static unsigned long long next_id() {
+        static std::atomic<unsigned long long> id{0};
+        return id.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t launches_;
+    std::string key_;
+    unsigned stage_ = 0;
+    bool on_device_ = false;
+    bool batched_ = false;
+    chain_device* pending_ = nullptr;  // device with submitted, unwaited work
+    std::vector<unsigned> deps_;
+};
+
+// f's kernel, compiled and loaded once (see ExecutionPolicyImpl::for_each_impl), or
+// null when f has no device body.
+template<typename F>
+const KernelTable::Entry* loaded_kernel(chain_device& dev, F& f, int arg_count) {
+    LambdaCompiler& compiler = jit_compiler();
+    KernelTable::Entry& kernel = KernelTable::instance().get(compiler.get_kernel_key(f, arg_count));
+    std::call_once(kernel.compiled, [&] {
+        kernel.name = compiler.get_kernel_name(f, arg_count);
+        kernel.spirv = compiler.compile(f, arg_count);
+    });
+    if (kernel.spirv.empty()) return nullptr;
+    std::call_once(kernel.loaded, [&] { dev.load(kernel.name, kernel.spirv); });
+    return &kernel;
+}
+
+// bulk over a span: f(T&) per element, launched without a wait.
+template<typename T, typename F>
+void device_bulk(chain_state& st, std::span<T> s, F& f) {
+    st.next_stage();
+    chain_device& dev = current_device();
+    if (st.on_device() && s.size() >= offload_min_elems() && dev.ready()) {
+        try {
+            if (const KernelTable::Entry* kernel = loaded_kernel(dev, f, 1)) {
+                st.before_launch();
+                if (dev.launch(kernel->name, const_cast<void*>(static_cast<const void*>(s.data())),
+                               s.size(), sizeof(T))) {
+                    st.after_launch(dev);
+                    return;
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Parallax exec: bulk launch failed: " << e.what() << std::endl;
+        }
+    }
+    st.drain();
+    host_for_each(s.begin(), s.end(), f);
+}
+
+// then over a span with an element map: x = g(x) in place, launched without a wait.
+template<typename T, typename G>
+void device_map(chain_state& st, std::span<T> s, G& g) {
+    st.next_stage();
+    chain_device& dev = current_device();
+    if (st.on_device() && s.size() >= offload_min_elems() && dev.ready()) {
+        try {
+            if (const KernelTable::Entry* kernel = loaded_kernel(dev, g, 2)) {
+                st.before_launch();
+                if (dev.launch_transform(kernel->name, (void*)s.data(), (void*)s.data(), s.size(),
+                                         sizeof(T))) {
+                    st.after_launch(dev);
+                    return;
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Parallax exec: then launch failed: " << e.what() << std::endl;
+        }
+    }
+    st.drain();
+    host_transform(s.begin(), s.end(), s.begin(), g);
+}
+
+template<typename V, typename F>
+constexpr bool element_bulk() {
+    if constexpr (is_span<V>::value) return std::is_invocable_v<F&, typename V::element_type&>;
+    else return false;
+}
+
+// bulk(shape, f): over a span, f(T&) on its first `shape` elements; otherwise P2300's
+// index form f(i) / f(i, value) for i in [0, shape), which has no element to hand a
+// kernel and runs on the host pool.
+template<typename V, typename F>
+V bulk_stage(chain_state& st, V v, size_t shape, F& f) {
+    if constexpr (element_bulk<V, F>()) {
+        device_bulk(st, v.first(std::min(shape, v.size())), f);
+    } else {
+        st.next_stage();
+        st.drain();
+        HostPool::instance().parallel_for(shape, [&](size_t b, size_t e) {
+            for (size_t i = b; i < e; ++i) {
+                if constexpr (std::is_same_v<V, std::monostate>) f(i);
+                else f(i, v);
+            }
+        });
+    }
+    return v;
+}
+
+template<typename V, typename G>
+constexpr bool element_map() {
+    if constexpr (is_span<V>::value) {
+        using T = typename V::element_type;
+        return !std::is_const_v<T> && std::is_invocable_r_v<T, G&, T&>;
+    } else {
+        return false;
+    }
+}
+
+// then(g): over a mutable span, a T -> T g maps the elements in place on the device.
+// Any other g (nullary after schedule, or taking the whole value) runs on the host
+// once the device work before it has finished, and its result is lifted.
+template<typename V, typename G>
+auto then_stage(chain_state& st, V v, G& g) {
+    if constexpr (element_map<V, G>()) {
+        device_map(st, v, g);
+        return v;
+    } else {
+        st.next_stage();
+        st.drain();
+        auto call = [&]() -> decltype(auto) {
+            if constexpr (std::is_same_v<V, std::monostate>) return g();
+            else return g(v);
+        };
+        if constexpr (std::is_void_v<decltype(call())>) {
+            call();
+            return std::monostate{};
+        } else {
+            return lift(call());
+        }
+    }
+}
+
+// reduce(init, op) over a span: waits for the chain, then runs ExecutionPolicyImpl's
+// reduce (device skeleton, host pool fallback) or, host-scheduled, the pool directly.
+template<typename T, typename U, typename Op>
+U reduce_stage(chain_state& st, std::span<T> s, U init, Op& op) {
+    st.next_stage();
+    st.drain();
+    if (st.on_device())
+        return ExecutionPolicyImpl::instance().reduce_impl(s.begin(), s.end(), init, op);
+    return host_reduce(s.begin(), s.end(), init, op);
+}
+
+} // namespace detail
+
+// A lazy chain. Stages counts its bulk, then and reduce steps; bit i of Launches is set
+// when step i can launch without waiting (see launch_bit). run() executes the chain on
+// the caller against a chain_state and yields the final value.
+template<unsigned Stages, uint64_t Launches, typename Run>
+class sender {
+public:
+    static constexpr unsigned stages = Stages;
+    static constexpr uint64_t launches = Launches;
+    using value_type = std::invoke_result_t<Run&, detail::chain_state&>;
+
+    explicit sender(Run run) : run_(std::move(run)) {}
+
+    value_type run(detail::chain_state& st) { return run_(st); }
+
+    auto operator co_await() &&;
+
+private:
+    Run run_;
+};
+
+template<typename S> struct is_sender : std::false_type {};
+template<unsigned N, uint64_t L, typename R> struct is_sender<sender<N, L, R>> : std::true_type {};
+
+namespace detail {
+
+template<unsigned Stages, uint64_t Launches, typename Run>
+auto make_sender(Run run) {
+    return sender<Stages, Launches, Run>(std::move(run));
+}
+
+// Right-hand side of `sndr | adaptor`: fn(sndr) builds the extended sender.
+template<typename Fn>
+struct adaptor {
+    Fn fn;
+};
+
+template<typename Fn>
+adaptor<Fn> make_adaptor(Fn fn) {
+    return adaptor<Fn>{std::move(fn)};
+}
+
+} // namespace detail
+
+template<typename S, typename Fn>
+    requires is_sender<S>::value
+auto operator|(S s, detail::adaptor<Fn> a) {
+    return a.fn(std::move(s));
+}
+
+// Sources.
+
+template<scheduler Sch>
+auto schedule(Sch) {
+    return detail::make_sender<0, 0>([](detail::chain_state& st) {
+        st.set_scheduler(Sch::on_device);
+        return std::monostate{};
+    });
+}
+
+// A sender of a view over r, completing inline on the caller (host); r must outlive
+// the chain.
+template<std::ranges::contiguous_range R>
+    requires std::ranges::borrowed_range<R>
+auto just(R&& r) {
+    return detail::make_sender<0, 0>([v = detail::lift(std::forward<R>(r))](detail::chain_state&) {
+        return v;
+    });
+}
+
+template<scheduler Sch, std::ranges::contiguous_range R>
+    requires std::ranges::borrowed_range<R>
+auto transfer_just(Sch, R&& r) {
+    return detail::make_sender<0, 0>([v = detail::lift(std::forward<R>(r))](detail::chain_state& st) {
+        st.set_scheduler(Sch::on_device);
+        return v;
+    });
+}
+
+// Adaptors. Each has a pipeable form and a sender-first form.
+
+template<typename F>
+auto bulk(size_t shape, F f) {
+    return detail::make_adaptor([shape, f = std::move(f)](auto prev) mutable {
+        using P = decltype(prev);
+        constexpr bool device = detail::element_bulk<typename P::value_type, F>();
+        return detail::make_sender<P::stages + 1, P::launches | detail::launch_bit(P::stages, device)>(
+            [prev = std::move(prev), shape, f](detail::chain_state& st) mutable {
+                return detail::bulk_stage(st, prev.run(st), shape, f);
+            });
+    });
+}
+
+template<typename S, typename F>
+    requires is_sender<S>::value
+auto bulk(S s, size_t shape, F f) {
+    return std::move(s) | bulk(shape, std::move(f));
+}
+
+template<typename G>
+auto then(G g) {
+    return detail::make_adaptor([g = std::move(g)](auto prev) mutable {
+        using P = decltype(prev);
+        constexpr bool device = detail::element_map<typename P::value_type, G>();
+        return detail::make_sender<P::stages + 1, P::launches | detail::launch_bit(P::stages, device)>(
+            [prev = std::move(prev), g](detail::chain_state& st) mutable {
+                return detail::then_stage(st, prev.run(st), g);
+            });
+    });
+}
+
+template<typename S, typename G>
+    requires is_sender<S>::value
+auto then(S s, G g) {
+    return std::move(s) | then(std::move(g));
+}
+
+// Steps after transfer(sch) run on sch. Moving to the host needs no explicit wait: the
+// first host step drains the device work before it.
+template<scheduler Sch>
+auto transfer(Sch) {
+    return detail::make_adaptor([](auto prev) {
+        using P = decltype(prev);
+        return detail::make_sender<P::stages, P::launches>(
+            [prev = std::move(prev)](detail::chain_state& st) mutable {
+                auto v = prev.run(st);
+                st.set_scheduler(Sch::on_device);
+                return v;
+            });
+    });
+}
+
+template<typename S, scheduler Sch>
+    requires is_sender<S>::value
+auto transfer(S s, Sch sch) {
+    return std::move(s) | transfer(sch);
+}
+
+template<typename U, typename Op = std::plus<>>
+auto reduce(U init, Op op = {}) {
+    return detail::make_adaptor([init, op = std::move(op)](auto prev) mutable {
+        using P = decltype(prev);
+        return detail::make_sender<P::stages + 1, P::launches>(
+            [prev = std::move(prev), init, op](detail::chain_state& st) mutable {
+                return detail::reduce_stage(st, prev.run(st), init, op);
+            });
+    });
+}
+
+template<typename S, typename U, typename Op = std::plus<>>
+    requires is_sender<S>::value
+auto reduce(S s, U init, Op op = {}) {
+    return std::move(s) | reduce(init, std::move(op));
+}
+
+// Consumers.
+
+// Runs the chain on the calling thread and returns its value, as P2300's sync_wait
+// does (std::optional<std::tuple<>> for a chain with no value). Errors propagate as
+// exceptions; device work already submitted is waited for first.
+template<typename S>
+    requires is_sender<S>::value
+auto sync_wait(S s) {
+    using V = typename S::value_type;
+    detail::chain_state st(S::launches);
+    if constexpr (std::is_same_v<V, std::monostate>) {
+        s.run(st);
+        st.drain();
+        return std::optional<std::tuple<>>(std::tuple<>());
+    } else {
+        V v = s.run(st);
+        st.drain();
+        return std::optional<std::tuple<V>>(std::tuple<V>(std::move(v)));
+    }
+}
+
+namespace detail {
+
+// `co_await sndr`: the chain runs on a thread of its own (it blocks on the device and
+// may fan out to the host pool) and the coroutine resumes there once it completes.
+template<typename S>
+class awaiter {
+public:
+    explicit awaiter(S s) : s_(std::move(s)) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> h) {
+        std::thread([this, h] {
+            try {
+                result_ = sync_wait(std::move(s_));
+            } catch (...) {
+                error_ = std::current_exception();
+            }
+            h.resume();
+        }).detach();
+    }
+
+    auto await_resume() {
+        if (error_) std::rethrow_exception(error_);
+        if constexpr (std::is_same_v<typename S::value_type, std::monostate>) return;
+        else return std::get<0>(std::move(*result_));
+    }
+
+private:
+    S s_;
+    decltype(sync_wait(std::declval<S>())) result_;
+    std::exception_ptr error_;
+};
+
+} // namespace detail
+
+template<unsigned Stages, uint64_t Launches, typename Run>
+auto sender<Stages, Launches, Run>::operator co_await() && {
+    return detail::awaiter<sender>(std::move(*this));
+}
+
+} // namespace exec
+} // namespace parallax
+
+#endif // PARALLAX_SENDER_HPP
@@ -113,6 +113,70 @@ public:
     // remove_if: keep elements where the predicate is FALSE. Negates the flag so the
     // same scatter compacts the not-removed elements.
     void set_predicate_negate(bool v) { predicate_negate_ = v; }
+
+    // Out-of-core streaming variant of the next kernel. The runtime streams a range
+    // larger than device memory (or staged, non-pool data) through a ring of 2-3
+    // device chunk buffers, uploading chunk k+1 while chunk k computes; one descriptor
+    // set binds the whole ring and each dispatch selects its slot with a push-constant
+    // base (uint @4, in the padding after count, so no other member moves):
+    //   lambda wrapper  : element base + gid, bounds gid < count
+    //   reduce          : in[base + gid], partials at out[part_base(@8) + wgid], so
+    //                     every chunk appends to one partials buffer (partial carry)
+    //   scan / scan_add : data[base + gid]; scan_add also takes has_carry@8 and
+    //                     carry@16 (the previous chunk's last inclusive value)
+    //   exclusive shift : in/out at base + gid; init stays @8
+    // Sort and the compaction scatters need the whole range and have no variant.
+    void set_stream_base(bool v) { stream_base_ = v; }
+
+    // >4G-element variant of the next kernel (Int64): count is a uint64 at push offset
+    // 0 (the bytes before host_base / init were padding), element indices are 64-bit,
+    // and the grid is 2D: workgroup (x, y) of an (X, Y) dispatch covers the flat group
+    // y*X + x, so no dimension needs more than 65535 groups; groups past the range are
+    // inert. Covers the lambda wrapper ({ uint64 count@0 [, host_base@8, dev_base@16] }),
+    // reduce, scan, scan_add ({ uint64 count@0 }) and the exclusive shift
+    // ({ uint64 count@0, elem init@8 }). Predicate modes, sort and the compaction
+    // scatters stay 32-bit (their positions are 32-bit scans). Streaming variants
+    // ignore it: every chunk is below 2^32 elements.
+    void set_wide_index(bool v) { wide_index_ = v; }
+
+    // Workgroup size (LocalSize x) of the reduce, scan (scan, scan_add, exclusive
+    // shift) and sort skeletons; the reduce/scan shared arrays, tree and Hillis-Steele
+    // steps follow it. Power of two in [32, 1024]. set_local_size overrides it for
+    // this generator (parallax-tune's variants); otherwise the process-wide tuned
+    // size for the skeleton ("reduce", "scan", "sort") and element type applies,
+    // else 256. The size is readable from the module (kernel layout / pre-warm
+    // record), so a runtime sizes its grid and block-sum pass as ceil(n / LocalSize).
+    void set_local_size(uint32_t n) {
+        local_size_ = (n >= 32 && n <= 1024 && (n & (n - 1)) == 0) ? n : 0;
+    }
+    // Tuned sizes are kept per log2(n) bucket. set_size_bucket picks the entry of the
+    // largest bucket <= log2_n (the smallest bucket below all of them); by default
+    // the largest bucket, the bulk-throughput regime. tuned_buckets lists, ascending,
+    // the buckets at which the tuned size changes; fewer than two means one size
+    // serves every n.
+    static void set_tuned_local_size(const std::string& skeleton, ReduceElemType elem,
+                                     unsigned log2_n, uint32_t n);
+    static std::vector<unsigned> tuned_buckets(const std::string& skeleton, ReduceElemType elem);
+    void set_size_bucket(unsigned log2_n) { size_bucket_ = log2_n; }
+
+    // Placement facts of the last generate_from_lambda, for the registrar's placement
+    // hint. Bit i covers capture leaf i (the i-th flattened capture after the element
+    // parameter) when it is a relocated pointer: readonly = the kernel only loads
+    // through it, written = it may store through it (or the pointer escapes). Leaves
+    // that are not pointers are in neither mask; a pointer leaf at index 64 or above
+    // sets every written bit. input_readonly: the kernel only reads its data input
+    // (transform / predicate kernels, not for_each).
+    uint64_t readonly_capture_mask() const { return readonly_capture_mask_; }
+    uint64_t written_capture_mask() const { return written_capture_mask_; }
+    bool     input_readonly() const { return input_readonly_; }
+
+    // Link single-entry-point modules into one module with an OpEntryPoint per part,
+    // renamed to part.first (e.g. "scan", "add", "shift"). Capabilities, imports and
+    // non-aggregate types / constants / Input builtins are shared by value; aggregates
+    // merge only when identically decorated. Returns {} if a part uses an opcode the
+    // linker does not know the operand layout of, so callers keep separate modules.
+    static std::vector<uint32_t> link_entry_points(
+        const std::vector<std::pair<std::string, std::vector<uint32_t>>>& parts);
     
 private:
     uint32_t vulkan_major_;
@@ -135,6 +199,8 @@ private:
                             const std::set<size_t>& buffer_param_indices = {});
     void translate_instruction(SPIRVBuilder& builder, llvm::Instruction* inst,
                                std::unordered_map<llvm::Value*, uint32_t>& value_map);
+    // Workgroup size for a skeleton: the override, else the tuned size, else 256.
+    uint32_t skeleton_local_size(const char* skeleton, ReduceElemType elem) const;
     // True if a scalar load/store through `ptr` is an offset-0 struct field whose GEP
     // LLVM elided (needs a synthesized member-0 access). Bails (translation_failed_)
     // if the offset-0 member's type doesn't match the scalar.
@@ -148,6 +214,25 @@ private:
     // custom-op paths; the op body goes through the shared translate_instruction path.
     uint32_t emit_inlined_op(SPIRVBuilder& builder, llvm::Function* user_op,
                              uint32_t elem_t, uint32_t uint_t, uint32_t bool_t, uint32_t ret_t);
+    // set_wide_index support. declare_wide_ids adds the NumWorkgroups input, plus
+    // WorkgroupId / LocalInvocationId when the kernel has none (pass 0); `added` lists
+    // the new inputs for the entry-point interface. emit_wide_gid loads the 64-bit
+    // flattened invocation index (and, optionally, the flat workgroup index);
+    // wide_const returns a deduplicated uint64 constant.
+    struct WideIds {
+        uint32_t u64_t = 0, nwg_var = 0, wgid_var = 0, lid_var = 0;
+        std::vector<uint32_t> added;
+        std::unordered_map<uint64_t, uint32_t> consts;
+    };
+    WideIds declare_wide_ids(SPIRVBuilder& builder, uint32_t u64_t, uint32_t ptr_in_v3,
+                             uint32_t wgid_var, uint32_t lid_var);
+    uint32_t wide_const(SPIRVBuilder& builder, WideIds& w, uint64_t v);
+    uint32_t emit_wide_gid(SPIRVBuilder& builder, WideIds& w, uint32_t uint_t,
+                           uint32_t v3uint, uint32_t local_size, uint32_t* flat_wg = nullptr);
+    // The lambda wrapper's wide layout applies to plain for_each/transform kernels.
+    bool wide_wrapper() const {
+        return wide_index_ && !stream_base_ && !predicate_count_ && !predicate_flags_;
+    }
     uint32_t get_type_id(SPIRVBuilder& builder, llvm::Type* type);
     uint32_t get_pointer_type_id(SPIRVBuilder& builder, uint32_t element_type_id, uint32_t storage_class);
     uint32_t get_value_id(SPIRVBuilder& builder, llvm::Value* val, std::unordered_map<llvm::Value*, uint32_t>& value_map);
@@ -203,6 +288,13 @@ private:
     bool        predicate_count_ = false;
     bool        predicate_flags_ = false;
     bool        predicate_negate_ = false;
+    bool        stream_base_ = false;      // streaming variant: push-constant base offset
+    uint32_t    local_size_ = 0;           // skeleton workgroup size override; 0 = tuned/256
+    unsigned    size_bucket_ = ~0u;        // log2(n) bucket for tuned sizes (set_size_bucket)
+    bool        wide_index_ = false;       // 64-bit count/index variant (set_wide_index)
+    uint64_t    readonly_capture_mask_ = 0;  // placement facts (see readonly_capture_mask)
+    uint64_t    written_capture_mask_ = 0;
+    bool        input_readonly_ = false;
     // A transform/predicate functor whose INPUT is taken by reference (const T&), so its
     // first parameter is a pointer to the element (not the value). The kernel must pass
     // the input buffer element POINTER, not a loaded value. Set per generate_from_lambda.
@@ -0,0 +1,99 @@
+#ifndef PARALLAX_STAGING_HPP
+#define PARALLAX_STAGING_HPP
+
+#include <parallax/runtime.h>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <vector>
+
+namespace parallax {
+
+// Staged offload for ranges whose elements are not contiguous in memory (std::deque,
+// std::list, strided views, node-based containers), which the direct launch paths
+// cannot hand to a kernel. The range is cut into chunks. Each chunk is gathered
+// through the iterator into a device-arena buffer, the kernel runs on that buffer,
+// and the results are scattered back through the iterator. Two buffer slots pipeline
+// the host copies against the device: while the GPU computes chunk k+1, the calling
+// thread scatters chunk k and gathers chunk k+2 into the slot chunk k just vacated.
+//
+// Opt-in: PARALLAX_STAGING=1, since a gather and a scatter per element only pay off
+// when the callable is compute-heavy. PARALLAX_STAGING_CHUNK sets the chunk length in
+// elements (default 65536).
+inline bool staging_enabled() {
+    static const bool on = std::getenv("PARALLAX_STAGING") != nullptr;
+    return on;
+}
+
+inline size_t staging_chunk_elems() {
+    static const size_t n = [] {
+        const char* v = std::getenv("PARALLAX_STAGING_CHUNK");
+        size_t c = v ? static_cast<size_t>(std::strtoull(v, nullptr, 10)) : 0;
+        return c ? c : size_t(65536);
+    }();
+    return n;
+}
+
+// Device-arena buffers for `slots` chunks of `bytes_per_slot` each, freed on scope exit.
+class StagingBuffers {
+public:
+    StagingBuffers(size_t bytes_per_slot, unsigned slots) : slots_(slots, nullptr) {
+        for (void*& p : slots_) p = parallax_arena_alloc(bytes_per_slot, 16);
+    }
+    ~StagingBuffers() {
+        for (void* p : slots_)
+            if (p) parallax_arena_free(p);
+    }
+    StagingBuffers(const StagingBuffers&) = delete;
+    StagingBuffers& operator=(const StagingBuffers&) = delete;
+
+    bool ok() const {
+        for (void* p : slots_)
+            if (!p) return false;
+        return true;
+    }
+    void* slot(unsigned i) const { return slots_[i]; }
+
+private:
+    std::vector<void*> slots_;
+};
+
+// Runs chunks 0..nchunks-1 through gather(k, slot) -> launch(k, slot) -> scatter(k, slot)
+// with slot = k % 2. launch runs on its own thread, overlapping the neighbouring chunks'
+// host copies. gather and scatter each see k in increasing order, so they can walk a
+// forward iterator. Returns how many leading chunks completed: all of them, or the
+// index of the first chunk whose launch failed or threw. That chunk and the ones after
+// it were never written back, so the caller finishes them on the host; a throwing
+// launch does not propagate, since rerunning the whole range would apply the chunks
+// already scattered a second time.
+template<typename Gather, typename Launch, typename Scatter>
+size_t run_staged(size_t nchunks, Gather gather, Launch launch, Scatter scatter) {
+    if (!nchunks) return 0;
+    auto guarded = [&launch](size_t k, unsigned slot) {
+        try {
+            return static_cast<bool>(launch(k, slot));
+        } catch (const std::exception& e) {
+            std::cerr << "Parallax JIT: staged chunk " << k << " threw: " << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "Parallax JIT: staged chunk " << k << " threw" << std::endl;
+        }
+        return false;
+    };
+    gather(size_t(0), 0u);
+    auto gpu = std::async(std::launch::async, guarded, size_t(0), 0u);
+    if (nchunks > 1) gather(size_t(1), 1u);
+    for (size_t k = 0; k < nchunks; ++k) {
+        const unsigned slot = static_cast<unsigned>(k & 1);
+        if (!gpu.get()) return k;
+        if (k + 1 < nchunks) gpu = std::async(std::launch::async, guarded, k + 1, slot ^ 1u);
+        scatter(k, slot);
+        if (k + 2 < nchunks) gather(k + 2, slot);
+    }
+    return nchunks;
+}
+
+} // namespace parallax
+
+#endif // PARALLAX_STAGING_HPP
@@ -0,0 +1,252 @@
+#include "parallax/host_kernel_generator.hpp"
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/IR/Verifier.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/TargetParser/Host.h>
+#include <llvm/TargetParser/SubtargetFeature.h>
+#include <llvm/TargetParser/Triple.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+namespace parallax {
+
+HostKernelGenerator::HostKernelGenerator() : ctx_(std::make_unique<llvm::LLVMContext>()) {}
+HostKernelGenerator::~HostKernelGenerator() = default;
+
+bool HostKernelGenerator::add_kernel(llvm::Function* body, const std::string& symbol,
+                                     unsigned elem_bytes, llvm::Type* flags_elem, Mode mode) {
+    if (!body || body->isDeclaration() || body->arg_size() < 1 || elem_bytes == 0)
+        return false;
+
+    const bool is_transform = !body->getReturnType()->isVoidTy();
+    llvm::Type* param0 = body->getFunctionType()->getParamType(0);
+    const bool byref_input = param0->isPointerTy();
+    // for_each needs the element pointer (a scalar arg 0 is for_each_n's index form);
+    // a transform input must be a pointer or a first-class scalar we can load.
+    if (!is_transform && !byref_input) return false;
+    if (is_transform && !byref_input && !param0->isIntOrIntVectorTy() && !param0->isFloatingPointTy())
+        return false;
+    llvm::Type* ret = body->getReturnType();
+    if (is_transform && !ret->isIntegerTy() && !ret->isFloatingPointTy()) return false;
+    if (mode.predicate_flags && !flags_elem) return false;
+    for (unsigned a = 1; a < body->arg_size(); ++a) {
+        llvm::Type* t = body->getFunctionType()->getParamType(a);
+        if (!t->isPointerTy() && !t->isIntegerTy() && !t->isFloatingPointTy()) return false;
+    }
+
+    // Work on a clone: the caller still hands the original body to the SPIR-V path.
+    std::unique_ptr<llvm::Module> clone = llvm::CloneModule(*body->getParent());
+    llvm::Function* kb = clone->getFunction(body->getName());
+    if (!kb) return false;
+    llvm::LLVMContext& ctx = clone->getContext();
+    const llvm::DataLayout& DL = clone->getDataLayout();
+
+    // The body is only reachable through this loop: internalize it (and any helper
+    // bodies left in the clone) so the inliner folds it in and nothing else is exported.
+    for (llvm::Function& f : *clone)
+        if (!f.isDeclaration()) f.setLinkage(llvm::GlobalValue::InternalLinkage);
+    // The clone is the whole TU's module. Its external globals must bind to the TU's
+    // own definitions (this object is linked beside it), so turn them into
+    // declarations; private constants (literals) may be duplicated, but a kernel that
+    // touches a file-static mutable would silently get its own copy — no host form.
+    for (llvm::GlobalVariable& g : clone->globals()) {
+        if (g.isDeclaration()) continue;
+        if (g.hasLocalLinkage()) {
+            if (!g.isConstant() && !g.use_empty()) return false;
+            continue;
+        }
+        g.setInitializer(nullptr);
+        g.setComdat(nullptr);
+        g.setLinkage(llvm::GlobalValue::ExternalLinkage);
+    }
+    kb->addFnAttr(llvm::Attribute::AlwaysInline);
+    kb->removeFnAttr(llvm::Attribute::NoInline);
+    kb->removeFnAttr(llvm::Attribute::OptimizeNone);
+
+    llvm::Type* ptr = llvm::PointerType::getUnqual(ctx);
+    llvm::Type* i64 = llvm::Type::getInt64Ty(ctx);
+    llvm::Type* i8 = llvm::Type::getInt8Ty(ctx);
+    llvm::Type* i32 = llvm::Type::getInt32Ty(ctx);
+    llvm::FunctionType* fty = llvm::FunctionType::get(
+        llvm::Type::getVoidTy(ctx), {ptr, ptr, i64, ptr}, false);
+    // Weak ODR: the same header-defined functor instantiated in two TUs yields the
+    // same key (and symbol); the linker keeps one copy.
+    llvm::Function* fn = llvm::Function::Create(fty, llvm::GlobalValue::WeakODRLinkage,
+                                                symbol, clone.get());
+    llvm::Argument* in = fn->getArg(0);
+    llvm::Argument* out = fn->getArg(1);
+    llvm::Argument* n = fn->getArg(2);
+    llvm::Argument* caps = fn->getArg(3);
+
+    llvm::BasicBlock* entry = llvm::BasicBlock::Create(ctx, "entry", fn);
+    llvm::BasicBlock* loop = llvm::BasicBlock::Create(ctx, "loop", fn);
+    llvm::BasicBlock* exit = llvm::BasicBlock::Create(ctx, "exit", fn);
+    llvm::IRBuilder<> b(entry);
+
+    // Captures: loop-invariant, loaded once with the device's member-offset rule.
+    std::vector<llvm::Value*> cap_vals;
+    uint64_t off = 0;
+    for (unsigned a = 1; a < kb->arg_size(); ++a) {
+        llvm::Type* t = kb->getFunctionType()->getParamType(a);
+        uint64_t sz = t->isPointerTy() ? 8 : std::max<uint64_t>(4, DL.getTypeStoreSize(t));
+        off = (off + sz - 1) & ~(sz - 1);
+        llvm::Value* p = b.CreateInBoundsGEP(i8, caps, b.getInt64(off));
+        cap_vals.push_back(b.CreateAlignedLoad(t, p, llvm::Align(std::min<uint64_t>(sz, 8))));
+        off += sz;
+    }
+    b.CreateCondBr(b.CreateICmpEQ(n, b.getInt64(0)), exit, loop);
+
+    b.SetInsertPoint(loop);
+    llvm::PHINode* i = b.CreatePHI(i64, 2, "i");
+    i->addIncoming(b.getInt64(0), entry);
+    llvm::Value* in_i = b.CreateInBoundsGEP(i8, in, b.CreateMul(i, b.getInt64(elem_bytes)));
+    std::vector<llvm::Value*> args;
+    args.push_back(is_transform && !byref_input ? static_cast<llvm::Value*>(b.CreateLoad(param0, in_i))
+                                                : in_i);
+    args.insert(args.end(), cap_vals.begin(), cap_vals.end());
+    llvm::Value* r = b.CreateCall(kb, args);
+
+    if (is_transform) {
+        auto truth = [&](llvm::Value* v) -> llvm::Value* {
+            return v->getType()->isFloatingPointTy()
+                       ? b.CreateFCmpUNE(v, llvm::ConstantFP::get(v->getType(), 0.0))
+                       : b.CreateICmpNE(v, llvm::ConstantInt::get(v->getType(), 0));
+        };
+        if (mode.predicate_count) {
+            llvm::Value* v = b.CreateSelect(truth(r), b.getInt32(1), b.getInt32(0));
+            b.CreateStore(v, b.CreateInBoundsGEP(i32, out, i));
+        } else if (mode.predicate_flags) {
+            auto c = [&](double x) -> llvm::Value* {
+                return flags_elem->isFloatingPointTy() ? llvm::ConstantFP::get(flags_elem, x)
+                                                       : llvm::ConstantInt::get(flags_elem, (uint64_t)x);
+            };
+            llvm::Value* t_arm = mode.predicate_negate ? c(0) : c(1);
+            llvm::Value* f_arm = mode.predicate_negate ? c(1) : c(0);
+            b.CreateStore(b.CreateSelect(truth(r), t_arm, f_arm),
+                          b.CreateInBoundsGEP(flags_elem, out, i));
+        } else {
+            b.CreateStore(r, b.CreateInBoundsGEP(ret, out, i));
+        }
+    }
+    llvm::Value* next = b.CreateAdd(i, b.getInt64(1), "", /*HasNUW=*/true);
+    i->addIncoming(next, loop);
+    b.CreateCondBr(b.CreateICmpEQ(next, n), exit, loop);
+    b.SetInsertPoint(exit);
+    b.CreateRetVoid();
+
+    if (llvm::verifyFunction(*fn, &llvm::errs())) {
+        llvm::errs() << "[HostKernel] generated loop for " << symbol << " failed verification\n";
+        return false;
+    }
+
+    // Move the loop into ctx_ (a module cannot be cloned across contexts).
+    llvm::SmallVector<char, 0> bitcode;
+    {
+        llvm::raw_svector_ostream os(bitcode);
+        llvm::WriteBitcodeToFile(*clone, os);
+    }
+    auto owned = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef(llvm::StringRef(bitcode.data(), bitcode.size()), symbol), *ctx_);
+    if (!owned) {
+        llvm::errs() << "[HostKernel] could not move host loop " << symbol << ": "
+                     << llvm::toString(owned.takeError()) << "\n";
+        return false;
+    }
+
+    if (!module_) {
+        module_ = std::make_unique<llvm::Module>("parallax_host_kernels", *ctx_);
+        module_->setDataLayout((*owned)->getDataLayout());
+        module_->setTargetTriple((*owned)->getTargetTriple());
+    }
+    if (llvm::Linker::linkModules(*module_, std::move(*owned))) {
+        llvm::errs() << "[HostKernel] failed to link host loop " << symbol << "\n";
+        return false;
+    }
+    ++kernel_count_;
+    return true;
+}
+
+bool HostKernelGenerator::emit_object(const std::string& path) {
+    if (empty()) return false;
+
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    llvm::Triple triple(module_->getTargetTriple());
+    std::string err;
+    const llvm::Target* target = llvm::TargetRegistry::lookupTarget(triple.getTriple(), err);
+    if (!target) {
+        llvm::errs() << "[HostKernel] no target for " << triple.getTriple() << ": " << err << "\n";
+        return false;
+    }
+    std::string cpu = "generic";
+    std::string features;
+    if (const char* c = std::getenv("PARALLAX_HOST_CPU")) {
+        cpu = c;
+        if (cpu == "native") {
+            cpu = llvm::sys::getHostCPUName().str();
+            llvm::SubtargetFeatures f;
+            for (const auto& kv : llvm::sys::getHostCPUFeatures())
+                f.AddFeature(kv.getKey(), kv.getValue());
+            features = f.getString();
+        }
+    }
+    llvm::TargetOptions opts;
+    std::unique_ptr<llvm::TargetMachine> tm(target->createTargetMachine(
+        triple, cpu, features, opts, llvm::Reloc::PIC_, std::nullopt,
+        llvm::CodeGenOptLevel::Aggressive));
+    if (!tm) {
+        llvm::errs() << "[HostKernel] could not create a TargetMachine for " << cpu << "\n";
+        return false;
+    }
+    module_->setDataLayout(tm->createDataLayout());
+
+    // -O3 with the target's cost model, so the loop vectorizer and SLP see real widths.
+    {
+        llvm::LoopAnalysisManager LAM;
+        llvm::FunctionAnalysisManager FAM;
+        llvm::CGSCCAnalysisManager CGAM;
+        llvm::ModuleAnalysisManager MAM;
+        llvm::PassBuilder PB(tm.get());
+        PB.registerModuleAnalyses(MAM);
+        PB.registerCGSCCAnalyses(CGAM);
+        PB.registerFunctionAnalyses(FAM);
+        PB.registerLoopAnalyses(LAM);
+        PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+        llvm::ModulePassManager MPM = PB.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3);
+        MPM.run(*module_, MAM);
+    }
+
+    std::error_code ec;
+    llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::OF_None);
+    if (ec) {
+        llvm::errs() << "[HostKernel] cannot write " << path << ": " << ec.message() << "\n";
+        return false;
+    }
+    llvm::legacy::PassManager pm;
+    if (tm->addPassesToEmitFile(pm, os, nullptr, llvm::CodeGenFileType::ObjectFile)) {
+        llvm::errs() << "[HostKernel] target cannot emit object files\n";
+        return false;
+    }
+    pm.run(*module_);
+    os.flush();
+    llvm::errs() << "[HostKernel] wrote " << kernel_count_ << " host kernel(s) to " << path
+                 << " (cpu=" << cpu << ")\n";
+    return true;
+}
+
+} // namespace parallax
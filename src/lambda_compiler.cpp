@@ -1,17 +1,273 @@
 #include "parallax/lambda_compiler.hpp"
 #include "parallax/spirv_generator.hpp"
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <unordered_map>
 
 namespace parallax {
 
+namespace {
+
+std::mutex& bitcode_mutex() {
+    static std::mutex m;
+    return m;
+}
+
+// The plugin's extraction leaves one definition: the body with the data parameters
+// first, then one scalar argument per closure leaf in field order.
+llvm::Function* embedded_body(llvm::Module& module) {
+    for (auto& f : module)
+        if (f.getName().starts_with("kernel_")) return &f;
+    for (auto& f : module)
+        if (!f.isDeclaration()) return &f;
+    return nullptr;
+}
+
+} // namespace
+
+// Embedded bodies by typeid name. Filled by static initializers (one per plugin-built
+// object), read at first launch of each functor type.
+std::unordered_map<std::string, std::unique_ptr<LambdaCompiler::EmbeddedBitcode>>&
+LambdaCompiler::bitcode_registry() {
+    static std::unordered_map<std::string, std::unique_ptr<EmbeddedBitcode>> r;
+    return r;
+}
+
 LambdaCompiler::LambdaCompiler()
     : context_(std::make_unique<llvm::LLVMContext>()) {}
 
 LambdaCompiler::~LambdaCompiler() = default;
 
-// Template implementations are in the header.
-// This file can contain explicit instantiations or non-template helpers.
+void LambdaCompiler::register_bitcode(const char* type_name, const char* elem_type,
+                                      const void* data, size_t size) {
+    if (!type_name || !data || !size) return;
+    auto bc = std::make_unique<EmbeddedBitcode>();
+    bc->elem_type = elem_type ? elem_type : "float";
+    bc->bitcode.assign(static_cast<const char*>(data), size);  // aligned copy for the reader
+    std::lock_guard<std::mutex> lock(bitcode_mutex());
+    // First registration wins: an inline function's functor registers from every TU
+    // that instantiates it, and callers may already hold the first entry.
+    bitcode_registry().try_emplace(type_name, std::move(bc));
+}
+
+LambdaCompiler::EmbeddedBitcode* LambdaCompiler::find_bitcode(const char* type_name) {
+    std::lock_guard<std::mutex> lock(bitcode_mutex());
+    auto it = bitcode_registry().find(type_name);
+    return it == bitcode_registry().end() ? nullptr : it->second.get();
+}
+
+unsigned LambdaCompiler::max_specializations() {
+    static const unsigned n = [] {
+        const char* v = std::getenv("PARALLAX_JIT_MAX_SPECIALIZATIONS");
+        return v ? static_cast<unsigned>(std::strtoul(v, nullptr, 10)) : 64u;
+    }();
+    return n;
+}
+
+bool LambdaCompiler::claim_specialization(EmbeddedBitcode& bc, const std::string& name) {
+    if (bc.specializations >= max_specializations()) {
+        std::cerr << "Parallax JIT: " << name << " reached PARALLAX_JIT_MAX_SPECIALIZATIONS ("
+                  << max_specializations() << "); host path" << std::endl;
+        return false;
+    }
+    ++bc.specializations;
+    return true;
+}
+
+const std::vector<LambdaCompiler::CaptureLeaf>* LambdaCompiler::capture_leaves(EmbeddedBitcode& bc) {
+    std::call_once(bc.leaves_once, [&bc] {
+        // Own context: this runs outside compile_mutex_, on whichever thread asks first.
+        llvm::LLVMContext ctx;
+        auto parsed = llvm::parseBitcodeFile(
+            llvm::MemoryBufferRef(llvm::StringRef(bc.bitcode.data(), bc.bitcode.size()), "leaves"), ctx);
+        if (!parsed) {
+            llvm::consumeError(parsed.takeError());
+            return;
+        }
+        llvm::Function* body = embedded_body(**parsed);
+        if (!body) return;
+        llvm::StructType* closure_ty = nullptr;
+        if (llvm::MDNode* md = body->getMetadata("parallax.closure"))
+            if (md->getNumOperands() == 1)
+                if (auto* vm = llvm::dyn_cast<llvm::ValueAsMetadata>(md->getOperand(0)))
+                    closure_ty = llvm::dyn_cast<llvm::StructType>(vm->getValue()->getType());
+        // Leaves in the order the plugin flattened them, each offset summed from the
+        // struct layouts and array strides along its path.
+        const llvm::DataLayout& dl = (*parsed)->getDataLayout();
+        bool ok = true;
+        std::function<void(llvm::Type*, uint64_t)> walk = [&](llvm::Type* t, uint64_t off) {
+            if (auto* st = llvm::dyn_cast<llvm::StructType>(t)) {
+                const llvm::StructLayout* sl = dl.getStructLayout(st);
+                for (unsigned i = 0; i < st->getNumElements(); ++i)
+                    walk(st->getElementType(i), off + uint64_t(sl->getElementOffset(i)));
+            } else if (auto* at = llvm::dyn_cast<llvm::ArrayType>(t)) {
+                const uint64_t stride = dl.getTypeAllocSize(at->getElementType());
+                for (uint64_t i = 0; i < at->getNumElements(); ++i)
+                    walk(at->getElementType(), off + i * stride);
+            } else if (t->isIntegerTy() || t->isFloatTy() || t->isDoubleTy()) {
+                bc.leaves.push_back({static_cast<uint32_t>(off),
+                                     static_cast<uint32_t>(dl.getTypeStoreSize(t))});
+            } else {
+                ok = false;
+            }
+        };
+        if (closure_ty) walk(closure_ty, 0);
+        bc.leaves_ok = ok;
+    });
+    if (!bc.leaves_ok) bc.specializable = 0;
+    return bc.leaves_ok ? &bc.leaves : nullptr;
+}
+
+uint64_t LambdaCompiler::closure_hash(const EmbeddedBitcode& bc, const void* closure, size_t size) {
+    uint64_t h = 1469598103934665603ull;
+    const auto* p = static_cast<const unsigned char*>(closure);
+    for (const CaptureLeaf& leaf : bc.leaves) {
+        if (leaf.offset + uint64_t(leaf.size) > size) break;
+        for (uint32_t i = 0; i < leaf.size; ++i) {
+            h ^= p[leaf.offset + i];
+            h *= 1099511628211ull;
+        }
+    }
+    return h;
+}
+
+llvm::Function* LambdaCompiler::specialize(EmbeddedBitcode& bc, const std::string& name,
+                                           const void* closure, size_t closure_size,
+                                           unsigned data_params,
+                                           std::unique_ptr<llvm::Module>& module) {
+    auto parsed = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef(llvm::StringRef(bc.bitcode.data(), bc.bitcode.size()), name), *context_);
+    if (!parsed) {
+        std::cerr << "Parallax JIT: unreadable embedded body for " << name << ": "
+                  << llvm::toString(parsed.takeError()) << std::endl;
+        bc.specializable = 0;
+        return nullptr;
+    }
+    module = std::move(*parsed);
+
+    llvm::Function* body = embedded_body(*module);
+    const std::vector<CaptureLeaf>* leaves = capture_leaves(bc);
+    if (!leaves) {
+        std::cerr << "Parallax JIT: " << name << " captures a pointer; host path" << std::endl;
+        return nullptr;
+    }
+    if (!body || body->arg_size() < data_params || body->arg_size() - data_params != leaves->size()) {
+        std::cerr << "Parallax JIT: " << name << " has no closure layout for its captures; host path"
+                  << std::endl;
+        bc.specializable = 0;
+        return nullptr;
+    }
+
+    // Read each capture from the closure at its leaf's offset and turn it into a
+    // constant; the data parameters stay the only parameters.
+    const auto* bytes = static_cast<const unsigned char*>(closure);
+    llvm::ValueToValueMapTy vmap;
+    for (unsigned i = data_params; i < body->arg_size(); ++i) {
+        llvm::Argument* a = body->getArg(i);
+        llvm::Type* t = a->getType();
+        const CaptureLeaf& leaf = (*leaves)[i - data_params];
+        const uint64_t size = leaf.size;
+        if ((!t->isIntegerTy() && !t->isFloatTy() && !t->isDoubleTy()) ||
+            module->getDataLayout().getTypeStoreSize(t) != size ||
+            leaf.offset + size > closure_size || size > 8) {
+            bc.specializable = 0;
+            return nullptr;
+        }
+        const unsigned char* field = bytes + leaf.offset;
+        if (t->isFloatTy()) {
+            float v; std::memcpy(&v, field, sizeof(v));
+            vmap[a] = llvm::ConstantFP::get(t, v);
+        } else if (t->isDoubleTy()) {
+            double v; std::memcpy(&v, field, sizeof(v));
+            vmap[a] = llvm::ConstantFP::get(t, v);
+        } else {
+            uint64_t v = 0;
+            std::memcpy(&v, field, size);  // little-endian: the low bytes are the value
+            vmap[a] = llvm::ConstantInt::get(t, v);
+        }
+    }
+
+    std::vector<llvm::Type*> params;
+    for (unsigned i = 0; i < data_params; ++i) params.push_back(body->getArg(i)->getType());
+    llvm::FunctionType* fty = llvm::FunctionType::get(body->getReturnType(), params, false);
+    llvm::Function* kernel = llvm::Function::Create(
+        fty, llvm::Function::ExternalLinkage, "kernel_" + name, module.get());
+    for (unsigned i = 0; i < data_params; ++i) vmap[body->getArg(i)] = kernel->getArg(i);
+    llvm::SmallVector<llvm::ReturnInst*, 4> returns;
+    llvm::CloneFunctionInto(kernel, body, vmap, llvm::CloneFunctionChangeType::LocalChangesOnly,
+                            returns);
+    const unsigned baked = body->arg_size() - data_params;
+    body->eraseFromParent();
+    if (llvm::verifyFunction(*kernel, &llvm::errs())) {
+        bc.specializable = 0;
+        return nullptr;
+    }
+    bc.specializable = 1;
+    std::cerr << "Parallax JIT: " << name << " specialized " << baked << " capture(s)" << std::endl;
+    return kernel;
+}
+
+std::vector<uint32_t> LambdaCompiler::compile_embedded(EmbeddedBitcode& bc, const std::string& name,
+                                                       const void* closure, size_t closure_size,
+                                                       int arg_count) {
+    std::lock_guard<std::mutex> lock(compile_mutex_);
+    if (!claim_specialization(bc, name)) return {};
+    std::unique_ptr<llvm::Module> module;
+    llvm::Function* kernel = specialize(bc, name, closure, closure_size, 1, module);
+    if (!kernel) return {};
+    // for_each bodies return void (in place); transform bodies return the new value.
+    if ((arg_count == 2) == kernel->getReturnType()->isVoidTy()) {
+        std::cerr << "Parallax JIT: " << name << " body does not match a "
+                  << (arg_count == 2 ? "transform" : "for_each") << "; host path" << std::endl;
+        return {};
+    }
+
+    SPIRVGenerator spirv_gen;
+    spirv_gen.set_target_vulkan_version(1, 3);
+    std::vector<std::string> params = {bc.elem_type + "&"};
+    auto words = spirv_gen.generate_from_lambda(kernel, params);
+    std::cerr << "Parallax JIT: " << name << " -> " << words.size() << " SPIR-V words" << std::endl;
+    return words;
+}
+
+std::vector<uint32_t> LambdaCompiler::compile_reduce_embedded(EmbeddedBitcode* bc,
+                                                              const std::string& name,
+                                                              const void* closure,
+                                                              size_t closure_size, int elem) {
+    const auto ek = static_cast<SPIRVGenerator::ReduceElemType>(elem);
+    std::lock_guard<std::mutex> lock(compile_mutex_);
+    std::unique_ptr<llvm::Module> module;
+    llvm::Function* op = nullptr;
+    if (bc) {
+        if (!claim_specialization(*bc, name)) return {};
+        op = specialize(*bc, name, closure, closure_size, 2, module);
+        if (!op || op->getReturnType()->isVoidTy()) {
+            std::cerr << "Parallax JIT: " << name << " is not a usable binary op; host path" << std::endl;
+            return {};
+        }
+    }
+    SPIRVGenerator spirv_gen;
+    spirv_gen.set_target_vulkan_version(1, 3);
+    auto words = spirv_gen.generate_reduce_kernel(ek, op);  // null op: baked-in '+'
+    std::cerr << "Parallax JIT: " << name << " -> " << words.size() << " SPIR-V words ("
+              << (op ? "user op" : "'+'") << ")" << std::endl;
+    return words;
+}
 
 } // namespace parallax
+
+extern "C" void parallax_bitcode_register(const char* type_name, const char* elem_type,
+                                          const void* data, unsigned long long size) {
+    parallax::LambdaCompiler::register_bitcode(type_name, elem_type, data,
+                                               static_cast<size_t>(size));
+}
@@ -2109,9 +2109,15 @@ std::unique_ptr<llvm::Module> LambdaIRGenerator::generateWithCodeGen(
         llvm::FunctionType::get(target_fty->getReturnType(), wrapper_params, false);
     llvm::Function* wrapper = llvm::Function::Create(
         wrapper_fty, llvm::Function::ExternalLinkage, "__parallax_kernel_body", module.get());
-    if (closure_ty)
+    if (closure_ty) {
         llvm::errs() << "[CodeGen] Lambda captures " << leaf_types.size()
                      << " leaf value(s); reconstructing closure in the kernel\n";
+        // Keep the closure type on the body: the leaf arguments alone lose where each
+        // leaf sits in the closure (nested struct padding), which LambdaCompiler needs
+        // to read capture values back out of a live closure.
+        wrapper->setMetadata("parallax.closure", llvm::MDNode::get(*llvm_context_,
+            {llvm::ValueAsMetadata::get(llvm::UndefValue::get(closure_ty))}));
+    }
 
     llvm::BasicBlock* entry =
         llvm::BasicBlock::Create(*llvm_context_, "entry", wrapper);
@@ -10,6 +10,15 @@
 
 namespace parallax {
 
+// Options given as -plugin-arg-parallax <opt>, parsed by ParallaxPluginActionV2::ParseArgs
+// before the V2 consumer is created.
+struct PluginOptions {
+    std::string profile_generate;  // -fprofile-generate[=path]: runtime records a profile
+    std::string profile_use;       // -fprofile-use=path: bake recorded decisions in
+    std::string tune_db;           // -tune-db=path: parallax-tune skeleton parameters
+};
+PluginOptions& pluginOptions();
+
 // Forward declaration of new rewriter-based consumer
 class ParallaxASTConsumerV2;
 
@@ -12,6 +12,11 @@ extern std::unique_ptr<clang::ASTConsumer> createParallaxASTConsumerV2(clang::Co
 
 namespace parallax {
 
+PluginOptions& pluginOptions() {
+    static PluginOptions opts;
+    return opts;
+}
+
 // Global initializer to confirm plugin loading
 struct GlobalInit {
     GlobalInit() {
@@ -42,11 +47,25 @@ protected:
         for (const auto& arg : args) {
             llvm::errs() << "[Parallax] Argument: " << arg << "\n";
 
+            llvm::StringRef a(arg);
+            if (a == "-fprofile-generate") {
+                pluginOptions().profile_generate = "parallax.plxprof";
+            } else if (a.consume_front("-fprofile-generate=")) {
+                pluginOptions().profile_generate = a.str();
+            } else if (a.consume_front("-fprofile-use=")) {
+                pluginOptions().profile_use = a.str();
+            } else if (a.consume_front("-tune-db=")) {
+                pluginOptions().tune_db = a.str();
+            }
+
             if (arg == "-help") {
                 llvm::errs() << "Parallax Plugin Options:\n";
                 llvm::errs() << "  -enable-rewrite : Enable code rewriting (default: on)\n";
                 llvm::errs() << "  -disable-rewrite : Disable code rewriting (detection only)\n";
                 llvm::errs() << "  -verbose : Enable verbose output\n";
+                llvm::errs() << "  -fprofile-generate[=path] : Record per-kernel offload profile at run time\n";
+                llvm::errs() << "  -fprofile-use=path : Bake thresholds/variants from a recorded profile\n";
+                llvm::errs() << "  -tune-db=path : Skeleton workgroup sizes from a parallax-tune database\n";
             }
         }
 
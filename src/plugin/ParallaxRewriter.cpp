@@ -1,8 +1,10 @@
 #include "ParallaxPlugin.h"
+#include <cstdio>
 #include <cstdlib>
 #include "parallax/lambda_ir_generator.hpp"
 #include "parallax/spirv_generator.hpp"
 #include "parallax/class_context_extractor.hpp"
+#include "parallax/host_kernel_generator.hpp"
 #include <clang/Rewrite/Core/Rewriter.h>
 #include <clang/Lex/Lexer.h>
 #include <clang/AST/Type.h>
@@ -10,12 +12,22 @@
 #include <clang/AST/TemplateBase.h>
 #include <clang/AST/ExprCXX.h>
 #include <clang/AST/Expr.h>
+#include <clang/AST/ParentMapContext.h>
+#include <clang/AST/Mangle.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ADT/StringExtras.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/Path.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/xxhash.h>
+#include <algorithm>
+#include <functional>
 #include <sstream>
 #include <iomanip>
+#include <map>
 #include <set>
+#include <tuple>
 #include <unordered_set>
 
 namespace parallax {
@@ -147,7 +159,9 @@ public:
     ParallaxRewriter(clang::SourceManager& SM,
                      clang::LangOptions& LO,
                      clang::CompilerInstance& CI)
-        : rewriter_(SM, LO), CI_(CI), SM_(SM) {}
+        : rewriter_(SM, LO), CI_(CI), SM_(SM) {
+        if (!pluginOptions().tune_db.empty()) loadTuningDB(pluginOptions().tune_db);
+    }
 
     /**
      * Add a transformation to be applied
@@ -168,6 +182,9 @@ public:
      */
     void applyAllTransformations() {
         if (!transforms_.empty()) {
+            // Prelude first: the runtime header is then inserted ahead of it, and the
+            // prelude's fallback pool uses parallax_arena_alloc from that header.
+            ensureScratchPrelude();
             ensureRuntimeHeader();
         }
         for (auto& transform : transforms_) {
@@ -229,35 +246,582 @@ public:
      * kernel. No shared template body is rewritten (all instantiations share one
      * source range); instead each instantiation's SPIR-V is registered at static-init
      * time under the key the runtime funnel computes identically (__PRETTY_FUNCTION__).
+     * The key's 64-bit FNV-1a hash is bound beside it (weak parallax_kernel_bind_hash),
+     * so a funnel can fold the same hash from __PRETTY_FUNCTION__ at compile time and
+     * cache the resolved handle in a function-local static instead of hashing the
+     * template name on every call.
+     *
+     * With PARALLAX_SECTION_REGISTRY=1 there is no static constructor: a descriptor
+     * (hash, key, words, word count, meta) goes into the `parallax_kernels` section and
+     * the runtime walks __start_/__stop_parallax_kernels on the first lookup, so start-up
+     * neither registers kernels nor touches their SPIR-V pages.
+     *
+     * Release builds drop debug instructions first (stripForRelease). PARALLAX_PACK_SPIRV=1
+     * stores the words in the packSpirv byte encoding: parallax_kernel_register_packed
+     * (weak) hands the bytes to the runtime to expand on first load, otherwise the
+     * registrar expands them itself; section descriptors set meta bit 8 and the byte
+     * count in meta[63:32].
+     *
+     * Every kernel also gets pre-warm records (emitPrewarmRecords) so the runtime can
+     * build its pipelines ahead of the first call. Twins registered for rare paths
+     * (:stream, :wide, :n<b>) pass prewarm = false and are compiled on first use.
+     *
+     * Constructor registrars first look for a replacement module in
+     * PARALLAX_KERNEL_OVERRIDE_DIR (see emitOverridePrelude) and, when one loads, mark the
+     * kernel's pre-warm records as skipped; with that variable set at compile time every
+     * kernel is also dumped there (dumpKernel). Section descriptors carry the content
+     * hash so the runtime's section walk can apply the same lookup.
      */
-    void emitFunnelRegistrar(const std::string& key, const std::vector<uint32_t>& spirv) {
+    void emitFunnelRegistrar(const std::string& key, const std::vector<uint32_t>& spirv,
+                             bool prewarm = true) {
         // Route-only pass (wrapper PASS 1): rewrite std::->parallax:: callees but do NOT
         // append kernel registrars. This keeps registration to the single funnel pass
         // (PASS 2), so a source that already calls parallax:: (device_invoke instantiated
         // in BOTH passes) doesn't get a duplicate registrar / redefinition.
         static const bool route_only = std::getenv("PARALLAX_ROUTE_ONLY") != nullptr;
         if (route_only) return;
+        static const bool pack = std::getenv("PARALLAX_PACK_SPIRV") != nullptr;
         int n = funnel_counter_++;
         std::string arr = "__plx_funnel_" + std::to_string(n);
         std::string esc;
         for (char c : key) { if (c == '\\' || c == '"') esc.push_back('\\'); esc.push_back(c); }
+        const std::vector<uint32_t> words = stripForRelease(spirv);
+        const uint64_t content = spirvContentHash(words);
+        dumpKernel(key, content, words);
         std::ostringstream ss;
+        if (pack) {
+            const std::vector<uint8_t> bytes = packSpirv(words);
+            ss << "\nstatic const unsigned char " << arr << "_packed[] = {\n";
+            for (size_t i = 0; i < bytes.size(); ++i)
+                ss << unsigned(bytes[i]) << (i + 1 < bytes.size() ? "," : "")
+                   << ((i + 1) % 24 == 0 ? "\n" : "");
+            ss << "\n};\n";
+            const size_t records = prewarm ? emitPrewarmRecords(ss, arr, esc, kernelKeyHash(key),
+                                                                words, /*packed=*/true) : 0;
+            emitUnpackPrelude();
+            return emitPackedRegistrar(ss, arr, esc, kernelKeyHash(key), content, words.size(),
+                                       bytes.size(), records);
+        }
         // `unsigned int` (not uint32_t) so no <cstdint> is required at end-of-file,
         // where these registrars are appended.
         ss << "\nstatic const unsigned int " << arr << "_spirv[] = {\n";
-        for (size_t i = 0; i < spirv.size(); ++i) {
-            ss << "0x" << std::hex << std::setw(8) << std::setfill('0') << spirv[i]
-               << std::dec << (i + 1 < spirv.size() ? "," : "")
+        for (size_t i = 0; i < words.size(); ++i) {
+            ss << "0x" << std::hex << std::setw(8) << std::setfill('0') << words[i]
+               << std::dec << (i + 1 < words.size() ? "," : "")
                << ((i + 1) % 8 == 0 ? "\n" : " ");
         }
-        ss << "\n};\n"
-           << "namespace { struct " << arr << "_reg { " << arr << "_reg() { "
-           << "parallax_kernel_register(\"" << esc << "\", " << arr << "_spirv, "
-           << "sizeof(" << arr << "_spirv)/sizeof(unsigned int)); } } "
+        ss << "\n};\n";
+        const size_t records = prewarm ? emitPrewarmRecords(ss, arr, esc, kernelKeyHash(key),
+                                                            words, /*packed=*/false) : 0;
+        static const bool section_registry = std::getenv("PARALLAX_SECTION_REGISTRY") != nullptr;
+        if (section_registry) {
+            emitKernelDescriptorType();
+            ss << "__attribute__((used, retain, section(\"parallax_kernels\"), aligned(8))) "
+               << "static const __plx_kdesc " << arr << "_desc = { 0x" << std::hex
+               << kernelKeyHash(key) << std::dec << "ull, \"" << esc << "\", " << arr
+               << "_spirv, sizeof(" << arr << "_spirv)/sizeof(unsigned int), 2ull, 0x" << std::hex
+               << content << std::dec << "ull };\n";
+            funnel_emissions_ += ss.str();
+            return;
+        }
+        ss << "namespace { struct " << arr << "_reg { " << arr << "_reg() { ";
+        if (emitOverridePrelude())
+            ss << "static std::vector<unsigned int> o; "
+               << "if (__plx_kernel_override(0x" << std::hex << kernelKeyHash(key) << "ull, 0x"
+               << content << std::dec << "ull, o)) { " << prewarmSkip(arr, records)
+               << "parallax_kernel_register(\"" << esc << "\", o.data(), o.size()); } else ";
+        ss << "parallax_kernel_register(\"" << esc << "\", " << arr << "_spirv, "
+           << "sizeof(" << arr << "_spirv)/sizeof(unsigned int)); ";
+        ss << "if (parallax_kernel_bind_hash) parallax_kernel_bind_hash(\"" << esc << "\", 0x"
+           << std::hex << kernelKeyHash(key) << std::dec << "ull); } } "
            << arr << "_reg_inst; }\n";
+        if (!hash_decl_emitted_) {
+            funnel_emissions_ += "\nextern \"C\" __attribute__((weak)) void parallax_kernel_bind_hash("
+                                 "const char*, unsigned long long);\n";
+            hash_decl_emitted_ = true;
+        }
+        funnel_emissions_ += ss.str();
+    }
+
+    // What a pipeline for one entry point needs up front, read back from the SPIR-V.
+    struct EntryLayout {
+        std::string name;
+        uint32_t local[3] = {1, 1, 1};
+        uint64_t bindings = 0;   // bit b: set 0, binding b (storage/uniform buffer)
+        uint32_t push_bytes = 0; // push-constant block size
+    };
+
+    /**
+     * Entry points of a module with their LocalSize, set-0 buffer bindings and
+     * push-constant size. Bindings are attributed per entry point through the
+     * OpEntryPoint interface (SPIR-V 1.4+ lists every global it uses); older modules
+     * give every entry point all bindings. Sizes cover the scalar/vector members our
+     * kernels put in push constants; anything else counts 8 bytes.
+     */
+    static std::vector<EntryLayout> kernelLayout(const std::vector<uint32_t>& w) {
+        std::vector<EntryLayout> eps;
+        if (w.size() < 5) return eps;
+        std::map<uint32_t, std::vector<uint32_t>> eps_iface;  // function id -> interface
+        std::map<uint32_t, size_t> ep_of;                     // function id -> index
+        std::map<uint32_t, uint32_t> set_of, binding_of, type_size, ptr_pointee;
+        std::map<uint32_t, std::vector<uint32_t>> struct_members;
+        std::map<std::pair<uint32_t, uint32_t>, uint32_t> member_offset;
+        std::vector<std::pair<uint32_t, uint32_t>> vars;      // (id, storage class)
+        std::map<uint32_t, uint32_t> var_type;
+        for (size_t k = 5; k < w.size();) {
+            const uint32_t op = w[k] & 0xffff, wc = w[k] >> 16;
+            if (wc == 0 || k + wc > w.size()) break;
+            const uint32_t* o = &w[k + 1];
+            const size_t n = wc - 1;
+            switch (op) {
+            case 15: if (n >= 3) {  // OpEntryPoint
+                EntryLayout e;
+                size_t i = 2;
+                for (bool end = false; i < n && !end; ++i)
+                    for (int b = 0; b < 4 && !end; ++b) {
+                        const char c = char((o[i] >> (8 * b)) & 0xff);
+                        if (c) e.name.push_back(c); else end = true;
+                    }
+                ep_of[o[1]] = eps.size();
+                eps_iface[o[1]].assign(o + i, o + n);
+                eps.push_back(std::move(e));
+                break;
+            }
+            case 16: if (n >= 5 && o[1] == 17 && ep_of.count(o[0])) {  // LocalSize
+                EntryLayout& e = eps[ep_of[o[0]]];
+                e.local[0] = o[2]; e.local[1] = o[3]; e.local[2] = o[4];
+            } break;
+            case 71: if (n >= 3) {
+                if (o[1] == 34) set_of[o[0]] = o[2];
+                if (o[1] == 33) binding_of[o[0]] = o[2];
+            } break;
+            case 72: if (n >= 4 && o[2] == 35) member_offset[{o[0], o[1]}] = o[3]; break;
+            case 20: if (n >= 1) type_size[o[0]] = 4; break;
+            case 21: case 22: if (n >= 2) type_size[o[0]] = o[1] / 8; break;
+            case 23: if (n >= 3 && type_size.count(o[1])) type_size[o[0]] = type_size[o[1]] * o[2]; break;
+            case 30: if (n >= 1) struct_members[o[0]].assign(o + 1, o + n); break;
+            case 32: if (n >= 3) ptr_pointee[o[0]] = o[2]; break;
+            case 59: if (n >= 3) { vars.push_back({o[1], o[2]}); var_type[o[1]] = o[0]; } break;
+            default: break;
+            }
+            k += wc;
+        }
+        const bool per_entry = w[1] >= 0x00010400;
+        for (auto& kv : ep_of) {
+            EntryLayout& e = eps[kv.second];
+            const std::vector<uint32_t>& iface = eps_iface[kv.first];
+            for (const auto& v : vars) {
+                if (per_entry && std::find(iface.begin(), iface.end(), v.first) == iface.end())
+                    continue;
+                if (v.second == 9) {  // PushConstant
+                    const uint32_t st = ptr_pointee[var_type[v.first]];
+                    const auto& mem = struct_members[st];
+                    for (uint32_t m = 0; m < mem.size(); ++m) {
+                        auto off = member_offset.find({st, m});
+                        const uint32_t sz = type_size.count(mem[m]) ? type_size[mem[m]] : 8;
+                        const uint32_t end = (off != member_offset.end() ? off->second : 0) + sz;
+                        e.push_bytes = std::max(e.push_bytes, end);
+                    }
+                } else if ((v.second == 12 || v.second == 2) && set_of[v.first] == 0 &&
+                           binding_of.count(v.first) && binding_of[v.first] < 64) {
+                    e.bindings |= 1ull << binding_of[v.first];
+                }
+            }
+        }
+        return eps;
+    }
+
+    /**
+     * Pipeline pre-warm manifest: one record per entry point in the `parallax_prewarm`
+     * section (key hash, key, entry name, SPIR-V, word count, set-0 binding mask,
+     * push-constant bytes, LocalSize, flags bit 0 = packed words, bit 1 = skip). Right
+     * after parallax_init the runtime can walk __start_/__stop_parallax_prewarm and
+     * create every compute pipeline on background threads into its VkPipelineCache,
+     * instead of compiling on the first call. Static data only; PARALLAX_NO_PREWARM=1
+     * skips it. Where a constructor registrar may load an override, the records are
+     * writable so it can mark them skipped (prewarmSkip): they describe the embedded
+     * module, not the one registered. Returns the number of records emitted.
+     */
+    size_t emitPrewarmRecords(std::ostringstream& ss, const std::string& arr, const std::string& esc,
+                              uint64_t hash, const std::vector<uint32_t>& words, bool packed) {
+        static const bool disabled = std::getenv("PARALLAX_NO_PREWARM") != nullptr;
+        static const bool section_registry = std::getenv("PARALLAX_SECTION_REGISTRY") != nullptr;
+        if (disabled) return 0;
+        const std::vector<EntryLayout> eps = kernelLayout(words);
+        if (eps.empty()) return 0;
+        // Every record of a TU shares one qualifier: const and writable objects cannot
+        // share a section.
+        const bool writable = !section_registry && overridesEnabled();
+        if (!prewarm_decl_emitted_) {
+            funnel_emissions_ += "\nnamespace { struct __plx_pwdesc { unsigned long long hash; "
+                                 "const char* key; const char* entry; const void* words; "
+                                 "unsigned long long nwords; unsigned long long bindings; "
+                                 "unsigned int push_bytes; unsigned int local[3]; "
+                                 "unsigned int flags; }; }\n";
+            prewarm_decl_emitted_ = true;
+        }
+        for (size_t i = 0; i < eps.size(); ++i) {
+            const EntryLayout& e = eps[i];
+            ss << "__attribute__((used, retain, section(\"parallax_prewarm\"), aligned(8))) "
+               << (writable ? "static __plx_pwdesc " : "static const __plx_pwdesc ")
+               << arr << "_pw" << i << " = { 0x" << std::hex
+               << hash << "ull, \"" << esc << "\", \"" << e.name << "\", " << arr
+               << (packed ? "_packed, " : "_spirv, ") << std::dec << words.size() << "ull, 0x"
+               << std::hex << e.bindings << std::dec << "ull, " << e.push_bytes << "u, { "
+               << e.local[0] << "u, " << e.local[1] << "u, " << e.local[2] << "u }, "
+               << (packed ? 1 : 0) << "u };\n";
+        }
+        return eps.size();
+    }
+
+    // Registrar statements marking an overridden kernel's pre-warm records skipped, so
+    // the runtime does not build pipelines from (or cache) the module it replaced.
+    static std::string prewarmSkip(const std::string& arr, size_t records) {
+        std::string out;
+        for (size_t i = 0; i < records; ++i) {
+            const std::string rec = arr + "_pw" + std::to_string(i);
+            out += rec + ".words = nullptr; " + rec + ".nwords = 0; " + rec + ".flags |= 2u; ";
+        }
+        return out;
+    }
+
+    /**
+     * Profile-guided offload (-plugin-arg-parallax -fprofile-generate[=path] /
+     * -fprofile-use=path). An instrumented TU turns recording on through the weak
+     * parallax_profile_enable(path); the runtime then times every funnel call (CPU
+     * and GPU, per variant) and writes at exit one tab-separated row per funnel key,
+     * log2 element bucket and variant:
+     *   key  bucket  variant  cpu_calls  cpu_ns  gpu_calls  gpu_ns
+     * (lines starting with '#' are comments). A -fprofile-use build bakes two
+     * decisions per profiled key into a registrar calling the weak
+     * parallax_profile_decision(key, min_offload_elems, variant):
+     *   min_offload_elems  2^b for the lowest bucket b from which the GPU beats the
+     *                      CPU in every bucket measured on both; ~0 if it never does
+     *                      (0 = no bucket timed on both: keep the runtime default)
+     *   variant            lowest GPU ns per element across the buckets it ran in
+     *                      ("" when the profile has no GPU timing for the key)
+     */
+    void emitProfileHooks(const std::string& key) {
+        static const bool route_only = std::getenv("PARALLAX_ROUTE_ONLY") != nullptr;
+        const PluginOptions& opts = pluginOptions();
+        if (route_only || (opts.profile_generate.empty() && opts.profile_use.empty())) return;
+        if (!opts.profile_generate.empty() && !profile_generate_emitted_) {
+            std::ostringstream hs;
+            if (!emitHookDescriptor(hs, 5, "__plx_profgen", "", opts.profile_generate, "", ""))
+                hs << "\nextern \"C\" __attribute__((weak)) void parallax_profile_enable(const char*);\n"
+                   << "namespace { struct __plx_profgen { __plx_profgen() { "
+                   << "if (parallax_profile_enable) parallax_profile_enable(\""
+                   << escapeLiteral(opts.profile_generate) << "\"); } } __plx_profgen_inst; }\n";
+            funnel_emissions_ += hs.str();
+            profile_generate_emitted_ = true;
+        }
+        if (opts.profile_use.empty() || !profiled_keys_.insert(key).second) return;
+        const auto& prof = loadProfile(opts.profile_use);
+        auto it = prof.find(key);
+        if (it == prof.end()) return;
+
+        uint64_t min_offload = ~0ull;
+        bool both = false;
+        std::map<unsigned, std::pair<double, double>> mean;  // bucket -> (cpu, gpu) ns/call
+        std::map<std::string, std::pair<double, double>> per_variant;  // ns, elems
+        for (const ProfileRow& r : it->second) {
+            if (r.gpu_calls) {
+                auto& v = per_variant[r.variant];
+                v.first += double(r.gpu_ns);
+                v.second += double(r.gpu_calls) * 1.5 * double(1ull << std::min(r.bucket, 62u));
+            }
+            if (r.cpu_calls && r.gpu_calls) {
+                auto& m = mean[r.bucket];
+                m.first = double(r.cpu_ns) / r.cpu_calls;
+                m.second = std::min(m.second ? m.second : 1e300, double(r.gpu_ns) / r.gpu_calls);
+            }
+        }
+        for (auto b = mean.rbegin(); b != mean.rend(); ++b) {
+            if (b->second.second >= b->second.first) break;
+            both = true;
+            min_offload = 1ull << std::min(b->first, 62u);
+        }
+        std::string variant;
+        double best = 1e300;
+        for (const auto& v : per_variant)
+            if (v.second.second > 0 && v.second.first / v.second.second < best) {
+                best = v.second.first / v.second.second;
+                variant = v.first;
+            }
+        if (!both && mean.empty() && variant.empty()) return;  // nothing measured
+        if (!both && mean.empty()) min_offload = 0;            // GPU-only timings
+        llvm::errs() << "[ParallaxPGO] min_offload=" << (min_offload == ~0ull ? std::string("never")
+                                                                              : std::to_string(min_offload))
+                     << " variant=" << (variant.empty() ? "-" : variant) << "\n  key=" << key << "\n";
+        std::string reg = "__plx_pgo_" + std::to_string(profile_counter_++);
+        std::ostringstream ss;
+        if (emitHookDescriptor(ss, 6, reg, key, variant, "", "", min_offload)) {
+            funnel_emissions_ += ss.str();
+            return;
+        }
+        if (!profile_decl_emitted_) {
+            ss << "\nextern \"C\" __attribute__((weak)) void parallax_profile_decision("
+               << "const char*, unsigned long long, const char*);\n";
+            profile_decl_emitted_ = true;
+        }
+        ss << "namespace { struct " << reg << " { " << reg << "() { "
+           << "if (parallax_profile_decision) parallax_profile_decision(\"" << escapeLiteral(key)
+           << "\", " << min_offload << "ull, \"" << escapeLiteral(variant) << "\"); } } "
+           << reg << "_inst; }\n";
+        funnel_emissions_ += ss.str();
+    }
+
+    // meta bits 0-7: descriptor layout version (2 adds `content`, the FNV-1a hash of the
+    // unpacked words that names a <content hash>.spv override). Same layout in every TU.
+    void emitKernelDescriptorType() {
+        if (kdesc_decl_emitted_) return;
+        funnel_emissions_ += "\nnamespace { struct __plx_kdesc { unsigned long long hash; "
+                             "const char* key; const void* words; "
+                             "unsigned long long nwords; unsigned long long meta; "
+                             "unsigned long long content; }; }\n";
+        kdesc_decl_emitted_ = true;
+    }
+
+    /**
+     * Section-registry form of the per-kernel hooks that are otherwise static
+     * constructors: with PARALLAX_SECTION_REGISTRY=1 each becomes a record in the
+     * `parallax_hooks` section, which the runtime applies when it walks
+     * `parallax_kernels`. Fields by kind:
+     *   1 host kernel      key, fn (null when the host object was not linked in)
+     *   2 placement        key, a = flags, b = readonly caps, c = written caps
+     *   3 scratch reserve  key, a = per_elem, b = per_group
+     *   4 bitcode          key = functor type, str = element type, data, a = bytes
+     *   5 profile enable   str = output path
+     *   6 profile decision key, str = variant, a = min_offload_elems
+     * Returns false outside section mode, where the caller emits its constructor.
+     */
+    bool emitHookDescriptor(std::ostringstream& ss, unsigned kind, const std::string& name,
+                            const std::string& key, const std::string& str, const std::string& data,
+                            const std::string& fn, uint64_t a = 0, uint64_t b = 0, uint64_t c = 0) {
+        static const bool section_registry = std::getenv("PARALLAX_SECTION_REGISTRY") != nullptr;
+        if (!section_registry) return false;
+        if (!hdesc_decl_emitted_) {
+            funnel_emissions_ += "\nnamespace { struct __plx_hdesc { unsigned long long kind; "
+                                 "const char* key; const char* str; const void* data; "
+                                 "void (*fn)(void*, void*, unsigned long long, const void*); "
+                                 "unsigned long long a, b, c; }; }\n";
+            hdesc_decl_emitted_ = true;
+        }
+        ss << "__attribute__((used, retain, section(\"parallax_hooks\"), aligned(8))) "
+           << "static const __plx_hdesc " << name << "_desc = { " << kind << "ull, \""
+           << escapeLiteral(key) << "\", \"" << escapeLiteral(str) << "\", "
+           << (data.empty() ? "nullptr" : data) << ", " << (fn.empty() ? "nullptr" : fn)
+           << ", " << a << "ull, " << b << "ull, " << c << "ull };\n";
+        return true;
+    }
+
+    void emitPackedRegistrar(std::ostringstream& ss, const std::string& arr, const std::string& esc,
+                             uint64_t hash, uint64_t content, size_t nwords, size_t nbytes,
+                             size_t prewarm_records) {
+        static const bool section_registry = std::getenv("PARALLAX_SECTION_REGISTRY") != nullptr;
+        if (section_registry) {
+            emitKernelDescriptorType();
+            ss << "__attribute__((used, retain, section(\"parallax_kernels\"), aligned(8))) "
+               << "static const __plx_kdesc " << arr << "_desc = { 0x" << std::hex << hash
+               << std::dec << "ull, \"" << esc << "\", " << arr << "_packed, " << nwords
+               << "ull, 0x" << std::hex << ((uint64_t(nbytes) << 32) | 0x102u) << "ull, 0x" << content
+               << std::dec << "ull };\n";
+            funnel_emissions_ += ss.str();
+            return;
+        }
+        ss << "namespace { struct " << arr << "_reg { " << arr << "_reg() { ";
+        if (emitOverridePrelude())
+            ss << "static std::vector<unsigned int> o; "
+               << "if (__plx_kernel_override(0x" << std::hex << hash << "ull, 0x" << content
+               << std::dec << "ull, o)) { " << prewarmSkip(arr, prewarm_records)
+               << "parallax_kernel_register(\"" << esc << "\", o.data(), o.size()); } else ";
+        // The expanded words live in static storage, like an unpacked kernel's array.
+        ss << "if (parallax_kernel_register_packed) { parallax_kernel_register_packed(\"" << esc
+           << "\", " << arr << "_packed, " << nbytes << "ull, " << nwords << "ull); } else { "
+           << "static unsigned int w[" << nwords << "]; "
+           << "__plx_spirv_unpack(" << arr << "_packed, w, " << nwords << "ull); "
+           << "parallax_kernel_register(\"" << esc << "\", w, " << nwords << "); } "
+           << "if (parallax_kernel_bind_hash) parallax_kernel_bind_hash(\"" << esc << "\", 0x"
+           << std::hex << hash << std::dec << "ull); } } " << arr << "_reg_inst; }\n";
+        if (!hash_decl_emitted_) {
+            funnel_emissions_ += "\nextern \"C\" __attribute__((weak)) void parallax_kernel_bind_hash("
+                                 "const char*, unsigned long long);\n";
+            hash_decl_emitted_ = true;
+        }
         funnel_emissions_ += ss.str();
     }
 
+    // Decoder for packSpirv's format, emitted once per TU ahead of the first packed kernel.
+    void emitUnpackPrelude() {
+        if (unpack_decl_emitted_) return;
+        funnel_emissions_ +=
+            "\nextern \"C\" __attribute__((weak)) void parallax_kernel_register_packed("
+            "const char*, const unsigned char*, unsigned long long, unsigned long long);\n"
+            "namespace { inline unsigned int __plx_uv(const unsigned char*& p) { "
+            "unsigned int v = 0, s = 0; unsigned char b; "
+            "do { b = *p++; v |= (unsigned int)(b & 0x7f) << s; s += 7; } while (b & 0x80); return v; }\n"
+            "inline void __plx_spirv_unpack(const unsigned char* p, unsigned int* out, unsigned long long n) { "
+            "unsigned long long k = 0; for (; k < 5 && k < n; ++k) out[k] = __plx_uv(p); "
+            "while (k < n) { unsigned int op = __plx_uv(p), wc = __plx_uv(p); out[k++] = (wc << 16) | op; "
+            "for (unsigned int i = 1; i < wc && k < n; ++i) out[k++] = __plx_uv(p); } } }\n";
+        unpack_decl_emitted_ = true;
+    }
+
+    static bool overridesEnabled() {
+        static const bool disabled = std::getenv("PARALLAX_NO_KERNEL_OVERRIDE") != nullptr;
+        return !disabled;
+    }
+
+    /**
+     * Kernel override lookup for constructor registrars: with PARALLAX_KERNEL_OVERRIDE_DIR
+     * set at run time, __plx_kernel_override(key hash, content hash, words) reads
+     * <dir>/<content hash>.spv, else <dir>/<key hash>.spv (16 lower-case hex digits),
+     * into `words`, and the registrar hands that module to the runtime instead of the
+     * embedded one. `words` is a static of the registrar, so the module lives as long
+     * as the embedded one would and is released at exit. A file that is not a whole
+     * SPIR-V module is reported and skipped. Returns false (no lookup is emitted) under
+     * PARALLAX_NO_KERNEL_OVERRIDE, for builds that must only run what they embed.
+     */
+    bool emitOverridePrelude() {
+        if (!overridesEnabled()) return false;
+        if (override_decl_emitted_) return true;
+        funnel_emissions_ +=
+            "\n#include <cstdio>\n#include <cstdlib>\n#include <vector>\n"
+            "namespace { inline bool __plx_kernel_override("
+            "unsigned long long key_hash, unsigned long long content_hash, std::vector<unsigned int>& words) { "
+            "static const char* dir = std::getenv(\"PARALLAX_KERNEL_OVERRIDE_DIR\"); "
+            "if (!dir || !*dir) return false; "
+            "const unsigned long long names[2] = { content_hash, key_hash }; "
+            "for (unsigned long long h : names) { char path[4096]; "
+            "std::snprintf(path, sizeof(path), \"%s/%016llx.spv\", dir, h); "
+            "std::FILE* f = std::fopen(path, \"rb\"); if (!f) continue; "
+            "long bytes = -1; bool ok = false; "
+            "if (std::fseek(f, 0, SEEK_END) == 0 && (bytes = std::ftell(f)) >= 20 && bytes % 4 == 0 && "
+            "std::fseek(f, 0, SEEK_SET) == 0) { words.resize((unsigned long)(bytes / 4)); "
+            "ok = std::fread(words.data(), 4, words.size(), f) == words.size() && words[0] == 0x07230203u; } "
+            "std::fclose(f); "
+            "if (!ok) { std::vector<unsigned int>().swap(words); "
+            "std::fprintf(stderr, \"[Parallax] kernel override %s is not a SPIR-V module; ignored\\n\", path); continue; } "
+            "std::fprintf(stderr, \"[Parallax] kernel override %s\\n\", path); "
+            "return true; } "
+            "return false; } }\n";
+        override_decl_emitted_ = true;
+        return true;
+    }
+
+    /**
+     * 64-bit FNV-1a over a module's bytes as they sit in a .spv file (little-endian
+     * words), so the override name of a dumped kernel is the hash of that file.
+     */
+    static uint64_t spirvContentHash(const std::vector<uint32_t>& words) {
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (uint32_t w : words)
+            for (int b = 0; b < 4; ++b) { h ^= (w >> (8 * b)) & 0xff; h *= 0x100000001b3ull; }
+        return h;
+    }
+
+    /**
+     * PARALLAX_KERNEL_OVERRIDE_DIR at compile time: write each registered kernel to
+     * <dir>/dump/<key hash>.spv, and its key and content hash to <key hash>.key beside
+     * it. The dump lives one level down so it never overrides itself; to try a tuned
+     * kernel, edit a copy and save it as <dir>/<key hash>.spv.
+     */
+    void dumpKernel(const std::string& key, uint64_t content, const std::vector<uint32_t>& words) {
+        const char* dir = std::getenv("PARALLAX_KERNEL_OVERRIDE_DIR");
+        if (!dir || !*dir) return;
+        llvm::SmallString<256> base(dir);
+        llvm::sys::path::append(base, "dump");
+        if (std::error_code ec = llvm::sys::fs::create_directories(base)) {
+            llvm::errs() << "[ParallaxFunnel] cannot create " << base << ": " << ec.message() << "\n";
+            return;
+        }
+        char stem[17];
+        std::snprintf(stem, sizeof(stem), "%016llx", (unsigned long long)kernelKeyHash(key));
+        llvm::sys::path::append(base, stem);
+        std::error_code ec;
+        {
+            llvm::raw_fd_ostream os(base.str().str() + ".spv", ec, llvm::sys::fs::OF_None);
+            if (!ec) os.write(reinterpret_cast<const char*>(words.data()), words.size() * 4);
+        }
+        if (!ec) {
+            llvm::raw_fd_ostream os(base.str().str() + ".key", ec, llvm::sys::fs::OF_Text);
+            char hex[17];
+            std::snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)content);
+            if (!ec) os << key << "\ncontent " << hex << "\n";
+        }
+        if (ec)
+            llvm::errs() << "[ParallaxFunnel] cannot dump " << base << ": " << ec.message() << "\n";
+    }
+
+    /**
+     * Compact byte encoding of a SPIR-V module: the five header words, then per
+     * instruction the opcode and word count as separate LEB128 varints, then each
+     * operand as a LEB128 varint. Ids, counts and small literals dominate kernel
+     * modules and take one or two bytes instead of four.
+     */
+    static std::vector<uint8_t> packSpirv(const std::vector<uint32_t>& words) {
+        std::vector<uint8_t> out;
+        out.reserve(words.size() * 2);
+        auto put = [&](uint32_t v) {
+            do { uint8_t b = v & 0x7f; v >>= 7; out.push_back(b | (v ? 0x80 : 0)); } while (v);
+        };
+        size_t k = 0;
+        for (; k < 5 && k < words.size(); ++k) put(words[k]);
+        while (k < words.size()) {
+            const uint32_t wc = words[k] >> 16;
+            put(words[k] & 0xffff);
+            put(wc);
+            for (uint32_t i = 1; i < wc && k + i < words.size(); ++i) put(words[k + i]);
+            k += wc ? wc : 1;
+        }
+        return out;
+    }
+
+    /**
+     * Release builds (-O1 and up without -g, or PARALLAX_STRIP_SPIRV=1) drop the debug
+     * instructions: OpSourceContinued/Source/SourceExtension/Name/MemberName/String/
+     * Line, OpNoLine and OpModuleProcessed. PARALLAX_KEEP_SPIRV_NAMES=1 keeps them.
+     */
+    std::vector<uint32_t> stripForRelease(const std::vector<uint32_t>& spirv) const {
+        static const bool force = std::getenv("PARALLAX_STRIP_SPIRV") != nullptr;
+        static const bool keep = std::getenv("PARALLAX_KEEP_SPIRV_NAMES") != nullptr;
+        const clang::CodeGenOptions& cg = CI_.getCodeGenOpts();
+        const bool release = cg.OptimizationLevel > 0 &&
+                             cg.getDebugInfo() == llvm::codegenoptions::NoDebugInfo;
+        if (keep || (!force && !release) || spirv.size() < 5) return spirv;
+        std::vector<uint32_t> out(spirv.begin(), spirv.begin() + 5);
+        out.reserve(spirv.size());
+        for (size_t k = 5; k < spirv.size();) {
+            const uint32_t op = spirv[k] & 0xffff, wc = spirv[k] >> 16;
+            if (wc == 0 || k + wc > spirv.size()) return spirv;  // malformed: leave as-is
+            const bool debug = (op >= 2 && op <= 8) || op == 317 || op == 330;
+            if (!debug) out.insert(out.end(), spirv.begin() + k, spirv.begin() + k + wc);
+            k += wc;
+        }
+        return out;
+    }
+
+    /**
+     * 64-bit FNV-1a over the key bytes (suffix included, no terminator). The funnel
+     * side computes the same value with a constexpr loop over __PRETTY_FUNCTION__.
+     */
+    static uint64_t kernelKeyHash(const std::string& key) {
+        uint64_t h = 0xcbf29ce484222325ull;
+        for (unsigned char c : key) { h ^= c; h *= 0x100000001b3ull; }
+        return h;
+    }
+
+    // Runtime key of a graph, batch or residency scope: the presumed path made absolute,
+    // then line:column, so loops in same-named files of different directories (or two
+    // on one line) never share the runtime's per-key state.
+    static std::string siteKey(const clang::PresumedLoc& ploc) {
+        llvm::SmallString<256> path(ploc.getFilename());
+        llvm::sys::fs::make_absolute(path);
+        llvm::sys::path::remove_dots(path, /*remove_dot_dot=*/true);
+        return std::string(path) + ":" + std::to_string(ploc.getLine()) + ":" +
+               std::to_string(ploc.getColumn());
+    }
+
     /**
      * Transparent std::execution::par routing: rewrite the CALLEE of a
      * std::for_each(policy, first, last, f) call to parallax::for_each so it funnels
@@ -266,8 +830,8 @@ public:
      * visited source-token rewrite (no call-site codegen); the SPIR-V is generated on
      * a subsequent plugin pass once the rewritten source instantiates device_invoke.
      */
-    void routeCallee(clang::CallExpr* call, const char* target) {
-        if (!call || !call->getCallee()) return;
+    bool routeCallee(clang::CallExpr* call, const char* target) {
+        if (!call || !call->getCallee()) return false;
         clang::SourceLocation loc = call->getBeginLoc();
         // NEVER route calls in SYSTEM headers — the C++ standard library's own
         // std::sort/std::reduce/etc. implementations call same-named overloads with
@@ -275,20 +839,279 @@ public:
         // those to parallax:: corrupts <algorithm>/<numeric>. Also skip our own stdpar
         // header (its serial std:: fallbacks). Only user TU + non-system algorithm
         // headers (e.g. pSTL-Bench's *_std.h, included via -I) get routed.
-        if (SM_.isInSystemHeader(loc)) return;
+        if (SM_.isInSystemHeader(loc)) return false;
         llvm::StringRef fname = SM_.getFilename(SM_.getExpansionLoc(loc));
-        if (fname.contains("stdpar.hpp")) return;
+        if (fname.contains("stdpar.hpp")) return false;
         unsigned key = call->getBeginLoc().getRawEncoding();
-        if (!seen_route_locs_.insert(key).second) return;
+        if (!seen_route_locs_.insert(key).second) return true;
         clang::Expr* callee = call->getCallee()->IgnoreImplicit();
         std::string cur = getSourceText(callee->getSourceRange());
-        if (cur.find("parallax") != std::string::npos) return;  // already routed
+        if (cur.find("parallax") != std::string::npos) return false;  // already routed
         rewriter_.ReplaceText(callee->getSourceRange(), target);
         llvm::errs() << "[ParallaxRoute] " << cur << " -> " << target << "\n";
+        return true;
+    }
+
+    /**
+     * Pool-residency assumption for a routed call: wrap its policy argument as
+     *     parallax::for_each(((void)__plx_pool_assume(mask), std::execution::par), ...)
+     * Bit i of mask = call argument i (the policy is argument 0) points into pool
+     * memory, because its storage is a parallax::allocator container or a pool array,
+     * or is about to become one by injection. The guard calls the weak
+     * parallax_pool_assume_begin(mask) before the call runs and
+     * parallax_pool_assume_end() at the end of the full-expression, so the funnel may
+     * bind those arguments zero-copy without its parallax_heap_contains probe. The
+     * policy operand keeps its type and value category, and the edit stays inside the
+     * argument list, clear of statement-level batch and residency insertions. Null
+     * hooks make the guard a no-op.
+     */
+    void emitPoolAssume(clang::CallExpr* call, unsigned mask) {
+        static const bool disabled = std::getenv("PARALLAX_NO_POOL_ASSUME") != nullptr;
+        if (disabled || !mask || !call || call->getNumArgs() == 0) return;
+        clang::SourceRange policy = call->getArg(0)->getSourceRange();
+        if (policy.getBegin().isMacroID() || policy.getEnd().isMacroID()) return;
+        if (!seen_pool_assume_locs_.insert(call->getBeginLoc().getRawEncoding()).second) return;
+        ensurePoolAssumePrelude();
+        rewriter_.InsertTextBefore(policy.getBegin(),
+                                   "((void)__plx_pool_assume(0x" + llvm::utohexstr(mask) + "u), ");
+        rewriter_.InsertTextAfterToken(policy.getEnd(), ")");
+        llvm::errs() << "[ParallaxPool] " << call->getBeginLoc().printToString(SM_)
+                     << ": argument mask 0x" << llvm::utohexstr(mask) << " is pool-resident\n";
+    }
+
+    /**
+     * Command-buffer capture/replay: open a per-iteration capture scope at the top of a
+     * replayable loop body. The scope object calls parallax_graph_begin(key, n) on
+     * entry and parallax_graph_end(key) on exit; the runtime records the n routed
+     * dispatches of the first iteration into one command buffer and replays it on later
+     * iterations with the new push constants, re-recording if the sequence diverges.
+     * Both hooks are weak, so against a runtime without graph support they are null and
+     * the loop runs exactly as before. Inserted on the '{' line so user line numbers
+     * (diagnostics, __LINE__, lambda line selection in PASS 2) are unchanged.
+     */
+    void emitGraphReplayScope(clang::CompoundStmt* body, const std::string& key, unsigned calls) {
+        unsigned loc_key = body->getLBracLoc().getRawEncoding();
+        if (!seen_graph_locs_.insert(loc_key).second) return;
+        ensureGraphPrelude();
+        std::string esc;
+        for (char c : key) { if (c == '\\' || c == '"') esc.push_back('\\'); esc.push_back(c); }
+        rewriter_.InsertTextAfterToken(body->getLBracLoc(),
+            " __plx_graph_scope __plx_graph_" + std::to_string(graph_counter_++) +
+            "(\"" + esc + "\", " + std::to_string(calls) + "u);");
+        llvm::errs() << "[ParallaxGraph] capture/replay scope for loop at " << key
+                     << " (" << calls << " routed call(s))\n";
+    }
+
+    /**
+     * Dependency-annotated launch batch: wrap a run of adjacent routed calls as
+     * `{ <batch scope>; call0; call1; ... }`. deps[i] is the bitmask of earlier calls in
+     * the run that call i must wait for. The scope calls the weak hooks
+     * parallax_batch_begin(key, n, deps) / parallax_batch_end(key); between them the
+     * runtime may submit the n dispatches with barriers only along deps edges, and
+     * batch_end is a full barrier. Only expression statements are wrapped, so the added
+     * braces never change a declaration's scope. Null hooks => ordinary in-order calls.
+     */
+    void emitLaunchBatch(clang::SourceLocation begin, clang::SourceLocation after_end,
+                         const std::string& key, const std::vector<unsigned>& deps) {
+        if (!seen_batch_locs_.insert(begin.getRawEncoding()).second) return;
+        ensureGraphPrelude();
+        std::string name = "__plx_batch_" + std::to_string(batch_counter_++);
+        std::string esc;
+        for (char c : key) { if (c == '\\' || c == '"') esc.push_back('\\'); esc.push_back(c); }
+        std::ostringstream ss;
+        ss << "{ static const unsigned int " << name << "_deps[] = {";
+        for (size_t i = 0; i < deps.size(); ++i) ss << (i ? ", " : "") << deps[i] << "u";
+        ss << "}; __plx_batch_scope " << name << "(\"" << esc << "\", " << deps.size()
+           << "u, " << name << "_deps); ";
+        rewriter_.InsertTextBefore(begin, ss.str());
+        rewriter_.InsertTextAfter(after_end, " }");
+        llvm::errs() << "[ParallaxBatch] " << deps.size() << "-call launch batch at " << key
+                     << " (deps:";
+        for (unsigned d : deps) llvm::errs() << " 0x" << llvm::utohexstr(d);
+        llvm::errs() << ")\n";
+    }
+
+    /**
+     * Device residency for one container across a live range of routed calls. Declares
+     * a residency handle right before the first device use; its constructor calls the
+     * weak parallax_resident_acquire(key, data, bytes), so the runtime may keep the
+     * range on the device between dispatches instead of staging it per call. Each
+     * host statement inside the range gets `handle.host(may_write)` (copy back if the
+     * device copy is newer; a write also drops the device copy), and the first host
+     * access after the last device use gets `handle.release()` (copy back and end
+     * residency). The handle's destructor releases too, so early exits and exceptions
+     * never leave data stranded on the device. All insertions stay on their lines.
+     */
+    void emitResidencyRange(clang::SourceLocation acquire_at, const std::string& key,
+                            const std::string& var,
+                            const std::vector<std::pair<clang::SourceLocation, bool>>& host_at,
+                            clang::SourceLocation release_at) {
+        if (!seen_residency_.insert(key).second) return;
+        ensureResidencyPrelude();
+        std::string name = "__plx_res_" + std::to_string(residency_counter_++);
+        std::string esc;
+        for (char c : key) { if (c == '\\' || c == '"') esc.push_back('\\'); esc.push_back(c); }
+        rewriter_.InsertTextBefore(acquire_at, "__plx_resident<decltype(" + var + ")> " + name +
+                                   "(\"" + esc + "\", " + var + "); ");
+        for (const auto& h : host_at)
+            rewriter_.InsertTextBefore(h.first, name + ".host(" + (h.second ? "1" : "0") + "); ");
+        if (release_at.isValid())
+            rewriter_.InsertTextBefore(release_at, name + ".release(); ");
+        llvm::errs() << "[ParallaxResidency] " << key << ": device-resident across the range, "
+                     << host_at.size() << " host access(es) inside, release "
+                     << (release_at.isValid() ? "before the next host access" : "at scope exit")
+                     << "\n";
+    }
+
+    /**
+     * Host-native twin of a funnel kernel: compile the same extracted body to a
+     * vectorized host loop (HostKernelGenerator, collected into the object named by
+     * PARALLAX_HOST_KERNELS) and append a registrar handing its address to the weak
+     * parallax_host_kernel_register(key, fn). The loop symbol is declared weak too, so
+     * a TU whose host object was not linked in (or a runtime without the hook) keeps
+     * building and simply has no host kernel for the key.
+     */
+    void emitHostKernel(const std::string& key, llvm::Function* body, unsigned elem_bytes,
+                        llvm::Type* flags_elem, HostKernelGenerator::Mode mode) {
+        static const bool route_only = std::getenv("PARALLAX_ROUTE_ONLY") != nullptr;
+        static const bool enabled = std::getenv("PARALLAX_HOST_KERNELS") != nullptr;
+        if (route_only || !enabled || !body) return;
+        std::string sym = "__plx_host_" + llvm::utohexstr(llvm::xxh3_64bits(key), /*LowerCase=*/true);
+        if (!host_kernels_.add_kernel(body, sym, elem_bytes, flags_elem, mode)) {
+            llvm::errs() << "[ParallaxFunnel] no host loop form for key=" << key << "\n";
+            return;
+        }
+        std::string reg = "__plx_hostreg_" + std::to_string(host_counter_++);
+        std::string esc;
+        for (char c : key) { if (c == '\\' || c == '"') esc.push_back('\\'); esc.push_back(c); }
+        std::ostringstream ss;
+        ss << "\nextern \"C\" __attribute__((weak)) void " << sym
+           << "(void*, void*, unsigned long long, const void*);\n";
+        if (emitHookDescriptor(ss, 1, reg, key, "", "", sym)) {
+            funnel_emissions_ += ss.str();
+            return;
+        }
+        ss << "extern \"C\" __attribute__((weak)) void parallax_host_kernel_register("
+           << "const char*, void (*)(void*, void*, unsigned long long, const void*));\n"
+           << "namespace { struct " << reg << " { " << reg << "() { "
+           << "if (parallax_host_kernel_register && " << sym << ") "
+           << "parallax_host_kernel_register(\"" << esc << "\", " << sym << "); } } "
+           << reg << "_inst; }\n";
+        funnel_emissions_ += ss.str();
+    }
+
+    /**
+     * Placement hint for a funnel kernel, appended beside its registrar: calls the weak
+     *     parallax_kernel_placement(key, flags, readonly_caps, written_caps)
+     * at static init. flags bit 0 = the kernel only reads its data input; bit i of
+     * readonly_caps / written_caps = relocated pointer capture leaf i is only read /
+     * may be written. The runtime aggregates these per captured address at launch: a
+     * range that several kernels read and none writes may be copied once into
+     * device-local memory, and the leaf's value in the uploaded captures block patched
+     * to (local - dev_base + host_base) so the kernel's unchanged relocation lands in
+     * the copy. A launch whose kernel writes the range, or a host write (residency
+     * hint), drops the copy, so kernels that only write captures emit a hint too.
+     * Kernels with nothing to place or invalidate emit none.
+     */
+    void emitPlacementHint(const std::string& key, unsigned flags,
+                           uint64_t readonly_caps, uint64_t written_caps) {
+        static const bool route_only = std::getenv("PARALLAX_ROUTE_ONLY") != nullptr;
+        static const bool no_placement = std::getenv("PARALLAX_NO_PLACEMENT") != nullptr;
+        if (route_only || no_placement || (!flags && !readonly_caps && !written_caps)) return;
+        std::string reg = "__plx_place_" + std::to_string(placement_counter_++);
+        std::string esc;
+        for (char c : key) { if (c == '\\' || c == '"') esc.push_back('\\'); esc.push_back(c); }
+        std::ostringstream ss;
+        if (emitHookDescriptor(ss, 2, reg, key, "", "", "", flags, readonly_caps, written_caps)) {
+            funnel_emissions_ += ss.str();
+            return;
+        }
+        ss << "\nextern \"C\" __attribute__((weak)) void parallax_kernel_placement("
+           << "const char*, unsigned int, unsigned long long, unsigned long long);\n"
+           << "namespace { struct " << reg << " { " << reg << "() { "
+           << "if (parallax_kernel_placement) parallax_kernel_placement(\"" << esc << "\", "
+           << flags << "u, 0x" << llvm::utohexstr(readonly_caps) << "ull, 0x"
+           << llvm::utohexstr(written_caps) << "ull); } } " << reg << "_inst; }\n";
+        funnel_emissions_ += ss.str();
+    }
+
+    /**
+     * Embedded body for the runtime JIT (PARALLAX_EMBED_BITCODE): the functor's
+     * extracted LLVM module as bitcode, registered once per functor type through the
+     * weak parallax_bitcode_register(type, elem, bytes, size). `type_name` is the
+     * closure's typeid name, which is what LambdaCompiler looks it up by; it lowers
+     * the body at first call with the closure's capture values folded in.
+     */
+    void emitEmbeddedBitcode(const std::string& type_name, const std::string& elem_type,
+                             const llvm::Module& module) {
+        static const bool route_only = std::getenv("PARALLAX_ROUTE_ONLY") != nullptr;
+        static const bool enabled = std::getenv("PARALLAX_EMBED_BITCODE") != nullptr;
+        if (route_only || !enabled || !bitcode_types_.insert(type_name).second) return;
+        llvm::SmallVector<char, 0> bitcode;
+        llvm::raw_svector_ostream bos(bitcode);
+        llvm::WriteBitcodeToFile(module, bos);
+        std::string arr = "__plx_bitcode_" + std::to_string(bitcode_counter_++);
+        auto escape = [](const std::string& in) {
+            std::string esc;
+            for (char c : in) { if (c == '\\' || c == '"') esc.push_back('\\'); esc.push_back(c); }
+            return esc;
+        };
+        std::ostringstream ss;
+        ss << "\nstatic const unsigned char " << arr << "[] = {\n";
+        for (size_t i = 0; i < bitcode.size(); ++i)
+            ss << unsigned(static_cast<unsigned char>(bitcode[i])) << (i + 1 < bitcode.size() ? "," : "")
+               << ((i + 1) % 24 == 0 ? "\n" : "");
+        ss << "\n};\n";
+        if (emitHookDescriptor(ss, 4, arr, type_name, elem_type, arr, "", bitcode.size())) {
+            funnel_emissions_ += ss.str();
+            return;
+        }
+        ss << "extern \"C\" __attribute__((weak)) void parallax_bitcode_register("
+           << "const char*, const char*, const void*, unsigned long long);\n"
+           << "namespace { struct " << arr << "_reg { " << arr << "_reg() { "
+           << "if (parallax_bitcode_register) parallax_bitcode_register(\"" << escape(type_name)
+           << "\", \"" << escape(elem_type) << "\", " << arr << ", sizeof(" << arr << ")); } } "
+           << arr << "_inst; }\n";
+        funnel_emissions_ += ss.str();
+    }
+
+    /**
+     * Scratch descriptor for a funnel kernel key: the most temporary device memory
+     * one call with n elements needs, as per_elem * n + per_group * ceil(n / 256)
+     * bytes (flags/positions/padding scale with n; reduce partials and scan blocksums
+     * with the workgroup count, summed over levels within 2x). Registered through the
+     * weak parallax_scratch_reserve(key, per_elem, per_group) so the runtime's
+     * size-class scratch arena can hand each call one block that persists across
+     * calls instead of allocating, zeroing and growing the pool per temporary.
+     */
+    void emitScratchDescriptor(const std::string& key, uint64_t per_elem, uint64_t per_group) {
+        static const bool route_only = std::getenv("PARALLAX_ROUTE_ONLY") != nullptr;
+        static const bool disabled = std::getenv("PARALLAX_NO_SCRATCH_DESC") != nullptr;
+        if (route_only || disabled || (!per_elem && !per_group)) return;
+        std::string reg = "__plx_scratchreg_" + std::to_string(scratch_counter_++);
+        std::string esc;
+        for (char c : key) { if (c == '\\' || c == '"') esc.push_back('\\'); esc.push_back(c); }
+        std::ostringstream ss;
+        if (emitHookDescriptor(ss, 3, reg, key, "", "", "", per_elem, 2 * per_group)) {
+            funnel_emissions_ += ss.str();
+            return;
+        }
+        ss << "\nextern \"C\" __attribute__((weak)) void parallax_scratch_reserve("
+           << "const char*, unsigned long long, unsigned long long);\n"
+           << "namespace { struct " << reg << " { " << reg << "() { "
+           << "if (parallax_scratch_reserve) parallax_scratch_reserve(\"" << esc << "\", "
+           << per_elem << "ull, " << 2 * per_group << "ull); } } " << reg << "_inst; }\n";
+        funnel_emissions_ += ss.str();
     }
 
     /** Insert all accumulated funnel registrars at end of the main file. */
     void finalizeFunnelEmissions() {
+        if (!host_kernels_.empty()) {
+            const char* path = std::getenv("PARALLAX_HOST_KERNELS");
+            if (!host_kernels_.emit_object(path))
+                llvm::errs() << "[ParallaxFunnel] host kernel object not written; "
+                             << "registrars resolve to null\n";
+        }
         if (funnel_emissions_.empty()) return;
         clang::SourceLocation eof = SM_.getLocForEndOfFile(SM_.getMainFileID());
         rewriter_.InsertText(eof, funnel_emissions_, /*InsertAfter=*/true,
@@ -296,14 +1119,51 @@ public:
     }
 
     /**
-     * Mark a container as needing allocator injection
+     * Mark a container as needing allocator injection: a variable, a field, or a
+     * by-reference parameter (whose callers' arguments are marked alongside it)
      */
-    void markContainerForAllocation(const clang::VarDecl* var_decl) {
-        if (var_decl) {
-            containers_needing_allocator_.insert(var_decl);
+    void markContainerForAllocation(const clang::DeclaratorDecl* decl) {
+        if (decl) {
+            containers_needing_allocator_.insert(decl);
         }
     }
 
+    void unmarkForAllocation(const clang::DeclaratorDecl* decl) {
+        containers_needing_allocator_.erase(decl);
+    }
+
+    bool isMarkedForAllocation(const clang::DeclaratorDecl* decl) const {
+        return containers_needing_allocator_.count(decl) || pool_arrays_.count(
+            llvm::dyn_cast_or_null<clang::VarDecl>(decl));
+    }
+
+    const std::set<const clang::DeclaratorDecl*>& containersForAllocation() const {
+        return containers_needing_allocator_;
+    }
+
+    /**
+     * Whether applyAllocatorInjections actually moved decl's storage into the pool
+     * (a rewritten container type, or a rewritten new[] array)
+     */
+    bool isRewrittenToPool(const clang::DeclaratorDecl* decl) const {
+        return rewritten_containers_.count(decl) || rewritten_pool_arrays_.count(
+            llvm::dyn_cast_or_null<clang::VarDecl>(decl));
+    }
+
+    /**
+     * Mark a new[] array (a raw pointer or std::unique_ptr<T[]> local) for pool
+     * allocation. `deletes` are the delete[] expressions that free it; the caller has
+     * checked that the pointer never escapes them.
+     */
+    void markPoolArray(const clang::VarDecl* var, std::vector<const clang::CXXDeleteExpr*> deletes) {
+        if (var) pool_arrays_.emplace(var, std::move(deletes));
+    }
+
+    /**
+     * Check if a container can be rewritten (memoized, so each reason is logged once)
+     */
+    bool canRewriteContainer(const clang::DeclaratorDecl* decl);
+
     /**
      * Apply allocator injections to all marked containers
      */
@@ -317,13 +1177,136 @@ private:
     std::unordered_set<unsigned> seen_call_locs_;  // dedup rewrites across instantiations
     std::string funnel_emissions_;                 // Layer A: appended registrars
     int funnel_counter_ = 0;
+    HostKernelGenerator host_kernels_;             // host twins of funnel kernels
+    int host_counter_ = 0;
+    int placement_counter_ = 0;
+    int scratch_counter_ = 0;
+    int bitcode_counter_ = 0;
+    std::set<std::string> bitcode_types_;          // functor types already embedded
+    bool hash_decl_emitted_ = false;
+    bool kdesc_decl_emitted_ = false;
+    bool hdesc_decl_emitted_ = false;
+    bool unpack_decl_emitted_ = false;
+    bool override_decl_emitted_ = false;
+    bool prewarm_decl_emitted_ = false;
+    bool profile_generate_emitted_ = false;
+    bool profile_decl_emitted_ = false;
+    int profile_counter_ = 0;
+    std::set<std::string> profiled_keys_;
+
+    struct ProfileRow {
+        unsigned bucket = 0;
+        std::string variant;
+        uint64_t cpu_calls = 0, cpu_ns = 0, gpu_calls = 0, gpu_ns = 0;
+    };
+
+    // Rows of a -fprofile-use file grouped by key, read once per compilation.
+    static const std::map<std::string, std::vector<ProfileRow>>& loadProfile(const std::string& path) {
+        static std::map<std::string, std::vector<ProfileRow>> rows;
+        static bool loaded = false;
+        if (loaded) return rows;
+        loaded = true;
+        auto buf = llvm::MemoryBuffer::getFile(path);
+        if (!buf) {
+            llvm::errs() << "[ParallaxPGO] cannot read profile " << path << "; static heuristics\n";
+            return rows;
+        }
+        llvm::SmallVector<llvm::StringRef, 8> lines, cols;
+        (*buf)->getBuffer().split(lines, '\n', -1, false);
+        for (llvm::StringRef line : lines) {
+            line = line.rtrim("\r");
+            if (line.empty() || line.starts_with("#")) continue;
+            cols.clear();
+            line.split(cols, '\t');
+            ProfileRow r;
+            if (cols.size() != 7 || cols[1].getAsInteger(10, r.bucket) ||
+                cols[3].getAsInteger(10, r.cpu_calls) || cols[4].getAsInteger(10, r.cpu_ns) ||
+                cols[5].getAsInteger(10, r.gpu_calls) || cols[6].getAsInteger(10, r.gpu_ns)) {
+                llvm::errs() << "[ParallaxPGO] skipping malformed profile row\n";
+                continue;
+            }
+            r.variant = cols[2].str();
+            rows[cols[0].str()].push_back(std::move(r));
+        }
+        llvm::errs() << "[ParallaxPGO] loaded " << rows.size() << " key(s) from " << path << "\n";
+        return rows;
+    }
+
+    // parallax-tune database: "skeleton<TAB>elem<TAB>log2_n<TAB>local_size<TAB>ns_per_elem"
+    // rows, '#' comments. Every size bucket keeps its own winner (the fastest row when
+    // a bucket repeats) as a tuned skeleton workgroup size in SPIRVGenerator. Base
+    // kernels use the largest bucket's size; the funnel registers per-bucket twins
+    // the runtime picks by n (emitTunedRegistrars).
+    static void loadTuningDB(const std::string& path) {
+        static bool loaded = false;
+        if (loaded) return;
+        loaded = true;
+        auto buf = llvm::MemoryBuffer::getFile(path);
+        if (!buf) {
+            llvm::errs() << "[ParallaxTune] cannot read tuning database " << path << "; LocalSize 256\n";
+            return;
+        }
+        static const std::map<std::string, SPIRVGenerator::ReduceElemType> elems = {
+            {"f32", SPIRVGenerator::ReduceElemType::F32}, {"f64", SPIRVGenerator::ReduceElemType::F64},
+            {"i32", SPIRVGenerator::ReduceElemType::I32}, {"i64", SPIRVGenerator::ReduceElemType::I64}};
+        // (skeleton, elem, log2_n) -> (ns_per_elem, size)
+        std::map<std::tuple<std::string, std::string, unsigned>, std::pair<double, unsigned>> best;
+        llvm::SmallVector<llvm::StringRef, 8> lines, cols;
+        (*buf)->getBuffer().split(lines, '\n', -1, false);
+        for (llvm::StringRef line : lines) {
+            line = line.rtrim("\r");
+            if (line.empty() || line.starts_with("#")) continue;
+            cols.clear();
+            line.split(cols, '\t');
+            unsigned log2_n = 0, local = 0;
+            if (cols.size() < 4 || !elems.count(cols[1].str()) ||
+                cols[2].getAsInteger(10, log2_n) || cols[3].getAsInteger(10, local)) {
+                llvm::errs() << "[ParallaxTune] skipping malformed tuning row\n";
+                continue;
+            }
+            double ns = 0;
+            if (cols.size() < 5 || cols[4].getAsDouble(ns)) ns = 0;
+            auto& b = best[{cols[0].str(), cols[1].str(), log2_n}];
+            if (!b.second || ns < b.first) b = {ns, local};
+        }
+        for (const auto& e : best) {
+            const auto& [skeleton, elem, log2_n] = e.first;
+            SPIRVGenerator::set_tuned_local_size(skeleton, elems.at(elem), log2_n, e.second.second);
+            llvm::errs() << "[ParallaxTune] " << skeleton << "/" << elem << " 2^" << log2_n
+                         << " LocalSize " << e.second.second << "\n";
+        }
+    }
+
+    static std::string escapeLiteral(const std::string& in) {
+        std::string esc;
+        for (char c : in) { if (c == '\\' || c == '"') esc.push_back('\\'); esc.push_back(c); }
+        return esc;
+    }
     std::unordered_set<unsigned> seen_route_locs_;  // transparent-routing dedup
+    std::unordered_set<unsigned> seen_graph_locs_;  // capture/replay scope dedup
+    int graph_counter_ = 0;
+    std::unordered_set<unsigned> seen_batch_locs_;  // launch batch dedup
+    int batch_counter_ = 0;
+    std::set<std::string> seen_residency_;          // residency range dedup (by key)
+    int residency_counter_ = 0;
+
+    std::unordered_set<unsigned> seen_pool_assume_locs_;  // pool-residency guard dedup
 
     // Container tracking for allocator injection
-    std::set<const clang::VarDecl*> containers_needing_allocator_;
-    std::set<const clang::VarDecl*> rewritten_containers_;
+    std::set<const clang::DeclaratorDecl*> containers_needing_allocator_;
+    std::set<const clang::DeclaratorDecl*> rewritten_containers_;
+    std::unordered_set<unsigned> rewritten_type_locs_;  // redeclarations share nothing else
+    std::map<const clang::DeclaratorDecl*, bool> can_rewrite_;
+    std::map<const clang::VarDecl*, std::vector<const clang::CXXDeleteExpr*>> pool_arrays_;
+    std::set<const clang::VarDecl*> rewritten_pool_arrays_;
     bool allocator_header_included_ = false;
+    bool pool_prelude_included_ = false;
+    bool pool_assume_prelude_included_ = false;
     bool runtime_header_included_ = false;
+    bool graph_prelude_included_ = false;
+    bool residency_prelude_included_ = false;
+    bool scratch_prelude_included_ = false;
+    bool adapt_prelude_included_ = false;
 
     /**
      * Apply a single transformation
@@ -347,14 +1330,27 @@ private:
                                    const std::vector<uint32_t>& spirv);
 
     /**
-     * Rewrite a container type to inject parallax::allocator
+     * Rewrite a container type to inject parallax::allocator. False if nothing was
+     * rewritten.
+     */
+    bool rewriteContainerType(const clang::DeclaratorDecl* decl);
+    bool rewriteDeclType(const clang::DeclaratorDecl* decl);
+
+    /**
+     * The spelled container type of decl (past a reference's '&' and cv-qualifiers)
+     * and its replacement with parallax::allocator. False if decl's type cannot be
+     * respelled: no type source info, 'auto', or not a std::vector/std::deque.
      */
-    void rewriteContainerType(const clang::VarDecl* var_decl);
+    bool planDeclType(const clang::DeclaratorDecl* decl, clang::SourceRange& range,
+                      std::string& new_type);
 
     /**
-     * Check if a container can be rewritten
+     * Move a marked new[] array into the pool: its allocation, its unique_ptr type if
+     * any, and its delete[] expressions. False (nothing rewritten) when the new[] has
+     * an initializer other than () or {}, which __plx_pool_new cannot reproduce.
      */
-    bool canRewriteContainer(const clang::VarDecl* var_decl);
+    bool rewritePoolArray(const clang::VarDecl* var,
+                          const std::vector<const clang::CXXDeleteExpr*>& deletes);
 
     /**
      * Ensure allocator header is included
@@ -366,6 +1362,42 @@ private:
      */
     void ensureRuntimeHeader();
 
+    /**
+     * Ensure the capture/replay and launch-batch hooks and scope helpers are declared
+     */
+    void ensureGraphPrelude();
+
+    /**
+     * Ensure the residency hooks and the __plx_resident handle template are declared
+     */
+    void ensureResidencyPrelude();
+
+    /**
+     * Ensure the pooled scratch helpers (__plx_scratch_get/put) are declared
+     */
+    void ensureScratchPrelude();
+
+    /**
+     * Ensure the pool array helpers (__plx_pool_new/__plx_pool_delete) are declared
+     */
+    void ensurePoolPrelude();
+
+    /**
+     * Ensure the pool-residency hooks and the __plx_pool_assume guard are declared
+     */
+    void ensurePoolAssumePrelude();
+
+    /**
+     * PARALLAX_ADAPTIVE=1: keep the original call beside the generated GPU path and
+     * let a per-call-site table pick between them at run time, per log2 size bucket
+     */
+    std::string wrapAdaptiveDispatch(TransformInfo& transform, const std::string& gpu);
+
+    /**
+     * Ensure the adaptive dispatch helpers (__plx_adapt_pick / __plx_adapt_timer)
+     */
+    void ensureAdaptPrelude();
+
     /**
      * NEW V2: Generate capture code for member variables
      */
@@ -382,7 +1414,7 @@ void ParallaxRewriter::applyTransformation(TransformInfo& transform) {
                  << transform.call_expr->getBeginLoc().printToString(SM_) << "\n";
 
     // Generate replacement code
-    std::string replacement = generateReplacementCode(transform);
+    std::string replacement = wrapAdaptiveDispatch(transform, generateReplacementCode(transform));
 
     // Replace the original call
     clang::SourceRange call_range = transform.call_expr->getSourceRange();
@@ -398,6 +1430,52 @@ void ParallaxRewriter::applyTransformation(TransformInfo& transform) {
     llvm::errs() << "[ParallaxRewriter] Replacement code:\n" << replacement << "\n";
 }
 
+std::string ParallaxRewriter::wrapAdaptiveDispatch(TransformInfo& transform, const std::string& gpu) {
+    static const bool enabled = std::getenv("PARALLAX_ADAPTIVE") != nullptr;
+    if (!enabled || transform.has_class_reference_captures() || !transform.first_iterator)
+        return gpu;
+
+    // The size is computed ahead of the branch and the chosen path evaluates its
+    // arguments again, so the range expressions must be free of side effects.
+    clang::ASTContext& ctx = CI_.getASTContext();
+    const bool count_form = transform.algorithm_name == "for_each_n";
+    clang::Expr* range_end = count_form ? transform.call_expr->getArg(2) : transform.last_iterator;
+    if (!range_end || transform.first_iterator->HasSideEffects(ctx) || range_end->HasSideEffects(ctx)) {
+        llvm::errs() << "[ParallaxAdapt] range has side effects; GPU path only\n";
+        return gpu;
+    }
+    std::string first_it = getSourceText(transform.first_iterator->getSourceRange());
+    std::string end_src = getSourceText(range_end->getSourceRange());
+    std::string n_expr = count_form ? "(unsigned long long)(" + end_src + ")"
+                                    : "(unsigned long long)std::distance((" + first_it + "), (" + end_src + "))";
+    std::string cpu = getSourceText(transform.call_expr->getSourceRange());
+
+    // Stable per-call-site id: FNV-1a of file:line:col (the same hash as funnel keys).
+    clang::PresumedLoc pl = SM_.getPresumedLoc(transform.call_expr->getBeginLoc());
+    std::string site = pl.isValid() ? std::string(pl.getFilename()) + ":" + std::to_string(pl.getLine()) +
+                                      ":" + std::to_string(pl.getColumn())
+                                    : transform.kernel_name;
+    uint64_t id = 0xcbf29ce484222325ull;
+    for (unsigned char c : site) { id ^= c; id *= 0x100000001b3ull; }
+
+    ensureAdaptPrelude();
+    std::ostringstream ss;
+    ss << "static __plx_adapt_site __plx_site = { 0x" << std::hex << id << std::dec << "ull }; "
+       << "const unsigned long long __plx_an = " << n_expr << "; "
+       << "const bool __plx_ag = __plx_adapt_pick(__plx_site, __plx_an); "
+       << "__plx_adapt_timer __plx_at(__plx_site, __plx_an, __plx_ag); ";
+    std::string out;
+    if (gpu.size() >= 3 && gpu.compare(gpu.size() - 3, 3, "});") == 0) {
+        // Value-yielding statement-expression: choose with ?: so the call keeps its
+        // value; the timer records when the outer statement-expression ends.
+        out = "({ " + ss.str() + "__plx_ag ? " + gpu.substr(0, gpu.size() - 1) + " : (" + cpu + "); });";
+    } else {
+        out = "{ " + ss.str() + "if (__plx_ag) " + gpu + " else { " + cpu + "; } }";
+    }
+    llvm::errs() << "[ParallaxAdapt] call site " << site << " gets CPU/GPU adaptive dispatch\n";
+    return out;
+}
+
 std::string ParallaxRewriter::generateReplacementCode(TransformInfo& transform) {
     std::ostringstream ss;
 
@@ -427,15 +1505,32 @@ std::string ParallaxRewriter::generateReplacementCode(TransformInfo& transform)
            << "_r_spirv, sizeof(" << k << "_r_spirv)/sizeof(uint32_t));\n";
         rs << "  auto __plx_first = (" << first_it << ");\n";
         rs << "  size_t __plx_n = (size_t)std::distance(__plx_first, (" << last_it << "));\n";
-        rs << "  std::vector<" << acc << "> __plx_scratch(__plx_n);\n";
+        // Pooled arena scratch (see ensureScratchPrelude): no per-call allocation or
+        // zeroing, and the transform writes every element before the reduce reads it.
+        // Inline kernels count in 32 bits, so a longer range takes no scratch at all: it
+        // runs on the host below and must not park a multi-GB block in the size class.
+        rs << "  " << acc << "* __plx_scratch = __plx_n <= 0xffffffffull ? (" << acc
+           << "*)__plx_scratch_get(__plx_n * sizeof(" << acc << ")) : nullptr;\n";
+        rs << "  " << acc << " __plx_gpu = " << acc << "();\n";
+        rs << "  bool __plx_dev = false;\n";
         // transform2 takes separate in/out element sizes: the input is the element
         // type T, the scratch/output is the accumulator type U (may differ in size).
-        rs << "  parallax_kernel_launch_transform2(" << k << "_t, (void*)&(*__plx_first), "
-           << "__plx_scratch.data(), __plx_n, sizeof(" << et << "), sizeof(" << acc << "));\n";
-        rs << "  " << acc << " __plx_gpu = " << acc << "();\n";
-        rs << "  parallax_reduce(" << k << "_r, __plx_scratch.data(), __plx_n, sizeof("
+        rs << "  if (__plx_scratch && " << k << "_t && " << k << "_r) {\n";
+        rs << "    parallax_kernel_launch_transform2(" << k << "_t, (void*)&(*__plx_first), "
+           << "__plx_scratch, __plx_n, sizeof(" << et << "), sizeof(" << acc << "));\n";
+        rs << "    parallax_reduce(" << k << "_r, __plx_scratch, __plx_n, sizeof("
            << acc << "), &__plx_gpu);\n";
+        rs << "    __plx_dev = true;\n";
+        rs << "  }\n";
+        rs << "  if (__plx_scratch) __plx_scratch_put(__plx_scratch, __plx_n * sizeof(" << acc << "));\n";
+        // No scratch, a kernel that failed to load or a range past 2^32 - 1: run the
+        // original algorithm on the host over the same range (as the sort skeleton
+        // does), rather than yielding the zero-initialized accumulator.
+        std::string op = getSourceText(
+            transform.call_expr->getArg(transform.call_expr->getNumArgs() - 1)->getSourceRange());
         if (transform.is_count) {
+            rs << "  if (!__plx_dev) __plx_gpu = (" << acc << ")std::count_if(__plx_first, "
+               << "std::next(__plx_first, __plx_n), (" << op << "));\n";
             // The reduction summed 1/0 predicate contributions. Yield the count, or
             // the corresponding boolean for any_of/all_of/none_of.
             switch (transform.count_yield) {
@@ -449,7 +1544,9 @@ std::string ParallaxRewriter::generateReplacementCode(TransformInfo& transform)
                 ? getSourceText(transform.init_expr->getSourceRange()) : (acc + "()");
             std::string rop = getSourceText(transform.reduce_op->getSourceRange());
             rs << "  auto __plx_rop = (" << rop << ");\n";
-            rs << "  " << acc << " __plx_result = __plx_rop((" << init << "), __plx_gpu);\n";
+            rs << "  " << acc << " __plx_result = __plx_dev ? __plx_rop((" << init << "), __plx_gpu)\n"
+               << "      : std::transform_reduce(__plx_first, std::next(__plx_first, __plx_n), "
+               << "(" << acc << ")(" << init << "), __plx_rop, (" << op << "));\n";
             rs << "  __plx_result;\n";
         }
         rs << "});";
@@ -485,12 +1582,23 @@ std::string ParallaxRewriter::generateReplacementCode(TransformInfo& transform)
         ld("_f"); ld("_s"); ld("_a"); ld("_x");
         rs << "  auto __plx_first = (" << first_it << ");\n";
         rs << "  size_t __plx_n = (size_t)std::distance(__plx_first, (" << last_it << "));\n";
+        // Flags, positions and the scatter are 32-bit (no :wide twin): ranges past
+        // 2^32 - 1 elements, like a missing scratch block, run the original algorithm
+        // on the host.
+        const clang::CallExpr* call = transform.call_expr;
+        const unsigned rest = transform.is_inplace_compact ? 3 : 4;
+        std::string host = "std::" + transform.algorithm_name +
+                           "(__plx_first, std::next(__plx_first, __plx_n)" +
+                           (transform.is_inplace_compact ? "" : ", __plx_dfirst");
+        for (unsigned i = rest; i < call->getNumArgs(); ++i)
+            host += ", (" + getSourceText(call->getArg(i)->getSourceRange()) + ")";
+        host += ")";
         if (transform.is_inplace_compact) {
             // remove_if: scatter into arena scratch (scatter can't run in place — the
             // destination index is <= i), then copy the kept prefix back over the
             // input range. Returns the new logical end first + kept.
-            rs << "  " << et << "* __plx_sc = (" << et << "*)parallax_arena_alloc("
-               << "__plx_n * sizeof(" << et << "), 16);\n";
+            rs << "  " << et << "* __plx_sc = __plx_n <= 0xffffffffull ? (" << et
+               << "*)__plx_scratch_get(__plx_n * sizeof(" << et << ")) : nullptr;\n";
             rs << "  size_t __plx_kept = 0;\n";
             rs << "  if (__plx_sc) {\n";
             rs << "    __plx_kept = parallax_copy_if(" << k << "_f, " << k << "_s, " << k
@@ -500,15 +1608,16 @@ std::string ParallaxRewriter::generateReplacementCode(TransformInfo& transform)
             // whole range back; remove_if/unique only keep the front kept prefix.
             const char* copy_n = transform.is_partition ? "__plx_n" : "__plx_kept";
             rs << "    std::copy(__plx_sc, __plx_sc + " << copy_n << ", __plx_first);\n";
-            rs << "    parallax_arena_free(__plx_sc);\n";
+            rs << "    __plx_scratch_put(__plx_sc, __plx_n * sizeof(" << et << "));\n";
             rs << "  }\n";
-            rs << "  std::next(__plx_first, __plx_kept);\n";  // remove_if returns the new end
+            // remove_if returns the new end
+            rs << "  __plx_sc ? std::next(__plx_first, __plx_kept) : " << host << ";\n";
         } else {
             rs << "  auto __plx_dfirst = (" << out_it << ");\n";
-            rs << "  size_t __plx_kept = parallax_copy_if(" << k << "_f, " << k << "_s, " << k
-               << "_a, " << k << "_x, (void*)&(*__plx_first), (void*)&(*__plx_dfirst), "
-               << "__plx_n, sizeof(" << et << "), " << isf << ");\n";
-            rs << "  std::next(__plx_dfirst, __plx_kept);\n";  // copy_if returns the output end
+            rs << "  __plx_n <= 0xffffffffull ? std::next(__plx_dfirst, parallax_copy_if(" << k
+               << "_f, " << k << "_s, " << k << "_a, " << k << "_x, (void*)&(*__plx_first), "
+               << "(void*)&(*__plx_dfirst), __plx_n, sizeof(" << et << "), " << isf << ")) : "
+               << host << ";\n";  // copy_if returns the output end
         }
         rs << "});";
         return rs.str();
@@ -533,24 +1642,32 @@ std::string ParallaxRewriter::generateReplacementCode(TransformInfo& transform)
         rs << "  auto __plx_first = (" << first_it << ");\n";
         rs << "  size_t __plx_n = (size_t)std::distance(__plx_first, (" << last_it << "));\n";
         rs << "  size_t __plx_m = 1; while (__plx_m < __plx_n) __plx_m <<= 1;\n";
-        rs << "  if (__plx_n > 1) {\n";
+        // The padded count must fit the kernel's 32-bit count; longer ranges sort on
+        // the host.
+        std::string host_sort = "std::sort(__plx_first, std::next(__plx_first, __plx_n)";
+        for (unsigned i = 3; i < transform.call_expr->getNumArgs(); ++i)
+            host_sort += ", (" + getSourceText(transform.call_expr->getArg(i)->getSourceRange()) + ")";
+        host_sort += ");\n";
+        rs << "  if (__plx_m > 0xffffffffull) {\n";
+        rs << "    " << host_sort;
+        rs << "  } else if (__plx_n > 1) {\n";
         rs << "    if (__plx_m == __plx_n) {\n";
         rs << "      parallax_sort(" << k << ", (void*)&(*__plx_first), __plx_n, sizeof(" << et << "));\n";
         rs << "    } else {\n";
         // Pad to the next power of two with max() so the padding sorts to the tail.
-        // The scratch comes from the arena so the sort uses the zero-copy GPU path
-        // (a default-allocator vector would take the slower register/sync path).
-        rs << "      " << et << "* __plx_pad = (" << et << "*)parallax_arena_alloc("
-           << "__plx_m * sizeof(" << et << "), 16);\n";
+        // The scratch comes from the pooled arena so the sort uses the zero-copy GPU
+        // path (a default-allocator vector would take the slower register/sync path).
+        rs << "      " << et << "* __plx_pad = (" << et << "*)__plx_scratch_get("
+           << "__plx_m * sizeof(" << et << "));\n";
         rs << "      if (__plx_pad) {\n";
         rs << "        for (size_t __plx_i = 0; __plx_i < __plx_m; ++__plx_i) "
            << "__plx_pad[__plx_i] = std::numeric_limits<" << et << ">::max();\n";
         rs << "        std::copy(__plx_first, std::next(__plx_first, __plx_n), __plx_pad);\n";
         rs << "        parallax_sort(" << k << ", __plx_pad, __plx_m, sizeof(" << et << "));\n";
         rs << "        std::copy(__plx_pad, __plx_pad + __plx_n, __plx_first);\n";
-        rs << "        parallax_arena_free(__plx_pad);\n";
+        rs << "        __plx_scratch_put(__plx_pad, __plx_m * sizeof(" << et << "));\n";
         rs << "      } else {\n";  // arena unavailable: sort on the CPU as a fallback
-        rs << "        std::sort(__plx_first, std::next(__plx_first, __plx_n));\n";
+        rs << "        " << host_sort;
         rs << "      }\n";
         rs << "    }\n";
         rs << "  }\n";
@@ -785,16 +1902,17 @@ std::string ParallaxRewriter::generateSPIRVArray(
     const std::string& name,
     const std::vector<uint32_t>& spirv) {
 
+    const std::vector<uint32_t> words = stripForRelease(spirv);
     std::ostringstream ss;
     ss << "  static const uint32_t " << name << "_spirv[] = {\n";
     ss << "    ";
 
-    for (size_t i = 0; i < spirv.size(); i++) {
-        ss << "0x" << std::hex << std::setw(8) << std::setfill('0') << spirv[i];
-        if (i + 1 < spirv.size()) {
+    for (size_t i = 0; i < words.size(); i++) {
+        ss << "0x" << std::hex << std::setw(8) << std::setfill('0') << words[i];
+        if (i + 1 < words.size()) {
             ss << ", ";
         }
-        if ((i + 1) % 8 == 0 && i + 1 < spirv.size()) {
+        if ((i + 1) % 8 == 0 && i + 1 < words.size()) {
             ss << "\n    ";
         }
     }
@@ -821,44 +1939,87 @@ std::string ParallaxRewriter::getSourceText(clang::SourceRange range) {
 
 void ParallaxRewriter::applyAllocatorInjections() {
     llvm::errs() << "[ParallaxRewriter] Injecting allocators into "
-                 << containers_needing_allocator_.size() << " containers\n";
+                 << containers_needing_allocator_.size() << " containers, "
+                 << pool_arrays_.size() << " heap arrays\n";
 
     if (!containers_needing_allocator_.empty()) {
         ensureAllocatorHeader();
     }
 
-    for (const clang::VarDecl* var_decl : containers_needing_allocator_) {
-        if (rewritten_containers_.count(var_decl)) {
+    for (const clang::DeclaratorDecl* decl : containers_needing_allocator_) {
+        if (rewritten_containers_.count(decl)) {
             continue;  // Already rewritten
         }
 
-        rewriteContainerType(var_decl);
-        rewritten_containers_.insert(var_decl);
+        if (rewriteContainerType(decl)) rewritten_containers_.insert(decl);
+    }
+
+    for (const auto& pa : pool_arrays_) {
+        if (rewritePoolArray(pa.first, pa.second)) rewritten_pool_arrays_.insert(pa.first);
     }
 }
 
-void ParallaxRewriter::rewriteContainerType(const clang::VarDecl* var_decl) {
-    if (!canRewriteContainer(var_decl)) {
-        return;
+bool ParallaxRewriter::rewriteContainerType(const clang::DeclaratorDecl* decl) {
+    if (!canRewriteContainer(decl)) {
+        return false;
+    }
+
+    // A by-reference parameter is spelled in every redeclaration of its function.
+    if (const auto* parm = llvm::dyn_cast<clang::ParmVarDecl>(decl)) {
+        const auto* fn = llvm::dyn_cast<clang::FunctionDecl>(parm->getDeclContext());
+        if (!fn) return false;
+        const unsigned idx = parm->getFunctionScopeIndex();
+        bool all = true;
+        for (const clang::FunctionDecl* redecl : fn->redecls()) {
+            if (idx < redecl->getNumParams()) {
+                all = rewriteDeclType(redecl->getParamDecl(idx)) && all;
+            }
+        }
+        return all;
     }
 
-    clang::QualType original_type = var_decl->getType();
-    std::string type_str = original_type.getAsString();
+    return rewriteDeclType(decl);
+}
 
-    llvm::errs() << "[ParallaxRewriter] Rewriting type: " << type_str << "\n";
+bool ParallaxRewriter::rewriteDeclType(const clang::DeclaratorDecl* decl) {
+    llvm::errs() << "[ParallaxRewriter] Rewriting type: " << decl->getType().getAsString() << "\n";
 
-    // Get the source range for the type
-    clang::TypeSourceInfo* type_src_info = var_decl->getTypeSourceInfo();
-    if (!type_src_info) {
-        llvm::errs() << "[ParallaxRewriter] Warning: No type source info for "
-                     << var_decl->getNameAsString() << "\n";
-        return;
+    clang::SourceRange type_range;
+    std::string new_type;
+    if (!planDeclType(decl, type_range, new_type)) return false;
+    if (!rewritten_type_locs_.insert(type_range.getBegin().getRawEncoding()).second) {
+        return true;  // a redeclaration sharing this spelling was already rewritten
     }
 
-    clang::SourceRange type_range = type_src_info->getTypeLoc().getSourceRange();
+    llvm::errs() << "[ParallaxRewriter] New type: " << new_type << "\n";
 
-    // Handle 'auto' types specially
-    if (original_type->isUndeducedType()) {
+    // Replace the type
+    rewriter_.ReplaceText(type_range, new_type);
+    return true;
+}
+
+bool ParallaxRewriter::planDeclType(const clang::DeclaratorDecl* decl, clang::SourceRange& type_range,
+                                    std::string& new_type) {
+    clang::QualType original_type = decl->getType();
+
+    // Get the source range for the type
+    clang::TypeSourceInfo* type_src_info = decl->getTypeSourceInfo();
+    if (!type_src_info) {
+        llvm::errs() << "[ParallaxRewriter] Warning: No type source info for "
+                     << decl->getNameAsString() << "\n";
+        return false;
+    }
+
+    // The container itself: a reference parameter keeps its '&' and cv-qualifiers.
+    clang::TypeLoc type_loc = type_src_info->getTypeLoc();
+    if (auto ref_loc = type_loc.getAs<clang::ReferenceTypeLoc>()) {
+        type_loc = ref_loc.getPointeeLoc();
+    }
+    type_loc = type_loc.getUnqualifiedLoc();
+    type_range = type_loc.getSourceRange();
+
+    // Handle 'auto' types specially
+    if (original_type->isUndeducedType()) {
         llvm::errs() << "[ParallaxRewriter] Warning: Cannot rewrite 'auto' types\n";
         clang::DiagnosticsEngine& diag = CI_.getDiagnostics();
         unsigned diag_id = diag.getCustomDiagID(
@@ -866,8 +2027,8 @@ void ParallaxRewriter::rewriteContainerType(const clang::VarDecl* var_decl) {
             "Cannot inject allocator into 'auto' type. Please use explicit type "
             "std::vector<T, parallax::allocator<T>>"
         );
-        diag.Report(var_decl->getLocation(), diag_id);
-        return;
+        diag.Report(decl->getLocation(), diag_id);
+        return false;
     }
 
     // Extract element type and container template
@@ -896,12 +2057,11 @@ void ParallaxRewriter::rewriteContainerType(const clang::VarDecl* var_decl) {
 
     if (element_type.isNull()) {
         llvm::errs() << "[ParallaxRewriter] Warning: Could not extract element type\n";
-        return;
+        return false;
     }
 
     // Build new type string with allocator
     std::string element_type_str = element_type.getAsString();
-    std::string new_type;
 
     if (container_template == "std::vector") {
         new_type = "std::vector<" + element_type_str +
@@ -912,28 +2072,169 @@ void ParallaxRewriter::rewriteContainerType(const clang::VarDecl* var_decl) {
     } else {
         llvm::errs() << "[ParallaxRewriter] Warning: Unsupported container type: "
                      << container_template << "\n";
-        return;
+        return false;
     }
+    return true;
+}
 
-    llvm::errs() << "[ParallaxRewriter] New type: " << new_type << "\n";
+bool ParallaxRewriter::canRewriteContainer(const clang::DeclaratorDecl* decl) {
+    auto known = can_rewrite_.find(decl);
+    if (known != can_rewrite_.end()) return known->second;
+    bool& ok = can_rewrite_[decl];
+    ok = false;
+
+    // Decided before anything is marked, so a declaration the rewrite cannot respell
+    // never counts as pool storage or pulls a caller's container in with it.
+    auto spellable = [this](const clang::DeclaratorDecl* d) {
+        clang::SourceRange range;
+        std::string new_type;
+        return planDeclType(d, range, new_type);
+    };
 
-    // Replace the type
-    rewriter_.ReplaceText(type_range, new_type);
-}
+    if (const auto* parm = llvm::dyn_cast<clang::ParmVarDecl>(decl)) {
+        // By-value parameters copy the caller's container; only a reference shares it.
+        // The collector has checked every call site passes a rewritable container.
+        if (!parm->getType()->isLValueReferenceType()) {
+            llvm::errs() << "[ParallaxRewriter] Skipping function parameter\n";
+            return false;
+        }
+    } else if (const auto* var_decl = llvm::dyn_cast<clang::VarDecl>(decl)) {
+        // Don't rewrite global variables (complex initialization issues)
+        if (var_decl->hasGlobalStorage() && !var_decl->isStaticLocal()) {
+            llvm::errs() << "[ParallaxRewriter] Skipping global variable\n";
+            return false;
+        }
+        // A deduced 'auto' would keep deducing the old container from its initializer.
+        if (var_decl->getType()->getContainedAutoType()) {
+            llvm::errs() << "[ParallaxRewriter] Skipping 'auto' variable\n";
+            return false;
+        }
+        ok = spellable(decl);
+        return ok;
+    } else if (const auto* field = llvm::dyn_cast<clang::FieldDecl>(decl)) {
+        // One spelling per class: a template's fields are shared by every specialization.
+        const auto* record = llvm::dyn_cast<clang::CXXRecordDecl>(field->getParent());
+        if (!record || record->isLambda() || record->getDescribedClassTemplate() ||
+            llvm::isa<clang::ClassTemplateSpecializationDecl>(record) ||
+            record->isDependentContext()) {
+            llvm::errs() << "[ParallaxRewriter] Skipping field of a class template\n";
+            return false;
+        }
+    } else {
+        return false;
+    }
 
-bool ParallaxRewriter::canRewriteContainer(const clang::VarDecl* var_decl) {
-    // Don't rewrite function parameters
-    if (llvm::isa<clang::ParmVarDecl>(var_decl)) {
-        llvm::errs() << "[ParallaxRewriter] Skipping function parameter\n";
+    // Fields and parameters change the type other translation units see; only rewrite
+    // declarations this file owns.
+    clang::SourceLocation loc = decl->getLocation();
+    if (loc.isMacroID() || !SM_.isInMainFile(loc)) {
+        llvm::errs() << "[ParallaxRewriter] Skipping " << decl->getNameAsString()
+                     << ": declared outside the main file\n";
         return false;
     }
 
-    // Don't rewrite global variables (complex initialization issues)
-    if (var_decl->hasGlobalStorage() && !var_decl->isStaticLocal()) {
-        llvm::errs() << "[ParallaxRewriter] Skipping global variable\n";
+    if (const auto* parm = llvm::dyn_cast<clang::ParmVarDecl>(decl)) {
+        const auto* fn = llvm::dyn_cast<clang::FunctionDecl>(parm->getDeclContext());
+        if (!fn) return false;
+        const unsigned idx = parm->getFunctionScopeIndex();
+        for (const clang::FunctionDecl* redecl : fn->redecls())
+            if (idx >= redecl->getNumParams() || !spellable(redecl->getParamDecl(idx))) return false;
+        ok = true;
+        return true;
+    }
+
+    ok = spellable(decl);
+    return ok;
+}
+
+bool ParallaxRewriter::rewritePoolArray(const clang::VarDecl* var,
+                                        const std::vector<const clang::CXXDeleteExpr*>& deletes) {
+    clang::QualType type = var->getType();
+    const clang::Expr* init = var->getInit();
+    if (!init) return false;
+
+    // The allocation: the new[] expression, or std::make_unique<T[]>(n).
+    const clang::CXXNewExpr* new_expr = nullptr;
+    const clang::CallExpr* make_unique = nullptr;
+    std::function<void(const clang::Stmt*)> find = [&](const clang::Stmt* st) {
+        if (!st || new_expr || make_unique) return;
+        if (const auto* ne = llvm::dyn_cast<clang::CXXNewExpr>(st)) { new_expr = ne; return; }
+        if (const auto* ce = llvm::dyn_cast<clang::CallExpr>(st)) {
+            if (const clang::FunctionDecl* fd = ce->getDirectCallee()) {
+                std::string qn = fd->getQualifiedNameAsString();
+                if ((qn == "std::make_unique" || qn == "std::make_unique_for_overwrite") &&
+                    ce->getNumArgs() == 1) {
+                    make_unique = ce;
+                    return;
+                }
+            }
+        }
+        for (const clang::Stmt* c : st->children()) find(c);
+    };
+    find(init);
+
+    clang::QualType elem;
+    std::string count;
+    bool zero = false;
+    clang::SourceRange alloc_range;
+    if (new_expr) {
+        elem = new_expr->getAllocatedType();
+        if (!new_expr->getArraySize()) return false;
+        count = getSourceText((*new_expr->getArraySize())->getSourceRange());
+        // new T[n]() and new T[n]{} value-initialize, which the pool reproduces by
+        // zeroing (elements are trivial); any other initializer sets values it cannot.
+        if (const clang::Expr* ni = new_expr->getInitializer()) {
+            const clang::Expr* e = ni->IgnoreImplicit();
+            const auto* list = llvm::dyn_cast<clang::InitListExpr>(e);
+            if (list && list->getSyntacticForm()) list = list->getSyntacticForm();
+            const auto* construct = llvm::dyn_cast<clang::CXXConstructExpr>(e);
+            zero = llvm::isa<clang::ImplicitValueInitExpr>(e) || (list && list->getNumInits() == 0) ||
+                   (construct && construct->getNumArgs() == 0);
+            if (!zero) {
+                llvm::errs() << "[ParallaxRewriter] Heap array " << var->getNameAsString()
+                             << " has an element initializer; left on the system heap\n";
+                return false;
+            }
+        }
+        alloc_range = new_expr->getSourceRange();
+    } else if (make_unique) {
+        const auto* fd = make_unique->getDirectCallee();
+        const clang::TemplateArgumentList* targs = fd->getTemplateSpecializationArgs();
+        if (!targs || !targs->size() || targs->get(0).getKind() != clang::TemplateArgument::Type) return false;
+        const clang::ArrayType* at = CI_.getASTContext().getAsArrayType(targs->get(0).getAsType());
+        if (!at) return false;
+        elem = at->getElementType();
+        count = getSourceText(make_unique->getArg(0)->getSourceRange());
+        zero = fd->getName() == "make_unique";
+        alloc_range = make_unique->getSourceRange();
+    } else {
         return false;
     }
+    if (count.empty()) return false;
+
+    ensurePoolPrelude();
+    const std::string elem_str = elem.getUnqualifiedType().getAsString();
+    const std::string alloc = "__plx_pool_new<" + elem_str + ">(" + count + ", " +
+                              (zero ? "true" : "false") + ")";
+    const bool is_unique = !type->isPointerType();
+    const std::string pool_unique = "std::unique_ptr<" + elem_str + "[], __plx_pool_deleter>";
+
+    if (is_unique && !type->getContainedAutoType()) {
+        clang::TypeLoc type_loc = var->getTypeSourceInfo()->getTypeLoc().getUnqualifiedLoc();
+        rewriter_.ReplaceText(type_loc.getSourceRange(), pool_unique);
+    }
+    if (make_unique) {
+        rewriter_.ReplaceText(alloc_range, pool_unique + "(" + alloc + ")");
+    } else {
+        rewriter_.ReplaceText(alloc_range, alloc);
+    }
+    for (const clang::CXXDeleteExpr* del : deletes) {
+        rewriter_.ReplaceText(del->getSourceRange(),
+                              "__plx_pool_delete(" + getSourceText(del->getArgument()->getSourceRange()) + ")");
+    }
 
+    llvm::errs() << "[ParallaxRewriter] Pool array: " << var->getNameAsString() << " ("
+                 << elem_str << "[" << count << "], " << deletes.size() << " delete[])\n";
     return true;
 }
 
@@ -971,6 +2272,184 @@ void ParallaxRewriter::ensureRuntimeHeader() {
     runtime_header_included_ = true;
 }
 
+void ParallaxRewriter::ensureGraphPrelude() {
+    if (graph_prelude_included_) return;
+
+    clang::SourceLocation insert_loc = SM_.getLocForStartOfFile(
+        SM_.getMainFileID()
+    );
+
+    // One line (like the injected #include) so user line numbers shift uniformly.
+    // Weak declarations: null when the linked runtime has no graph/batch support.
+    rewriter_.InsertTextBefore(insert_loc,
+        "extern \"C\" { __attribute__((weak)) void parallax_graph_begin(const char*, unsigned int); "
+        "__attribute__((weak)) void parallax_graph_end(const char*); "
+        "__attribute__((weak)) void parallax_batch_begin(const char*, unsigned int, const unsigned int*); "
+        "__attribute__((weak)) void parallax_batch_end(const char*); } "
+        "namespace { struct __plx_graph_scope { const char* key_; "
+        "__plx_graph_scope(const char* k, unsigned int n) : key_(k) "
+        "{ if (parallax_graph_begin) parallax_graph_begin(k, n); } "
+        "~__plx_graph_scope() { if (parallax_graph_end) parallax_graph_end(key_); } }; "
+        "struct __plx_batch_scope { const char* key_; "
+        "__plx_batch_scope(const char* k, unsigned int n, const unsigned int* d) : key_(k) "
+        "{ if (parallax_batch_begin) parallax_batch_begin(k, n, d); } "
+        "~__plx_batch_scope() { if (parallax_batch_end) parallax_batch_end(key_); } }; }\n");
+
+    llvm::errs() << "[ParallaxRewriter] Injected graph/batch scheduling prelude\n";
+
+    graph_prelude_included_ = true;
+}
+
+void ParallaxRewriter::ensureResidencyPrelude() {
+    if (residency_prelude_included_) return;
+
+    clang::SourceLocation insert_loc = SM_.getLocForStartOfFile(
+        SM_.getMainFileID()
+    );
+
+    // One line, like the graph prelude. The handle keeps the acquire-time address: a
+    // host write (which may reallocate) drops the device copy, so later device uses of
+    // a moved buffer are simply staged as non-resident data.
+    rewriter_.InsertTextBefore(insert_loc,
+        "extern \"C\" { __attribute__((weak)) void parallax_resident_acquire(const char*, const void*, unsigned long long); "
+        "__attribute__((weak)) void parallax_resident_host(const void*, int); "
+        "__attribute__((weak)) void parallax_resident_release(const void*); } "
+        "namespace { template <class C> struct __plx_resident { const void* p_; bool held_; "
+        "__plx_resident(const char* k, C& c) : p_(c.data()), held_(parallax_resident_acquire != nullptr) "
+        "{ if (held_) parallax_resident_acquire(k, p_, (unsigned long long)c.size() * sizeof(*c.data())); } "
+        "void host(int w) { if (held_ && parallax_resident_host) parallax_resident_host(p_, w); } "
+        "void release() { if (held_) { held_ = false; if (parallax_resident_release) parallax_resident_release(p_); } } "
+        "~__plx_resident() { release(); } }; }\n");
+
+    llvm::errs() << "[ParallaxRewriter] Injected device-residency prelude\n";
+
+    residency_prelude_included_ = true;
+}
+
+void ParallaxRewriter::ensurePoolPrelude() {
+    if (pool_prelude_included_) return;
+
+    clang::SourceLocation insert_loc = SM_.getLocForStartOfFile(
+        SM_.getMainFileID()
+    );
+
+    // The helpers call the arena directly, so they come with the runtime header (and
+    // <new> for bad_alloc). Pool arrays hold trivially destructible elements only, so
+    // __plx_pool_delete needs no count.
+    const bool exceptions = CI_.getLangOpts().CXXExceptions;
+    rewriter_.InsertTextBefore(insert_loc,
+        std::string(exceptions ? "#include <new>\n" : "") +
+        "#include <parallax/runtime.h>\n"
+        "namespace { template <class T> T* __plx_pool_new(unsigned long long n, bool zero) "
+        "{ void* p = parallax_arena_alloc(n * sizeof(T), alignof(T) > 16 ? alignof(T) : 16); "
+        "if (!p) " + (exceptions ? "throw std::bad_alloc();" : "__builtin_trap();") + " "
+        "if (zero) __builtin_memset(p, 0, n * sizeof(T)); return static_cast<T*>(p); } "
+        "inline void __plx_pool_delete(void* p) { if (p) parallax_arena_free(p); } "
+        "struct __plx_pool_deleter { void operator()(void* p) const { __plx_pool_delete(p); } }; }\n");
+
+    llvm::errs() << "[ParallaxRewriter] Injected pool array prelude\n";
+
+    pool_prelude_included_ = true;
+}
+
+void ParallaxRewriter::ensurePoolAssumePrelude() {
+    if (pool_assume_prelude_included_) return;
+
+    clang::SourceLocation insert_loc = SM_.getLocForStartOfFile(
+        SM_.getMainFileID()
+    );
+
+    // One line, like the graph prelude. The guard is a temporary of the routed call's
+    // full-expression, so the assumption ends with the call even if it throws.
+    rewriter_.InsertTextBefore(insert_loc,
+        "extern \"C\" { __attribute__((weak)) void parallax_pool_assume_begin(unsigned int); "
+        "__attribute__((weak)) void parallax_pool_assume_end(void); } "
+        "namespace { struct __plx_pool_assume { explicit __plx_pool_assume(unsigned int m) "
+        "{ if (parallax_pool_assume_begin) parallax_pool_assume_begin(m); } "
+        "~__plx_pool_assume() { if (parallax_pool_assume_end) parallax_pool_assume_end(); } }; }\n");
+
+    llvm::errs() << "[ParallaxRewriter] Injected pool-residency prelude\n";
+
+    pool_assume_prelude_included_ = true;
+}
+
+void ParallaxRewriter::ensureScratchPrelude() {
+    if (scratch_prelude_included_) return;
+
+    clang::SourceLocation insert_loc = SM_.getLocForStartOfFile(
+        SM_.getMainFileID()
+    );
+
+    // Skeleton temporaries (transform_reduce scratch, remove_if staging, sort padding)
+    // come from a size-class pool that persists across calls. The runtime's arena owns
+    // it when it exports parallax_scratch_acquire/release; otherwise this TU keeps one
+    // cached arena block per power-of-two class (4 KiB and up), taken and returned with
+    // an atomic exchange, so a reduction in a loop allocates once. Uninitialized: every
+    // skeleton writes its scratch before reading it.
+    rewriter_.InsertTextBefore(insert_loc,
+        "extern \"C\" { __attribute__((weak)) void* parallax_scratch_acquire(unsigned long long, unsigned long long); "
+        "__attribute__((weak)) void parallax_scratch_release(void*, unsigned long long); } "
+        "namespace { inline void*& __plx_scratch_slot(unsigned c) { static void* s[64]; return s[c]; } "
+        "inline unsigned __plx_scratch_class(unsigned long long b) { unsigned c = 12; while (c < 63 && (1ull << c) < b) ++c; return c; } "
+        "inline void* __plx_scratch_get(unsigned long long b) { "
+        "if (parallax_scratch_acquire) return parallax_scratch_acquire(b, 16); "
+        "unsigned c = __plx_scratch_class(b); "
+        "void* p = __atomic_exchange_n(&__plx_scratch_slot(c), (void*)0, __ATOMIC_ACQ_REL); "
+        "return p ? p : parallax_arena_alloc(1ull << c, 16); } "
+        "inline void __plx_scratch_put(void* p, unsigned long long b) { if (!p) return; "
+        "if (parallax_scratch_release) { parallax_scratch_release(p, b); return; } "
+        "void* old = __atomic_exchange_n(&__plx_scratch_slot(__plx_scratch_class(b)), p, __ATOMIC_ACQ_REL); "
+        "if (old) parallax_arena_free(old); } }\n");
+
+    llvm::errs() << "[ParallaxRewriter] Injected pooled scratch prelude\n";
+
+    scratch_prelude_included_ = true;
+}
+
+void ParallaxRewriter::ensureAdaptPrelude() {
+    if (adapt_prelude_included_) return;
+
+    clang::SourceLocation insert_loc = SM_.getLocForStartOfFile(
+        SM_.getMainFileID()
+    );
+
+    // Per call site and log2 size bucket: warm up by alternating GPU and CPU (the first
+    // run of each side is discarded as cold), then lock in the side with the lower
+    // moving-average time, re-probing the other side every 128th call. Decisions
+    // change only on a measured flip and are reported through the weak
+    // parallax_adapt_decision(site, bucket, gpu). choice: 0 undecided, 1 CPU, 2 GPU.
+    // Relaxed atomics: racing calls may lose a sample, never tear one.
+    rewriter_.InsertTextBefore(insert_loc,
+        "extern \"C\" __attribute__((weak)) void parallax_adapt_decision(unsigned long long, unsigned int, int); "
+        "namespace { struct __plx_adapt_site { unsigned long long id; unsigned long long cyc[48][2]; "
+        "unsigned char samples[48][2]; signed char choice[48]; unsigned int calls[48]; }; "
+        "inline unsigned int __plx_adapt_bucket(unsigned long long n) { unsigned int b = 0; "
+        "while (b < 47 && (2ull << b) <= n) ++b; return b; } "
+        "inline bool __plx_adapt_pick(__plx_adapt_site& s, unsigned long long n) { "
+        "unsigned int b = __plx_adapt_bucket(n); "
+        "unsigned char sg = __atomic_load_n(&s.samples[b][1], __ATOMIC_RELAXED), sc = __atomic_load_n(&s.samples[b][0], __ATOMIC_RELAXED); "
+        "if (sg < 3 || sc < 3) return sg <= sc; "
+        "const bool gpu = __atomic_load_n(&s.choice[b], __ATOMIC_RELAXED) == 2; "
+        "return ((__atomic_add_fetch(&s.calls[b], 1u, __ATOMIC_RELAXED) & 127u) == 0) ? !gpu : gpu; } "
+        "struct __plx_adapt_timer { __plx_adapt_site& s; unsigned long long n, t0; bool gpu; "
+        "__plx_adapt_timer(__plx_adapt_site& s_, unsigned long long n_, bool g) "
+        ": s(s_), n(n_), t0(__builtin_readcyclecounter()), gpu(g) {} "
+        "~__plx_adapt_timer() { unsigned long long dt = __builtin_readcyclecounter() - t0; "
+        "unsigned int b = __plx_adapt_bucket(n); int side = gpu ? 1 : 0; "
+        "unsigned char cnt = __atomic_load_n(&s.samples[b][side], __ATOMIC_RELAXED); "
+        "unsigned long long old = __atomic_load_n(&s.cyc[b][side], __ATOMIC_RELAXED); "
+        "if (cnt) __atomic_store_n(&s.cyc[b][side], cnt == 1 ? dt : (3 * old + dt) / 4, __ATOMIC_RELAXED); "
+        "if (cnt < 255) __atomic_store_n(&s.samples[b][side], (unsigned char)(cnt + 1), __ATOMIC_RELAXED); "
+        "if (__atomic_load_n(&s.samples[b][0], __ATOMIC_RELAXED) >= 3 && __atomic_load_n(&s.samples[b][1], __ATOMIC_RELAXED) >= 3) { "
+        "signed char c = __atomic_load_n(&s.cyc[b][1], __ATOMIC_RELAXED) < __atomic_load_n(&s.cyc[b][0], __ATOMIC_RELAXED) ? 2 : 1; "
+        "if (__atomic_exchange_n(&s.choice[b], c, __ATOMIC_RELAXED) != c && parallax_adapt_decision) "
+        "parallax_adapt_decision(s.id, b, c == 2); } } }; }\n");
+
+    llvm::errs() << "[ParallaxRewriter] Injected adaptive dispatch prelude\n";
+
+    adapt_prelude_included_ = true;
+}
+
 std::string ParallaxRewriter::generateMemberCaptureCode(const ClassContext& class_ctx, clang::CallExpr* call_expr) {
     std::ostringstream ss;
     
@@ -1148,11 +2627,21 @@ public:
     }
 
     void dispatchFunnel(clang::FunctionDecl* spec, const std::string& qn) {
+        if (spec && isAnyFunnel(qn) &&
+            (!pluginOptions().profile_generate.empty() || !pluginOptions().profile_use.empty()))
+            rewriter_.emitProfileHooks(clang::PredefinedExpr::ComputeName(
+                clang::PredefinedIdentKind::PrettyFunction, spec));
         if (isFunnelTemplate(qn)) processDeviceInvoke(spec);
         else if (isFixedKernelFunnel(qn)) processFixedKernel(spec, qn);
         else if (isTransformReduceFunnel(qn)) processTransformReduce(spec);
         else if (isCountIfFunnel(qn)) processCountIf(spec);
         else if (isCompactionFunnel(qn)) processCompactionFunnel(spec, qn);
+        else if (qn == "parallax::ExecutionPolicyImpl::for_each_impl" ||
+                 qn == "parallax::ExecutionPolicyImpl::transform_impl" ||
+                 qn == "parallax::ExecutionPolicyImpl::reduce_impl" ||
+                 qn == "parallax::exec::detail::device_bulk" ||
+                 qn == "parallax::exec::detail::device_map")
+            processPolicyImpl(spec, qn);
     }
 
     bool VisitFunctionDecl(clang::FunctionDecl* FD) {
@@ -1201,6 +2690,8 @@ public:
             clang::PredefinedIdentKind::PrettyFunction, FD);
         if (!seen_funnel_keys_.insert(key).second) return;
 
+        const uint64_t es = context_.getTypeSizeInChars(elemT).getQuantity();
+
         SPIRVGenerator gen;
         gen.set_target_vulkan_version(1, 2);
         if (qn == "parallax::detail::device_scan") {
@@ -1214,8 +2705,20 @@ public:
             }
             llvm::errs() << "[ParallaxFunnel] device_scan<" << elemT.getAsString() << "> "
                          << scan_spv.size() << "+" << add_spv.size() << " SPIR-V words; registering\n";
-            rewriter_.emitFunnelRegistrar(key + ":scan", scan_spv);
-            rewriter_.emitFunnelRegistrar(key + ":add", add_spv);
+            if (!emitLinkedStages(key, {{"scan", scan_spv}, {"add", add_spv}})) {
+                rewriter_.emitFunnelRegistrar(key + ":scan", scan_spv);
+                rewriter_.emitFunnelRegistrar(key + ":add", add_spv);
+            }
+            rewriter_.emitScratchDescriptor(key, 0, es);  // blocksums
+            emitTunedRegistrars(key, "scan", ek, {{":scan", tunedScan}, {":add", tunedScanAdd}});
+            if (streamVariantsEnabled()) {
+                emitStreamRegistrar(key + ":scan", streamKernel(&SPIRVGenerator::generate_scan_kernel, ek));
+                emitStreamRegistrar(key + ":add", streamKernel(&SPIRVGenerator::generate_scan_add_kernel, ek));
+            }
+            if (wideVariantsEnabled()) {
+                emitWideRegistrar(key + ":scan", wideKernel(&SPIRVGenerator::generate_scan_kernel, ek));
+                emitWideRegistrar(key + ":add", wideKernel(&SPIRVGenerator::generate_scan_add_kernel, ek));
+            }
             return;
         }
         if (qn == "parallax::detail::device_exclusive_scan") {
@@ -1233,9 +2736,26 @@ public:
             llvm::errs() << "[ParallaxFunnel] device_exclusive_scan<" << elemT.getAsString() << "> "
                          << scan_spv.size() << "+" << add_spv.size() << "+" << shift_spv.size()
                          << " SPIR-V words; registering\n";
-            rewriter_.emitFunnelRegistrar(key + ":scan", scan_spv);
-            rewriter_.emitFunnelRegistrar(key + ":add", add_spv);
-            rewriter_.emitFunnelRegistrar(key + ":shift", shift_spv);
+            if (!emitLinkedStages(key, {{"scan", scan_spv}, {"add", add_spv}, {"shift", shift_spv}})) {
+                rewriter_.emitFunnelRegistrar(key + ":scan", scan_spv);
+                rewriter_.emitFunnelRegistrar(key + ":add", add_spv);
+                rewriter_.emitFunnelRegistrar(key + ":shift", shift_spv);
+            }
+            rewriter_.emitScratchDescriptor(key, es, es);  // shifted copy + blocksums
+            emitTunedRegistrars(key, "scan", ek,
+                                {{":scan", tunedScan}, {":add", tunedScanAdd}, {":shift", tunedShift}});
+            if (streamVariantsEnabled()) {
+                SPIRVGenerator hs; hs.set_target_vulkan_version(1, 2); hs.set_stream_base(true);
+                emitStreamRegistrar(key + ":scan", streamKernel(&SPIRVGenerator::generate_scan_kernel, ek));
+                emitStreamRegistrar(key + ":add", streamKernel(&SPIRVGenerator::generate_scan_add_kernel, ek));
+                emitStreamRegistrar(key + ":shift", hs.generate_exclusive_shift_kernel(ek));
+            }
+            if (wideVariantsEnabled()) {
+                SPIRVGenerator hw; hw.set_target_vulkan_version(1, 2); hw.set_wide_index(true);
+                emitWideRegistrar(key + ":scan", wideKernel(&SPIRVGenerator::generate_scan_kernel, ek));
+                emitWideRegistrar(key + ":add", wideKernel(&SPIRVGenerator::generate_scan_add_kernel, ek));
+                emitWideRegistrar(key + ":shift", hw.generate_exclusive_shift_kernel(ek));
+            }
             return;
         }
         const bool is_sort = qn == "parallax::detail::device_sort";
@@ -1245,36 +2765,103 @@ public:
                      << elemT.getAsString() << "> " << spirv.size()
                      << " SPIR-V words; registering\n  key=" << key << "\n";
         rewriter_.emitFunnelRegistrar(key, spirv);
+        // Sort pads to the next power of two (< 2n); reduce keeps one partial per group.
+        if (is_sort) rewriter_.emitScratchDescriptor(key, 2 * es, 0);
+        else rewriter_.emitScratchDescriptor(key, 0, es);
+        if (is_sort) emitTunedRegistrars(key, "sort", ek, {{"", tunedSort}});
+        else emitTunedRegistrars(key, "reduce", ek, {{"", tunedReduce}});
+        // Sort needs the whole range resident; only the reduce streams.
+        if (!is_sort && streamVariantsEnabled())
+            emitStreamRegistrar(key, streamKernel(&SPIRVGenerator::generate_reduce_kernel, ek));
+        // Bitonic sort of > 2^32 elements is left to the host; the reduce goes wide.
+        if (!is_sort && wideVariantsEnabled())
+            emitWideRegistrar(key, wideKernel(&SPIRVGenerator::generate_reduce_kernel, ek));
+    }
+
+    // Generic lambda's operator() is a FunctionTemplateDecl (methods() hides it);
+    // use getLambdaCallOperator, then pick the concrete operator()<T&> instantiation.
+    clang::CXXMethodDecl* resolveCallOperator(clang::CXXRecordDecl* functor) {
+        clang::CXXMethodDecl* op_call =
+            functor->isLambda() ? functor->getLambdaCallOperator()
+                                : getFunctionCallOperator(functor);
+        if (!op_call) return nullptr;
+        if (clang::FunctionTemplateDecl* ft = op_call->getDescribedFunctionTemplate()) {
+            clang::CXXMethodDecl* concrete = nullptr;
+            for (clang::FunctionDecl* s : ft->specializations())
+                if (s->hasBody()) { concrete = llvm::dyn_cast<clang::CXXMethodDecl>(s); break; }
+            if (concrete) op_call = concrete;
+        }
+        return op_call;
+    }
+
+    // ExecutionPolicyImpl::{for_each,transform,reduce}_impl<..., F>, and the sender
+    // steps exec::detail::device_{bulk,map}<T, F> (sender.hpp): no kernel is built
+    // here; LambdaCompiler JIT-compiles F at its first call, so embed F's body for it
+    // (PARALLAX_EMBED_BITCODE). The element type is reduce's T, else the callable's
+    // parameter type.
+    void processPolicyImpl(clang::FunctionDecl* FD, const std::string& qn) {
+        static const bool enabled = std::getenv("PARALLAX_EMBED_BITCODE") != nullptr;
+        if (!enabled || !FD) return;
+        const clang::TemplateArgumentList* targs = FD->getTemplateSpecializationArgs();
+        if (!targs || targs->size() < 2 ||
+            targs->get(targs->size() - 1).getKind() != clang::TemplateArgument::Type)
+            return;
+        clang::QualType funcT = targs->get(targs->size() - 1).getAsType();
+        std::string type_name = typeidName(funcT);
+        clang::CXXRecordDecl* functor = funcT->getAsCXXRecordDecl();
+        if (type_name.empty() || !functor || !seen_funnel_keys_.insert("bitcode:" + type_name).second)
+            return;
+        clang::CXXMethodDecl* op_call = resolveCallOperator(functor);
+        if (!op_call || !op_call->hasBody() || op_call->getNumParams() < 1) return;
+        clang::QualType elemT = op_call->getParamDecl(0)->getType().getNonReferenceType();
+        if (qn == "parallax::ExecutionPolicyImpl::reduce_impl" &&
+            targs->get(1).getKind() == clang::TemplateArgument::Type)
+            elemT = targs->get(1).getAsType();
+        auto module = ir_generator_.generateIR(op_call, context_);
+        if (!module) {
+            llvm::errs() << "[ParallaxFunnel] " << qn << ": callable codegen failed; no JIT body\n";
+            return;
+        }
+        rewriter_.emitEmbeddedBitcode(type_name, elemT.getUnqualifiedType().getAsString(), *module);
+    }
+
+    // typeid(T).name() as the runtime will see it: the Itanium RTTI name minus "_ZTS".
+    // Empty under other ABIs.
+    std::string typeidName(clang::QualType t) {
+        std::unique_ptr<clang::MangleContext> mangler(context_.createMangleContext());
+        std::string rtti;
+        llvm::raw_string_ostream ros(rtti);
+        mangler->mangleCXXRTTIName(t.getUnqualifiedType(), ros);
+        ros.flush();
+        return llvm::StringRef(rtti).starts_with("_ZTS") ? rtti.substr(4) : std::string();
     }
 
     // Compile a functor's operator() (applied to an element of type elemT) to a SPIR-V
     // kernel. generate_from_lambda auto-detects for_each (void -> in-place) vs transform
     // (non-void -> in/out) from the return type. predicate_count: a T->bool predicate
     // becomes a transform storing int 1/0 per element (so a '+' reduce yields the count).
-    // Returns empty on any failure.
+    // Returns empty on any failure. A non-empty host_key (the kernel's registrar key)
+    // also emits the body's host-native loop under that key (PARALLAX_HOST_KERNELS; see
+    // emitHostKernel), its placement hint (see emitPlacementHint) and, for plain
+    // for_each/transform bodies, the embedded bitcode (see emitEmbeddedBitcode).
+    // stream_spirv, if given, receives the out-of-core variant of the same body (push
+    // base offset; see SPIRVGenerator::set_stream_base), or stays empty; wide_spirv
+    // likewise receives its 64-bit index variant (SPIRVGenerator::set_wide_index).
     std::vector<uint32_t> compileFunctorKernel(clang::QualType funcT, clang::QualType elemT,
                                                bool predicate_count = false,
                                                bool predicate_flags = false,
-                                               bool predicate_negate = false) {
+                                               bool predicate_negate = false,
+                                               const std::string& host_key = std::string(),
+                                               std::vector<uint32_t>* stream_spirv = nullptr,
+                                               std::vector<uint32_t>* wide_spirv = nullptr) {
         std::vector<uint32_t> spirv;
         clang::CXXRecordDecl* functor = funcT->getAsCXXRecordDecl();
         if (!functor) {
             llvm::errs() << "[ParallaxFunnel] F not a record (" << funcT.getAsString() << ")\n";
             return spirv;
         }
-        // Generic lambda's operator() is a FunctionTemplateDecl (methods() hides it);
-        // use getLambdaCallOperator, then pick the concrete operator()<T&> instantiation.
-        clang::CXXMethodDecl* op_call =
-            functor->isLambda() ? functor->getLambdaCallOperator()
-                                : getFunctionCallOperator(functor);
-        if (!op_call) return spirv;
-        if (clang::FunctionTemplateDecl* ft = op_call->getDescribedFunctionTemplate()) {
-            clang::CXXMethodDecl* concrete = nullptr;
-            for (clang::FunctionDecl* s : ft->specializations())
-                if (s->hasBody()) { concrete = llvm::dyn_cast<clang::CXXMethodDecl>(s); break; }
-            if (concrete) op_call = concrete;
-        }
-        if (!op_call->hasBody()) return spirv;
+        clang::CXXMethodDecl* op_call = resolveCallOperator(functor);
+        if (!op_call || !op_call->hasBody()) return spirv;
         auto module = ir_generator_.generateIR(op_call, context_);
         if (!module) return spirv;
         llvm::Function* kf = nullptr;
@@ -1282,13 +2869,153 @@ public:
             if (f.getName().str().rfind("kernel_", 0) == 0) { kf = &f; break; }
         if (!kf) for (auto& f : *module) if (!f.isDeclaration()) { kf = &f; break; }
         if (!kf) return spirv;
-        SPIRVGenerator gen;
-        gen.set_target_vulkan_version(1, 2);
-        if (predicate_count) gen.set_predicate_count(true);
-        if (predicate_flags) gen.set_predicate_flags(true);
-        if (predicate_negate) gen.set_predicate_negate(true);
+        if (!host_key.empty() && !elemT->isIncompleteType()) {
+            // Before SPIR-V generation: the host twin clones the body as extracted.
+            clang::QualType et = elemT.getUnqualifiedType();
+            llvm::LLVMContext& lctx = kf->getContext();
+            llvm::Type* elem_ty = nullptr;
+            if (et->isRealFloatingType())
+                elem_ty = context_.getTypeSize(et) >= 64 ? llvm::Type::getDoubleTy(lctx)
+                                                         : llvm::Type::getFloatTy(lctx);
+            else if (et->isIntegerType())
+                elem_ty = llvm::Type::getIntNTy(lctx, context_.getTypeSize(et));
+            HostKernelGenerator::Mode mode;
+            mode.predicate_count = predicate_count;
+            mode.predicate_flags = predicate_flags;
+            mode.predicate_negate = predicate_negate;
+            rewriter_.emitHostKernel(host_key, kf,
+                static_cast<unsigned>(context_.getTypeSizeInChars(et).getQuantity()),
+                elem_ty, mode);
+        }
+        if (!host_key.empty() && !predicate_count && !predicate_flags) {
+            std::string type_name = typeidName(funcT);
+            if (!type_name.empty())
+                rewriter_.emitEmbeddedBitcode(type_name, elemT.getUnqualifiedType().getAsString(),
+                                              *module);
+        }
         std::vector<std::string> pt = {elemT.getUnqualifiedType().getAsString() + "&"};
-        return gen.generate_from_lambda(kf, pt);
+        auto generate = [&](bool stream, bool wide = false) {
+            SPIRVGenerator gen;
+            gen.set_target_vulkan_version(1, 2);
+            if (predicate_count) gen.set_predicate_count(true);
+            if (predicate_flags) gen.set_predicate_flags(true);
+            if (predicate_negate) gen.set_predicate_negate(true);
+            if (stream) gen.set_stream_base(true);
+            if (wide) gen.set_wide_index(true);
+            auto words = gen.generate_from_lambda(kf, pt);
+            if (!stream && !wide && !words.empty() && !host_key.empty())
+                rewriter_.emitPlacementHint(host_key, gen.input_readonly() ? 1u : 0u,
+                                            gen.readonly_capture_mask(),
+                                            gen.written_capture_mask());
+            return words;
+        };
+        spirv = generate(false);
+        if (stream_spirv && !spirv.empty()) *stream_spirv = generate(true);
+        if (wide_spirv && !spirv.empty()) *wide_spirv = generate(false, true);
+        return spirv;
+    }
+
+    // PARALLAX_STREAM=1: register out-of-core streaming variants beside the resident
+    // kernels under the same key + ":stream" (after any kernel suffix). Off by default,
+    // like the :wide twins, so ordinary builds don't carry a second module per kernel.
+    static bool streamVariantsEnabled() {
+        static const bool on = std::getenv("PARALLAX_STREAM") != nullptr;
+        return on;
+    }
+    static std::vector<uint32_t> streamKernel(
+            std::vector<uint32_t> (SPIRVGenerator::*gen_fn)(SPIRVGenerator::ReduceElemType, llvm::Function*),
+            SPIRVGenerator::ReduceElemType ek) {
+        SPIRVGenerator g; g.set_target_vulkan_version(1, 2); g.set_stream_base(true);
+        return (g.*gen_fn)(ek, nullptr);
+    }
+    void emitStreamRegistrar(const std::string& key, const std::vector<uint32_t>& spirv) {
+        if (spirv.empty()) {
+            llvm::errs() << "[ParallaxFunnel] no streaming variant for " << key << "; resident only\n";
+            return;
+        }
+        rewriter_.emitFunnelRegistrar(key + ":stream", spirv, /*prewarm=*/false);
+    }
+
+    // PARALLAX_WIDE_INDEX=1: register each kernel's 64-bit count/index twin under the
+    // same key + ":wide" (after any kernel suffix). The runtime keeps the 32-bit
+    // kernel as the fast path and launches the twin only when n exceeds 2^32 - 1,
+    // with count as a uint64 and the groups folded into a 2D grid (see
+    // SPIRVGenerator::set_wide_index). Predicate, sort and compaction kernels have none.
+    static bool wideVariantsEnabled() {
+        static const bool on = std::getenv("PARALLAX_WIDE_INDEX") != nullptr;
+        return on;
+    }
+    static std::vector<uint32_t> wideKernel(
+            std::vector<uint32_t> (SPIRVGenerator::*gen_fn)(SPIRVGenerator::ReduceElemType, llvm::Function*),
+            SPIRVGenerator::ReduceElemType ek) {
+        SPIRVGenerator g; g.set_target_vulkan_version(1, 2); g.set_wide_index(true);
+        return (g.*gen_fn)(ek, nullptr);
+    }
+    void emitWideRegistrar(const std::string& key, const std::vector<uint32_t>& spirv) {
+        if (spirv.empty()) {
+            llvm::errs() << "[ParallaxFunnel] no wide-index variant for " << key << "; 32-bit only\n";
+            return;
+        }
+        rewriter_.emitFunnelRegistrar(key + ":wide", spirv, /*prewarm=*/false);
+    }
+
+    // Tuning database with different winners per size bucket: register each stage
+    // again per bucket, built for that bucket's LocalSize, under key + stage +
+    // ":n<log2_n>". The runtime launches the twin of the largest bucket <= log2(n), or
+    // the smallest bucket's for n below all of them; the base kernel (largest
+    // bucket's size) serves runtimes that do not look twins up.
+    using TunedStage = std::vector<uint32_t> (*)(SPIRVGenerator&, SPIRVGenerator::ReduceElemType);
+    void emitTunedRegistrars(const std::string& key, const char* skeleton,
+                             SPIRVGenerator::ReduceElemType ek,
+                             std::initializer_list<std::pair<const char*, TunedStage>> stages) {
+        const std::vector<unsigned> buckets = SPIRVGenerator::tuned_buckets(skeleton, ek);
+        if (buckets.size() < 2) return;
+        for (unsigned b : buckets)
+            for (const auto& st : stages) {
+                SPIRVGenerator g; g.set_target_vulkan_version(1, 2); g.set_size_bucket(b);
+                std::vector<uint32_t> words = st.second(g, ek);
+                if (!words.empty())
+                    rewriter_.emitFunnelRegistrar(key + st.first + ":n" + std::to_string(b), words,
+                                                  /*prewarm=*/false);
+            }
+    }
+    static std::vector<uint32_t> tunedReduce(SPIRVGenerator& g, SPIRVGenerator::ReduceElemType ek) {
+        return g.generate_reduce_kernel(ek);
+    }
+    static std::vector<uint32_t> tunedScan(SPIRVGenerator& g, SPIRVGenerator::ReduceElemType ek) {
+        return g.generate_scan_kernel(ek);
+    }
+    static std::vector<uint32_t> tunedScanAdd(SPIRVGenerator& g, SPIRVGenerator::ReduceElemType ek) {
+        return g.generate_scan_add_kernel(ek);
+    }
+    static std::vector<uint32_t> tunedShift(SPIRVGenerator& g, SPIRVGenerator::ReduceElemType ek) {
+        return g.generate_exclusive_shift_kernel(ek);
+    }
+    static std::vector<uint32_t> tunedSort(SPIRVGenerator& g, SPIRVGenerator::ReduceElemType ek) {
+        return g.generate_sort_kernel(ek);
+    }
+
+    // PARALLAX_LINK_STAGES=1: register a skeleton's stages as ONE module under
+    // key + ":module", one OpEntryPoint per stage named by its suffix ("scan", "add",
+    // ...), sharing capabilities, types and constants. The runtime then creates one
+    // VkShaderModule per skeleton and a pipeline per entry point. Streaming twins stay
+    // separate. Returns false (caller registers the stages separately) when disabled
+    // or when the linker meets an instruction it cannot renumber.
+    bool emitLinkedStages(const std::string& key,
+                          const std::vector<std::pair<std::string, std::vector<uint32_t>>>& stages) {
+        static const bool enabled = std::getenv("PARALLAX_LINK_STAGES") != nullptr;
+        if (!enabled) return false;
+        std::vector<uint32_t> linked = SPIRVGenerator::link_entry_points(stages);
+        if (linked.empty()) {
+            llvm::errs() << "[ParallaxFunnel] stage link failed; separate modules\n  key=" << key << "\n";
+            return false;
+        }
+        size_t separate = 0;
+        for (const auto& st : stages) separate += st.second.size();
+        llvm::errs() << "[ParallaxFunnel] linked " << stages.size() << " stages: " << separate
+                     << " -> " << linked.size() << " SPIR-V words\n";
+        rewriter_.emitFunnelRegistrar(key + ":module", linked);
+        return true;
     }
 
     // device_count_if<T,Pred>: a predicate-count transform kernel (Pred -> int 1/0) under
@@ -1305,7 +3032,8 @@ public:
         std::string key = clang::PredefinedExpr::ComputeName(
             clang::PredefinedIdentKind::PrettyFunction, FD);
         if (!seen_funnel_keys_.insert(key).second) return;
-        auto pspv = compileFunctorKernel(funcT, elemT, /*predicate_count=*/true);
+        auto pspv = compileFunctorKernel(funcT, elemT, /*predicate_count=*/true,
+                                         false, false, key + ":pred");
         SPIRVGenerator rgen; rgen.set_target_vulkan_version(1, 2);
         auto rspv = rgen.generate_reduce_kernel(SPIRVGenerator::ReduceElemType::I32);
         if (pspv.empty() || rspv.empty()) {
@@ -1313,8 +3041,12 @@ public:
         }
         llvm::errs() << "[ParallaxFunnel] device_count_if<" << elemT.getAsString() << "> "
                      << pspv.size() << "+" << rspv.size() << " SPIR-V words; registering\n";
-        rewriter_.emitFunnelRegistrar(key + ":pred", pspv);
-        rewriter_.emitFunnelRegistrar(key + ":reduce", rspv);
+        if (!emitLinkedStages(key, {{"pred", pspv}, {"reduce", rspv}})) {
+            rewriter_.emitFunnelRegistrar(key + ":pred", pspv);
+            rewriter_.emitFunnelRegistrar(key + ":reduce", rspv);
+        }
+        rewriter_.emitScratchDescriptor(key, 4, 4);  // int flags + partials
+        emitTunedRegistrars(key, "reduce", SPIRVGenerator::ReduceElemType::I32, {{":reduce", tunedReduce}});
     }
 
     // device_copy_if<T,Pred> / device_remove_if<T,Pred> / device_partition<T,Pred> /
@@ -1357,7 +3089,8 @@ public:
                 llvm::errs() << "[ParallaxFunnel] compaction: missing predicate arg; host\n"; return;
             }
             clang::QualType predT = targs->get(targs->size() - 1).getAsType();
-            flags = compileFunctorKernel(predT, elemT, /*count=*/false, /*flags=*/true, /*negate=*/is_remove);
+            flags = compileFunctorKernel(predT, elemT, /*count=*/false, /*flags=*/true, /*negate=*/is_remove,
+                                         key + ":flags");
         }
         SPIRVGenerator gs; gs.set_target_vulkan_version(1, 2);
         SPIRVGenerator ga; ga.set_target_vulkan_version(1, 2);
@@ -1369,95 +3102,863 @@ public:
         if (flags.empty() || scan.empty() || add.empty() || scat.empty()) {
             llvm::errs() << "[ParallaxFunnel] compaction codegen failed; host fallback\n"; return;
         }
-        llvm::errs() << "[ParallaxFunnel] " << qn << "<" << elemT.getAsString() << "> "
-                     << flags.size() << "+" << scan.size() << "+" << add.size() << "+"
-                     << scat.size() << " SPIR-V words; registering\n";
-        rewriter_.emitFunnelRegistrar(key + ":flags", flags);
-        rewriter_.emitFunnelRegistrar(key + ":scan", scan);
-        rewriter_.emitFunnelRegistrar(key + ":add", add);
-        rewriter_.emitFunnelRegistrar(key + ":scatter", scat);
+        llvm::errs() << "[ParallaxFunnel] " << qn << "<" << elemT.getAsString() << "> "
+                     << flags.size() << "+" << scan.size() << "+" << add.size() << "+"
+                     << scat.size() << " SPIR-V words; registering\n";
+        if (!emitLinkedStages(key, {{"flags", flags}, {"scan", scan}, {"add", add}, {"scatter", scat}})) {
+            rewriter_.emitFunnelRegistrar(key + ":flags", flags);
+            rewriter_.emitFunnelRegistrar(key + ":scan", scan);
+            rewriter_.emitFunnelRegistrar(key + ":add", add);
+            rewriter_.emitFunnelRegistrar(key + ":scatter", scat);
+        }
+        // flags + scanned positions (element-typed) + their blocksums
+        rewriter_.emitScratchDescriptor(key, 2 * (esz / 8), esz / 8);
+        emitTunedRegistrars(key, "scan", ek, {{":scan", tunedScan}, {":add", tunedScanAdd}});
+    }
+
+    // Compile one device_invoke<T,F> / device_transform<Tin,Tout,F> instantiation to
+    // SPIR-V and register it under the instantiation's __PRETTY_FUNCTION__. The functor
+    // is the LAST type template arg; the element type is the first.
+    void processDeviceInvoke(clang::FunctionDecl* FD) {
+        if (!FD) return;
+        const clang::TemplateArgumentList* targs = FD->getTemplateSpecializationArgs();
+        if (!targs || targs->size() < 2) return;
+        const unsigned func_idx = targs->size() - 1;  // functor is last
+        if (targs->get(0).getKind() != clang::TemplateArgument::Type ||
+            targs->get(func_idx).getKind() != clang::TemplateArgument::Type)
+            return;
+        clang::QualType elemT = targs->get(0).getAsType();
+        clang::QualType funcT = targs->get(func_idx).getAsType();
+        std::string key = clang::PredefinedExpr::ComputeName(
+            clang::PredefinedIdentKind::PrettyFunction, FD);
+        if (!seen_funnel_keys_.insert(key).second) return;
+        std::vector<uint32_t> stream, wide;
+        auto spirv = compileFunctorKernel(funcT, elemT, false, false, false, key,
+                                          streamVariantsEnabled() ? &stream : nullptr,
+                                          wideVariantsEnabled() ? &wide : nullptr);
+        if (spirv.empty()) {
+            llvm::errs() << "[ParallaxFunnel] functor codegen failed; host fallback\n  key=" << key << "\n";
+            return;
+        }
+        llvm::errs() << "[ParallaxFunnel] " << FD->getQualifiedNameAsString() << " "
+                     << spirv.size() << " SPIR-V words; registering\n  key=" << key << "\n";
+        rewriter_.emitFunnelRegistrar(key, spirv);
+        if (streamVariantsEnabled()) emitStreamRegistrar(key, stream);
+        if (wideVariantsEnabled()) emitWideRegistrar(key, wide);
+    }
+
+    // device_transform_reduce<T,U,F>: a transform kernel (from F, T->U) PLUS a reduce
+    // kernel (for U), registered under ":xform" and ":reduce".
+    void processTransformReduce(clang::FunctionDecl* FD) {
+        if (!FD) return;
+        const clang::TemplateArgumentList* targs = FD->getTemplateSpecializationArgs();
+        if (!targs || targs->size() < 3) return;
+        for (unsigned i = 0; i < 3; ++i)
+            if (targs->get(i).getKind() != clang::TemplateArgument::Type) return;
+        clang::QualType elemT = targs->get(0).getAsType();
+        clang::QualType accT  = targs->get(1).getAsType();
+        clang::QualType funcT = targs->get(2).getAsType();
+        SPIRVGenerator::ReduceElemType ek;
+        if (accT->isRealFloatingType())
+            ek = context_.getTypeSize(accT) >= 64 ? SPIRVGenerator::ReduceElemType::F64
+                                                  : SPIRVGenerator::ReduceElemType::F32;
+        else if (accT->isIntegerType())
+            ek = context_.getTypeSize(accT) >= 64 ? SPIRVGenerator::ReduceElemType::I64
+                                                  : SPIRVGenerator::ReduceElemType::I32;
+        else { llvm::errs() << "[ParallaxFunnel] transform_reduce: unsupported accum type\n"; return; }
+
+        std::string key = clang::PredefinedExpr::ComputeName(
+            clang::PredefinedIdentKind::PrettyFunction, FD);
+        if (!seen_funnel_keys_.insert(key).second) return;
+        std::vector<uint32_t> xstream, xwide;
+        auto xspv = compileFunctorKernel(funcT, elemT, false, false, false,
+                                         key + ":xform",  // T -> U transform (non-void)
+                                         streamVariantsEnabled() ? &xstream : nullptr,
+                                         wideVariantsEnabled() ? &xwide : nullptr);
+        SPIRVGenerator rgen; rgen.set_target_vulkan_version(1, 2);
+        auto rspv = rgen.generate_reduce_kernel(ek);
+        if (xspv.empty() || rspv.empty()) {
+            llvm::errs() << "[ParallaxFunnel] transform_reduce codegen failed; host fallback\n"; return;
+        }
+        llvm::errs() << "[ParallaxFunnel] device_transform_reduce<" << elemT.getAsString()
+                     << "," << accT.getAsString() << "> " << xspv.size() << "+" << rspv.size()
+                     << " SPIR-V words; registering\n";
+        if (!emitLinkedStages(key, {{"xform", xspv}, {"reduce", rspv}})) {
+            rewriter_.emitFunnelRegistrar(key + ":xform", xspv);
+            rewriter_.emitFunnelRegistrar(key + ":reduce", rspv);
+        }
+        const uint64_t as = context_.getTypeSizeInChars(accT).getQuantity();
+        rewriter_.emitScratchDescriptor(key, as, as);  // transformed values + partials
+        emitTunedRegistrars(key, "reduce", ek, {{":reduce", tunedReduce}});
+        if (streamVariantsEnabled()) {
+            emitStreamRegistrar(key + ":xform", xstream);
+            emitStreamRegistrar(key + ":reduce", streamKernel(&SPIRVGenerator::generate_reduce_kernel, ek));
+        }
+        if (wideVariantsEnabled()) {
+            emitWideRegistrar(key + ":xform", xwide);
+            emitWideRegistrar(key + ":reduce", wideKernel(&SPIRVGenerator::generate_reduce_kernel, ek));
+        }
+    }
+
+    // std::<name>(policy, ...) with nargs args, whether resolved (concrete call) or
+    // dependent (inside a generic wrapper, callee = UnresolvedLookupExpr).
+    bool isStdAlgoWithPolicy(clang::CallExpr* call, const char* name, unsigned nargs) {
+        if (!call || call->getNumArgs() != nargs) return false;
+        if (auto* fd = call->getDirectCallee())
+            return fd->getQualifiedNameAsString() == std::string("std::") + name;
+        const clang::Expr* callee =
+            call->getCallee() ? call->getCallee()->IgnoreImplicit() : nullptr;
+        if (auto* ule = llvm::dyn_cast_or_null<clang::UnresolvedLookupExpr>(callee))
+            return ule->getName().getAsString() == name;
+        return false;
+    }
+
+    // The transparent routing table: std::<name>(policy, ...) with exactly nargs args
+    // is rewritten to <target>, which funnels through the device_* templates.
+    struct RouteEntry { const char* name; unsigned nargs; const char* target; };
+    static constexpr RouteEntry kRoutes[] = {
+        {"for_each", 4, "parallax::for_each"},
+        {"transform", 5, "parallax::transform"},              // unary transform
+        {"fill", 4, "parallax::fill"},                        // fill(par, first, last, value)
+        {"generate", 4, "parallax::generate"},                // generate(par, first, last, gen)
+        {"reduce", 4, "parallax::reduce"},                    // reduce(par, first, last, init)
+        {"sort", 3, "parallax::sort"},                        // sort(par, first, last)
+        {"inclusive_scan", 4, "parallax::inclusive_scan"},    // inclusive_scan(par, first, last, d_first)
+        {"exclusive_scan", 5, "parallax::exclusive_scan"},    // exclusive_scan(par, first, last, d_first, init)
+        // Compaction family — funnelled so it offloads in GENERIC wrappers (unlike the
+        // concrete-only collector path, which still handles direct concrete-type calls).
+        {"copy_if", 5, "parallax::copy_if"},                  // copy_if(par, first, last, d_first, pred)
+        {"remove_if", 4, "parallax::remove_if"},              // remove_if(par, first, last, pred)
+        {"partition", 4, "parallax::partition"},              // partition(par, first, last, pred)
+        {"unique", 3, "parallax::unique"},                    // unique(par, first, last)
+        {"transform_reduce", 6, "parallax::transform_reduce"},  // (par,f,l,init,binop,unop)
+        // count_if/all_of/any_of/none_of -> predicate-count transform + I32 reduce.
+        // (all_of/any_of/none_of derive from count_if; they offload when the predicate
+        // is captureless, else fall back to the host cleanly.)
+        {"count_if", 4, "parallax::count_if"},
+        {"all_of", 4, "parallax::all_of"},
+        {"any_of", 4, "parallax::any_of"},
+        {"none_of", 4, "parallax::none_of"},
+    };
+
+    // The parallax:: target a std:: policy call is routed to, or nullptr if the call
+    // is not one the transparent path handles.
+    const char* routeTargetFor(clang::CallExpr* call) {
+        for (const RouteEntry& r : kRoutes)
+            if (isStdAlgoWithPolicy(call, r.name, r.nargs)) return r.target;
+        return nullptr;
+    }
+
+    // Command-buffer capture/replay for iterative loops. A time-stepping loop whose
+    // body is ONLY routed parallel calls plus pure host scalar code issues the same
+    // dispatch sequence every iteration; only push-constant values (counts, captured
+    // scalars) change. Such a loop body gets a capture scope (see
+    // ParallaxRewriter::emitGraphReplayScope): the runtime records the sequence on the
+    // first iteration and resubmits the recorded command buffer thereafter, patching
+    // push constants, like a CUDA graph. Any host side effect we cannot see through
+    // (a non-routed call, a store through a pointer, a non-scalar local, early exit)
+    // disqualifies the loop, so a replayed iteration can never skip host work.
+    bool VisitForStmt(clang::ForStmt* loop) {
+        if (!loop) return true;
+        unsigned calls = 0;
+        if (loop->getInit() && !isReplayableStmt(loop->getInit(), calls)) return true;
+        if (loop->getCond() && !isPureScalarExpr(loop->getCond(), calls)) return true;
+        if (loop->getInc() && !isPureScalarExpr(loop->getInc(), calls)) return true;
+        if (calls != 0) return true;  // routed calls in the loop header: not a steady body
+        considerReplayLoop(loop->getBeginLoc(), loop->getBody());
+        return true;
+    }
+    bool VisitWhileStmt(clang::WhileStmt* loop) {
+        unsigned calls = 0;
+        if (loop && isPureScalarExpr(loop->getCond(), calls) && calls == 0)
+            considerReplayLoop(loop->getBeginLoc(), loop->getBody());
+        return true;
+    }
+    bool VisitDoStmt(clang::DoStmt* loop) {
+        unsigned calls = 0;
+        if (loop && isPureScalarExpr(loop->getCond(), calls) && calls == 0)
+            considerReplayLoop(loop->getBeginLoc(), loop->getBody());
+        return true;
+    }
+
+    void considerReplayLoop(clang::SourceLocation loc, clang::Stmt* body) {
+        static const bool plx_transparent = std::getenv("PARALLAX_TRANSPARENT") != nullptr;
+        static const bool no_graph = std::getenv("PARALLAX_NO_GRAPH") != nullptr;
+        if (!plx_transparent || no_graph) return;
+        auto* cs = llvm::dyn_cast_or_null<clang::CompoundStmt>(body);
+        if (!cs || cs->body_empty()) return;
+        // Main-file loops only: the scope helper is declared in the main file's prelude.
+        clang::SourceManager& SM = context_.getSourceManager();
+        if (loc.isMacroID() || !SM.isInMainFile(loc)) return;
+        unsigned calls = 0;
+        for (clang::Stmt* s : cs->body())
+            if (!isReplayableStmt(s, calls)) return;
+        if (calls == 0) return;
+        clang::PresumedLoc ploc = SM.getPresumedLoc(loc);
+        if (ploc.isInvalid()) return;
+        std::string key = ParallaxRewriter::siteKey(ploc);
+        rewriter_.emitGraphReplayScope(cs, key, calls);
+    }
+
+    // A statement a replayed iteration may contain. Routed calls are counted in 'calls'.
+    bool isReplayableStmt(clang::Stmt* s, unsigned& calls) {
+        if (!s) return true;
+        if (llvm::isa<clang::NullStmt>(s)) return true;
+        if (auto* cs = llvm::dyn_cast<clang::CompoundStmt>(s)) {
+            for (clang::Stmt* c : cs->body())
+                if (!isReplayableStmt(c, calls)) return false;
+            return true;
+        }
+        if (auto* ds = llvm::dyn_cast<clang::DeclStmt>(s)) {
+            for (clang::Decl* d : ds->decls()) {
+                auto* vd = llvm::dyn_cast<clang::VarDecl>(d);
+                if (!vd || vd->isStaticLocal() || !vd->getType()->isScalarType() ||
+                    vd->getType()->isPointerType())
+                    return false;
+                // An already-inserted capture scope (re-run over rewritten source).
+                if (vd->getName().starts_with("__plx_graph")) return false;
+                if (vd->hasInit() && !isPureScalarExpr(vd->getInit(), calls)) return false;
+            }
+            return true;
+        }
+        if (auto* is = llvm::dyn_cast<clang::IfStmt>(s)) {
+            if (is->getInit() || is->getConditionVariable()) return false;
+            return isPureScalarExpr(is->getCond(), calls) &&
+                   isReplayableStmt(is->getThen(), calls) &&
+                   isReplayableStmt(is->getElse(), calls);
+        }
+        if (auto* e = llvm::dyn_cast<clang::Expr>(s)) return isPureScalarExpr(e, calls);
+        return false;  // nested loops, return/break/goto, try, asm, ...
+    }
+
+    // Scalar arithmetic over locals and literals, plus routed calls as leaves. No other
+    // calls, no memory access through pointers/containers, no volatile.
+    bool isPureScalarExpr(clang::Expr* e, unsigned& calls) {
+        if (!e) return true;
+        e = e->IgnoreParenImpCasts();
+        if (auto* fe = llvm::dyn_cast<clang::FullExpr>(e)) return isPureScalarExpr(fe->getSubExpr(), calls);
+        if (auto* call = llvm::dyn_cast<clang::CallExpr>(e)) {
+            if (!routeTargetFor(call)) return false;
+            ++calls;
+            return true;
+        }
+        if (e->getType().isVolatileQualified()) return false;
+        if (!e->getType()->isScalarType() && !e->getType()->isVoidType()) return false;
+        if (e->getType()->isPointerType()) return false;
+        if (llvm::isa<clang::IntegerLiteral, clang::FloatingLiteral, clang::CXXBoolLiteralExpr,
+                      clang::CharacterLiteral>(e))
+            return true;
+        if (auto* dre = llvm::dyn_cast<clang::DeclRefExpr>(e)) {
+            if (llvm::isa<clang::EnumConstantDecl>(dre->getDecl())) return true;
+            auto* vd = llvm::dyn_cast<clang::VarDecl>(dre->getDecl());
+            return vd && vd->isLocalVarDeclOrParm() && !vd->getType()->isReferenceType();
+        }
+        if (auto* bo = llvm::dyn_cast<clang::BinaryOperator>(e)) {
+            if (bo->getOpcode() == clang::BO_Comma) return false;
+            return isPureScalarExpr(bo->getLHS(), calls) && isPureScalarExpr(bo->getRHS(), calls);
+        }
+        if (auto* uo = llvm::dyn_cast<clang::UnaryOperator>(e)) {
+            if (uo->getOpcode() == clang::UO_Deref || uo->getOpcode() == clang::UO_AddrOf)
+                return false;
+            return isPureScalarExpr(uo->getSubExpr(), calls);
+        }
+        if (auto* co = llvm::dyn_cast<clang::ConditionalOperator>(e))
+            return isPureScalarExpr(co->getCond(), calls) &&
+                   isPureScalarExpr(co->getTrueExpr(), calls) &&
+                   isPureScalarExpr(co->getFalseExpr(), calls);
+        if (auto* ce = llvm::dyn_cast<clang::ExplicitCastExpr>(e))
+            return isPureScalarExpr(ce->getSubExpr(), calls);
+        return false;
+    }
+
+    // Dependency-annotated launch batches. Adjacent routed calls in one block run
+    // strictly in order today, with a full barrier between dispatches even when they
+    // touch disjoint containers. For each maximal run of adjacent, discarded-result
+    // routed calls we compute every call's read/write container sets (iterator tracing
+    // + by-reference captures) and wrap the run in a batch scope carrying, per call, a
+    // bitmask of the earlier calls it depends on (RAW/WAR/WAW). The runtime may then
+    // submit independent dispatches without barriers between them (or on separate
+    // queues); the scope's end is a full barrier, so host code after the run sees
+    // every result. Anything we cannot attribute to a named local container (pointers,
+    // references that may alias, 'this' captures, opaque functors) orders the call
+    // after everything before it.
+    struct AccessSet {
+        std::set<const clang::VarDecl*> reads, writes;
+        bool unknown = false;  // may touch anything: depends on / is depended on by all
+    };
+
+    bool VisitCompoundStmt(clang::CompoundStmt* block) {
+        static const bool plx_transparent = std::getenv("PARALLAX_TRANSPARENT") != nullptr;
+        static const bool no_batch = std::getenv("PARALLAX_NO_BATCH") != nullptr;
+        static const bool no_residency = std::getenv("PARALLAX_NO_RESIDENCY") != nullptr;
+        if (!plx_transparent || !block) return true;
+        if (!no_batch) collectLaunchBatches(block);
+        // After batching: the residency handle is then inserted ahead of a batch's '{'.
+        if (!no_residency) analyzeResidency(block);
+        return true;
+    }
+
+    void collectLaunchBatches(clang::CompoundStmt* block) {
+        clang::SourceManager& SM = context_.getSourceManager();
+        std::vector<clang::Stmt*> run;
+        std::vector<AccessSet> sets;
+        auto flush = [&]() {
+            if (run.size() >= 2) emitBatchIfUseful(run, sets);
+            run.clear(); sets.clear();
+        };
+        for (clang::Stmt* s : block->body()) {
+            AccessSet as;
+            if (s->getBeginLoc().isMacroID() || !SM.isInMainFile(s->getBeginLoc()) ||
+                !batchableCallAccess(s, as)) {
+                flush();
+                continue;
+            }
+            if (run.size() == 32) flush();  // deps are 32-bit masks
+            run.push_back(s);
+            sets.push_back(std::move(as));
+        }
+        flush();
+    }
+
+    static bool conflicts(const AccessSet& a, const AccessSet& b) {
+        if (a.unknown || b.unknown) return true;
+        auto meets = [](const std::set<const clang::VarDecl*>& x,
+                        const std::set<const clang::VarDecl*>& y) {
+            for (const clang::VarDecl* v : x) if (y.count(v)) return true;
+            return false;
+        };
+        return meets(a.writes, b.writes) || meets(a.writes, b.reads) || meets(a.reads, b.writes);
+    }
+
+    void emitBatchIfUseful(const std::vector<clang::Stmt*>& run, const std::vector<AccessSet>& sets) {
+        std::vector<unsigned> deps(run.size(), 0u);
+        bool any_independent = false;
+        for (size_t i = 1; i < run.size(); ++i) {
+            for (size_t j = 0; j < i; ++j)
+                if (conflicts(sets[i], sets[j])) deps[i] |= 1u << j;
+            // Call i is free to overlap something earlier unless it depends on ALL of them.
+            if (deps[i] != (1u << i) - 1u) any_independent = true;
+        }
+        if (!any_independent) return;  // a pure chain: batching would only add overhead
+        clang::SourceManager& SM = context_.getSourceManager();
+        clang::PresumedLoc ploc = SM.getPresumedLoc(run.front()->getBeginLoc());
+        if (ploc.isInvalid()) return;
+        std::string key = ParallaxRewriter::siteKey(ploc);
+        clang::SourceLocation after = clang::Lexer::findLocationAfterToken(
+            run.back()->getEndLoc(), clang::tok::semi, SM, CI_.getLangOpts(),
+            /*SkipTrailingWhitespaceAndNewLine=*/false);
+        if (after.isInvalid()) return;
+        rewriter_.emitLaunchBatch(run.front()->getBeginLoc(), after, key, deps);
+    }
+
+    // A statement that is a routed, discarded-result call whose accesses we can model.
+    // Value-returning calls (reduce, count_if, compaction) need their result on the host
+    // immediately, so they end a batch instead of joining it.
+    bool batchableCallAccess(clang::Stmt* s, AccessSet& as) {
+        auto* e = llvm::dyn_cast<clang::Expr>(s);
+        if (!e) return false;
+        if (auto* fe = llvm::dyn_cast<clang::FullExpr>(e)) e = fe->getSubExpr();
+        auto* call = llvm::dyn_cast<clang::CallExpr>(e->IgnoreParenImpCasts());
+        if (!call || call->isInstantiationDependent()) return false;
+        const char* target = routeTargetFor(call);
+        if (!target) return false;
+        llvm::StringRef t(target);
+        if (t != "parallax::for_each" && t != "parallax::sort" && t != "parallax::fill" &&
+            t != "parallax::generate" && t != "parallax::transform" &&
+            t != "parallax::inclusive_scan" && t != "parallax::exclusive_scan")
+            return false;
+        RoutedShape shape = routedShape(t);
+        for (const auto& ca : shape.containers) {
+            const clang::VarDecl* vd = traceIteratorToContainer(call->getArg(ca.first));
+            // Pointers, references and views (spans, iterator locals) may alias any other
+            // container: only a range traced to the storage itself names what it touches.
+            if (!ownsStorage(vd))
+                as.unknown = true;
+            else if (ca.second)
+                as.writes.insert(vd);
+            else
+                as.reads.insert(vd);
+        }
+        if (shape.callable) addCallableAccess(call->getArg(call->getNumArgs() - 1), as);
+        return true;
+    }
+
+    // What a routed call touches: the iterator arguments that open a container range
+    // (arg index, written?) and whether the last argument is a callable whose
+    // captures the kernel may access. The range's end iterator (arg 2) is implied.
+    struct RoutedShape {
+        std::vector<std::pair<unsigned, bool>> containers;
+        bool callable = false;
+    };
+    static RoutedShape routedShape(llvm::StringRef t) {
+        RoutedShape s;
+        if (t == "parallax::for_each" || t == "parallax::generate") {
+            s.containers = {{1, true}}; s.callable = true;
+        } else if (t == "parallax::sort" || t == "parallax::fill" || t == "parallax::unique") {
+            s.containers = {{1, true}};
+        } else if (t == "parallax::transform" || t == "parallax::copy_if") {
+            s.containers = {{1, false}, {3, true}}; s.callable = true;
+        } else if (t == "parallax::inclusive_scan" || t == "parallax::exclusive_scan") {
+            s.containers = {{1, false}, {3, true}};
+        } else if (t == "parallax::remove_if" || t == "parallax::partition") {
+            s.containers = {{1, true}}; s.callable = true;
+        } else if (t == "parallax::reduce") {
+            s.containers = {{1, false}};
+        } else {  // transform_reduce, count_if, all_of/any_of/none_of
+            s.containers = {{1, false}}; s.callable = true;
+        }
+        return s;
+    }
+
+    // A variable that is itself the storage it names: a vector/deque or a fixed array,
+    // not a pointer, reference, span, iterator or other view that could alias another.
+    bool ownsStorage(const clang::VarDecl* vd) {
+        if (!vd || vd->getType()->isPointerType() || vd->getType()->isReferenceType())
+            return false;
+        const RangeOrigin::Kind kind = originOfType(vd).kind;
+        return kind == RangeOrigin::Container || kind == RangeOrigin::FixedArray;
+    }
+
+    // By-reference captures may be read or written by the kernel: count them as writes.
+    // By-value scalar captures are copied into push constants and touch no container; a
+    // container copied by value is only read. Any other capture (a span, an iterator,
+    // a view) can write through to storage it does not name, so it may touch anything.
+    void addCallableAccess(clang::Expr* fn, AccessSet& as) {
+        clang::LambdaExpr* lambda = unwrapLambda(fn);
+        if (!lambda) {
+            if (auto* dre = llvm::dyn_cast<clang::DeclRefExpr>(fn->IgnoreParenImpCasts()))
+                if (auto* vd = llvm::dyn_cast<clang::VarDecl>(dre->getDecl()))
+                    if (vd->hasInit()) lambda = unwrapLambda(const_cast<clang::Expr*>(vd->getInit()));
+        }
+        if (!lambda) {
+            const clang::CXXRecordDecl* rd = fn->getType()->getAsCXXRecordDecl();
+            if (!rd || !rd->hasDefinition() || !rd->field_empty()) as.unknown = true;
+            return;
+        }
+        for (const clang::LambdaCapture& cap : lambda->captures()) {
+            if (!cap.capturesVariable()) { as.unknown = true; return; }  // this / VLA
+            auto* vd = llvm::dyn_cast<clang::VarDecl>(cap.getCapturedVar());
+            if (!vd) { as.unknown = true; return; }
+            clang::QualType ty = vd->getType();
+            if (ty->isPointerType() || ty->isReferenceType()) { as.unknown = true; return; }
+            if (!ty->isScalarType() && !ownsStorage(vd)) { as.unknown = true; return; }
+            if (cap.getCaptureKind() == clang::LCK_ByRef) as.writes.insert(vd);
+            else if (!ty->isScalarType()) as.reads.insert(vd);  // container copied by value
+        }
+    }
+
+    // Device residency across routed calls. On a discrete GPU (and for data outside the
+    // imported pool) every routed call stages its containers on its own: upload before
+    // the dispatch, copy back after it. For each local container a block's routed
+    // calls reach we compute its live range over the block's statements — first device
+    // use, last device use, host accesses in between — and emit acquire/host/release
+    // hints (ParallaxRewriter::emitResidencyRange), so the data stays on the device
+    // between calls and is copied back only before a host statement touches it. A loop
+    // or nested block counts as a device use when every mention of the container in
+    // it is a routed call's iterator range or a by-reference kernel capture. If the
+    // container's address escapes (pointer, reference or iterator locals, '&v', a
+    // non-kernel lambda capturing it by reference), or a statement mixes host and
+    // device use of it, the container keeps today's per-call staging.
+    enum class Use { None, Device, Host, Mixed };
+
+    static Use combineUse(Use a, Use b) {
+        if (a == Use::None) return b;
+        if (b == Use::None || a == b) return a;
+        return Use::Mixed;
+    }
+
+    void analyzeResidency(clang::CompoundStmt* block) {
+        clang::SourceManager& SM = context_.getSourceManager();
+        if (block->body_empty() || block->getLBracLoc().isMacroID() ||
+            !SM.isInMainFile(block->getLBracLoc()))
+            return;
+        // A declaration ahead of a case label or goto target could be jumped over.
+        for (clang::Stmt* s : block->body())
+            if (llvm::isa<clang::SwitchCase, clang::LabelStmt>(s)) return;
+        std::vector<const clang::VarDecl*> candidates;
+        collectRoutedContainers(block, candidates);
+        std::vector<clang::Stmt*> stmts(block->body_begin(), block->body_end());
+        for (const clang::VarDecl* vd : candidates) {
+            if (!residencyCandidate(vd) || coveredByEnclosing(vd, block) || escapes(vd)) continue;
+            std::vector<Use> uses(stmts.size(), Use::None);
+            unsigned weight = 0;
+            int first = -1, last = -1;
+            bool mixed = false;
+            for (size_t i = 0; i < stmts.size() && !mixed; ++i) {
+                uses[i] = classifyUse(stmts[i], vd, weight);
+                if (uses[i] == Use::Mixed) mixed = true;
+                if (uses[i] == Use::Device) { if (first < 0) first = int(i); last = int(i); }
+            }
+            // One plain call has nothing to share residency with.
+            if (mixed || first < 0 || weight < 2) continue;
+
+            std::vector<std::pair<clang::SourceLocation, bool>> host_at;
+            clang::SourceLocation release_at;
+            bool macro = stmts[first]->getBeginLoc().isMacroID();
+            for (int i = first + 1; i < int(stmts.size()) && !macro; ++i) {
+                if (uses[i] != Use::Host) continue;
+                macro = stmts[i]->getBeginLoc().isMacroID();
+                if (i < last) {
+                    host_at.emplace_back(stmts[i]->getBeginLoc(), hostMayWrite(stmts[i], vd));
+                } else {
+                    release_at = stmts[i]->getBeginLoc();
+                    break;
+                }
+            }
+            if (macro) continue;
+            clang::PresumedLoc ploc = SM.getPresumedLoc(stmts[first]->getBeginLoc());
+            if (ploc.isInvalid()) continue;
+            std::string key = ParallaxRewriter::siteKey(ploc) + ":" + vd->getNameAsString();
+            resident_ranges_.push_back({vd, clang::SourceRange(stmts[first]->getBeginLoc(),
+                                                               stmts[last]->getEndLoc())});
+            rewriter_.emitResidencyRange(stmts[first]->getBeginLoc(), key, vd->getNameAsString(),
+                                         host_at, release_at);
+        }
+    }
+
+    // Containers opened directly (v.begin(), std::begin(v), v.data()) by any routed
+    // call inside s. Kernel lambda bodies are not searched.
+    void collectRoutedContainers(clang::Stmt* s, std::vector<const clang::VarDecl*>& out) {
+        if (!s || llvm::isa<clang::LambdaExpr>(s)) return;
+        if (auto* call = llvm::dyn_cast<clang::CallExpr>(s)) {
+            if (const char* target = routeTargetFor(call)) {
+                for (const auto& ca : routedShape(target).containers)
+                    if (ca.first < call->getNumArgs())
+                        if (const clang::VarDecl* vd = directContainerOf(call->getArg(ca.first)))
+                            if (std::find(out.begin(), out.end(), vd) == out.end()) out.push_back(vd);
+            }
+        }
+        for (clang::Stmt* c : s->children()) collectRoutedContainers(c, out);
+    }
+
+    // The container an iterator argument opens, only when named directly: v.begin(),
+    // v.end(), v.data(), std::begin(v)/std::end(v), optionally +/- an offset.
+    // (traceIteratorToContainer also looks through arrays[i].begin(), which names the
+    // outer array rather than the buffer the kernel touches.)
+    const clang::VarDecl* directContainerOf(clang::Expr* it) {
+        clang::Expr* e = it ? it->IgnoreImplicit() : nullptr;
+        for (int guard = 0; e && guard < 8; ++guard) {
+            if (auto* bo = llvm::dyn_cast<clang::BinaryOperator>(e)) {
+                if (bo->getOpcode() != clang::BO_Add && bo->getOpcode() != clang::BO_Sub) return nullptr;
+                e = bo->getLHS()->IgnoreImplicit();
+            } else if (auto* oc = llvm::dyn_cast<clang::CXXOperatorCallExpr>(e)) {
+                if (oc->getOperator() != clang::OO_Plus && oc->getOperator() != clang::OO_Minus) break;
+                e = oc->getArg(0)->IgnoreImplicit();
+            } else {
+                break;
+            }
+        }
+        clang::Expr* obj = nullptr;
+        if (auto* mc = llvm::dyn_cast_or_null<clang::CXXMemberCallExpr>(e)) {
+            clang::CXXMethodDecl* md = mc->getMethodDecl();
+            if (md && md->getIdentifier() &&
+                (md->getName() == "begin" || md->getName() == "end" || md->getName() == "data"))
+                obj = mc->getImplicitObjectArgument();
+        } else if (auto* ce = llvm::dyn_cast_or_null<clang::CallExpr>(e)) {
+            if (auto* fd = ce->getDirectCallee()) {
+                std::string n = fd->getQualifiedNameAsString();
+                if ((n == "std::begin" || n == "std::end") && ce->getNumArgs() == 1) obj = ce->getArg(0);
+            }
+        }
+        if (!obj) return nullptr;
+        auto* dre = llvm::dyn_cast<clang::DeclRefExpr>(obj->IgnoreImplicit());
+        return dre ? llvm::dyn_cast<clang::VarDecl>(dre->getDecl()) : nullptr;
+    }
+
+    // A local (or by-value parameter) contiguous container: a class with data()/size().
+    bool residencyCandidate(const clang::VarDecl* vd) {
+        if (!vd->hasLocalStorage() || vd->getType()->isReferenceType() ||
+            vd->getType().isVolatileQualified())
+            return false;
+        const clang::CXXRecordDecl* rd = vd->getType()->getAsCXXRecordDecl();
+        if (!rd || !rd->hasDefinition()) return false;
+        auto has = [&](const char* name) {
+            return !rd->lookup(&context_.Idents.get(name)).empty();
+        };
+        return has("data") && has("size");
+    }
+
+    bool coveredByEnclosing(const clang::VarDecl* vd, clang::CompoundStmt* block) {
+        clang::SourceManager& SM = context_.getSourceManager();
+        for (const auto& r : resident_ranges_)
+            if (r.first == vd && !SM.isBeforeInTranslationUnit(block->getLBracLoc(), r.second.getBegin()) &&
+                !SM.isBeforeInTranslationUnit(r.second.getEnd(), block->getLBracLoc()))
+                return true;
+        return false;
+    }
+
+    static void collectRefs(clang::Stmt* s, const clang::VarDecl* vd,
+                            std::vector<const clang::DeclRefExpr*>& out) {
+        if (!s) return;
+        if (auto* dre = llvm::dyn_cast<clang::DeclRefExpr>(s))
+            if (dre->getDecl() == vd) out.push_back(dre);
+        for (clang::Stmt* c : s->children()) collectRefs(c, vd, out);
+    }
+
+    // The parent of e, looking through parens and implicit casts.
+    const clang::Stmt* semanticParent(const clang::Stmt* e) {
+        for (;;) {
+            auto parents = context_.getParents(*e);
+            if (parents.size() != 1) return nullptr;
+            const clang::Stmt* p = parents[0].get<clang::Stmt>();
+            if (p && (llvm::isa<clang::ParenExpr>(p) || llvm::isa<clang::ImplicitCastExpr>(p) ||
+                      llvm::isa<clang::MaterializeTemporaryExpr>(p))) {
+                e = p;
+                continue;
+            }
+            return p;
+        }
+    }
+
+    // Could another name reach vd's storage after the statement that mentions it? Any
+    // pointer/reference/iterator local initialized from it, '&v', or a lambda holding
+    // it by reference that is not a routed call's kernel.
+    bool escapes(const clang::VarDecl* vd) {
+        const auto* dc = llvm::dyn_cast<clang::FunctionDecl>(vd->getDeclContext());
+        clang::Stmt* body = dc ? dc->getBody() : nullptr;
+        if (!body) return true;
+        std::vector<const clang::DeclRefExpr*> refs;
+        collectRefs(body, vd, refs);
+        for (const clang::DeclRefExpr* dre : refs) {
+            const clang::Stmt* p = semanticParent(dre);
+            if (auto* uo = llvm::dyn_cast_or_null<clang::UnaryOperator>(p))
+                if (uo->getOpcode() == clang::UO_AddrOf) return true;
+            // Climb to the enclosing declaration, if any (stopping at a lambda).
+            const clang::Stmt* cur = dre;
+            for (int guard = 0; cur && guard < 64; ++guard) {
+                auto parents = context_.getParents(*cur);
+                if (parents.size() != 1) break;
+                if (const auto* var = parents[0].get<clang::VarDecl>()) {
+                    clang::QualType t = var->getType();
+                    if (var != vd && (t->isPointerType() || t->isReferenceType() ||
+                        (t->isRecordType() && !context_.hasSameUnqualifiedType(t, vd->getType()))))
+                        return true;
+                    break;
+                }
+                const clang::Stmt* ps = parents[0].get<clang::Stmt>();
+                if (!ps || llvm::isa<clang::LambdaExpr>(ps)) break;
+                cur = ps;
+            }
+        }
+        std::vector<const clang::LambdaExpr*> lambdas;
+        collectLambdas(body, lambdas);
+        for (const clang::LambdaExpr* le : lambdas)
+            for (const clang::LambdaCapture& cap : le->captures())
+                if (cap.capturesVariable() && cap.getCapturedVar() == vd &&
+                    cap.getCaptureKind() == clang::LCK_ByRef && !isRoutedKernel(le))
+                    return true;
+        return false;
+    }
+
+    static void collectLambdas(clang::Stmt* s, std::vector<const clang::LambdaExpr*>& out) {
+        if (!s) return;
+        if (auto* le = llvm::dyn_cast<clang::LambdaExpr>(s)) out.push_back(le);
+        for (clang::Stmt* c : s->children()) collectLambdas(c, out);
+    }
+
+    // The lambda is (after implicit wrappers) the callable argument of a routed call.
+    bool isRoutedKernel(const clang::LambdaExpr* le) {
+        const clang::Stmt* p = semanticParent(le);
+        for (int guard = 0; p && guard < 4 &&
+             (llvm::isa<clang::CXXBindTemporaryExpr>(p) || llvm::isa<clang::CXXConstructExpr>(p) ||
+              llvm::isa<clang::CXXFunctionalCastExpr>(p)); ++guard)
+            p = semanticParent(p);
+        auto* call = llvm::dyn_cast_or_null<clang::CallExpr>(p);
+        return call && routeTargetFor(const_cast<clang::CallExpr*>(call));
+    }
+
+    // The routed call a statement consists of: `call;`, `x = call;`, `x op= call;` or a
+    // single-variable declaration initialized by the call.
+    clang::CallExpr* routedCallOf(clang::Stmt* s) {
+        clang::Expr* e = nullptr;
+        if (auto* ds = llvm::dyn_cast<clang::DeclStmt>(s)) {
+            if (!ds->isSingleDecl()) return nullptr;
+            auto* var = llvm::dyn_cast<clang::VarDecl>(ds->getSingleDecl());
+            if (!var || !var->hasInit()) return nullptr;
+            e = const_cast<clang::Expr*>(var->getInit());
+        } else {
+            e = llvm::dyn_cast<clang::Expr>(s);
+        }
+        if (!e) return nullptr;
+        if (auto* fe = llvm::dyn_cast<clang::FullExpr>(e)) e = fe->getSubExpr();
+        e = e->IgnoreParenImpCasts();
+        if (auto* bo = llvm::dyn_cast<clang::BinaryOperator>(e))
+            if (bo->isAssignmentOp()) e = bo->getRHS()->IgnoreParenImpCasts();
+        if (auto* fe = llvm::dyn_cast<clang::FullExpr>(e)) e = fe->getSubExpr()->IgnoreParenImpCasts();
+        auto* call = llvm::dyn_cast<clang::CallExpr>(e);
+        if (!call || call->isInstantiationDependent() || !routeTargetFor(call)) return nullptr;
+        return call;
+    }
+
+    bool mentionsRoutedUse(clang::Stmt* s, const clang::VarDecl* vd) {
+        std::vector<const clang::VarDecl*> reached;
+        collectRoutedContainers(s, reached);
+        return std::find(reached.begin(), reached.end(), vd) != reached.end();
+    }
+
+    // How statement s uses vd; weight accumulates device dispatches (a loop counts twice).
+    Use classifyUse(clang::Stmt* s, const clang::VarDecl* vd, unsigned& weight) {
+        if (!s) return Use::None;
+        std::vector<const clang::DeclRefExpr*> refs;
+        collectRefs(s, vd, refs);
+        if (refs.empty()) return Use::None;
+        auto header = [&](clang::Stmt* h) {
+            std::vector<const clang::DeclRefExpr*> r;
+            collectRefs(h, vd, r);
+            return r.empty() ? Use::None : Use::Host;
+        };
+        auto loop = [&](std::initializer_list<clang::Stmt*> hdr, clang::Stmt* body) {
+            Use u = Use::None;
+            for (clang::Stmt* h : hdr) u = combineUse(u, header(h));
+            unsigned w = 0;
+            u = combineUse(u, classifyUse(body, vd, w));
+            if (w) weight += w + 2;
+            return u;
+        };
+        if (auto* cs = llvm::dyn_cast<clang::CompoundStmt>(s)) {
+            Use u = Use::None;
+            for (clang::Stmt* c : cs->body()) {
+                if (llvm::isa<clang::SwitchCase, clang::LabelStmt>(c)) return Use::Mixed;
+                u = combineUse(u, classifyUse(c, vd, weight));
+            }
+            return u;
+        }
+        if (auto* fs = llvm::dyn_cast<clang::ForStmt>(s))
+            return loop({fs->getInit(), fs->getCond(), fs->getInc()}, fs->getBody());
+        if (auto* ws = llvm::dyn_cast<clang::WhileStmt>(s))
+            return loop({ws->getCond()}, ws->getBody());
+        if (auto* ds = llvm::dyn_cast<clang::DoStmt>(s))
+            return loop({ds->getCond()}, ds->getBody());
+        if (auto* rs = llvm::dyn_cast<clang::CXXForRangeStmt>(s))
+            return loop({rs->getInit(), rs->getRangeInit()}, rs->getBody());
+        if (auto* is = llvm::dyn_cast<clang::IfStmt>(s)) {
+            Use u = combineUse(header(is->getInit()), header(is->getCond()));
+            u = combineUse(u, classifyUse(is->getThen(), vd, weight));
+            return combineUse(u, classifyUse(is->getElse(), vd, weight));
+        }
+        clang::CallExpr* call = routedCallOf(s);
+        if (!call) return mentionsRoutedUse(s, vd) ? Use::Mixed : Use::Host;
+        // Mentions inside the call's iterator ranges and by-reference kernel captures
+        // are device accesses; any other mention (an init value, a by-value capture,
+        // the assignment target) is the host's.
+        std::vector<const clang::DeclRefExpr*> dev;
+        RoutedShape shape = routedShape(routeTargetFor(call));
+        bool opens = false;
+        for (const auto& ca : shape.containers) {
+            if (ca.first >= call->getNumArgs() || directContainerOf(call->getArg(ca.first)) != vd) continue;
+            opens = true;
+            collectRefs(call->getArg(ca.first), vd, dev);
+            if (ca.first == 1 && call->getNumArgs() > 2 && directContainerOf(call->getArg(2)) == vd)
+                collectRefs(call->getArg(2), vd, dev);
+        }
+        if (shape.callable) {
+            clang::Expr* fn = call->getArg(call->getNumArgs() - 1);
+            if (clang::LambdaExpr* le = unwrapLambda(fn)) {
+                for (const clang::LambdaCapture& cap : le->captures())
+                    if (cap.capturesVariable() && cap.getCapturedVar() == vd &&
+                        cap.getCaptureKind() == clang::LCK_ByRef) {
+                        opens = true;
+                        collectRefs(le, vd, dev);
+                    }
+            }
+        }
+        if (!opens) return mentionsRoutedUse(s, vd) ? Use::Mixed : Use::Host;
+        if (dev.size() != refs.size()) return Use::Mixed;
+        ++weight;
+        return Use::Device;
     }
 
-    // Compile one device_invoke<T,F> / device_transform<Tin,Tout,F> instantiation to
-    // SPIR-V and register it under the instantiation's __PRETTY_FUNCTION__. The functor
-    // is the LAST type template arg; the element type is the first.
-    void processDeviceInvoke(clang::FunctionDecl* FD) {
-        if (!FD) return;
-        const clang::TemplateArgumentList* targs = FD->getTemplateSpecializationArgs();
-        if (!targs || targs->size() < 2) return;
-        const unsigned func_idx = targs->size() - 1;  // functor is last
-        if (targs->get(0).getKind() != clang::TemplateArgument::Type ||
-            targs->get(func_idx).getKind() != clang::TemplateArgument::Type)
-            return;
-        clang::QualType elemT = targs->get(0).getAsType();
-        clang::QualType funcT = targs->get(func_idx).getAsType();
-        std::string key = clang::PredefinedExpr::ComputeName(
-            clang::PredefinedIdentKind::PrettyFunction, FD);
-        if (!seen_funnel_keys_.insert(key).second) return;
-        auto spirv = compileFunctorKernel(funcT, elemT);
-        if (spirv.empty()) {
-            llvm::errs() << "[ParallaxFunnel] functor codegen failed; host fallback\n  key=" << key << "\n";
-            return;
+    // Conservative: false only when every mention of vd in s reads it (a const member
+    // call, a const reference binding, or an element access used as an rvalue).
+    bool hostMayWrite(clang::Stmt* s, const clang::VarDecl* vd) {
+        std::vector<const clang::DeclRefExpr*> refs;
+        collectRefs(s, vd, refs);
+        for (const clang::DeclRefExpr* dre : refs) {
+            const clang::Stmt* p = semanticParent(dre);
+            bool read = false;
+            // Const binding: the implicit cast right above the reference adds const.
+            auto parents = context_.getParents(*dre);
+            if (parents.size() == 1)
+                if (auto* ice = parents[0].get<clang::ImplicitCastExpr>())
+                    read = ice->getCastKind() == clang::CK_NoOp && ice->getType().isConstQualified();
+            const clang::Stmt* call = nullptr;
+            const clang::CXXMethodDecl* md = nullptr;
+            if (auto* me = llvm::dyn_cast_or_null<clang::MemberExpr>(p)) {
+                md = llvm::dyn_cast<clang::CXXMethodDecl>(me->getMemberDecl());
+                call = semanticParent(me);
+            } else if (auto* oc = llvm::dyn_cast_or_null<clang::CXXOperatorCallExpr>(p)) {
+                if (oc->getNumArgs() > 0 && oc->getArg(0)->IgnoreParenImpCasts() == dre) {
+                    md = llvm::dyn_cast_or_null<clang::CXXMethodDecl>(oc->getDirectCallee());
+                    call = oc;
+                }
+            }
+            if (!read && md) {
+                if (md->isConst()) {
+                    read = true;
+                } else if (call && md->getIdentifier() &&
+                           (md->getName() == "at" || md->getName() == "front" || md->getName() == "back")) {
+                    read = isRValueUse(call);
+                } else if (call && md->getOverloadedOperator() == clang::OO_Subscript) {
+                    read = isRValueUse(call);
+                }
+            }
+            if (!read) return true;
         }
-        llvm::errs() << "[ParallaxFunnel] " << FD->getQualifiedNameAsString() << " "
-                     << spirv.size() << " SPIR-V words; registering\n  key=" << key << "\n";
-        rewriter_.emitFunnelRegistrar(key, spirv);
+        return false;
     }
 
-    // device_transform_reduce<T,U,F>: a transform kernel (from F, T->U) PLUS a reduce
-    // kernel (for U), registered under ":xform" and ":reduce".
-    void processTransformReduce(clang::FunctionDecl* FD) {
-        if (!FD) return;
-        const clang::TemplateArgumentList* targs = FD->getTemplateSpecializationArgs();
-        if (!targs || targs->size() < 3) return;
-        for (unsigned i = 0; i < 3; ++i)
-            if (targs->get(i).getKind() != clang::TemplateArgument::Type) return;
-        clang::QualType elemT = targs->get(0).getAsType();
-        clang::QualType accT  = targs->get(1).getAsType();
-        clang::QualType funcT = targs->get(2).getAsType();
-        SPIRVGenerator::ReduceElemType ek;
-        if (accT->isRealFloatingType())
-            ek = context_.getTypeSize(accT) >= 64 ? SPIRVGenerator::ReduceElemType::F64
-                                                  : SPIRVGenerator::ReduceElemType::F32;
-        else if (accT->isIntegerType())
-            ek = context_.getTypeSize(accT) >= 64 ? SPIRVGenerator::ReduceElemType::I64
-                                                  : SPIRVGenerator::ReduceElemType::I32;
-        else { llvm::errs() << "[ParallaxFunnel] transform_reduce: unsupported accum type\n"; return; }
+    // The element reference an accessor returned is only loaded from.
+    bool isRValueUse(const clang::Stmt* e) {
+        auto parents = context_.getParents(*e);
+        if (parents.size() != 1) return false;
+        auto* ice = parents[0].get<clang::ImplicitCastExpr>();
+        return ice && ice->getCastKind() == clang::CK_LValueToRValue;
+    }
 
-        std::string key = clang::PredefinedExpr::ComputeName(
-            clang::PredefinedIdentKind::PrettyFunction, FD);
-        if (!seen_funnel_keys_.insert(key).second) return;
-        auto xspv = compileFunctorKernel(funcT, elemT);  // T -> U transform (non-void)
-        SPIRVGenerator rgen; rgen.set_target_vulkan_version(1, 2);
-        auto rspv = rgen.generate_reduce_kernel(ek);
-        if (xspv.empty() || rspv.empty()) {
-            llvm::errs() << "[ParallaxFunnel] transform_reduce codegen failed; host fallback\n"; return;
-        }
-        llvm::errs() << "[ParallaxFunnel] device_transform_reduce<" << elemT.getAsString()
-                     << "," << accT.getAsString() << "> " << xspv.size() << "+" << rspv.size()
-                     << " SPIR-V words; registering\n";
-        rewriter_.emitFunnelRegistrar(key + ":xform", xspv);
-        rewriter_.emitFunnelRegistrar(key + ":reduce", rspv);
+    // References to free functions; a function referenced more often than it is
+    // called has its address taken, so its parameters keep their types. Uses of
+    // container variables are kept for containerUsesFit.
+    bool VisitDeclRefExpr(clang::DeclRefExpr* ref) {
+        if (auto* fd = llvm::dyn_cast<clang::FunctionDecl>(ref->getDecl()))
+            if (!llvm::isa<clang::CXXMethodDecl>(fd)) ++fn_refs_[fd->getCanonicalDecl()];
+        if (auto* var = llvm::dyn_cast<clang::VarDecl>(ref->getDecl()))
+            if (var->getType().getNonReferenceType()->isRecordType() && isStandardContainer(var->getType()))
+                container_uses_[var].push_back(ref);
+        return true;
     }
 
-    // std::<name>(policy, ...) with nargs args, whether resolved (concrete call) or
-    // dependent (inside a generic wrapper, callee = UnresolvedLookupExpr).
-    bool isStdAlgoWithPolicy(clang::CallExpr* call, const char* name, unsigned nargs) {
-        if (!call || call->getNumArgs() != nargs) return false;
-        if (auto* fd = call->getDirectCallee())
-            return fd->getQualifiedNameAsString() == std::string("std::") + name;
-        const clang::Expr* callee =
-            call->getCallee() ? call->getCallee()->IgnoreImplicit() : nullptr;
-        if (auto* ule = llvm::dyn_cast_or_null<clang::UnresolvedLookupExpr>(callee))
-            return ule->getName().getAsString() == name;
-        return false;
+    // Uses of container fields, for containerUsesFit.
+    bool VisitMemberExpr(clang::MemberExpr* member) {
+        if (auto* field = llvm::dyn_cast<clang::FieldDecl>(member->getMemberDecl()))
+            if (field->getType()->isRecordType() && isStandardContainer(field->getType()))
+                container_uses_[field].push_back(member);
+        return true;
     }
 
+    /**
+     * After traversal: settle which fields and by-reference parameters can take the
+     * allocator (every use still compiles with the new type, and every call site of a
+     * parameter passes rewritable storage whose own uses do too).
+     */
+    void finishRanges();
+
+    /**
+     * After applyAllocatorInjections: give each routed call the mask of its arguments
+     * whose storage is pool memory as rewritten (see emitPoolAssume).
+     */
+    void finishPoolMasks();
+
     bool VisitCallExpr(clang::CallExpr* call) {
         // Debug: Log ALL call expressions to see if traversal is working
         static int call_count = 0;
         call_count++;
 
+        if (call) {
+            if (auto* fd = call->getDirectCallee())
+                if (!llvm::isa<clang::CXXMethodDecl>(fd) && !llvm::isa<clang::CXXOperatorCallExpr>(call))
+                    calls_by_callee_[fd->getCanonicalDecl()].push_back(call);
+        }
+
         if (call_count == 1) {
             llvm::errs() << "[ParallaxCollector] VisitCallExpr is being called!\n";
         }
@@ -1467,54 +3968,18 @@ public:
         // call-site codegen for it (the funnel path handles codegen on a later pass).
         static const bool plx_transparent = std::getenv("PARALLAX_TRANSPARENT") != nullptr;
         if (plx_transparent) {
-            if (isStdAlgoWithPolicy(call, "for_each", 4)) {
-                rewriter_.routeCallee(call, "parallax::for_each"); return true;
-            }
-            if (isStdAlgoWithPolicy(call, "transform", 5)) {   // unary transform
-                rewriter_.routeCallee(call, "parallax::transform"); return true;
-            }
-            if (isStdAlgoWithPolicy(call, "fill", 4)) {         // fill(par, first, last, value)
-                rewriter_.routeCallee(call, "parallax::fill"); return true;
-            }
-            if (isStdAlgoWithPolicy(call, "generate", 4)) {     // generate(par, first, last, gen)
-                rewriter_.routeCallee(call, "parallax::generate"); return true;
-            }
-            if (isStdAlgoWithPolicy(call, "reduce", 4)) {       // reduce(par, first, last, init)
-                rewriter_.routeCallee(call, "parallax::reduce"); return true;
-            }
-            if (isStdAlgoWithPolicy(call, "sort", 3)) {         // sort(par, first, last)
-                rewriter_.routeCallee(call, "parallax::sort"); return true;
-            }
-            if (isStdAlgoWithPolicy(call, "inclusive_scan", 4)) {  // inclusive_scan(par, first, last, d_first)
-                rewriter_.routeCallee(call, "parallax::inclusive_scan"); return true;
-            }
-            if (isStdAlgoWithPolicy(call, "exclusive_scan", 5)) {  // exclusive_scan(par, first, last, d_first, init)
-                rewriter_.routeCallee(call, "parallax::exclusive_scan"); return true;
-            }
-            // Compaction family — funnelled so it offloads in GENERIC wrappers (unlike the
-            // concrete-only collector path, which still handles direct concrete-type calls).
-            if (isStdAlgoWithPolicy(call, "copy_if", 5)) {    // copy_if(par, first, last, d_first, pred)
-                rewriter_.routeCallee(call, "parallax::copy_if"); return true;
-            }
-            if (isStdAlgoWithPolicy(call, "remove_if", 4)) {  // remove_if(par, first, last, pred)
-                rewriter_.routeCallee(call, "parallax::remove_if"); return true;
-            }
-            if (isStdAlgoWithPolicy(call, "partition", 4)) {  // partition(par, first, last, pred)
-                rewriter_.routeCallee(call, "parallax::partition"); return true;
-            }
-            if (isStdAlgoWithPolicy(call, "unique", 3)) {     // unique(par, first, last)
-                rewriter_.routeCallee(call, "parallax::unique"); return true;
-            }
-            if (isStdAlgoWithPolicy(call, "transform_reduce", 6)) {  // (par,f,l,init,binop,unop)
-                rewriter_.routeCallee(call, "parallax::transform_reduce"); return true;
+            if (const char* target = routeTargetFor(call)) {
+                // PARALLAX_ROUTE_ALLOCATORS=1 also moves the routed ranges' storage into
+                // the pool; either way the call learns which arguments already are.
+                static const bool route_alloc = std::getenv("PARALLAX_ROUTE_ALLOCATORS") != nullptr;
+                if (rewriter_.routeCallee(call, target)) {
+                    if (route_alloc)
+                        for (const auto& ca : routedShape(target).containers)
+                            if (ca.first < call->getNumArgs()) claimRange(call->getArg(ca.first));
+                    routed_pool_calls_.emplace_back(call, target);
+                }
+                return true;
             }
-            // count_if/all_of/any_of/none_of -> predicate-count transform + I32 reduce.
-            // (all_of/any_of/none_of derive from count_if; they offload when the predicate
-            // is captureless, else fall back to the host cleanly.)
-            if (isStdAlgoWithPolicy(call, "count_if", 4)) { rewriter_.routeCallee(call, "parallax::count_if"); return true; }
-            if (isStdAlgoWithPolicy(call, "all_of", 4))   { rewriter_.routeCallee(call, "parallax::all_of");   return true; }
-            if (isStdAlgoWithPolicy(call, "any_of", 4))   { rewriter_.routeCallee(call, "parallax::any_of");   return true; }
-            if (isStdAlgoWithPolicy(call, "none_of", 4))  { rewriter_.routeCallee(call, "parallax::none_of");  return true; }
         }
 
         if (call && call->getDirectCallee()) {
@@ -1586,10 +4051,7 @@ public:
             clang::Expr* transform_op_expr = call->getArg(5);
 
             clang::QualType elemQT;
-            if (const clang::VarDecl* c = traceIteratorToContainer(info.first_iterator)) {
-                elemQT = getContainerElementType(c->getType().getNonReferenceType());
-                if (!hasParallaxAllocator(c->getType())) rewriter_.markContainerForAllocation(c);
-            }
+            elemQT = claimRange(info.first_iterator);
             if (elemQT.isNull()) {
                 llvm::errs() << "[ParallaxCollector] transform_reduce: element type undetermined; CPU\n";
                 return true;
@@ -1684,10 +4146,7 @@ public:
             if (!info.first_iterator || !info.last_iterator) return true;
 
             clang::QualType elemQT;
-            if (const clang::VarDecl* c = traceIteratorToContainer(info.first_iterator)) {
-                elemQT = getContainerElementType(c->getType().getNonReferenceType());
-                if (!hasParallaxAllocator(c->getType())) rewriter_.markContainerForAllocation(c);
-            }
+            elemQT = claimRange(info.first_iterator);
             if (elemQT.isNull()) {
                 llvm::errs() << "[ParallaxCollector] count_if: element type undetermined; CPU\n";
                 return true;
@@ -1752,10 +4211,7 @@ public:
             info.output_iterator = info.first_iterator;  // in-place
 
             clang::QualType elemQT;
-            if (const clang::VarDecl* c = traceIteratorToContainer(info.first_iterator)) {
-                elemQT = getContainerElementType(c->getType().getNonReferenceType());
-                if (!hasParallaxAllocator(c->getType())) rewriter_.markContainerForAllocation(c);
-            }
+            elemQT = claimRange(info.first_iterator);
             SPIRVGenerator::ReduceElemType ek;
             const unsigned uesz = elemQT.isNull() ? 0 : context_.getTypeSize(elemQT);
             if (elemQT.isNull() || (uesz != 32 && uesz != 64) || !elem_kind(elemQT, ek)) {
@@ -1813,14 +4269,9 @@ public:
             }
 
             clang::QualType elemQT;
-            if (const clang::VarDecl* c = traceIteratorToContainer(info.first_iterator)) {
-                elemQT = getContainerElementType(c->getType().getNonReferenceType());
-                if (!hasParallaxAllocator(c->getType())) rewriter_.markContainerForAllocation(c);
-            }
+            elemQT = claimRange(info.first_iterator);
             if (!in_place) {
-                if (const clang::VarDecl* oc = traceIteratorToContainer(info.output_iterator)) {
-                    if (!hasParallaxAllocator(oc->getType())) rewriter_.markContainerForAllocation(oc);
-                }
+                claimRange(info.output_iterator);
             }
             // 32- or 64-bit float/int elements (the flags/scan/scatter kernels are all
             // type-parametric in ek; the predicate's element type is inferred from its
@@ -1893,10 +4344,7 @@ public:
             info.last_iterator = call->getArg(2);
 
             clang::QualType elemQT;
-            if (const clang::VarDecl* c = traceIteratorToContainer(info.first_iterator)) {
-                elemQT = getContainerElementType(c->getType().getNonReferenceType());
-                if (!hasParallaxAllocator(c->getType())) rewriter_.markContainerForAllocation(c);
-            }
+            elemQT = claimRange(info.first_iterator);
             if (elemQT.isNull()) {
                 llvm::errs() << "[ParallaxCollector] sort: element type undetermined; CPU\n";
                 return true;
@@ -1972,14 +4420,9 @@ public:
                 return true;
             }
             clang::QualType elemQT;
-            if (const clang::VarDecl* c = traceIteratorToContainer(info.first_iterator)) {
-                elemQT = getContainerElementType(c->getType().getNonReferenceType());
-                if (!hasParallaxAllocator(c->getType())) rewriter_.markContainerForAllocation(c);
-            }
+            elemQT = claimRange(info.first_iterator);
             // Also mark the output container (where the scan is written / scanned in place).
-            if (const clang::VarDecl* oc = traceIteratorToContainer(info.output_iterator)) {
-                if (!hasParallaxAllocator(oc->getType())) rewriter_.markContainerForAllocation(oc);
-            }
+            claimRange(info.output_iterator);
             if (elemQT.isNull()) {
                 llvm::errs() << "[ParallaxCollector] inclusive_scan: element type undetermined; CPU\n";
                 return true;
@@ -2056,12 +4499,7 @@ public:
             // Determine the element type from the source container (and mark it for
             // arena allocation); fall back to the init argument's type.
             clang::QualType elemQT;
-            if (const clang::VarDecl* c = traceIteratorToContainer(info.first_iterator)) {
-                elemQT = getContainerElementType(c->getType().getNonReferenceType());
-                if (!hasParallaxAllocator(c->getType())) {
-                    rewriter_.markContainerForAllocation(c);
-                }
-            }
+            elemQT = claimRange(info.first_iterator);
             if (elemQT.isNull() && info.init_expr) elemQT = info.init_expr->getType();
             if (elemQT.isNull()) {
                 llvm::errs() << "[ParallaxCollector] reduce: element type undetermined; leaving on CPU\n";
@@ -2108,6 +4546,11 @@ public:
                     llvm::errs() << "[ParallaxCollector] reduce: failed to compile binary op; leaving on CPU\n";
                     return true;
                 }
+                // The same op reached through ExecutionPolicyImpl::reduce_impl is JIT-
+                // compiled from this body (PARALLAX_EMBED_BITCODE).
+                std::string type_name = typeidName(op_lambda->getType());
+                if (!type_name.empty())
+                    rewriter_.emitEmbeddedBitcode(type_name, info.elem_type_str, *op_module);
             }
 
             SPIRVGenerator spirv_gen;
@@ -2141,46 +4584,25 @@ public:
             info.output_iterator = nullptr;
         }
 
-        // NEW: Trace iterators to containers and mark for allocator injection
-        const clang::VarDecl* first_container = nullptr;
-        const clang::VarDecl* last_container = nullptr;
-
-        if (info.first_iterator) {
-            first_container = traceIteratorToContainer(info.first_iterator);
-        }
-        if (info.last_iterator) {
-            last_container = traceIteratorToContainer(info.last_iterator);
-        }
-
-        // Validate that both iterators come from the same container
-        if (first_container && last_container && first_container == last_container) {
-            llvm::errs() << "[ParallaxCollector] Found container: "
-                         << first_container->getNameAsString() << "\n";
-
-            // Check if container already has parallax::allocator
-            clang::QualType container_type = first_container->getType();
-            if (!hasParallaxAllocator(container_type)) {
-                llvm::errs() << "[ParallaxCollector] Marking for allocator injection\n";
-                rewriter_.markContainerForAllocation(first_container);
-            } else {
-                llvm::errs() << "[ParallaxCollector] Already has parallax::allocator\n";
+        // Trace iterators to their storage and mark it for allocator injection
+        if (info.first_iterator && info.last_iterator) {
+            RangeOrigin first_origin = traceRangeOrigin(info.first_iterator);
+            RangeOrigin last_origin = traceRangeOrigin(info.last_iterator);
+
+            // Validate that both iterators come from the same container
+            if (first_origin.decl && first_origin.decl == last_origin.decl) {
+                llvm::errs() << "[ParallaxCollector] Found container: "
+                             << first_origin.decl->getNameAsString() << "\n";
+                claimRange(info.first_iterator);
+            } else if (first_origin.decl || last_origin.decl) {
+                llvm::errs() << "[ParallaxCollector] Warning: Iterators from different "
+                             << "containers or one iterator not traceable\n";
             }
-        } else if (first_container || last_container) {
-            llvm::errs() << "[ParallaxCollector] Warning: Iterators from different "
-                         << "containers or one iterator not traceable\n";
         }
 
         // For transform, also check output iterator
         if (info.algorithm_name == "transform" && info.output_iterator) {
-            const clang::VarDecl* output_container =
-                traceIteratorToContainer(info.output_iterator);
-            if (output_container) {
-                clang::QualType container_type = output_container->getType();
-                if (!hasParallaxAllocator(container_type)) {
-                    llvm::errs() << "[ParallaxCollector] Marking output container for allocator injection\n";
-                    rewriter_.markContainerForAllocation(output_container);
-                }
-            }
+            claimRange(info.output_iterator);
         }
 
         info.kernel_name = generateKernelName(info);
@@ -2348,6 +4770,8 @@ private:
     LambdaIRGenerator ir_generator_;
     ClassContextExtractor class_extractor_;
     std::unordered_set<std::string> seen_funnel_keys_;  // Layer A: dedup device_invoke instantiations
+    // Residency ranges already emitted; a nested block inside one is not re-acquired.
+    std::vector<std::pair<const clang::VarDecl*, clang::SourceRange>> resident_ranges_;
 
     bool isParallelAlgorithm(clang::CallExpr* call);
     std::string extractAlgorithmName(clang::CallExpr* call);
@@ -2362,6 +4786,44 @@ private:
 
     // NEW: Container tracking methods
     const clang::VarDecl* traceIteratorToContainer(clang::Expr* iterator_expr);
+
+    // Where an iterator range's elements live. `decl` names the storage: a vector/deque
+    // variable, field or by-reference parameter (Container), a std::array or C array
+    // (FixedArray, never pool memory), or a local pointer / unique_ptr<T[]> holding a
+    // new[] allocation (HeapArray). Spans, data() pointers, get(), +/- offsets and
+    // iterator variables are looked through to the storage they view.
+    struct RangeOrigin {
+        enum Kind { None, Container, FixedArray, HeapArray };
+        Kind kind = None;
+        const clang::DeclaratorDecl* decl = nullptr;
+    };
+    RangeOrigin traceRangeOrigin(clang::Expr* iterator_expr, int depth = 0);
+    RangeOrigin originOfObject(clang::Expr* object_expr, int depth);
+    RangeOrigin originOfType(const clang::DeclaratorDecl* decl);
+    clang::QualType claimRange(clang::Expr* iterator_expr);
+    bool isPoolResident(const RangeOrigin& origin);
+    bool neverReassigned(const clang::VarDecl* var);
+    bool poolArrayCandidate(const clang::VarDecl* var,
+                            std::vector<const clang::CXXDeleteExpr*>& deletes);
+    bool pointerValueStays(const clang::Expr* value,
+                           std::vector<const clang::CXXDeleteExpr*>* deletes, int depth);
+    bool pointerParamStays(const clang::ParmVarDecl* parm, const clang::FunctionDecl* fn, int depth);
+    bool paramFeeds(const clang::ParmVarDecl* parm, std::set<const clang::ParmVarDecl*>& seen,
+                    std::vector<const clang::DeclaratorDecl*>& feeds, std::string& why);
+    bool containerUsesFit(const clang::DeclaratorDecl* decl,
+                          const std::set<const clang::DeclaratorDecl*>& rewriting, std::string& why);
+    bool containerUseFits(const clang::Expr* use,
+                          const std::set<const clang::DeclaratorDecl*>& rewriting);
+
+    // Routed calls awaiting a pool-residency mask (finishRanges), and the call sites
+    // and references of every free function, for rewriting by-reference parameters.
+    std::vector<std::pair<clang::CallExpr*, const char*>> routed_pool_calls_;
+    std::map<const clang::FunctionDecl*, std::vector<clang::CallExpr*>> calls_by_callee_;
+    std::map<const clang::FunctionDecl*, unsigned> fn_refs_;
+    // Every reference to a container variable, parameter or field; and the declarations
+    // finishRanges found with a use that would not compile after the rewrite.
+    std::map<const clang::DeclaratorDecl*, std::vector<const clang::Expr*>> container_uses_;
+    std::set<const clang::DeclaratorDecl*> unfit_containers_;
     bool isStandardContainer(clang::QualType type);
     clang::QualType getContainerElementType(clang::QualType container_type);
     bool hasParallaxAllocator(clang::QualType type);
@@ -2616,6 +5078,625 @@ const clang::VarDecl* ParallaxCollectorVisitor::traceIteratorToContainer(clang::
     return nullptr;
 }
 
+ParallaxCollectorVisitor::RangeOrigin
+ParallaxCollectorVisitor::originOfType(const clang::DeclaratorDecl* decl) {
+    RangeOrigin origin;
+    clang::QualType type = decl->getType().getNonReferenceType();
+    if (type->isConstantArrayType()) {
+        origin.kind = RangeOrigin::FixedArray;
+        origin.decl = decl;
+        return origin;
+    }
+    const auto* record = type->getAsCXXRecordDecl();
+    const auto* spec = llvm::dyn_cast_or_null<clang::ClassTemplateSpecializationDecl>(record);
+    if (!spec) return origin;
+    std::string name = spec->getSpecializedTemplate()->getQualifiedNameAsString();
+    if (name == "std::vector" || name == "std::deque") {
+        origin.kind = RangeOrigin::Container;
+    } else if (name == "std::array") {
+        origin.kind = RangeOrigin::FixedArray;
+    } else if (name == "std::unique_ptr" && spec->getTemplateArgs().size() > 0 &&
+               spec->getTemplateArgs()[0].getKind() == clang::TemplateArgument::Type &&
+               spec->getTemplateArgs()[0].getAsType()->isArrayType()) {
+        origin.kind = RangeOrigin::HeapArray;
+    } else {
+        return origin;
+    }
+    origin.decl = decl;
+    return origin;
+}
+
+ParallaxCollectorVisitor::RangeOrigin
+ParallaxCollectorVisitor::originOfObject(clang::Expr* object_expr, int depth) {
+    if (!object_expr || depth > 6) return {};
+    clang::Expr* expr = object_expr->IgnoreParenImpCasts();
+
+    const clang::DeclaratorDecl* decl = nullptr;
+    if (auto* decl_ref = llvm::dyn_cast<clang::DeclRefExpr>(expr)) {
+        decl = llvm::dyn_cast<clang::VarDecl>(decl_ref->getDecl());
+    } else if (auto* member = llvm::dyn_cast<clang::MemberExpr>(expr)) {
+        decl = llvm::dyn_cast<clang::FieldDecl>(member->getMemberDecl());  // s.v, this->v, v
+    }
+    if (!decl) return {};
+
+    // A span views other storage: follow a local span to what it was built from.
+    clang::QualType type = decl->getType().getNonReferenceType();
+    const auto* spec = llvm::dyn_cast_or_null<clang::ClassTemplateSpecializationDecl>(
+        type->getAsCXXRecordDecl());
+    if (spec && spec->getSpecializedTemplate()->getQualifiedNameAsString() == "std::span") {
+        const auto* var = llvm::dyn_cast<clang::VarDecl>(decl);
+        if (!var || !var->hasLocalStorage() || llvm::isa<clang::ParmVarDecl>(var) ||
+            !var->hasInit() || !neverReassigned(var))
+            return {};
+        auto* construct = llvm::dyn_cast<clang::CXXConstructExpr>(
+            const_cast<clang::Expr*>(var->getInit())->IgnoreImplicit());
+        if (!construct || construct->getNumArgs() == 0) return {};
+        clang::Expr* source = construct->getArg(0);
+        if (source->getType()->isPointerType() || source->IgnoreImplicit()->getType()->isPointerType())
+            return traceRangeOrigin(source, depth + 1);  // span(ptr, n), span(v.data(), n)
+        return originOfObject(source, depth + 1);        // span(v), span(arr)
+    }
+    return originOfType(decl);
+}
+
+ParallaxCollectorVisitor::RangeOrigin
+ParallaxCollectorVisitor::traceRangeOrigin(clang::Expr* iterator_expr, int depth) {
+    if (!iterator_expr || depth > 6) return {};
+    clang::Expr* expr = iterator_expr->IgnoreParenImpCasts();
+
+    // Offsets into the range: first + k, v.data() + n, end - 1.
+    for (int guard = 0; guard < 8; ++guard) {
+        if (auto* bo = llvm::dyn_cast<clang::BinaryOperator>(expr)) {
+            if (bo->getOpcode() != clang::BO_Add && bo->getOpcode() != clang::BO_Sub) return {};
+            clang::Expr* lhs = bo->getLHS()->IgnoreParenImpCasts();
+            // k + p puts the pointer on the right.
+            expr = (bo->getOpcode() == clang::BO_Add && !lhs->getType()->isPointerType() &&
+                    !lhs->getType()->isRecordType())
+                       ? bo->getRHS()->IgnoreParenImpCasts() : lhs;
+        } else if (auto* oc = llvm::dyn_cast<clang::CXXOperatorCallExpr>(expr)) {
+            if (oc->getOperator() != clang::OO_Plus && oc->getOperator() != clang::OO_Minus) return {};
+            expr = oc->getArg(0)->IgnoreParenImpCasts();
+        } else {
+            break;
+        }
+    }
+
+    // container.begin() / .end() / .data(), span.begin(), unique_ptr.get()
+    if (auto* member_call = llvm::dyn_cast<clang::CXXMemberCallExpr>(expr)) {
+        clang::CXXMethodDecl* method = member_call->getMethodDecl();
+        if (!method || !method->getIdentifier()) return {};
+        llvm::StringRef name = method->getName();
+        if (name == "begin" || name == "end" || name == "cbegin" || name == "cend" ||
+            name == "data" || name == "get")
+            return originOfObject(member_call->getImplicitObjectArgument(), depth + 1);
+        return {};
+    }
+
+    // std::begin(c) / std::end(c) / std::data(c)
+    if (auto* call_expr = llvm::dyn_cast<clang::CallExpr>(expr)) {
+        if (auto* func_decl = call_expr->getDirectCallee()) {
+            std::string func_name = func_decl->getQualifiedNameAsString();
+            if ((func_name == "std::begin" || func_name == "std::end" ||
+                 func_name == "std::cbegin" || func_name == "std::cend" ||
+                 func_name == "std::data") && call_expr->getNumArgs() == 1)
+                return originOfObject(call_expr->getArg(0), depth + 1);
+        }
+        return {};
+    }
+
+    // A named array, pointer or iterator variable.
+    if (auto* decl_ref = llvm::dyn_cast<clang::DeclRefExpr>(expr)) {
+        auto* var = llvm::dyn_cast<clang::VarDecl>(decl_ref->getDecl());
+        if (!var) return {};
+        if (var->getType()->isConstantArrayType()) return originOfType(var);
+        if (!var->hasLocalStorage() || llvm::isa<clang::ParmVarDecl>(var) || !var->hasInit() ||
+            !neverReassigned(var))
+            return {};
+        const clang::Expr* init = var->getInit()->IgnoreImplicit();
+        if (const auto* new_expr = llvm::dyn_cast<clang::CXXNewExpr>(init)) {
+            if (!new_expr->isArray()) return {};
+            RangeOrigin origin;
+            origin.kind = RangeOrigin::HeapArray;
+            origin.decl = var;
+            return origin;
+        }
+        return traceRangeOrigin(const_cast<clang::Expr*>(var->getInit()), depth + 1);
+    }
+
+    return {};
+}
+
+clang::QualType ParallaxCollectorVisitor::claimRange(clang::Expr* iterator_expr) {
+    if (!iterator_expr) return clang::QualType();
+    RangeOrigin origin = traceRangeOrigin(iterator_expr);
+
+    if (origin.kind == RangeOrigin::Container) {
+        // Check if container already has parallax::allocator
+        if (!hasParallaxAllocator(origin.decl->getType())) {
+            llvm::errs() << "[ParallaxCollector] Marking " << origin.decl->getNameAsString()
+                         << " for allocator injection\n";
+            rewriter_.markContainerForAllocation(origin.decl);
+        } else {
+            llvm::errs() << "[ParallaxCollector] Already has parallax::allocator\n";
+        }
+    } else if (origin.kind == RangeOrigin::HeapArray) {
+        const auto* var = llvm::cast<clang::VarDecl>(origin.decl);
+        std::vector<const clang::CXXDeleteExpr*> deletes;
+        const bool pool_already = rewriter_.isMarkedForAllocation(var) ||
+            var->getType().getAsString().find("__plx_pool_deleter") != std::string::npos;
+        if (!pool_already && poolArrayCandidate(var, deletes)) {
+            llvm::errs() << "[ParallaxCollector] Marking heap array " << var->getNameAsString()
+                         << " for pool allocation\n";
+            rewriter_.markPoolArray(var, std::move(deletes));
+        }
+    }
+
+    // Pointer ranges name their element type; iterator classes go by the container.
+    clang::QualType iter_type = iterator_expr->IgnoreParens()->getType();
+    if (iter_type->isPointerType()) return iter_type->getPointeeType();
+    if (origin.decl && (origin.kind == RangeOrigin::Container || origin.kind == RangeOrigin::FixedArray))
+        return getContainerElementType(origin.decl->getType().getNonReferenceType());
+    return clang::QualType();
+}
+
+// Storage that is pool memory as written, or that applyAllocatorInjections actually
+// rewrote; a marked declaration whose rewrite was refused does not count.
+bool ParallaxCollectorVisitor::isPoolResident(const RangeOrigin& origin) {
+    if (!origin.decl) return false;
+    switch (origin.kind) {
+    case RangeOrigin::Container:
+        return hasParallaxAllocator(origin.decl->getType()) ||
+               rewriter_.isRewrittenToPool(origin.decl);
+    case RangeOrigin::HeapArray:
+        return origin.decl->getType().getAsString().find("__plx_pool_deleter") != std::string::npos ||
+               rewriter_.isRewrittenToPool(origin.decl);
+    default:
+        return false;
+    }
+}
+
+// Every use of a local only reads it: no assignment, increment, address-of or
+// non-const reference binding anywhere in its function (lambda bodies included).
+bool ParallaxCollectorVisitor::neverReassigned(const clang::VarDecl* var) {
+    const auto* fn = llvm::dyn_cast_or_null<clang::FunctionDecl>(var->getParentFunctionOrMethod());
+    if (!fn || !fn->getBody()) return false;
+    bool written = false;
+    std::function<void(const clang::Stmt*)> walk = [&](const clang::Stmt* st) {
+        if (!st || written) return;
+        if (const auto* ref = llvm::dyn_cast<clang::DeclRefExpr>(st)) {
+            if (ref->getDecl() == var) {
+                auto parents = context_.getParents(*ref);
+                const auto* cast = parents.size() == 1 ? parents[0].get<clang::ImplicitCastExpr>() : nullptr;
+                const auto* member = parents.size() == 1 ? parents[0].get<clang::MemberExpr>() : nullptr;
+                // Loads, and member calls on class-typed iterators/pointers (which the
+                // const check below covers: a non-const member could move the iterator).
+                bool read = cast && (cast->getCastKind() == clang::CK_LValueToRValue ||
+                                     cast->getCastKind() == clang::CK_ArrayToPointerDecay ||
+                                     (cast->getCastKind() == clang::CK_NoOp &&
+                                      cast->getType().isConstQualified()));
+                if (member) {
+                    const auto* method = llvm::dyn_cast<clang::CXXMethodDecl>(member->getMemberDecl());
+                    read = method && method->isConst();
+                }
+                if (!read) {
+                    // A class-typed iterator copied into a by-value parameter or variable.
+                    const auto* construct = parents.size() == 1 ? parents[0].get<clang::CXXConstructExpr>() : nullptr;
+                    read = construct && construct->getConstructor()->isCopyOrMoveConstructor() &&
+                           construct->getConstructor()->getParamDecl(0)->getType()
+                               ->getPointeeType().isConstQualified();
+                }
+                if (!read) written = true;
+            }
+            return;
+        }
+        for (const clang::Stmt* child : st->children()) walk(child);
+    };
+    walk(fn->getBody());
+    return !written;
+}
+
+// A local new[] array whose pointer never leaves the function's delete[]s: it is only
+// read, indexed, offset, handed to a call that does not keep it (pointerValueStays) or
+// deleted with delete[], never stored, returned, aliased or released. Elements must
+// be trivial, since pool memory is freed without running destructors.
+bool ParallaxCollectorVisitor::poolArrayCandidate(const clang::VarDecl* var,
+                                                  std::vector<const clang::CXXDeleteExpr*>& deletes) {
+    clang::SourceManager& SM = context_.getSourceManager();
+    if (!var->hasLocalStorage() || llvm::isa<clang::ParmVarDecl>(var) || !var->hasInit() ||
+        var->getLocation().isMacroID() || !SM.isInMainFile(var->getLocation()))
+        return false;
+    const auto* fn = llvm::dyn_cast_or_null<clang::FunctionDecl>(var->getParentFunctionOrMethod());
+    if (!fn || !fn->getBody() || fn->isTemplateInstantiation()) return false;
+
+    const bool is_pointer = var->getType()->isPointerType();
+    clang::QualType elem = is_pointer ? var->getType()->getPointeeType() : clang::QualType();
+    if (!is_pointer) {
+        const auto* spec = llvm::dyn_cast_or_null<clang::ClassTemplateSpecializationDecl>(
+            var->getType()->getAsCXXRecordDecl());
+        if (!spec) return false;
+        const clang::TemplateArgumentList& args = spec->getTemplateArgs();
+        // std::unique_ptr<T[]> with the default deleter only.
+        if (args.size() != 2 || args[1].getKind() != clang::TemplateArgument::Type ||
+            args[1].getAsType().getAsString().find("default_delete") == std::string::npos)
+            return false;
+        if (const clang::ArrayType* at = context_.getAsArrayType(args[0].getAsType()))
+            elem = at->getElementType();
+        // An 'auto' unique_ptr only changes type through a make_unique initializer.
+        if (var->getType()->getContainedAutoType()) {
+            const auto* call = llvm::dyn_cast<clang::CallExpr>(var->getInit()->IgnoreImplicit());
+            const clang::FunctionDecl* callee = call ? call->getDirectCallee() : nullptr;
+            if (!callee || callee->getQualifiedNameAsString().find("std::make_unique") != 0) return false;
+        }
+    } else {
+        const auto* new_expr = llvm::dyn_cast<clang::CXXNewExpr>(var->getInit()->IgnoreImplicit());
+        if (!new_expr || !new_expr->isArray() || new_expr->getNumPlacementArgs() ||
+            new_expr->getBeginLoc().isMacroID())
+            return false;
+    }
+    if (elem.isNull() || !elem.isTriviallyCopyableType(context_)) return false;
+    if (const auto* record = elem->getAsCXXRecordDecl())
+        if (!record->hasTrivialDefaultConstructor() || !record->hasTrivialDestructor()) return false;
+
+    bool escapes = false;
+    std::function<void(const clang::Stmt*)> walk = [&](const clang::Stmt* st) {
+        if (!st || escapes) return;
+        if (const auto* ref = llvm::dyn_cast<clang::DeclRefExpr>(st)) {
+            if (ref->getDecl() != var) return;
+            auto parents = context_.getParents(*ref);
+            if (parents.size() != 1) { escapes = true; return; }
+            if (!is_pointer) {
+                // unique_ptr: only get() (whose pointer must stay), operator[] and operator bool.
+                if (const auto* member = parents[0].get<clang::MemberExpr>()) {
+                    std::string name = member->getMemberDecl()->getNameAsString();
+                    if (name == "get") {
+                        auto call = context_.getParents(*member);
+                        const auto* mc = call.size() == 1 ? call[0].get<clang::CXXMemberCallExpr>() : nullptr;
+                        escapes = !mc || !pointerValueStays(mc, nullptr, 0);
+                    } else {
+                        escapes = name != "operator bool";
+                    }
+                } else {
+                    const auto* cast = parents[0].get<clang::ImplicitCastExpr>();
+                    auto up = cast ? context_.getParents(*cast) : parents;
+                    const auto* op = up.size() == 1 ? up[0].get<clang::CXXOperatorCallExpr>() : nullptr;
+                    escapes = !op || op->getOperator() != clang::OO_Subscript;
+                }
+                return;
+            }
+            const auto* cast = parents[0].get<clang::ImplicitCastExpr>();
+            if (cast && cast->getCastKind() == clang::CK_LValueToRValue)
+                escapes = !pointerValueStays(cast, &deletes, 0);
+            else if (parents[0].get<clang::LambdaExpr>())
+                escapes = !pointerValueStays(ref, nullptr, 0);  // captured by reference
+            else
+                escapes = true;  // assigned, incremented, address taken
+            return;
+        }
+        for (const clang::Stmt* child : st->children()) walk(child);
+    };
+    walk(fn->getBody());
+    if (escapes) {
+        llvm::errs() << "[ParallaxCollector] Heap array " << var->getNameAsString()
+                     << " escapes its function; left on the system heap\n";
+        return false;
+    }
+    return true;
+}
+
+// Follows one pointer value into the array (the array itself, an offset into it, or a
+// closure holding it) up to where it is consumed. It stays if it is only dereferenced,
+// indexed, compared, tested, discarded, deleted with delete[] (the array itself, when
+// `deletes` collects them), or passed to a call that does not keep it: the routed
+// algorithm, a std:: function (one returning a pointer is followed like an offset), or
+// a function with a visible body whose `const T*` parameter stays there. Anything else
+// (stored, returned, copied into an owner, converted) escapes.
+bool ParallaxCollectorVisitor::pointerValueStays(const clang::Expr* value,
+                                                 std::vector<const clang::CXXDeleteExpr*>* deletes,
+                                                 int depth) {
+    const clang::Stmt* cur = value;
+    bool derived = false;  // an offset or closure, not the array pointer itself
+    for (int guard = 0; guard < 32; ++guard) {
+        auto up = context_.getParents(*cur);
+        if (up.size() != 1) return false;
+        const auto* e = up[0].get<clang::Expr>();
+        if (!e) return up[0].get<clang::CompoundStmt>() != nullptr;  // value discarded
+        if (llvm::isa<clang::ParenExpr>(e) || llvm::isa<clang::ExprWithCleanups>(e) ||
+            llvm::isa<clang::MaterializeTemporaryExpr>(e) || llvm::isa<clang::CXXBindTemporaryExpr>(e)) {
+            cur = e;
+            continue;
+        }
+        if (const auto* c = llvm::dyn_cast<clang::ImplicitCastExpr>(e)) {
+            if (!c->getType()->isPointerType()) return true;  // to bool
+            if (c->getCastKind() != clang::CK_NoOp) return false;  // to void*, a base
+            cur = c;
+            continue;
+        }
+        if (llvm::isa<clang::ArraySubscriptExpr>(e) || llvm::isa<clang::MemberExpr>(e)) return true;
+        if (const auto* un = llvm::dyn_cast<clang::UnaryOperator>(e))
+            return un->getOpcode() == clang::UO_Deref || un->getOpcode() == clang::UO_LNot;
+        if (const auto* bo = llvm::dyn_cast<clang::BinaryOperator>(e)) {
+            if (bo->isAssignmentOp()) return false;
+            if (bo->getOpcode() == clang::BO_Comma) {
+                if (bo->getRHS() != cur) return true;
+            } else if (!bo->isAdditiveOp() || !bo->getType()->isPointerType()) {
+                return true;  // comparison, pointer difference
+            }
+            cur = bo;
+            derived = true;
+            continue;
+        }
+        if (const auto* del = llvm::dyn_cast<clang::CXXDeleteExpr>(e)) {
+            if (!deletes || derived || !del->isArrayForm() || del->getBeginLoc().isMacroID()) return false;
+            deletes->push_back(del);
+            return true;
+        }
+        if (llvm::isa<clang::LambdaExpr>(e)) {
+            cur = e;
+            derived = true;
+            continue;
+        }
+        const auto* call = llvm::dyn_cast<clang::CallExpr>(e);
+        if (!call || llvm::isa<clang::CXXOperatorCallExpr>(call) || call->getCallee() == cur) return false;
+        const clang::FunctionDecl* fd = call->getDirectCallee();
+        if (!fd) return false;
+        if (isParallelAlgorithm(const_cast<clang::CallExpr*>(call))) return true;
+        if (fd->isInStdNamespace()) {
+            if (!call->getType()->isPointerType()) return true;
+            cur = call;
+            derived = true;
+            continue;
+        }
+        unsigned idx = 0;
+        while (idx < call->getNumArgs() && call->getArg(idx) != cur) ++idx;
+        const clang::FunctionDecl* def = fd->getDefinition();
+        if (idx == call->getNumArgs() || !def || !def->hasBody() || idx >= def->getNumParams() ||
+            depth > 4)
+            return false;
+        const clang::ParmVarDecl* parm = def->getParamDecl(idx);
+        if (!parm->getType()->isPointerType() || !parm->getType()->getPointeeType().isConstQualified())
+            return false;
+        return pointerParamStays(parm, def, depth + 1);
+    }
+    return false;
+}
+
+// A callee's pointer parameter stays if every use of it is a load whose value stays.
+bool ParallaxCollectorVisitor::pointerParamStays(const clang::ParmVarDecl* parm,
+                                                 const clang::FunctionDecl* fn, int depth) {
+    bool stays = true;
+    std::function<void(const clang::Stmt*)> walk = [&](const clang::Stmt* st) {
+        if (!st || !stays) return;
+        if (const auto* ref = llvm::dyn_cast<clang::DeclRefExpr>(st)) {
+            if (ref->getDecl() != parm) return;
+            auto parents = context_.getParents(*ref);
+            const auto* cast = parents.size() == 1 ? parents[0].get<clang::ImplicitCastExpr>() : nullptr;
+            stays = cast && cast->getCastKind() == clang::CK_LValueToRValue &&
+                    pointerValueStays(cast, nullptr, depth);
+            return;
+        }
+        for (const clang::Stmt* child : st->children()) walk(child);
+    };
+    walk(fn->getBody());
+    return stays;
+}
+
+// Whether a by-reference container parameter can take the allocator: its function is
+// a non-template free function private to this file whose address is never taken, and
+// every call passes a rewritable container (recursively, for parameters passed on).
+// `feeds` collects those containers.
+bool ParallaxCollectorVisitor::paramFeeds(const clang::ParmVarDecl* parm,
+                                          std::set<const clang::ParmVarDecl*>& seen,
+                                          std::vector<const clang::DeclaratorDecl*>& feeds,
+                                          std::string& why) {
+    if (!seen.insert(parm).second) return true;  // recursion: already being checked
+    const auto* fn = llvm::dyn_cast<clang::FunctionDecl>(parm->getDeclContext());
+    if (!fn || llvm::isa<clang::CXXMethodDecl>(fn) || fn->isTemplateInstantiation() ||
+        fn->isDependentContext() || fn->getDescribedFunctionTemplate()) {
+        why = "not a plain free function";
+        return false;
+    }
+    if (fn->isExternallyVisible()) {
+        why = "function is visible to other translation units";
+        return false;
+    }
+    if (!rewriter_.canRewriteContainer(parm)) {
+        why = "parameter type cannot be rewritten";
+        return false;
+    }
+    clang::SourceManager& SM = context_.getSourceManager();
+    for (const clang::FunctionDecl* redecl : fn->redecls()) {
+        if (redecl->getLocation().isMacroID() || !SM.isInMainFile(redecl->getLocation())) {
+            why = "declared outside the main file";
+            return false;
+        }
+    }
+    const clang::FunctionDecl* canon = fn->getCanonicalDecl();
+    const std::vector<clang::CallExpr*>& calls = calls_by_callee_[canon];
+    if (fn_refs_[canon] != calls.size()) {
+        why = "function's address is taken";
+        return false;
+    }
+    const unsigned idx = parm->getFunctionScopeIndex();
+    for (clang::CallExpr* call : calls) {
+        if (idx >= call->getNumArgs()) { why = "default argument"; return false; }
+        RangeOrigin origin = originOfObject(call->getArg(idx), 0);
+        if (origin.kind != RangeOrigin::Container) {
+            why = "a caller passes storage that cannot be traced";
+            return false;
+        }
+        if (unfit_containers_.count(origin.decl)) {
+            why = "a caller's container has a use that would not compile with the allocator";
+            return false;
+        }
+        if (const auto* outer = llvm::dyn_cast<clang::ParmVarDecl>(origin.decl)) {
+            if (!paramFeeds(outer, seen, feeds, why)) return false;
+        } else if (!rewriter_.canRewriteContainer(origin.decl)) {
+            why = "a caller passes a container that cannot be rewritten";
+            return false;
+        }
+        if (!hasParallaxAllocator(origin.decl->getType())) feeds.push_back(origin.decl);
+    }
+    return true;
+}
+
+void ParallaxCollectorVisitor::finishRanges() {
+    // By-reference parameters change type only together with every container that
+    // reaches them; otherwise the call sites would no longer compile. Every rewritten
+    // declaration (fields, such parameters and the caller containers they pull in
+    // included) is also used beyond the routed call, so each of its uses must survive
+    // the new type. Dropping one can drop a parameter it fed (and the containers only
+    // that parameter pulled in), so this repeats until nothing else is dropped.
+    const std::set<const clang::DeclaratorDecl*> direct = rewriter_.containersForAllocation();
+    std::set<const clang::DeclaratorDecl*> rewriting;
+    for (int round = 0; round < 16; ++round) {
+        rewriting.clear();
+        for (const clang::DeclaratorDecl* decl : direct) {
+            if (unfit_containers_.count(decl)) continue;
+            const auto* parm = llvm::dyn_cast<clang::ParmVarDecl>(decl);
+            if (!parm) {
+                rewriting.insert(decl);
+                continue;
+            }
+            std::set<const clang::ParmVarDecl*> seen;
+            std::vector<const clang::DeclaratorDecl*> feeds;
+            std::string why;
+            if (!paramFeeds(parm, seen, feeds, why)) {
+                unfit_containers_.insert(parm);
+                llvm::errs() << "[ParallaxCollector] Skipping parameter " << parm->getNameAsString()
+                             << ": " << why << "\n";
+                continue;
+            }
+            rewriting.insert(seen.begin(), seen.end());
+            rewriting.insert(feeds.begin(), feeds.end());
+        }
+        bool dropped = false;
+        for (const clang::DeclaratorDecl* decl : rewriting) {
+            std::string why;
+            if (containerUsesFit(decl, rewriting, why)) continue;
+            unfit_containers_.insert(decl);
+            dropped = true;
+            llvm::errs() << "[ParallaxCollector] Skipping " << decl->getNameAsString() << ": " << why << "\n";
+        }
+        if (!dropped) break;
+    }
+
+    for (const clang::DeclaratorDecl* decl : direct)
+        if (!rewriting.count(decl)) rewriter_.unmarkForAllocation(decl);
+    for (const clang::DeclaratorDecl* decl : rewriting) {
+        rewriter_.markContainerForAllocation(decl);
+        if (const auto* parm = llvm::dyn_cast<clang::ParmVarDecl>(decl))
+            llvm::errs() << "[ParallaxCollector] Parameter " << parm->getNameAsString()
+                         << ": rewritten with its caller container(s)\n";
+    }
+}
+
+void ParallaxCollectorVisitor::finishPoolMasks() {
+    // One mask per call location: a call in a template is visited once per
+    // instantiation, and an argument counts only if it is pool memory in all of them.
+    std::map<unsigned, std::pair<clang::CallExpr*, unsigned>> masks;
+    for (const auto& routed : routed_pool_calls_) {
+        clang::CallExpr* call = routed.first;
+        unsigned mask = 0;
+        for (const auto& ca : routedShape(routed.second).containers)
+            if (ca.first < call->getNumArgs() && isPoolResident(traceRangeOrigin(call->getArg(ca.first))))
+                mask |= 1u << ca.first;
+        auto slot = masks.try_emplace(call->getBeginLoc().getRawEncoding(), call, mask);
+        if (!slot.second) slot.first->second.second &= mask;
+    }
+    for (const auto& m : masks) rewriter_.emitPoolAssume(m.second.first, m.second.second);
+}
+
+// Whether every recorded use of a container declaration still compiles once it (and
+// everything in `rewriting`) carries parallax::allocator.
+bool ParallaxCollectorVisitor::containerUsesFit(const clang::DeclaratorDecl* decl,
+                                                const std::set<const clang::DeclaratorDecl*>& rewriting,
+                                                std::string& why) {
+    for (const clang::Expr* use : container_uses_[decl]) {
+        if (containerUseFits(use, rewriting)) continue;
+        why = "a use at " + use->getBeginLoc().printToString(context_.getSourceManager()) +
+              " would not compile with the allocator";
+        return false;
+    }
+    return true;
+}
+
+// One use of a container: member calls (except swap), indexing, range-for, auto
+// bindings, lambda captures and template arguments deduce or accept any allocator.
+// Binding it to a non-template parameter, copying it into another container, or
+// assigning or comparing it with one only fits if that other declaration is being
+// rewritten too. Anything else (address taken, returned, unknown context) does not.
+bool ParallaxCollectorVisitor::containerUseFits(const clang::Expr* use,
+                                                const std::set<const clang::DeclaratorDecl*>& rewriting) {
+    auto rewritten = [&](const clang::Expr* other) {
+        if (!other) return false;
+        const clang::Expr* e = other->IgnoreParenImpCasts();
+        if (llvm::isa<clang::InitListExpr>(e) || llvm::isa<clang::CXXStdInitializerListExpr>(e)) return true;
+        RangeOrigin origin = originOfObject(const_cast<clang::Expr*>(e), 0);
+        return origin.kind == RangeOrigin::Container &&
+               (rewriting.count(origin.decl) || hasParallaxAllocator(origin.decl->getType()));
+    };
+    const clang::Stmt* cur = use;
+    for (int guard = 0; guard < 8; ++guard) {
+        auto up = context_.getParents(*cur);
+        if (up.size() != 1) return false;
+        if (const auto* vd = up[0].get<clang::VarDecl>()) {
+            // auto&& __range in a range-for, or an explicit auto binding; otherwise the
+            // variable's own type must be rewritten with it.
+            return vd->getType()->getContainedAutoType() || rewriting.count(vd);
+        }
+        const auto* e = up[0].get<clang::Expr>();
+        if (!e) return false;
+        if (llvm::isa<clang::ParenExpr>(e) || llvm::isa<clang::MaterializeTemporaryExpr>(e) ||
+            llvm::isa<clang::ExprWithCleanups>(e)) {
+            cur = e;
+            continue;
+        }
+        if (const auto* c = llvm::dyn_cast<clang::ImplicitCastExpr>(e)) {
+            if (c->getCastKind() != clang::CK_NoOp && c->getCastKind() != clang::CK_LValueToRValue)
+                return false;
+            cur = c;
+            continue;
+        }
+        if (const auto* member = llvm::dyn_cast<clang::MemberExpr>(e))
+            return member->getMemberDecl()->getNameAsString() != "swap";
+        if (llvm::isa<clang::LambdaExpr>(e)) return true;
+        if (const auto* op = llvm::dyn_cast<clang::CXXOperatorCallExpr>(e)) {
+            if (op->getOperator() == clang::OO_Subscript) return op->getArg(0) == cur;
+            if (op->getNumArgs() == 2 &&
+                (op->getOperator() == clang::OO_Equal || op->getOperator() == clang::OO_EqualEqual ||
+                 op->getOperator() == clang::OO_ExclaimEqual))
+                return rewritten(op->getArg(op->getArg(0) == cur ? 1 : 0));
+            return false;
+        }
+        if (const auto* construct = llvm::dyn_cast<clang::CXXConstructExpr>(e)) {
+            // A constructor template (std::span, iterator-pair ranges) takes any allocator;
+            // a container's copy or move constructor only a matching one.
+            const clang::CXXConstructorDecl* ctor = construct->getConstructor();
+            if (ctor->getPrimaryTemplate()) return true;
+            auto owner = context_.getParents(*construct);
+            if (owner.size() == 1 && owner[0].get<clang::LambdaExpr>()) return true;  // by-copy capture
+            const auto* vd = owner.size() == 1 ? owner[0].get<clang::VarDecl>() : nullptr;
+            return vd && rewriting.count(vd);
+        }
+        if (const auto* call = llvm::dyn_cast<clang::CallExpr>(e)) {
+            const clang::FunctionDecl* fd = call->getDirectCallee();
+            if (!fd || call->getCallee() == cur) return false;
+            if (fd->getPrimaryTemplate()) return true;  // deduces the new type
+            unsigned idx = 0;
+            while (idx < call->getNumArgs() && call->getArg(idx) != cur) ++idx;
+            if (idx >= call->getNumArgs() || idx >= fd->getNumParams()) return false;
+            const clang::ParmVarDecl* parm = fd->getParamDecl(idx);
+            if (rewriting.count(parm)) return true;
+            // The definition's parameter is the one paramFeeds rewrites.
+            if (const clang::FunctionDecl* def = fd->getDefinition())
+                if (idx < def->getNumParams() && rewriting.count(def->getParamDecl(idx))) return true;
+            return false;
+        }
+        return false;
+    }
+    return false;
+}
+
 bool ParallaxCollectorVisitor::isStandardContainer(clang::QualType type) {
     // Remove cv-qualifiers and references
     type = type.getNonReferenceType().getUnqualifiedType();
@@ -2675,11 +5756,14 @@ public:
         llvm::errs() << "[Parallax] Starting AST traversal...\n";
         collector.TraverseDecl(context.getTranslationUnitDecl());
         llvm::errs() << "[Parallax] AST traversal complete\n";
+        collector.finishRanges();
 
         llvm::errs() << "[Parallax] Phase 1.5: Injecting allocators...\n";
 
-        // Phase 1.5: Inject allocators into containers
+        // Phase 1.5: Inject allocators into containers, then flag the routed calls
+        // whose ranges the injection actually moved into the pool
         rewriter_.applyAllocatorInjections();
+        collector.finishPoolMasks();
 
         llvm::errs() << "[Parallax] Phase 2: Applying transformations...\n";
 
@@ -13,6 +13,9 @@
 #include <cstdlib>
 #include <unordered_map>
 #include <set>
+#include <map>
+#include <algorithm>
+#include <iterator>
 #include <stdexcept>
 
 namespace parallax {
@@ -1255,6 +1258,33 @@ static llvm::Type* infer_pointee_type(llvm::Function* f, const llvm::Argument* a
     return fallback;
 }
 
+// Could the kernel store through pointer p (or anything derived from it)? Follows
+// address arithmetic, selects and phis; a store/atomic/call on a derived pointer, or
+// the pointer itself escaping (stored as a value, converted to an integer, passed to a
+// call), counts as a write. Conservative: only a pure load chain is read-only.
+static bool may_write_through(const llvm::Value* p) {
+    std::vector<const llvm::Value*> work = {p};
+    std::set<const llvm::Value*> seen = {p};
+    while (!work.empty()) {
+        const llvm::Value* v = work.back();
+        work.pop_back();
+        for (const llvm::User* u : v->users()) {
+            if (llvm::isa<llvm::LoadInst>(u)) continue;
+            // A store to it, or the address itself stored somewhere.
+            if (llvm::isa<llvm::StoreInst>(u)) return true;
+            if (llvm::isa<llvm::GetElementPtrInst>(u) || llvm::isa<llvm::BitCastInst>(u) ||
+                llvm::isa<llvm::AddrSpaceCastInst>(u) || llvm::isa<llvm::SelectInst>(u) ||
+                llvm::isa<llvm::PHINode>(u)) {
+                if (seen.insert(u).second) work.push_back(u);
+                continue;
+            }
+            if (llvm::isa<llvm::ICmpInst>(u)) continue;
+            return true;  // call, atomic, ptrtoint, return, ...
+        }
+    }
+    return false;
+}
+
 std::vector<uint32_t> SPIRVGenerator::generate_from_lambda(
     llvm::Function* lambda_func,
     const std::vector<std::string>& param_types) {
@@ -1327,6 +1357,27 @@ std::vector<uint32_t> SPIRVGenerator::generate_from_lambda(
         }
     }
 
+    // Placement facts for the registrar: which relocated capture leaves the kernel
+    // only reads through, and whether the data input is read-only (transform and
+    // predicate kernels read param 0; for_each updates it in place).
+    readonly_capture_mask_ = 0;
+    written_capture_mask_ = 0;
+    input_readonly_ = is_transform;
+    bool leaf_overflow = false;
+    for (auto& arg : lambda_func->args()) {
+        if (!reloc_capture_params_.count(&arg)) continue;
+        unsigned leaf = arg.getArgNo() - 1;  // captures follow the element parameter
+        if (leaf >= 64) { leaf_overflow = true; continue; }
+        if (may_write_through(&arg)) written_capture_mask_ |= 1ull << leaf;
+        else                         readonly_capture_mask_ |= 1ull << leaf;
+    }
+    // A pointer leaf past bit 63 cannot be named in the masks, so the kernel counts
+    // as writing all of its captures: the runtime must drop any copy it placed.
+    if (leaf_overflow) {
+        written_capture_mask_ = ~0ull;
+        readonly_capture_mask_ = 0;
+    }
+
     // Derive the kernel's element type so opaque data pointers and the data
     // buffer use the real type instead of float. for_each: the first data
     // parameter is the element pointer (recover its pointee). transform: the
@@ -1472,12 +1523,129 @@ uint32_t SPIRVGenerator::emit_inlined_op(SPIRVBuilder& B, llvm::Function* user_o
     return op_fn_id;
 }
 
+SPIRVGenerator::WideIds SPIRVGenerator::declare_wide_ids(SPIRVBuilder& B, uint32_t u64_t,
+                                                         uint32_t ptr_in_v3, uint32_t wgid_var,
+                                                         uint32_t lid_var) {
+    SPIRVBuilder::Section prev = B.get_current_section();
+    WideIds w;
+    w.u64_t = u64_t;
+    B.set_section(SPIRVBuilder::Section::Types);
+    w.nwg_var = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_in_v3, w.nwg_var, 1});
+    w.added.push_back(w.nwg_var);
+    w.wgid_var = wgid_var;
+    if (!w.wgid_var) {
+        w.wgid_var = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_in_v3, w.wgid_var, 1});
+        w.added.push_back(w.wgid_var);
+    }
+    w.lid_var = lid_var;
+    if (!w.lid_var) {
+        w.lid_var = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_in_v3, w.lid_var, 1});
+        w.added.push_back(w.lid_var);
+    }
+    B.set_section(SPIRVBuilder::Section::Decorations);
+    B.emit_op(SPIRVOp::OpDecorate, {w.nwg_var, 11 /*BuiltIn*/, 24 /*NumWorkgroups*/});
+    if (!wgid_var) B.emit_op(SPIRVOp::OpDecorate, {w.wgid_var, 11, 26 /*WorkgroupId*/});
+    if (!lid_var)  B.emit_op(SPIRVOp::OpDecorate, {w.lid_var, 11, 27 /*LocalInvocationId*/});
+    B.set_section(prev);
+    return w;
+}
+
+uint32_t SPIRVGenerator::wide_const(SPIRVBuilder& B, WideIds& w, uint64_t v) {
+    auto it = w.consts.find(v);
+    if (it != w.consts.end()) return it->second;
+    SPIRVBuilder::Section prev = B.get_current_section();
+    B.set_section(SPIRVBuilder::Section::Types);
+    uint32_t id = B.get_next_id();
+    B.emit_op(SPIRVOp::OpConstant, {w.u64_t, id, static_cast<uint32_t>(v),
+                                    static_cast<uint32_t>(v >> 32)});
+    B.set_section(prev);
+    w.consts[v] = id;
+    return id;
+}
+
+// gid = (wgid.y * nwg.x + wgid.x) * local_size + lid.x, all in uint64.
+uint32_t SPIRVGenerator::emit_wide_gid(SPIRVBuilder& B, WideIds& w, uint32_t uint_t,
+                                       uint32_t v3uint, uint32_t local_size, uint32_t* flat_wg) {
+    uint32_t c_local = wide_const(B, w, local_size);
+    auto component = [&](uint32_t var, uint32_t c) {
+        uint32_t vec = B.get_next_id();
+        B.emit_op(SPIRVOp::OpLoad, {v3uint, vec, var});
+        uint32_t x = B.get_next_id();
+        B.emit_op(SPIRVOp::OpCompositeExtract, {uint_t, x, vec, c});
+        uint32_t x64 = B.get_next_id();
+        B.emit_op(SPIRVOp::OpUConvert, {w.u64_t, x64, x});
+        return x64;
+    };
+    uint32_t wx = component(w.wgid_var, 0), wy = component(w.wgid_var, 1);
+    uint32_t nx = component(w.nwg_var, 0), lx = component(w.lid_var, 0);
+    uint32_t row = B.get_next_id();
+    B.emit_op(SPIRVOp::OpIMul, {w.u64_t, row, wy, nx});
+    uint32_t flat = B.get_next_id();
+    B.emit_op(SPIRVOp::OpIAdd, {w.u64_t, flat, row, wx});
+    uint32_t first = B.get_next_id();
+    B.emit_op(SPIRVOp::OpIMul, {w.u64_t, first, flat, c_local});
+    uint32_t gid = B.get_next_id();
+    B.emit_op(SPIRVOp::OpIAdd, {w.u64_t, gid, first, lx});
+    if (flat_wg) *flat_wg = flat;
+    return gid;
+}
+
+namespace {
+// Tuned skeleton workgroup sizes, keyed "skeleton/elem", then by log2(n) bucket
+// (see set_tuned_local_size).
+std::map<std::string, std::map<unsigned, uint32_t>>& tuned_local_sizes() {
+    static std::map<std::string, std::map<unsigned, uint32_t>> table;
+    return table;
+}
+
+const char* elem_tag(SPIRVGenerator::ReduceElemType e) {
+    switch (e) {
+    case SPIRVGenerator::ReduceElemType::F32: return "f32";
+    case SPIRVGenerator::ReduceElemType::F64: return "f64";
+    case SPIRVGenerator::ReduceElemType::I32: return "i32";
+    case SPIRVGenerator::ReduceElemType::I64: return "i64";
+    }
+    return "f32";
+}
+
+bool valid_local_size(uint32_t n) { return n >= 32 && n <= 1024 && (n & (n - 1)) == 0; }
+} // namespace
+
+void SPIRVGenerator::set_tuned_local_size(const std::string& skeleton, ReduceElemType elem,
+                                          unsigned log2_n, uint32_t n) {
+    if (valid_local_size(n)) tuned_local_sizes()[skeleton + "/" + elem_tag(elem)][log2_n] = n;
+}
+
+std::vector<unsigned> SPIRVGenerator::tuned_buckets(const std::string& skeleton, ReduceElemType elem) {
+    std::vector<unsigned> out;
+    auto& table = tuned_local_sizes();
+    auto it = table.find(skeleton + "/" + elem_tag(elem));
+    if (it == table.end()) return out;
+    uint32_t prev = 0;
+    for (const auto& b : it->second) {
+        if (b.second != prev) out.push_back(b.first);
+        prev = b.second;
+    }
+    return out;
+}
+
+uint32_t SPIRVGenerator::skeleton_local_size(const char* skeleton, ReduceElemType elem) const {
+    if (local_size_) return local_size_;
+    auto& table = tuned_local_sizes();
+    auto it = table.find(std::string(skeleton) + "/" + elem_tag(elem));
+    if (it == table.end() || it->second.empty()) return 256;
+    auto b = it->second.upper_bound(size_bucket_);
+    return b == it->second.begin() ? b->second : std::prev(b)->second;
+}
+
 std::vector<uint32_t> SPIRVGenerator::generate_reduce_kernel(ReduceElemType elem,
                                                              llvm::Function* user_op) {
     // Element kind specifics.
     const bool is_float = (elem == ReduceElemType::F32 || elem == ReduceElemType::F64);
     const bool is_wide  = (elem == ReduceElemType::F64 || elem == ReduceElemType::I64);
     const uint32_t stride = is_wide ? 8 : 4;
+    const uint32_t local_size = skeleton_local_size("reduce", elem);
+    const bool W = wide_index_ && !stream_base_;  // set_wide_index
 
     // The user-op body is translated via the shared translate_instruction path,
     // which uses these member caches/state — start clean (and not pointer-chasing).
@@ -1496,7 +1664,7 @@ std::vector<uint32_t> SPIRVGenerator::generate_reduce_kernel(ReduceElemType elem
     B.set_section(SPIRVBuilder::Section::Capabilities);
     B.emit_op(SPIRVOp::OpCapability, {1});            // Shader
     if (elem == ReduceElemType::F64) B.emit_op(SPIRVOp::OpCapability, {10}); // Float64
-    if (elem == ReduceElemType::I64) B.emit_op(SPIRVOp::OpCapability, {11}); // Int64
+    if (elem == ReduceElemType::I64 || W) B.emit_op(SPIRVOp::OpCapability, {11}); // Int64
 
     // Logical addressing (this primitive needs no physical pointers).
     B.set_section(SPIRVBuilder::Section::Preamble);
@@ -1508,6 +1676,9 @@ std::vector<uint32_t> SPIRVGenerator::generate_reduce_kernel(ReduceElemType elem
     uint32_t fn_t   = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeFunction, {fn_t, void_t});
     uint32_t uint_t = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeInt, {uint_t, 32, 0});
     uint32_t bool_t = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeBool, {bool_t});
+    uint32_t u64_t = 0;
+    if (W) { u64_t = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeInt, {u64_t, 64, 0}); }
+    const uint32_t idx_t = W ? u64_t : uint_t;  // count / element index type
 
     uint32_t elem_t = B.get_next_id();
     if (is_float) B.emit_op(SPIRVOp::OpTypeFloat, {elem_t, is_wide ? 64u : 32u});
@@ -1537,14 +1708,20 @@ std::vector<uint32_t> SPIRVGenerator::generate_reduce_kernel(ReduceElemType elem
         return id;
     };
 
-    uint32_t c256 = U(256);
-    uint32_t arr256 = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeArray, {arr256, elem_t, c256});
-    uint32_t ptr_wg_arr = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_wg_arr, 4 /*Workgroup*/, arr256});
+    uint32_t c_local = U(local_size);
+    uint32_t arr_local = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeArray, {arr_local, elem_t, c_local});
+    uint32_t ptr_wg_arr = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_wg_arr, 4 /*Workgroup*/, arr_local});
     uint32_t ptr_wg_elem = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_wg_elem, 4, elem_t});
 
-    uint32_t pc_struct = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeStruct, {pc_struct, uint_t});
+    // push { uint count@0 } — streaming: { uint count@0, uint base@4, uint part_base@8 };
+    // wide: { uint64 count@0 }.
+    uint32_t pc_struct = B.get_next_id();
+    if (stream_base_) B.emit_op(SPIRVOp::OpTypeStruct, {pc_struct, uint_t, uint_t, uint_t});
+    else              B.emit_op(SPIRVOp::OpTypeStruct, {pc_struct, idx_t});
     uint32_t ptr_pc_struct = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_pc_struct, 9 /*PushConstant*/, pc_struct});
     uint32_t ptr_pc_uint = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_pc_uint, 9, uint_t});
+    uint32_t ptr_pc_idx = ptr_pc_uint;
+    if (W) { ptr_pc_idx = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_pc_idx, 9, u64_t}); }
 
     // Global variables.
     uint32_t gid_var  = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_in_v3, gid_var, 1});
@@ -1554,6 +1731,9 @@ std::vector<uint32_t> SPIRVGenerator::generate_reduce_kernel(ReduceElemType elem
     uint32_t out_var  = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_sb_struct, out_var, 12});
     uint32_t sdata_var= B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_wg_arr, sdata_var, 4});
     uint32_t pc_var   = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_pc_struct, pc_var, 9});
+    WideIds wide;
+    if (W) wide = declare_wide_ids(B, u64_t, ptr_in_v3, wgid_var, lid_var);
+    auto X = [&](uint32_t v) { return W ? wide_const(B, wide, v) : U(v); };
 
     uint32_t main_id = B.get_next_id();
 
@@ -1571,6 +1751,10 @@ std::vector<uint32_t> SPIRVGenerator::generate_reduce_kernel(ReduceElemType elem
     B.emit_op(SPIRVOp::OpDecorate, {out_var, 34, 0});
     B.emit_op(SPIRVOp::OpDecorate, {out_var, 33, 1});
     B.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct, 0, 35, 0});
+    if (stream_base_) {
+        B.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct, 1, 35, 4});
+        B.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct, 2, 35, 8});
+    }
     B.emit_op(SPIRVOp::OpDecorate, {pc_struct, 2 /*Block*/});
     B.emit_op(SPIRVOp::OpDecorate, {gid_var, 11 /*BuiltIn*/, 28 /*GlobalInvocationId*/});
     B.emit_op(SPIRVOp::OpDecorate, {lid_var, 11, 27 /*LocalInvocationId*/});
@@ -1578,15 +1762,16 @@ std::vector<uint32_t> SPIRVGenerator::generate_reduce_kernel(ReduceElemType elem
 
     // ---- Entry point + execution mode ----
     B.set_section(SPIRVBuilder::Section::EntryPoints);
-    uint32_t iface[] = {gid_var, lid_var, wgid_var, in_var, out_var, sdata_var, pc_var};
-    uint32_t ep_wc = 1 + 1 + 1 + 2 + static_cast<uint32_t>(sizeof(iface) / sizeof(iface[0]));
+    std::vector<uint32_t> iface = {gid_var, lid_var, wgid_var, in_var, out_var, sdata_var, pc_var};
+    iface.insert(iface.end(), wide.added.begin(), wide.added.end());
+    uint32_t ep_wc = 1 + 1 + 1 + 2 + static_cast<uint32_t>(iface.size());
     B.emit_word((ep_wc << 16) | static_cast<uint32_t>(SPIRVOp::OpEntryPoint));
     B.emit_word(5);  // GLCompute
     B.emit_word(main_id);
     B.emit_word(0x6e69616d);  // "main"
     B.emit_word(0x00000000);  // "\0\0\0\0"
     for (uint32_t id : iface) B.emit_word(id);
-    B.emit_op(SPIRVOp::OpExecutionMode, {main_id, 17 /*LocalSize*/, 256, 1, 1});
+    B.emit_op(SPIRVOp::OpExecutionMode, {main_id, 17 /*LocalSize*/, local_size, 1, 1});
 
     // ---- Optional user binary op as a callable SPIR-V function ----
     // Translated through the shared translate_instruction path; its element/int/
@@ -1638,21 +1823,57 @@ std::vector<uint32_t> SPIRVGenerator::generate_reduce_kernel(ReduceElemType elem
     uint32_t gid = load_x(gid_var);
     uint32_t tid = load_x(lid_var);
     uint32_t wgid = load_x(wgid_var);
+    // Wide: gid / wgid are the 64-bit flat invocation and workgroup of the 2D grid.
+    if (W) gid = emit_wide_gid(B, wide, uint_t, v3uint, local_size, &wgid);
 
     // count = pc.count
     uint32_t pc_count_ptr = B.get_next_id();
-    B.emit_op(SPIRVOp::OpAccessChain, {ptr_pc_uint, pc_count_ptr, pc_var, U(0)});
+    B.emit_op(SPIRVOp::OpAccessChain, {ptr_pc_idx, pc_count_ptr, pc_var, U(0)});
     uint32_t count = B.get_next_id();
-    B.emit_op(SPIRVOp::OpLoad, {uint_t, count, pc_count_ptr});
+    B.emit_op(SPIRVOp::OpLoad, {idx_t, count, pc_count_ptr});
+
+    // Streaming (partial carry): this chunk is in[base, base+count) and its workgroup
+    // partials land at out[part_base + wgid], so every chunk of a stream appends to
+    // ONE partials buffer that a final ordinary pass reduces. Chunk-local otherwise.
+    uint32_t in_idx = gid, out_idx = wgid;
+    if (stream_base_) {
+        auto pc_load = [&](uint32_t member) {
+            uint32_t p = B.get_next_id();
+            B.emit_op(SPIRVOp::OpAccessChain, {ptr_pc_uint, p, pc_var, U(member)});
+            uint32_t v = B.get_next_id();
+            B.emit_op(SPIRVOp::OpLoad, {uint_t, v, p});
+            return v;
+        };
+        uint32_t base = pc_load(1), part_base = pc_load(2);
+        in_idx = B.get_next_id();
+        B.emit_op(SPIRVOp::OpIAdd, {uint_t, in_idx, base, gid});
+        out_idx = B.get_next_id();
+        B.emit_op(SPIRVOp::OpIAdd, {uint_t, out_idx, part_base, wgid});
+    }
 
-    // blockActive = count - wgid*256: the number of valid elements this workgroup
+    // blockActive = count - wgid*local_size: the number of valid elements this workgroup
     // owns. The reduction combines only in-range lanes (tid+s < blockActive), so it
     // needs no identity padding and works for any associative op. Full blocks have
-    // blockActive >= 256 > any (tid+s), so the guard is a no-op there.
+    // blockActive >= local_size > any (tid+s), so the guard is a no-op there.
     uint32_t base = B.get_next_id();
-    B.emit_op(SPIRVOp::OpIMul, {uint_t, base, wgid, U(256)});
+    B.emit_op(SPIRVOp::OpIMul, {idx_t, base, wgid, X(local_size)});
     uint32_t block_active = B.get_next_id();
-    B.emit_op(SPIRVOp::OpISub, {uint_t, block_active, count, base});
+    B.emit_op(SPIRVOp::OpISub, {idx_t, block_active, count, base});
+    uint32_t block_live = 0;
+    if (W) {
+        // Narrow to 32 bits for the tree compares: min(count - base, local_size), and
+        // 0 for the padding groups of the 2D grid (base >= count), which store nothing.
+        block_live = B.get_next_id();
+        B.emit_op(SPIRVOp::OpULessThan, {bool_t, block_live, base, count});
+        uint32_t partial = B.get_next_id();
+        B.emit_op(SPIRVOp::OpULessThan, {bool_t, partial, block_active, X(local_size)});
+        uint32_t clamped = B.get_next_id();
+        B.emit_op(SPIRVOp::OpSelect, {u64_t, clamped, partial, block_active, X(local_size)});
+        uint32_t narrow = B.get_next_id();
+        B.emit_op(SPIRVOp::OpUConvert, {uint_t, narrow, clamped});
+        block_active = B.get_next_id();
+        B.emit_op(SPIRVOp::OpSelect, {uint_t, block_active, block_live, narrow, U(0)});
+    }
 
     // if (gid < count) sdata[tid] = indata[gid];  (lanes tid>=blockActive are never read)
     uint32_t p_sd_tid = B.get_next_id();
@@ -1667,7 +1888,7 @@ std::vector<uint32_t> SPIRVGenerator::generate_reduce_kernel(ReduceElemType elem
     B.emit_op(SPIRVOp::OpLabel, {then0});
     {
         uint32_t p_in = B.get_next_id();
-        B.emit_op(SPIRVOp::OpAccessChain, {ptr_sb_elem, p_in, in_var, U(0), gid});
+        B.emit_op(SPIRVOp::OpAccessChain, {ptr_sb_elem, p_in, in_var, U(0), in_idx});
         uint32_t v = B.get_next_id();
         B.emit_op(SPIRVOp::OpLoad, {elem_t, v, p_in});
         B.emit_op(SPIRVOp::OpStore, {p_sd_tid, v});
@@ -1676,10 +1897,10 @@ std::vector<uint32_t> SPIRVGenerator::generate_reduce_kernel(ReduceElemType elem
     B.emit_op(SPIRVOp::OpLabel, {m0});
     B.emit_op(SPIRVOp::OpControlBarrier, {scope_wg, scope_wg, sem});
 
-    // Unrolled tree reduction: for (s = 128; s > 0; s >>= 1)
+    // Unrolled tree reduction: for (s = local_size/2; s > 0; s >>= 1)
     //   if (tid < s && tid + s < blockActive) sdata[tid] = op(sdata[tid], sdata[tid+s]);
     SPIRVOp add_op = is_float ? SPIRVOp::OpFAdd : SPIRVOp::OpIAdd;
-    for (uint32_t s = 128; s > 0; s >>= 1) {
+    for (uint32_t s = local_size / 2; s > 0; s >>= 1) {
         uint32_t cs = U(s);
         uint32_t c1 = B.get_next_id();
         B.emit_op(SPIRVOp::OpULessThan, {bool_t, c1, tid, cs});
@@ -1716,6 +1937,11 @@ std::vector<uint32_t> SPIRVGenerator::generate_reduce_kernel(ReduceElemType elem
     // if (tid == 0) partials[wgid] = sdata[0];
     uint32_t is_leader = B.get_next_id();
     B.emit_op(SPIRVOp::OpIEqual, {bool_t, is_leader, tid, U(0)});
+    if (W) {
+        uint32_t live_leader = B.get_next_id();
+        B.emit_op(SPIRVOp::OpLogicalAnd, {bool_t, live_leader, is_leader, block_live});
+        is_leader = live_leader;
+    }
     uint32_t thenf = B.get_next_id();
     uint32_t mf = B.get_next_id();
     B.emit_op(SPIRVOp::OpSelectionMerge, {mf, 0});
@@ -1727,7 +1953,7 @@ std::vector<uint32_t> SPIRVGenerator::generate_reduce_kernel(ReduceElemType elem
         uint32_t r = B.get_next_id();
         B.emit_op(SPIRVOp::OpLoad, {elem_t, r, p_s0});
         uint32_t p_out = B.get_next_id();
-        B.emit_op(SPIRVOp::OpAccessChain, {ptr_sb_elem, p_out, out_var, U(0), wgid});
+        B.emit_op(SPIRVOp::OpAccessChain, {ptr_sb_elem, p_out, out_var, U(0), out_idx});
         B.emit_op(SPIRVOp::OpStore, {p_out, r});
         B.emit_op(SPIRVOp::OpBranch, {mf});
     }
@@ -1757,6 +1983,8 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_kernel(ReduceElemType elem,
     const bool is_float = (elem == ReduceElemType::F32 || elem == ReduceElemType::F64);
     const bool is_wide  = (elem == ReduceElemType::F64 || elem == ReduceElemType::I64);
     const uint32_t stride = is_wide ? 8 : 4;
+    const uint32_t local_size = skeleton_local_size("scan", elem);
+    const bool W = wide_index_ && !stream_base_;  // set_wide_index
 
     type_cache_.clear();
     constant_cache_.clear();
@@ -1772,7 +2000,7 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_kernel(ReduceElemType elem,
     B.set_section(SPIRVBuilder::Section::Capabilities);
     B.emit_op(SPIRVOp::OpCapability, {1});            // Shader
     if (elem == ReduceElemType::F64) B.emit_op(SPIRVOp::OpCapability, {10}); // Float64
-    if (elem == ReduceElemType::I64) B.emit_op(SPIRVOp::OpCapability, {11}); // Int64
+    if (elem == ReduceElemType::I64 || W) B.emit_op(SPIRVOp::OpCapability, {11}); // Int64
 
     B.set_section(SPIRVBuilder::Section::Preamble);
     B.emit_op(SPIRVOp::OpMemoryModel, {0, 1});        // Logical GLSL450
@@ -1783,6 +2011,9 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_kernel(ReduceElemType elem,
     uint32_t fn_t   = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeFunction, {fn_t, void_t});
     uint32_t uint_t = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeInt, {uint_t, 32, 0});
     uint32_t bool_t = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeBool, {bool_t});
+    uint32_t u64_t = 0;
+    if (W) { u64_t = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeInt, {u64_t, 64, 0}); }
+    const uint32_t idx_t = W ? u64_t : uint_t;  // count / element index type
 
     uint32_t elem_t = B.get_next_id();
     if (is_float) B.emit_op(SPIRVOp::OpTypeFloat, {elem_t, is_wide ? 64u : 32u});
@@ -1818,14 +2049,19 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_kernel(ReduceElemType elem,
         B.set_section(prev);
     }
 
-    uint32_t c256 = U(256);
-    uint32_t arr256 = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeArray, {arr256, elem_t, c256});
-    uint32_t ptr_wg_arr = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_wg_arr, 4 /*Workgroup*/, arr256});
+    uint32_t c_local = U(local_size);
+    uint32_t arr_local = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeArray, {arr_local, elem_t, c_local});
+    uint32_t ptr_wg_arr = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_wg_arr, 4 /*Workgroup*/, arr_local});
     uint32_t ptr_wg_elem = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_wg_elem, 4, elem_t});
 
-    uint32_t pc_struct = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeStruct, {pc_struct, uint_t});
+    // push { uint count@0 } — streaming: { uint count@0, uint base@4 }; wide: { uint64 count@0 }.
+    uint32_t pc_struct = B.get_next_id();
+    if (stream_base_) B.emit_op(SPIRVOp::OpTypeStruct, {pc_struct, uint_t, uint_t});
+    else              B.emit_op(SPIRVOp::OpTypeStruct, {pc_struct, idx_t});
     uint32_t ptr_pc_struct = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_pc_struct, 9 /*PushConstant*/, pc_struct});
     uint32_t ptr_pc_uint = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_pc_uint, 9, uint_t});
+    uint32_t ptr_pc_idx = ptr_pc_uint;
+    if (W) { ptr_pc_idx = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_pc_idx, 9, u64_t}); }
 
     // Global variables: data (in place) @0, blocksums @1.
     uint32_t gid_var  = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_in_v3, gid_var, 1});
@@ -1835,6 +2071,9 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_kernel(ReduceElemType elem,
     uint32_t bs_var   = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_sb_struct, bs_var, 12});
     uint32_t sdata_var= B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_wg_arr, sdata_var, 4});
     uint32_t pc_var   = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_pc_struct, pc_var, 9});
+    WideIds wide;
+    if (W) wide = declare_wide_ids(B, u64_t, ptr_in_v3, wgid_var, lid_var);
+    auto X = [&](uint32_t v) { return W ? wide_const(B, wide, v) : U(v); };
 
     uint32_t main_id = B.get_next_id();
     uint32_t scope_wg = U(2);
@@ -1850,6 +2089,7 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_kernel(ReduceElemType elem,
     B.emit_op(SPIRVOp::OpDecorate, {bs_var, 34, 0});
     B.emit_op(SPIRVOp::OpDecorate, {bs_var, 33, 1});
     B.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct, 0, 35, 0});
+    if (stream_base_) B.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct, 1, 35, 4});
     B.emit_op(SPIRVOp::OpDecorate, {pc_struct, 2 /*Block*/});
     B.emit_op(SPIRVOp::OpDecorate, {gid_var, 11 /*BuiltIn*/, 28 /*GlobalInvocationId*/});
     B.emit_op(SPIRVOp::OpDecorate, {lid_var, 11, 27 /*LocalInvocationId*/});
@@ -1857,15 +2097,16 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_kernel(ReduceElemType elem,
 
     // ---- Entry point + execution mode ----
     B.set_section(SPIRVBuilder::Section::EntryPoints);
-    uint32_t iface[] = {gid_var, lid_var, wgid_var, data_var, bs_var, sdata_var, pc_var};
-    uint32_t ep_wc = 1 + 1 + 1 + 2 + static_cast<uint32_t>(sizeof(iface) / sizeof(iface[0]));
+    std::vector<uint32_t> iface = {gid_var, lid_var, wgid_var, data_var, bs_var, sdata_var, pc_var};
+    iface.insert(iface.end(), wide.added.begin(), wide.added.end());
+    uint32_t ep_wc = 1 + 1 + 1 + 2 + static_cast<uint32_t>(iface.size());
     B.emit_word((ep_wc << 16) | static_cast<uint32_t>(SPIRVOp::OpEntryPoint));
     B.emit_word(5);  // GLCompute
     B.emit_word(main_id);
     B.emit_word(0x6e69616d);  // "main"
     B.emit_word(0x00000000);
     for (uint32_t id : iface) B.emit_word(id);
-    B.emit_op(SPIRVOp::OpExecutionMode, {main_id, 17 /*LocalSize*/, 256, 1, 1});
+    B.emit_op(SPIRVOp::OpExecutionMode, {main_id, 17 /*LocalSize*/, local_size, 1, 1});
 
     // Optional user binary op T(T,T) called at each combine step (else baked '+').
     uint32_t op_fn_id = emit_inlined_op(B, user_op, elem_t, uint_t, bool_t, elem_t);
@@ -1885,20 +2126,39 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_kernel(ReduceElemType elem,
     uint32_t gid = load_x(gid_var);
     uint32_t tid = load_x(lid_var);
     uint32_t wgid = load_x(wgid_var);
+    // Wide: gid / wgid are the 64-bit flat invocation and workgroup of the 2D grid.
+    if (W) gid = emit_wide_gid(B, wide, uint_t, v3uint, local_size, &wgid);
 
     uint32_t pc_count_ptr = B.get_next_id();
-    B.emit_op(SPIRVOp::OpAccessChain, {ptr_pc_uint, pc_count_ptr, pc_var, U(0)});
+    B.emit_op(SPIRVOp::OpAccessChain, {ptr_pc_idx, pc_count_ptr, pc_var, U(0)});
     uint32_t count = B.get_next_id();
-    B.emit_op(SPIRVOp::OpLoad, {uint_t, count, pc_count_ptr});
+    B.emit_op(SPIRVOp::OpLoad, {idx_t, count, pc_count_ptr});
+
+    // Streaming: scan the chunk data[base, base+count) in place. Block sums stay
+    // chunk-local (blocksums[wgid]); the chunk's carry-in is applied by scan_add.
+    uint32_t data_base = U(0);
+    if (stream_base_) {
+        uint32_t p = B.get_next_id();
+        B.emit_op(SPIRVOp::OpAccessChain, {ptr_pc_uint, p, pc_var, U(1)});
+        data_base = B.get_next_id();
+        B.emit_op(SPIRVOp::OpLoad, {uint_t, data_base, p});
+    }
 
     // temp[tid] = (gid < count) ? data[gid] : 0;  (loaded branchlessly via select)
     uint32_t inb = B.get_next_id();
     B.emit_op(SPIRVOp::OpULessThan, {bool_t, inb, gid, count});
     // Clamp the load index to a valid lane so out-of-range lanes never read OOB.
     uint32_t safe_gid = B.get_next_id();
-    B.emit_op(SPIRVOp::OpSelect, {uint_t, safe_gid, inb, gid, U(0)});
+    B.emit_op(SPIRVOp::OpSelect, {idx_t, safe_gid, inb, gid, X(0)});
+    uint32_t safe_idx = safe_gid, out_idx = gid;
+    if (stream_base_) {
+        safe_idx = B.get_next_id();
+        B.emit_op(SPIRVOp::OpIAdd, {uint_t, safe_idx, data_base, safe_gid});
+        out_idx = B.get_next_id();
+        B.emit_op(SPIRVOp::OpIAdd, {uint_t, out_idx, data_base, gid});
+    }
     uint32_t p_din = B.get_next_id();
-    B.emit_op(SPIRVOp::OpAccessChain, {ptr_sb_elem, p_din, data_var, U(0), safe_gid});
+    B.emit_op(SPIRVOp::OpAccessChain, {ptr_sb_elem, p_din, data_var, U(0), safe_idx});
     uint32_t dval = B.get_next_id();
     B.emit_op(SPIRVOp::OpLoad, {elem_t, dval, p_din});
     uint32_t init_v = B.get_next_id();
@@ -1908,11 +2168,11 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_kernel(ReduceElemType elem,
     B.emit_op(SPIRVOp::OpStore, {p_sd_tid, init_v});
     B.emit_op(SPIRVOp::OpControlBarrier, {scope_wg, scope_wg, sem});
 
-    // Unrolled inclusive Hillis-Steele: for (offset = 1; offset < 256; offset <<= 1)
+    // Unrolled inclusive Hillis-Steele: for (offset = 1; offset < local_size; offset <<= 1)
     //   v = (tid >= offset) ? temp[tid-offset] : 0;  barrier;  temp[tid] += v;  barrier;
     // The select keeps both barriers uniform (no divergent control flow).
     SPIRVOp add_op = is_float ? SPIRVOp::OpFAdd : SPIRVOp::OpIAdd;
-    for (uint32_t offset = 1; offset < 256; offset <<= 1) {
+    for (uint32_t offset = 1; offset < local_size; offset <<= 1) {
         uint32_t co = U(offset);
         uint32_t ge = B.get_next_id();
         B.emit_op(SPIRVOp::OpUGreaterThanEqual, {bool_t, ge, tid, co});
@@ -1962,23 +2222,33 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_kernel(ReduceElemType elem,
         uint32_t r = B.get_next_id();
         B.emit_op(SPIRVOp::OpLoad, {elem_t, r, p_self});
         uint32_t p_out = B.get_next_id();
-        B.emit_op(SPIRVOp::OpAccessChain, {ptr_sb_elem, p_out, data_var, U(0), gid});
+        B.emit_op(SPIRVOp::OpAccessChain, {ptr_sb_elem, p_out, data_var, U(0), out_idx});
         B.emit_op(SPIRVOp::OpStore, {p_out, r});
         B.emit_op(SPIRVOp::OpBranch, {m0});
         B.emit_op(SPIRVOp::OpLabel, {m0});
     }
 
-    // if (tid == 255) blocksums[wgid] = temp[255];  (= chunk total; padding added 0)
+    // if (tid == local_size-1) blocksums[wgid] = temp[local_size-1];  (= chunk total; padding added 0)
     {
         uint32_t is_last = B.get_next_id();
-        B.emit_op(SPIRVOp::OpIEqual, {bool_t, is_last, tid, U(255)});
+        B.emit_op(SPIRVOp::OpIEqual, {bool_t, is_last, tid, U(local_size - 1)});
+        if (W) {
+            // The padding groups of the 2D grid have no blocksums slot.
+            uint32_t first = B.get_next_id();
+            B.emit_op(SPIRVOp::OpIMul, {u64_t, first, wgid, X(local_size)});
+            uint32_t live = B.get_next_id();
+            B.emit_op(SPIRVOp::OpULessThan, {bool_t, live, first, count});
+            uint32_t live_last = B.get_next_id();
+            B.emit_op(SPIRVOp::OpLogicalAnd, {bool_t, live_last, is_last, live});
+            is_last = live_last;
+        }
         uint32_t thenl = B.get_next_id();
         uint32_t ml = B.get_next_id();
         B.emit_op(SPIRVOp::OpSelectionMerge, {ml, 0});
         B.emit_op(SPIRVOp::OpBranchConditional, {is_last, thenl, ml});
         B.emit_op(SPIRVOp::OpLabel, {thenl});
         uint32_t p_255 = B.get_next_id();
-        B.emit_op(SPIRVOp::OpAccessChain, {ptr_wg_elem, p_255, sdata_var, U(255)});
+        B.emit_op(SPIRVOp::OpAccessChain, {ptr_wg_elem, p_255, sdata_var, U(local_size - 1)});
         uint32_t total = B.get_next_id();
         B.emit_op(SPIRVOp::OpLoad, {elem_t, total, p_255});
         uint32_t p_bs = B.get_next_id();
@@ -2010,6 +2280,8 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_add_kernel(ReduceElemType el
     const bool is_float = (elem == ReduceElemType::F32 || elem == ReduceElemType::F64);
     const bool is_wide  = (elem == ReduceElemType::F64 || elem == ReduceElemType::I64);
     const uint32_t stride = is_wide ? 8 : 4;
+    const uint32_t local_size = skeleton_local_size("scan", elem);
+    const bool W = wide_index_ && !stream_base_;  // set_wide_index
 
     type_cache_.clear();
     constant_cache_.clear();
@@ -2022,7 +2294,7 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_add_kernel(ReduceElemType el
     B.set_section(SPIRVBuilder::Section::Capabilities);
     B.emit_op(SPIRVOp::OpCapability, {1});            // Shader
     if (elem == ReduceElemType::F64) B.emit_op(SPIRVOp::OpCapability, {10});
-    if (elem == ReduceElemType::I64) B.emit_op(SPIRVOp::OpCapability, {11});
+    if (elem == ReduceElemType::I64 || W) B.emit_op(SPIRVOp::OpCapability, {11});
 
     B.set_section(SPIRVBuilder::Section::Preamble);
     B.emit_op(SPIRVOp::OpMemoryModel, {0, 1});        // Logical GLSL450
@@ -2032,6 +2304,9 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_add_kernel(ReduceElemType el
     uint32_t fn_t   = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeFunction, {fn_t, void_t});
     uint32_t uint_t = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeInt, {uint_t, 32, 0});
     uint32_t bool_t = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeBool, {bool_t});
+    uint32_t u64_t = 0;
+    if (W) { u64_t = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeInt, {u64_t, 64, 0}); }
+    const uint32_t idx_t = W ? u64_t : uint_t;
 
     uint32_t elem_t = B.get_next_id();
     if (is_float) B.emit_op(SPIRVOp::OpTypeFloat, {elem_t, is_wide ? 64u : 32u});
@@ -2058,15 +2333,27 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_add_kernel(ReduceElemType el
         return id;
     };
 
-    uint32_t pc_struct = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeStruct, {pc_struct, uint_t});
+    // push { uint count@0 } — streaming: { uint count@0, uint base@4, uint has_carry@8,
+    // elem carry@16 }. carry is the last inclusive value of the previous chunk.
+    // Wide: { uint64 count@0 }.
+    uint32_t pc_struct = B.get_next_id();
+    if (stream_base_) B.emit_op(SPIRVOp::OpTypeStruct, {pc_struct, uint_t, uint_t, uint_t, elem_t});
+    else              B.emit_op(SPIRVOp::OpTypeStruct, {pc_struct, idx_t});
     uint32_t ptr_pc_struct = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_pc_struct, 9, pc_struct});
     uint32_t ptr_pc_uint = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_pc_uint, 9, uint_t});
+    uint32_t ptr_pc_idx = ptr_pc_uint;
+    if (W) { ptr_pc_idx = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_pc_idx, 9, u64_t}); }
+    uint32_t ptr_pc_elem = 0;
+    if (stream_base_) { ptr_pc_elem = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_pc_elem, 9, elem_t}); }
 
     uint32_t gid_var  = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_in_v3, gid_var, 1});
     uint32_t wgid_var = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_in_v3, wgid_var, 1});
     uint32_t data_var = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_sb_struct, data_var, 12});
     uint32_t off_var  = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_sb_struct, off_var, 12});
     uint32_t pc_var   = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_pc_struct, pc_var, 9});
+    WideIds wide;
+    if (W) wide = declare_wide_ids(B, u64_t, ptr_in_v3, wgid_var, 0);
+    auto X = [&](uint32_t v) { return W ? wide_const(B, wide, v) : U(v); };
 
     uint32_t main_id = B.get_next_id();
 
@@ -2079,20 +2366,26 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_add_kernel(ReduceElemType el
     B.emit_op(SPIRVOp::OpDecorate, {off_var, 34, 0});
     B.emit_op(SPIRVOp::OpDecorate, {off_var, 33, 1});
     B.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct, 0, 35, 0});
+    if (stream_base_) {
+        B.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct, 1, 35, 4});
+        B.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct, 2, 35, 8});
+        B.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct, 3, 35, 16});
+    }
     B.emit_op(SPIRVOp::OpDecorate, {pc_struct, 2});
     B.emit_op(SPIRVOp::OpDecorate, {gid_var, 11, 28});
     B.emit_op(SPIRVOp::OpDecorate, {wgid_var, 11, 26});
 
     B.set_section(SPIRVBuilder::Section::EntryPoints);
-    uint32_t iface[] = {gid_var, wgid_var, data_var, off_var, pc_var};
-    uint32_t ep_wc = 1 + 1 + 1 + 2 + static_cast<uint32_t>(sizeof(iface) / sizeof(iface[0]));
+    std::vector<uint32_t> iface = {gid_var, wgid_var, data_var, off_var, pc_var};
+    iface.insert(iface.end(), wide.added.begin(), wide.added.end());
+    uint32_t ep_wc = 1 + 1 + 1 + 2 + static_cast<uint32_t>(iface.size());
     B.emit_word((ep_wc << 16) | static_cast<uint32_t>(SPIRVOp::OpEntryPoint));
     B.emit_word(5);
     B.emit_word(main_id);
     B.emit_word(0x6e69616d);
     B.emit_word(0x00000000);
     for (uint32_t id : iface) B.emit_word(id);
-    B.emit_op(SPIRVOp::OpExecutionMode, {main_id, 17, 256, 1, 1});
+    B.emit_op(SPIRVOp::OpExecutionMode, {main_id, 17, local_size, 1, 1});
 
     // Optional user binary op T(T,T) for the block-offset combine (else baked '+').
     uint32_t op_fn_id = emit_inlined_op(B, user_op, elem_t, uint_t, bool_t, elem_t);
@@ -2110,27 +2403,40 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_add_kernel(ReduceElemType el
     };
     uint32_t gid = load_x(gid_var);
     uint32_t wgid = load_x(wgid_var);
+    if (W) gid = emit_wide_gid(B, wide, uint_t, v3uint, local_size, &wgid);
 
     uint32_t pc_count_ptr = B.get_next_id();
-    B.emit_op(SPIRVOp::OpAccessChain, {ptr_pc_uint, pc_count_ptr, pc_var, U(0)});
+    B.emit_op(SPIRVOp::OpAccessChain, {ptr_pc_idx, pc_count_ptr, pc_var, U(0)});
     uint32_t count = B.get_next_id();
-    B.emit_op(SPIRVOp::OpLoad, {uint_t, count, pc_count_ptr});
+    B.emit_op(SPIRVOp::OpLoad, {idx_t, count, pc_count_ptr});
 
-    // if (gid < count && wgid > 0) data[gid] += offsets[wgid-1];
-    uint32_t c1 = B.get_next_id();
-    B.emit_op(SPIRVOp::OpULessThan, {bool_t, c1, gid, count});
-    uint32_t c2 = B.get_next_id();
-    B.emit_op(SPIRVOp::OpUGreaterThan, {bool_t, c2, wgid, U(0)});
-    uint32_t doit = B.get_next_id();
-    B.emit_op(SPIRVOp::OpLogicalAnd, {bool_t, doit, c1, c2});
-    uint32_t thenb = B.get_next_id();
-    uint32_t mb = B.get_next_id();
-    B.emit_op(SPIRVOp::OpSelectionMerge, {mb, 0});
-    B.emit_op(SPIRVOp::OpBranchConditional, {doit, thenb, mb});
-    B.emit_op(SPIRVOp::OpLabel, {thenb});
-    {
+    auto combine = [&](uint32_t earlier, uint32_t later) {
+        // op(earlier, later): the offset/carry covers EARLIER elements, so it is the
+        // left operand (left-associative inclusive scan); '+' commutes so the default
+        // path is unaffected.
+        uint32_t r = B.get_next_id();
+        if (op_fn_id)
+            B.emit_op(SPIRVOp::OpFunctionCall, {elem_t, r, op_fn_id, earlier, later});
+        else
+            B.emit_op(is_float ? SPIRVOp::OpFAdd : SPIRVOp::OpIAdd, {elem_t, r, later, earlier});
+        return r;
+    };
+
+    if (!stream_base_) {
+        // if (gid < count && wgid > 0) data[gid] += offsets[wgid-1];
+        uint32_t c1 = B.get_next_id();
+        B.emit_op(SPIRVOp::OpULessThan, {bool_t, c1, gid, count});
+        uint32_t c2 = B.get_next_id();
+        B.emit_op(SPIRVOp::OpUGreaterThan, {bool_t, c2, wgid, X(0)});
+        uint32_t doit = B.get_next_id();
+        B.emit_op(SPIRVOp::OpLogicalAnd, {bool_t, doit, c1, c2});
+        uint32_t thenb = B.get_next_id();
+        uint32_t mb = B.get_next_id();
+        B.emit_op(SPIRVOp::OpSelectionMerge, {mb, 0});
+        B.emit_op(SPIRVOp::OpBranchConditional, {doit, thenb, mb});
+        B.emit_op(SPIRVOp::OpLabel, {thenb});
         uint32_t prev_idx = B.get_next_id();
-        B.emit_op(SPIRVOp::OpISub, {uint_t, prev_idx, wgid, U(1)});
+        B.emit_op(SPIRVOp::OpISub, {idx_t, prev_idx, wgid, X(1)});
         uint32_t p_off = B.get_next_id();
         B.emit_op(SPIRVOp::OpAccessChain, {ptr_sb_elem, p_off, off_var, U(0), prev_idx});
         uint32_t ofs = B.get_next_id();
@@ -2139,18 +2445,64 @@ std::vector<uint32_t> SPIRVGenerator::generate_scan_add_kernel(ReduceElemType el
         B.emit_op(SPIRVOp::OpAccessChain, {ptr_sb_elem, p_d, data_var, U(0), gid});
         uint32_t dv = B.get_next_id();
         B.emit_op(SPIRVOp::OpLoad, {elem_t, dv, p_d});
-        uint32_t nv = B.get_next_id();
-        // out[gid] = op(offset, local_prefix). The block offset covers EARLIER elements,
-        // so it is the left operand (left-associative inclusive scan); '+' commutes so
-        // the default path is unaffected.
-        if (op_fn_id)
-            B.emit_op(SPIRVOp::OpFunctionCall, {elem_t, nv, op_fn_id, ofs, dv});
-        else
-            B.emit_op(is_float ? SPIRVOp::OpFAdd : SPIRVOp::OpIAdd, {elem_t, nv, dv, ofs});
-        B.emit_op(SPIRVOp::OpStore, {p_d, nv});
+        B.emit_op(SPIRVOp::OpStore, {p_d, combine(ofs, dv)});
+        B.emit_op(SPIRVOp::OpBranch, {mb});
+        B.emit_op(SPIRVOp::OpLabel, {mb});
+    } else {
+        // Streaming: data[base+gid] = op(carry?, op(offsets[wgid-1]?, data[base+gid])),
+        // so block 0 of every chunk after the first also picks up the carry-in. Both
+        // optional terms are combined unconditionally and selected away (uniform flow).
+        auto pc_ptr = [&](uint32_t ptr_t, uint32_t member) {
+            uint32_t p = B.get_next_id();
+            B.emit_op(SPIRVOp::OpAccessChain, {ptr_t, p, pc_var, U(member)});
+            return p;
+        };
+        uint32_t base = B.get_next_id();
+        B.emit_op(SPIRVOp::OpLoad, {uint_t, base, pc_ptr(ptr_pc_uint, 1)});
+        uint32_t has_carry_u = B.get_next_id();
+        B.emit_op(SPIRVOp::OpLoad, {uint_t, has_carry_u, pc_ptr(ptr_pc_uint, 2)});
+        uint32_t has_carry = B.get_next_id();
+        B.emit_op(SPIRVOp::OpINotEqual, {bool_t, has_carry, has_carry_u, U(0)});
+        uint32_t carry = B.get_next_id();
+        B.emit_op(SPIRVOp::OpLoad, {elem_t, carry, pc_ptr(ptr_pc_elem, 3)});
+
+        uint32_t c1 = B.get_next_id();
+        B.emit_op(SPIRVOp::OpULessThan, {bool_t, c1, gid, count});
+        uint32_t c2 = B.get_next_id();
+        B.emit_op(SPIRVOp::OpUGreaterThan, {bool_t, c2, wgid, U(0)});
+        uint32_t any = B.get_next_id();
+        B.emit_op(SPIRVOp::OpLogicalOr, {bool_t, any, c2, has_carry});
+        uint32_t doit = B.get_next_id();
+        B.emit_op(SPIRVOp::OpLogicalAnd, {bool_t, doit, c1, any});
+        uint32_t thenb = B.get_next_id();
+        uint32_t mb = B.get_next_id();
+        B.emit_op(SPIRVOp::OpSelectionMerge, {mb, 0});
+        B.emit_op(SPIRVOp::OpBranchConditional, {doit, thenb, mb});
+        B.emit_op(SPIRVOp::OpLabel, {thenb});
+        uint32_t wgm1 = B.get_next_id();
+        B.emit_op(SPIRVOp::OpISub, {uint_t, wgm1, wgid, U(1)});
+        uint32_t prev_idx = B.get_next_id();        // clamped: block 0 reads offsets[0]
+        B.emit_op(SPIRVOp::OpSelect, {uint_t, prev_idx, c2, wgm1, U(0)});
+        uint32_t p_off = B.get_next_id();
+        B.emit_op(SPIRVOp::OpAccessChain, {ptr_sb_elem, p_off, off_var, U(0), prev_idx});
+        uint32_t ofs = B.get_next_id();
+        B.emit_op(SPIRVOp::OpLoad, {elem_t, ofs, p_off});
+        uint32_t idx = B.get_next_id();
+        B.emit_op(SPIRVOp::OpIAdd, {uint_t, idx, base, gid});
+        uint32_t p_d = B.get_next_id();
+        B.emit_op(SPIRVOp::OpAccessChain, {ptr_sb_elem, p_d, data_var, U(0), idx});
+        uint32_t dv = B.get_next_id();
+        B.emit_op(SPIRVOp::OpLoad, {elem_t, dv, p_d});
+        uint32_t with_ofs = combine(ofs, dv);
+        uint32_t v1 = B.get_next_id();
+        B.emit_op(SPIRVOp::OpSelect, {elem_t, v1, c2, with_ofs, dv});
+        uint32_t with_carry = combine(carry, v1);
+        uint32_t v2 = B.get_next_id();
+        B.emit_op(SPIRVOp::OpSelect, {elem_t, v2, has_carry, with_carry, v1});
+        B.emit_op(SPIRVOp::OpStore, {p_d, v2});
         B.emit_op(SPIRVOp::OpBranch, {mb});
+        B.emit_op(SPIRVOp::OpLabel, {mb});
     }
-    B.emit_op(SPIRVOp::OpLabel, {mb});
     B.emit_op(SPIRVOp::OpReturn, {});
     B.emit_op(SPIRVOp::OpFunctionEnd, {});
 
@@ -2173,6 +2525,8 @@ std::vector<uint32_t> SPIRVGenerator::generate_exclusive_shift_kernel(ReduceElem
     const bool is_float = (elem == ReduceElemType::F32 || elem == ReduceElemType::F64);
     const bool is_wide  = (elem == ReduceElemType::F64 || elem == ReduceElemType::I64);
     const uint32_t stride = is_wide ? 8 : 4;
+    const uint32_t local_size = skeleton_local_size("scan", elem);
+    const bool W = wide_index_ && !stream_base_;  // set_wide_index
 
     type_cache_.clear();
     constant_cache_.clear();
@@ -2185,7 +2539,7 @@ std::vector<uint32_t> SPIRVGenerator::generate_exclusive_shift_kernel(ReduceElem
     B.set_section(SPIRVBuilder::Section::Capabilities);
     B.emit_op(SPIRVOp::OpCapability, {1});            // Shader
     if (elem == ReduceElemType::F64) B.emit_op(SPIRVOp::OpCapability, {10});
-    if (elem == ReduceElemType::I64) B.emit_op(SPIRVOp::OpCapability, {11});
+    if (elem == ReduceElemType::I64 || W) B.emit_op(SPIRVOp::OpCapability, {11});
 
     B.set_section(SPIRVBuilder::Section::Preamble);
     B.emit_op(SPIRVOp::OpMemoryModel, {0, 1});        // Logical GLSL450
@@ -2195,6 +2549,9 @@ std::vector<uint32_t> SPIRVGenerator::generate_exclusive_shift_kernel(ReduceElem
     uint32_t fn_t   = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeFunction, {fn_t, void_t});
     uint32_t uint_t = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeInt, {uint_t, 32, 0});
     uint32_t bool_t = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeBool, {bool_t});
+    uint32_t u64_t = 0;
+    if (W) { u64_t = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeInt, {u64_t, 64, 0}); }
+    const uint32_t idx_t = W ? u64_t : uint_t;
 
     uint32_t elem_t = B.get_next_id();
     if (is_float) B.emit_op(SPIRVOp::OpTypeFloat, {elem_t, is_wide ? 64u : 32u});
@@ -2225,16 +2582,27 @@ std::vector<uint32_t> SPIRVGenerator::generate_exclusive_shift_kernel(ReduceElem
     if (is_wide) B.emit_op(SPIRVOp::OpConstant, {elem_t, elem_zero, 0, 0});
     else         B.emit_op(SPIRVOp::OpConstant, {elem_t, elem_zero, 0});
 
-    // push { uint count@0, elem init@8 }.
-    uint32_t pc_struct = B.get_next_id(); B.emit_op(SPIRVOp::OpTypeStruct, {pc_struct, uint_t, elem_t});
+    // push { uint count@0, elem init@8 } — streaming adds uint base@4 (member 1), which
+    // fits the padding, so init keeps its offset. A streamed exclusive scan runs the
+    // chunk-local inclusive pair and pushes init' = init + (total of earlier chunks).
+    // Wide: { uint64 count@0, elem init@8 }.
+    uint32_t pc_struct = B.get_next_id();
+    if (stream_base_) B.emit_op(SPIRVOp::OpTypeStruct, {pc_struct, uint_t, uint_t, elem_t});
+    else              B.emit_op(SPIRVOp::OpTypeStruct, {pc_struct, idx_t, elem_t});
+    const uint32_t init_member = stream_base_ ? 2 : 1;
     uint32_t ptr_pc_struct = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_pc_struct, 9, pc_struct});
     uint32_t ptr_pc_uint = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_pc_uint, 9, uint_t});
     uint32_t ptr_pc_elem = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_pc_elem, 9, elem_t});
+    uint32_t ptr_pc_idx = ptr_pc_uint;
+    if (W) { ptr_pc_idx = B.get_next_id(); B.emit_op(SPIRVOp::OpTypePointer, {ptr_pc_idx, 9, u64_t}); }
 
     uint32_t gid_var  = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_in_v3, gid_var, 1});
     uint32_t in_var   = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_sb_struct, in_var, 12});
     uint32_t out_var  = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_sb_struct, out_var, 12});
     uint32_t pc_var   = B.get_next_id(); B.emit_op(SPIRVOp::OpVariable, {ptr_pc_struct, pc_var, 9});
+    WideIds wide;
+    if (W) wide = declare_wide_ids(B, u64_t, ptr_in_v3, 0, 0);
+    auto X = [&](uint32_t v) { return W ? wide_const(B, wide, v) : U(v); };
 
     uint32_t main_id = B.get_next_id();
 
@@ -2247,20 +2615,22 @@ std::vector<uint32_t> SPIRVGenerator::generate_exclusive_shift_kernel(ReduceElem
     B.emit_op(SPIRVOp::OpDecorate, {out_var, 34, 0});
     B.emit_op(SPIRVOp::OpDecorate, {out_var, 33, 1});
     B.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct, 0, 35, 0});   // count offset 0
-    B.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct, 1, 35, 8});   // init  offset 8
+    if (stream_base_) B.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct, 1, 35, 4});  // base
+    B.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct, init_member, 35, 8});  // init offset 8
     B.emit_op(SPIRVOp::OpDecorate, {pc_struct, 2});
     B.emit_op(SPIRVOp::OpDecorate, {gid_var, 11, 28});
 
     B.set_section(SPIRVBuilder::Section::EntryPoints);
-    uint32_t iface[] = {gid_var, in_var, out_var, pc_var};
-    uint32_t ep_wc = 1 + 1 + 1 + 2 + static_cast<uint32_t>(sizeof(iface) / sizeof(iface[0]));
+    std::vector<uint32_t> iface = {gid_var, in_var, out_var, pc_var};
+    iface.insert(iface.end(), wide.added.begin(), wide.added.end());
+    uint32_t ep_wc = 1 + 1 + 1 + 2 + static_cast<uint32_t>(iface.size());
     B.emit_word((ep_wc << 16) | static_cast<uint32_t>(SPIRVOp::OpEntryPoint));
     B.emit_word(5);
     B.emit_word(main_id);
     B.emit_word(0x6e69616d);
     B.emit_word(0x00000000);
     for (uint32_t id : iface) B.emit_word(id);
-    B.emit_op(SPIRVOp::OpExecutionMode, {main_id, 17, 256, 1, 1});
+    B.emit_op(SPIRVOp::OpExecutionMode, {main_id, 17, local_size, 1, 1});
 
     B.set_section(SPIRVBuilder::Section::Code);
     B.emit_op(SPIRVOp::OpFunction, {void_t, main_id, 0, fn_t});
@@ -2270,25 +2640,48 @@ std::vector<uint32_t> SPIRVGenerator::generate_exclusive_shift_kernel(ReduceElem
     B.emit_op(SPIRVOp::OpLoad, {v3uint, gvec, gid_var});
     uint32_t gid = B.get_next_id();
     B.emit_op(SPIRVOp::OpCompositeExtract, {uint_t, gid, gvec, 0});
+    if (W) gid = emit_wide_gid(B, wide, uint_t, v3uint, local_size);
 
     uint32_t pc_count_ptr = B.get_next_id();
-    B.emit_op(SPIRVOp::OpAccessChain, {ptr_pc_uint, pc_count_ptr, pc_var, U(0)});
+    B.emit_op(SPIRVOp::OpAccessChain, {ptr_pc_idx, pc_count_ptr, pc_var, U(0)});
     uint32_t count = B.get_next_id();
-    B.emit_op(SPIRVOp::OpLoad, {uint_t, count, pc_count_ptr});
+    B.emit_op(SPIRVOp::OpLoad, {idx_t, count, pc_count_ptr});
     uint32_t pc_init_ptr = B.get_next_id();
-    B.emit_op(SPIRVOp::OpAccessChain, {ptr_pc_elem, pc_init_ptr, pc_var, U(1)});
+    B.emit_op(SPIRVOp::OpAccessChain, {ptr_pc_elem, pc_init_ptr, pc_var, U(init_member)});
     uint32_t init = B.get_next_id();
     B.emit_op(SPIRVOp::OpLoad, {elem_t, init, pc_init_ptr});
+    uint32_t base = U(0);
+    if (stream_base_) {
+        uint32_t p = B.get_next_id();
+        B.emit_op(SPIRVOp::OpAccessChain, {ptr_pc_uint, p, pc_var, U(1)});
+        base = B.get_next_id();
+        B.emit_op(SPIRVOp::OpLoad, {uint_t, base, p});
+    }
 
     // is_first = (gid == 0); prev_idx = is_first ? 0 : gid-1 (branchless, avoids underflow OOB).
     uint32_t is_first = B.get_next_id();
-    B.emit_op(SPIRVOp::OpIEqual, {bool_t, is_first, gid, U(0)});
+    B.emit_op(SPIRVOp::OpIEqual, {bool_t, is_first, gid, X(0)});
     uint32_t gid_m1 = B.get_next_id();
-    B.emit_op(SPIRVOp::OpISub, {uint_t, gid_m1, gid, U(1)});
+    B.emit_op(SPIRVOp::OpISub, {idx_t, gid_m1, gid, X(1)});
     uint32_t prev_idx = B.get_next_id();
-    B.emit_op(SPIRVOp::OpSelect, {uint_t, prev_idx, is_first, U(0), gid_m1});
+    B.emit_op(SPIRVOp::OpSelect, {idx_t, prev_idx, is_first, X(0), gid_m1});
+    if (W) {
+        // The padding groups of the 2D grid lie far past the range: read in[0] there.
+        uint32_t live = B.get_next_id();
+        B.emit_op(SPIRVOp::OpULessThan, {bool_t, live, gid, count});
+        uint32_t clamped = B.get_next_id();
+        B.emit_op(SPIRVOp::OpSelect, {idx_t, clamped, live, prev_idx, X(0)});
+        prev_idx = clamped;
+    }
+    uint32_t prev_at = prev_idx, out_at = gid;
+    if (stream_base_) {
+        prev_at = B.get_next_id();
+        B.emit_op(SPIRVOp::OpIAdd, {uint_t, prev_at, base, prev_idx});
+        out_at = B.get_next_id();
+        B.emit_op(SPIRVOp::OpIAdd, {uint_t, out_at, base, gid});
+    }
     uint32_t p_prev = B.get_next_id();
-    B.emit_op(SPIRVOp::OpAccessChain, {ptr_sb_elem, p_prev, in_var, U(0), prev_idx});
+    B.emit_op(SPIRVOp::OpAccessChain, {ptr_sb_elem, p_prev, in_var, U(0), prev_at});
     uint32_t prevv = B.get_next_id();
     B.emit_op(SPIRVOp::OpLoad, {elem_t, prevv, p_prev});
     // addend = is_first ? 0 : in[gid-1]; val = init + addend.
@@ -2307,7 +2700,7 @@ std::vector<uint32_t> SPIRVGenerator::generate_exclusive_shift_kernel(ReduceElem
     B.emit_op(SPIRVOp::OpLabel, {thenb});
     {
         uint32_t p_out = B.get_next_id();
-        B.emit_op(SPIRVOp::OpAccessChain, {ptr_sb_elem, p_out, out_var, U(0), gid});
+        B.emit_op(SPIRVOp::OpAccessChain, {ptr_sb_elem, p_out, out_var, U(0), out_at});
         B.emit_op(SPIRVOp::OpStore, {p_out, val});
         B.emit_op(SPIRVOp::OpBranch, {mb});
     }
@@ -2334,6 +2727,7 @@ std::vector<uint32_t> SPIRVGenerator::generate_sort_kernel(ReduceElemType elem,
     const bool is_float = (elem == ReduceElemType::F32 || elem == ReduceElemType::F64);
     const bool is_wide  = (elem == ReduceElemType::F64 || elem == ReduceElemType::I64);
     const uint32_t stride = is_wide ? 8 : 4;
+    const uint32_t local_size = skeleton_local_size("sort", elem);
 
     // The user comparator is translated via the shared translate_instruction path,
     // which uses these member caches/state — start clean (and not pointer-chasing).
@@ -2419,7 +2813,7 @@ std::vector<uint32_t> SPIRVGenerator::generate_sort_kernel(ReduceElemType elem,
     B.emit_word(0x6e69616d);
     B.emit_word(0x00000000);
     for (uint32_t id : iface) B.emit_word(id);
-    B.emit_op(SPIRVOp::OpExecutionMode, {main_id, 17, 256, 1, 1});
+    B.emit_op(SPIRVOp::OpExecutionMode, {main_id, 17, local_size, 1, 1});
 
     // ---- Optional user comparator as a callable SPIR-V function bool(T,T) ----
     // Emitted like the reduce keystone's binary op, but returns bool: comp(x,y) is
@@ -3154,7 +3548,8 @@ uint32_t SPIRVGenerator::data_element_type_id(SPIRVBuilder& builder, llvm::LLVMC
 // count). Layout matches the runtime's push: { uint count @0 } for ordinary
 // kernels, extended to { uint count @0, uint64 host_base @8, uint64 dev_base @16 }
 // for pointer-chasing kernels. count stays at offset 0 in both, so ordinary
-// kernels are unaffected.
+// kernels are unaffected. Streaming variants (set_stream_base) add { uint base @4 },
+// which sits in the padding before host_base, so the other offsets do not move.
 void SPIRVGenerator::setup_push_constants(SPIRVBuilder& builder, llvm::LLVMContext& ctx) {
     uint32_t int_id = get_type_id(builder, llvm::Type::getInt32Ty(ctx));
     pc_int32_id_ = int_id;
@@ -3166,21 +3561,24 @@ void SPIRVGenerator::setup_push_constants(SPIRVBuilder& builder, llvm::LLVMConte
 
     builder.set_section(SPIRVBuilder::Section::Types);
     uint32_t pc_struct_id = builder.get_next_id();
+    // Wide: count is a uint64 (offset 0); host_base/dev_base keep offsets 8/16.
+    std::vector<uint32_t> members = {wide_wrapper() ? get_type_id(builder, llvm::Type::getInt64Ty(ctx))
+                                                    : int_id};
+    std::vector<uint32_t> offsets = {0};
+    if (stream_base_) { members.push_back(int_id); offsets.push_back(4); }
     if (needs_reloc_bases) {
         uint32_t u64 = get_type_id(builder, llvm::Type::getInt64Ty(ctx));
-        builder.set_section(SPIRVBuilder::Section::Types);
-        builder.emit_op(SPIRVOp::OpTypeStruct, {pc_struct_id, int_id, u64, u64});
-        builder.set_section(SPIRVBuilder::Section::Decorations);
-        builder.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct_id, 0, 35 /* Offset */, 0});
-        builder.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct_id, 1, 35 /* Offset */, 8});
-        builder.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct_id, 2, 35 /* Offset */, 16});
-        builder.emit_op(SPIRVOp::OpDecorate, {pc_struct_id, 2 /* Block */});
-    } else {
-        builder.emit_op(SPIRVOp::OpTypeStruct, {pc_struct_id, int_id});
-        builder.set_section(SPIRVBuilder::Section::Decorations);
-        builder.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct_id, 0, 35 /* Offset */, 0});
-        builder.emit_op(SPIRVOp::OpDecorate, {pc_struct_id, 2 /* Block */});
+        members.push_back(u64); offsets.push_back(8);
+        members.push_back(u64); offsets.push_back(16);
     }
+    std::vector<uint32_t> struct_ops = {pc_struct_id};
+    struct_ops.insert(struct_ops.end(), members.begin(), members.end());
+    builder.set_section(SPIRVBuilder::Section::Types);
+    builder.emit_op(SPIRVOp::OpTypeStruct, struct_ops);
+    builder.set_section(SPIRVBuilder::Section::Decorations);
+    for (uint32_t m = 0; m < offsets.size(); ++m)
+        builder.emit_op(SPIRVOp::OpMemberDecorate, {pc_struct_id, m, 35 /* Offset */, offsets[m]});
+    builder.emit_op(SPIRVOp::OpDecorate, {pc_struct_id, 2 /* Block */});
 
     uint32_t ptr_pc_id = get_pointer_type_id(builder, pc_struct_id, 9 /* PushConstant */);
 
@@ -3197,8 +3595,10 @@ void SPIRVGenerator::ensure_reloc_bases(SPIRVBuilder& builder, llvm::LLVMContext
     uint32_t u64 = get_type_id(builder, llvm::Type::getInt64Ty(ctx));
     llvm::Type* i32 = llvm::Type::getInt32Ty(ctx);
     uint32_t ptr_u64_pc = get_pointer_type_id(builder, u64, 9 /* PushConstant */);
-    uint32_t one = get_constant_id(builder, llvm::ConstantInt::get(i32, 1));
-    uint32_t two = get_constant_id(builder, llvm::ConstantInt::get(i32, 2));
+    // host_base/dev_base follow count (and the streaming base, when present).
+    const unsigned first = stream_base_ ? 2 : 1;
+    uint32_t one = get_constant_id(builder, llvm::ConstantInt::get(i32, first));
+    uint32_t two = get_constant_id(builder, llvm::ConstantInt::get(i32, first + 1));
 
     builder.set_section(SPIRVBuilder::Section::Code);
     uint32_t p_host = builder.get_next_id();
@@ -3472,12 +3872,20 @@ void SPIRVGenerator::generate_kernel_wrapper(SPIRVBuilder& builder, uint32_t ent
     builder.emit_op(SPIRVOp::OpVariable, {ptr_input_v3uint_id, gl_id_var_id, 1});
     builder.set_section(SPIRVBuilder::Section::Decorations);
     builder.emit_op(SPIRVOp::OpDecorate, {gl_id_var_id, 11 /* BuiltIn */, 28 /* GlobalInvocationID */});
+
+    // Wide variant (set_wide_index): elements are indexed by the 64-bit flat
+    // invocation of a 2D grid and count is a uint64.
+    const bool wide = wide_wrapper();
+    uint32_t u64_id = wide ? get_type_id(builder, llvm::Type::getInt64Ty(ctx)) : 0;
+    WideIds wide_ids;
+    if (wide) wide_ids = declare_wide_ids(builder, u64_id, ptr_input_v3uint_id, 0, 0);
     
     // Entry Point Decl
     builder.set_section(SPIRVBuilder::Section::EntryPoints);
-    // Count: Model(1)+Func(1)+Name(2)+GlobalID(1)+Buffers+PC(1)+Captures(0 or 1)
+    // Count: Model(1)+Func(1)+Name(2)+GlobalID(1)+Buffers+PC(1)+Captures(0 or 1)+wide inputs
     uint32_t ep_wc = 1 + 1 + 1 + 2 + 1 + static_cast<uint32_t>(buffer_var_ids.size()) + 1;
     if (captures_var_id != 0) ep_wc += 1;
+    ep_wc += static_cast<uint32_t>(wide_ids.added.size());
 
     builder.emit_word((ep_wc << 16) | static_cast<uint32_t>(SPIRVOp::OpEntryPoint));
     builder.emit_word(5); // GLCompute
@@ -3488,6 +3896,7 @@ void SPIRVGenerator::generate_kernel_wrapper(SPIRVBuilder& builder, uint32_t ent
     for (auto id : buffer_var_ids) builder.emit_word(id);
     builder.emit_word(pc_var_id_);
     if (captures_var_id != 0) builder.emit_word(captures_var_id);
+    for (auto id : wide_ids.added) builder.emit_word(id);
     
     builder.emit_op(SPIRVOp::OpExecutionMode, {entry_id, 17 /* LocalSize */, 256, 1, 1});
     
@@ -3507,14 +3916,31 @@ void SPIRVGenerator::generate_kernel_wrapper(SPIRVBuilder& builder, uint32_t ent
     builder.emit_op(SPIRVOp::OpLoad, {v3uint_id, id_vec, gl_id_var_id});
     uint32_t id_x = builder.get_next_id();
     builder.emit_op(SPIRVOp::OpCompositeExtract, {int_id, id_x, id_vec, 0});
+    if (wide) id_x = emit_wide_gid(builder, wide_ids, int_id, v3uint_id, 256);
     
     // Load Count from PC
     uint32_t Zero = get_constant_id(builder, llvm::ConstantInt::get(int32_ty, 0));
     uint32_t ptr_int_pc = get_pointer_type_id(builder, int_id, 9 /* PushConstant */);
+    uint32_t count_id = wide ? u64_id : int_id;
+    uint32_t ptr_count_pc = wide ? get_pointer_type_id(builder, u64_id, 9 /* PushConstant */) : ptr_int_pc;
     uint32_t ptr_count = builder.get_next_id();
-    builder.emit_op(SPIRVOp::OpAccessChain, {ptr_int_pc, ptr_count, pc_var_id_, Zero});
+    builder.emit_op(SPIRVOp::OpAccessChain, {ptr_count_pc, ptr_count, pc_var_id_, Zero});
     uint32_t count = builder.get_next_id();
-    builder.emit_op(SPIRVOp::OpLoad, {int_id, count, ptr_count});
+    builder.emit_op(SPIRVOp::OpLoad, {count_id, count, ptr_count});
+
+    // Streaming variant: this dispatch covers [base, base + count) of the bound
+    // buffers (one slot of the runtime's chunk ring), so elements are addressed at
+    // base + x while the bounds check stays chunk-local.
+    uint32_t elem_idx = id_x;
+    if (stream_base_) {
+        uint32_t One = get_constant_id(builder, llvm::ConstantInt::get(int32_ty, 1));
+        uint32_t ptr_base = builder.get_next_id();
+        builder.emit_op(SPIRVOp::OpAccessChain, {ptr_int_pc, ptr_base, pc_var_id_, One});
+        uint32_t base = builder.get_next_id();
+        builder.emit_op(SPIRVOp::OpLoad, {int_id, base, ptr_base});
+        elem_idx = builder.get_next_id();
+        builder.emit_op(SPIRVOp::OpIAdd, {int_id, elem_idx, base, id_x});
+    }
     
     // Bounds Check: if (x < count)
     uint32_t cond = builder.get_next_id();
@@ -3538,7 +3964,7 @@ void SPIRVGenerator::generate_kernel_wrapper(SPIRVBuilder& builder, uint32_t ent
         uint32_t var_id = buffer_var_ids[i];
         uint32_t this_ptr_elem = (is_transform && i == 1) ? ptr_out_elem_sb : ptr_elem_sb;
         uint32_t element_ptr = builder.get_next_id();
-        builder.emit_op(SPIRVOp::OpAccessChain, {this_ptr_elem, element_ptr, var_id, Zero, id_x});
+        builder.emit_op(SPIRVOp::OpAccessChain, {this_ptr_elem, element_ptr, var_id, Zero, elem_idx});
         data_buffer_ptrs.push_back(element_ptr);
         llvm::errs() << "[SPIRVGenerator] Data buffer param " << i << " -> element ptr\n";
     }
@@ -3671,4 +4097,254 @@ void SPIRVGenerator::emit_decorations(std::vector<uint32_t>& spirv) {}
 void SPIRVGenerator::emit_types(std::vector<uint32_t>& spirv) {}
 void SPIRVGenerator::emit_function(std::vector<uint32_t>& spirv, llvm::Function* func) {}
 
+
+// ---------------------------------------------------------------------------
+// Multi-entry-point linking
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// Words taken by the literal string starting at w[i] (NUL-terminated, padded).
+size_t string_words(const uint32_t* w, size_t avail) {
+    for (size_t k = 0; k < avail; ++k)
+        if (((w[k] >> 24) & 0xff) == 0 || ((w[k] >> 16) & 0xff) == 0 ||
+            ((w[k] >> 8) & 0xff) == 0 || (w[k] & 0xff) == 0)
+            return k + 1;
+    return avail;
+}
+
+std::vector<uint32_t> encode_string(const std::string& s) {
+    std::vector<uint32_t> out((s.size() + 4) / 4, 0);
+    for (size_t i = 0; i < s.size(); ++i) out[i / 4] |= uint32_t(uint8_t(s[i])) << (8 * (i % 4));
+    return out;
+}
+
+// Operand kinds for the opcodes our generators emit inside functions: 1 = the
+// operand at idx (0-based, after the opcode word) is an id, 0 = a literal,
+// -1 = an opcode we do not know, so the module cannot be relinked safely.
+int body_operand_is_id(uint32_t op, size_t idx) {
+    if ((op >= 109 && op <= 122) || op == 124 || (op >= 126 && op <= 152) ||
+        (op >= 154 && op <= 191) || (op >= 194 && op <= 205) || op == 224 || op == 225 ||
+        (op >= 227 && op <= 242) || (op >= 333 && op <= 341) || (op >= 343 && op <= 348) ||
+        (op >= 400 && op <= 403))
+        return 1;
+    switch (op) {
+    case 0: case 1: case 55: case 56: case 57: case 65: case 66: case 67: case 70:
+    case 77: case 78: case 80: case 83: case 84: case 245: case 248: case 249:
+    case 252: case 253: case 254: case 255: case 317:
+        return 1;
+    case 8:   return idx == 0;                  // OpLine: file id, line/column
+    case 12:  return idx != 3;                  // OpExtInst: instruction number
+    case 54:  return idx != 2;                  // OpFunction: control mask
+    case 59:  return idx != 2;                  // OpVariable: storage class
+    case 61:  return idx <= 2;                  // OpLoad: memory operands
+    case 62:  case 63: return idx <= 1;         // OpStore / OpCopyMemory
+    case 68:  return idx != 3;                  // OpArrayLength: member index
+    case 79:  return idx <= 3;                  // OpVectorShuffle: components
+    case 81:  return idx <= 2;                  // OpCompositeExtract: indices
+    case 82:  return idx <= 3;                  // OpCompositeInsert: indices
+    case 246: return idx <= 1;                  // OpLoopMerge: control
+    case 247: return idx == 0;                  // OpSelectionMerge: control
+    case 250: return idx <= 2;                  // OpBranchConditional: weights
+    case 342: return idx != 3;                  // OpGroupNonUniformBallotBitCount
+    default:
+        if (op >= 349 && op <= 364) return idx != 3;  // group arithmetic: GroupOperation
+        return -1;
+    }
+}
+
+// Global-section opcodes: which operand is the result id and whether operand idx is
+// an id. Returns false for anything outside the types/constants/variables we emit.
+bool global_operand_kinds(uint32_t op, size_t nops, size_t& result, std::vector<bool>& is_id) {
+    is_id.assign(nops, false);
+    switch (op) {
+    case 19: case 20: case 21: case 22: result = 0; return true;  // void/bool/int/float
+    case 23: case 24: result = 0; if (nops > 1) is_id[1] = true; return true;
+    case 28: case 29: case 30: case 33:
+        result = 0; for (size_t i = 1; i < nops; ++i) is_id[i] = true; return true;
+    case 32: result = 0; if (nops > 2) is_id[2] = true; return true;
+    case 1: case 41: case 42: case 43: case 46:
+        result = 1; if (nops > 0) is_id[0] = true; return true;
+    case 44: result = 1; for (size_t i = 0; i < nops; ++i) is_id[i] = i != 1; return true;
+    case 59: result = 1; if (nops > 0) is_id[0] = true; if (nops > 3) is_id[3] = true; return true;
+    default: return false;
+    }
+}
+
+} // namespace
+
+std::vector<uint32_t> SPIRVGenerator::link_entry_points(
+    const std::vector<std::pair<std::string, std::vector<uint32_t>>>& parts) {
+    std::vector<uint32_t> caps, exts, imports, memory_model, entries, modes,
+                          strings, names, annotations, globals, functions;
+    std::set<uint32_t> seen_caps;
+    std::set<std::string> seen_exts;
+    std::map<std::string, uint32_t> import_ids;
+    std::map<std::vector<uint32_t>, uint32_t> global_ids;  // dedup key -> linked id
+    uint32_t version = 0, generator = 0, next = 1;
+
+    for (const auto& part : parts) {
+        const std::vector<uint32_t>& m = part.second;
+        if (m.size() < 5 || m[0] != 0x07230203) return {};
+        version = std::max(version, m[1]);
+        if (!generator) generator = m[2];
+
+        struct Inst { uint32_t op; const uint32_t* w; size_t n; };  // w: operands
+        std::vector<Inst> insts;
+        for (size_t k = 5; k < m.size();) {
+            const uint32_t wc = m[k] >> 16;
+            if (wc == 0 || k + wc > m.size()) return {};
+            insts.push_back({m[k] & 0xffff, &m[k + 1], size_t(wc - 1)});
+            k += wc;
+        }
+
+        std::unordered_map<uint32_t, uint32_t> ids;
+        std::set<uint32_t> merged;  // old ids folded into an earlier module's definition
+        auto map = [&](uint32_t id) {
+            auto it = ids.find(id);
+            return it != ids.end() ? it->second : (ids[id] = next++);
+        };
+        auto emit = [](std::vector<uint32_t>& out, uint32_t op, const std::vector<uint32_t>& ops) {
+            out.push_back(uint32_t(ops.size() + 1) << 16 | op);
+            out.insert(out.end(), ops.begin(), ops.end());
+        };
+
+        // Decoration signature per target, so only identically-decorated globals merge.
+        std::map<uint32_t, std::vector<std::vector<uint32_t>>> decos;
+        for (const Inst& in : insts)
+            if ((in.op == 71 || in.op == 72) && in.n >= 1) {
+                std::vector<uint32_t> sig{in.op};
+                sig.insert(sig.end(), in.w + 1, in.w + in.n);
+                decos[in.w[0]].push_back(std::move(sig));
+            }
+        for (auto& kv : decos) std::sort(kv.second.begin(), kv.second.end());
+
+        // Pass A: types, constants and global variables, in order (they only refer
+        // backwards). Non-aggregate types, constants and Input builtins merge by value.
+        bool in_function = false;
+        for (const Inst& in : insts) {
+            if (in.op == 54) in_function = true;
+            if (in.op == 56) in_function = false;
+            if (in_function) continue;
+            size_t result;
+            std::vector<bool> is_id;
+            if (in.op == 39 || (in.op >= 25 && in.op <= 27) || in.op == 31 ||
+                (in.op >= 45 && in.op <= 52 && in.op != 46))
+                return {};  // forward pointers, images, spec constants: not linked
+            if (!global_operand_kinds(in.op, in.n, result, is_id)) continue;
+            std::vector<uint32_t> ops(in.w, in.w + in.n);
+            std::vector<uint32_t> key{in.op};
+            for (size_t i = 0; i < in.n; ++i) {
+                if (i == result) continue;
+                if (is_id[i]) ops[i] = map(in.w[i]);
+                key.push_back(ops[i]);
+            }
+            auto d = decos.find(in.w[result]);
+            if (d != decos.end())
+                for (const auto& sig : d->second) {
+                    key.push_back(~0u);
+                    key.insert(key.end(), sig.begin(), sig.end());
+                }
+            const bool mergeable = in.op != 59 || (in.n > 2 && in.w[2] == 1 /* Input */);
+            if (mergeable) {
+                auto it = global_ids.find(key);
+                if (it != global_ids.end()) {
+                    ids[in.w[result]] = it->second;
+                    merged.insert(in.w[result]);
+                    continue;
+                }
+            }
+            ops[result] = map(in.w[result]);
+            if (mergeable) global_ids.emplace(std::move(key), ops[result]);
+            emit(globals, in.op, ops);
+        }
+
+        // Pass B: everything else, renumbered; merged targets drop their decorations.
+        unsigned entry_points = 0;
+        in_function = false;
+        for (const Inst& in : insts) {
+            if (in.op == 54) in_function = true;
+            if (!in_function) {
+                std::vector<uint32_t> ops(in.w, in.w + in.n);
+                switch (in.op) {
+                case 17:  // OpCapability
+                    if (in.n && seen_caps.insert(in.w[0]).second) emit(caps, in.op, ops);
+                    break;
+                case 10: {  // OpExtension
+                    std::string e(reinterpret_cast<const char*>(in.w));
+                    if (seen_exts.insert(e).second) emit(exts, in.op, ops);
+                    break;
+                }
+                case 11: {  // OpExtInstImport
+                    std::string name(reinterpret_cast<const char*>(in.w + 1));
+                    auto it = import_ids.find(name);
+                    if (it != import_ids.end()) { ids[in.w[0]] = it->second; break; }
+                    ops[0] = map(in.w[0]);
+                    import_ids[name] = ops[0];
+                    emit(imports, in.op, ops);
+                    break;
+                }
+                case 14:  // OpMemoryModel
+                    if (memory_model.empty()) emit(memory_model, in.op, ops);
+                    else if (std::vector<uint32_t>(memory_model.begin() + 1, memory_model.end()) != ops) return {};
+                    break;
+                case 15: {  // OpEntryPoint: model, function, name, interface...
+                    if (in.n < 3 || ++entry_points > 1) return {};
+                    const size_t sw = string_words(in.w + 2, in.n - 2);
+                    std::vector<uint32_t> ep{in.w[0], map(in.w[1])};
+                    std::vector<uint32_t> nm = encode_string(part.first);
+                    ep.insert(ep.end(), nm.begin(), nm.end());
+                    for (size_t i = 2 + sw; i < in.n; ++i) ep.push_back(map(in.w[i]));
+                    emit(entries, in.op, ep);
+                    break;
+                }
+                case 16:  // OpExecutionMode: function, mode, literals
+                    if (!in.n) return {};
+                    ops[0] = map(in.w[0]);
+                    emit(modes, in.op, ops);
+                    break;
+                case 2: case 3: case 4: case 8: case 317: case 330:  // source / lines: dropped
+                    break;
+                case 7:  // OpString
+                    ops[0] = map(in.w[0]);
+                    emit(strings, in.op, ops);
+                    break;
+                case 5: case 6:  // OpName / OpMemberName
+                    if (!in.n || merged.count(in.w[0])) break;
+                    ops[0] = map(in.w[0]);
+                    emit(names, in.op, ops);
+                    break;
+                case 71: case 72:  // OpDecorate / OpMemberDecorate (literal operands)
+                    if (!in.n || merged.count(in.w[0])) break;
+                    ops[0] = map(in.w[0]);
+                    emit(annotations, in.op, ops);
+                    break;
+                default: {
+                    size_t result;
+                    std::vector<bool> is_id;
+                    if (!global_operand_kinds(in.op, in.n, result, is_id)) return {};
+                    break;  // emitted in pass A
+                }
+                }
+                continue;
+            }
+            std::vector<uint32_t> ops(in.w, in.w + in.n);
+            for (size_t i = 0; i < in.n; ++i) {
+                const int k = body_operand_is_id(in.op, i);
+                if (k < 0) return {};
+                if (k) ops[i] = map(in.w[i]);
+            }
+            emit(functions, in.op, ops);
+            if (in.op == 56) in_function = false;
+        }
+        if (entry_points != 1) return {};
+    }
+
+    std::vector<uint32_t> out{0x07230203, version, generator, next, 0};
+    for (const auto* sec : {&caps, &exts, &imports, &memory_model, &entries, &modes,
+                            &strings, &names, &annotations, &globals, &functions})
+        out.insert(out.end(), sec->begin(), sec->end());
+    return out;
+}
+
 } // namespace parallax
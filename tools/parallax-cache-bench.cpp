@@ -0,0 +1,175 @@
+// parallax-cache-bench.cpp - Per-call kernel lookup overhead under concurrent callers
+// Times the lookup ExecutionPolicyImpl does on every offloaded call (integer key into
+// the sharded KernelTable) against a string name in one mutex-guarded map, with
+// 1..64 calling threads. No device is needed: kernels are never compiled or launched.
+// Before timing, every caller races on the same fresh keys and the tool checks that
+// each key was compiled once and loaded once, and that all callers saw one entry;
+// it exits non-zero otherwise. The timings are only reported.
+
+#include "parallax/kernel_table.hpp"
+#include "parallax/lambda_compiler.hpp"
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/raw_ostream.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace parallax;
+using namespace llvm;
+
+static cl::OptionCategory BenchCategory("parallax-cache-bench options");
+static cl::opt<unsigned> Calls("calls", cl::desc("Lookups per thread"),
+                               cl::init(200000), cl::cat(BenchCategory));
+static cl::list<unsigned> Callers("callers", cl::desc("Calling thread counts to time"),
+                                  cl::CommaSeparated, cl::cat(BenchCategory));
+
+// One call site per functor shape the dispatch path sees: captureless and capturing
+// (f2, f3 in main), for_each and transform arity.
+static auto f0 = [](float& x) { x += 1.0f; };
+static auto f1 = [](float x) { return x * 2.0f; };
+
+// All nthreads callers released at once on the same keys, each in its own rotation,
+// doing what the dispatch path does on a miss: compile under e.compiled, then load
+// under e.loaded. Returns false (and reports) unless every key ran each step once.
+static bool checkContention(unsigned nthreads, const std::vector<uint64_t>& keys) {
+    const size_t k = keys.size();
+    std::vector<std::atomic<unsigned>> compiles(k), loads(k), wrong(k);
+    std::vector<std::atomic<KernelTable::Entry*>> seen(k);
+    std::atomic<unsigned> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < nthreads; ++t) {
+        pool.emplace_back([&, t] {
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            for (size_t j = 0; j < k; ++j) {
+                const size_t i = (j + t) % k;
+                KernelTable::Entry& e = KernelTable::instance().get(keys[i]);
+                KernelTable::Entry* expected = nullptr;
+                if (!seen[i].compare_exchange_strong(expected, &e) && expected != &e)
+                    wrong[i].fetch_add(1);
+                std::call_once(e.compiled, [&] {
+                    compiles[i].fetch_add(1);
+                    e.name = std::to_string(keys[i]);
+                    e.spirv.assign(4, static_cast<uint32_t>(keys[i]));
+                });
+                std::call_once(e.loaded, [&] {
+                    loads[i].fetch_add(1);
+                    e.handle = &e;
+                });
+                if (e.name != std::to_string(keys[i]) || e.spirv.size() != 4 || e.handle != &e)
+                    wrong[i].fetch_add(1);
+            }
+        });
+    }
+    while (ready.load() < nthreads) std::this_thread::yield();
+    go.store(true, std::memory_order_release);
+    for (auto& th : pool) th.join();
+    bool ok = true;
+    for (size_t i = 0; i < k; ++i) {
+        if (compiles[i] != 1 || loads[i] != 1 || wrong[i] != 0) {
+            errs() << "[ParallaxCacheBench] key " << keys[i] << ": " << compiles[i].load()
+                   << " compiles, " << loads[i].load() << " loads, " << wrong[i].load()
+                   << " mismatched entries\n";
+            ok = false;
+        }
+    }
+    outs() << "contention: " << nthreads << " callers, " << k << " keys, "
+           << (ok ? "one compile and one load per key" : "FAILED") << '\n';
+    return ok;
+}
+
+template <typename Lookup>
+static double timeCalls(unsigned nthreads, Lookup lookup) {
+    std::atomic<unsigned> ready{0};
+    std::atomic<bool> go{false};
+    std::vector<std::thread> pool;
+    std::vector<double> ns(nthreads);
+    for (unsigned t = 0; t < nthreads; ++t) {
+        pool.emplace_back([&, t] {
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            auto t0 = std::chrono::steady_clock::now();
+            size_t sink = 0;
+            for (unsigned i = 0; i < Calls; ++i) sink += lookup(i);
+            auto t1 = std::chrono::steady_clock::now();
+            ns[t] = std::chrono::duration<double, std::nano>(t1 - t0).count() / Calls;
+            if (sink == size_t(-1)) outs() << "";  // keep the loop observable
+        });
+    }
+    while (ready.load() < nthreads) std::this_thread::yield();
+    go.store(true, std::memory_order_release);
+    for (auto& th : pool) th.join();
+    double sum = 0;
+    for (double v : ns) sum += v;
+    return sum / nthreads;
+}
+
+int main(int argc, const char** argv) {
+    cl::HideUnrelatedOptions(BenchCategory);
+    cl::ParseCommandLineOptions(argc, argv,
+        "parallax-cache-bench: per-call kernel lookup cost with concurrent callers\n");
+
+    std::vector<unsigned> counts(Callers.begin(), Callers.end());
+    if (counts.empty()) counts = {1, 2, 4, 8, 16, 32, 64};
+
+    LambdaCompiler compiler;
+    float a = 2.0f;
+    int b = 3;
+    auto f2 = [a](float& x) { x *= a; };
+    auto f3 = [b](float x) { return x + float(b); };
+
+    // Fresh entries for the race: the four functor keys plus synthetic ones so
+    // several keys land on each shard.
+    std::vector<uint64_t> race = {compiler.get_kernel_key(f0), compiler.get_kernel_key(f1, 2),
+                                  compiler.get_kernel_key(f2), compiler.get_kernel_key(f3, 2)};
+    for (uint64_t i = 1; i <= 252; ++i) race.push_back(i * 0x9E3779B97F4A7C15ull);
+    unsigned contenders = 0;
+    for (unsigned n : counts) contenders = std::max(contenders, n);
+    if (!checkContention(std::max(contenders, 2u), race)) return 1;
+
+    // Table path: integer key, sharded shared-lock probe, once-flag already set.
+    auto table_lookup = [&](unsigned i) -> size_t {
+        uint64_t key;
+        switch (i & 3) {
+        case 0:  key = compiler.get_kernel_key(f0); break;
+        case 1:  key = compiler.get_kernel_key(f1, 2); break;
+        case 2:  key = compiler.get_kernel_key(f2); break;
+        default: key = compiler.get_kernel_key(f3, 2); break;
+        }
+        KernelTable::Entry& e = KernelTable::instance().get(key);
+        std::call_once(e.compiled, [&] { e.name = std::to_string(key); });
+        return e.spirv.size() + e.name.size();
+    };
+
+    // Baseline: the name string per call and one global lock around one map.
+    std::mutex map_mutex;
+    std::unordered_map<std::string, std::vector<uint32_t>> map;
+    auto string_lookup = [&](unsigned i) -> size_t {
+        std::string name;
+        switch (i & 3) {
+        case 0:  name = compiler.get_kernel_name(f0); break;
+        case 1:  name = compiler.get_kernel_name(f1, 2); break;
+        case 2:  name = compiler.get_kernel_name(f2); break;
+        default: name = compiler.get_kernel_name(f3, 2); break;
+        }
+        std::lock_guard<std::mutex> lock(map_mutex);
+        return map[name].size() + name.size();
+    };
+
+    outs() << "threads\ttable ns/call\tstring+mutex ns/call\n";
+    for (unsigned n : counts) {
+        if (!n) continue;
+        double t = timeCalls(n, table_lookup);
+        double m = timeCalls(n, string_lookup);
+        outs() << n << '\t' << format("%.1f", t) << "\t\t" << format("%.1f", m) << '\n';
+    }
+    errs() << "[ParallaxCacheBench] " << KernelTable::instance().size() << " table entries\n";
+    return 0;
+}
@@ -0,0 +1,125 @@
+// parallax-staging-check.cpp - Staged offload of deque/list ranges against the runtime
+// Runs staged_for_each, staged_transform and staged_reduce over std::deque and
+// std::list ranges through the runtime's device-arena buffers, once clean and once
+// with the launch of one chunk failing (a throw for for_each, a false status for
+// transform and reduce), and compares every result with the host algorithm. Reduce
+// runs on the real reduce skeleton; the for_each/transform chunks are applied to the
+// staged arena buffers on the launch thread, standing in for a JIT kernel, since the
+// policy's KernelLauncher is owned by the application. Set PARALLAX_STAGING_CHUNK to
+// a small value so the ranges span many chunks.
+
+#include "parallax/execution_policy_impl.hpp"
+#include "parallax/spirv_generator.hpp"
+#include <parallax/runtime.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/raw_ostream.h>
+#include <algorithm>
+#include <deque>
+#include <list>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace parallax;
+using namespace llvm;
+
+static cl::OptionCategory StagingCategory("parallax-staging-check options");
+static cl::opt<unsigned> Elems("n", cl::desc("Elements per range"),
+                               cl::init(100003), cl::cat(StagingCategory));
+static cl::opt<unsigned> FailAt("fail-at", cl::desc("Chunk whose launch fails in the second run"),
+                                cl::init(3), cl::cat(StagingCategory));
+
+static unsigned failures = 0;
+
+static void report(const std::string& what, bool ok) {
+    outs() << "staging: " << what << (ok ? " ok" : " MISMATCH") << '\n';
+    if (!ok) ++failures;
+}
+
+// Small integers, so every float sum and product below is exact.
+template <typename C>
+static C ramp(size_t n) {
+    C c;
+    for (size_t i = 0; i < n; ++i) c.push_back(float(i % 97));
+    return c;
+}
+
+template <typename C>
+static void checkForEach(const std::string& what, long fail_at) {
+    C data = ramp<C>(Elems), ref = data;
+    auto f = [](float& x) { x = x * 2.0f + 1.0f; };
+    std::for_each(ref.begin(), ref.end(), f);
+    long chunk = 0;
+    staged_for_each(what, data.begin(), data.end(), data.size(), f, [&](void* buf, size_t n) {
+        if (chunk++ == fail_at) throw std::runtime_error("injected launch failure");
+        std::for_each(static_cast<float*>(buf), static_cast<float*>(buf) + n, f);
+        return true;
+    });
+    report(what, data == ref);
+}
+
+template <typename C>
+static void checkTransform(const std::string& what, long fail_at) {
+    C data = ramp<C>(Elems);
+    std::vector<float> out(data.size()), ref(data.size());
+    auto op = [](float x) { return x * 3.0f - 1.0f; };
+    std::transform(data.begin(), data.end(), ref.begin(), op);
+    long chunk = 0;
+    auto end = staged_transform(what, data.begin(), data.end(), out.begin(), data.size(), op,
+        [&](void* in, void* o, size_t n) {
+            if (chunk++ == fail_at) return false;
+            std::transform(static_cast<const float*>(in), static_cast<const float*>(in) + n,
+                           static_cast<float*>(o), op);
+            return true;
+        });
+    report(what, out == ref && end == out.end());
+}
+
+template <typename C>
+static void checkReduce(const std::string& what, parallax_kernel_t kernel, long fail_at) {
+    C data = ramp<C>(Elems);
+    const float ref = std::accumulate(data.begin(), data.end(), 5.0f);
+    long chunk = 0;
+    float got = staged_reduce(what, data.begin(), data.end(), data.size(), 5.0f, std::plus<>{},
+        [&](void* buf, size_t n, float* partial) {
+            if (chunk++ == fail_at) return false;
+            return device_reduce(kernel, buf, n, partial);
+        });
+    report(what, got == ref);
+}
+
+int main(int argc, const char** argv) {
+    cl::HideUnrelatedOptions(StagingCategory);
+    cl::ParseCommandLineOptions(argc, argv,
+        "parallax-staging-check: staged deque/list offload against host results\n");
+
+    if (!staging_enabled())
+        errs() << "[ParallaxStagingCheck] PARALLAX_STAGING is not set; the policy would not stage\n";
+    const size_t chunk = staging_chunk_elems();
+    if (chunk > Elems / 4) {
+        errs() << "[ParallaxStagingCheck] PARALLAX_STAGING_CHUNK=" << chunk << " leaves fewer than 4 chunks\n";
+        return 1;
+    }
+
+    SPIRVGenerator gen;
+    gen.set_target_vulkan_version(1, 2);
+    std::vector<uint32_t> words = gen.generate_reduce_kernel(SPIRVGenerator::ReduceElemType::F32);
+    parallax_kernel_t reduce = parallax_kernel_load(words.data(), words.size());
+    if (!reduce) {
+        errs() << "[ParallaxStagingCheck] reduce skeleton did not load\n";
+        return 1;
+    }
+
+    for (long fail_at : {-1L, static_cast<long>(FailAt)}) {
+        const std::string tag = fail_at < 0 ? "" : " (chunk " + std::to_string(fail_at) + " fails)";
+        checkForEach<std::deque<float>>("for_each deque" + tag, fail_at);
+        checkForEach<std::list<float>>("for_each list" + tag, fail_at);
+        checkTransform<std::deque<float>>("transform deque" + tag, fail_at);
+        checkTransform<std::list<float>>("transform list" + tag, fail_at);
+        checkReduce<std::deque<float>>("reduce deque" + tag, reduce, fail_at);
+        checkReduce<std::list<float>>("reduce list" + tag, reduce, fail_at);
+    }
+    errs() << "[ParallaxStagingCheck] " << failures << " mismatch(es), chunk " << chunk << "\n";
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,198 @@
+// parallax-tune.cpp - Offline autotuner for the fixed GPU skeletons
+// Generates reduce/scan/sort variants per workgroup size through SPIRVGenerator,
+// times them on the local Vulkan device through the runtime's launch entry points
+// and writes the tuning database the plugin reads with -tune-db=path.
+
+#include "parallax/spirv_generator.hpp"
+#include <parallax/runtime.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/raw_ostream.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace parallax;
+using namespace llvm;
+
+static cl::OptionCategory TuneCategory("parallax-tune options");
+static cl::opt<std::string> OutputPath("o", cl::desc("Tuning database to write"),
+                                       cl::init("parallax.tunedb"), cl::cat(TuneCategory));
+static cl::list<unsigned> LocalSizes("local-sizes", cl::desc("Workgroup sizes to try"),
+                                     cl::CommaSeparated, cl::cat(TuneCategory));
+static cl::list<unsigned> SizesLog2("sizes", cl::desc("Input sizes to time, as log2(n)"),
+                                    cl::CommaSeparated, cl::cat(TuneCategory));
+static cl::list<std::string> Skeletons("skeletons", cl::desc("Skeletons: reduce, scan, sort"),
+                                       cl::CommaSeparated, cl::cat(TuneCategory));
+static cl::list<std::string> Elems("elems", cl::desc("Element types: f32, f64, i32, i64"),
+                                   cl::CommaSeparated, cl::cat(TuneCategory));
+static cl::opt<unsigned> Reps("reps", cl::desc("Timed runs per variant (the best is kept)"),
+                              cl::init(5), cl::cat(TuneCategory));
+
+using Elem = SPIRVGenerator::ReduceElemType;
+
+// Runtimes that can release a loaded module export this; others keep every variant
+// until exit.
+extern "C" __attribute__((weak)) void parallax_kernel_free(parallax_kernel_t);
+
+static void freeKernel(parallax_kernel_t k) {
+    if (k && parallax_kernel_free) parallax_kernel_free(k);
+}
+
+static bool parseElem(const std::string& s, Elem& e, size_t& size) {
+    if (s == "f32") { e = Elem::F32; size = 4; return true; }
+    if (s == "f64") { e = Elem::F64; size = 8; return true; }
+    if (s == "i32") { e = Elem::I32; size = 4; return true; }
+    if (s == "i64") { e = Elem::I64; size = 8; return true; }
+    return false;
+}
+
+// Inputs whose results are exact in every element type: reduce/scan over ones
+// (n <= 2^24 stays exact in f32), sort over a descending ramp.
+template <typename T>
+static void fill(T* p, size_t n, const std::string& skeleton) {
+    for (size_t i = 0; i < n; ++i) p[i] = skeleton == "sort" ? T(n - i) : T(1);
+}
+
+template <typename T>
+static bool check(const T* p, size_t n, const T& reduced, const std::string& skeleton) {
+    if (skeleton == "reduce") return reduced == T(n);
+    for (size_t i = 0; i < n; ++i)
+        if (p[i] != T(i + 1)) return false;  // scan of ones and the sorted ramp agree
+    return true;
+}
+
+template <typename T>
+static bool checkTyped(const void* data, size_t n, const void* out, const std::string& skeleton) {
+    return check(static_cast<const T*>(data), n, *static_cast<const T*>(out), skeleton);
+}
+
+template <typename T>
+static void fillTyped(void* data, size_t n, const std::string& skeleton) {
+    fill(static_cast<T*>(data), n, skeleton);
+}
+
+// One timed run of a variant. Returns ns, or -1 when the result is wrong (a runtime
+// that sizes its grid for a fixed LocalSize miscomputes other sizes; such variants
+// must never reach the database).
+static double runOnce(const std::string& skeleton, Elem elem, size_t esz, size_t n,
+                      parallax_kernel_t k0, parallax_kernel_t k1, void* data) {
+    void (*fillFn)(void*, size_t, const std::string&) = nullptr;
+    bool (*checkFn)(const void*, size_t, const void*, const std::string&) = nullptr;
+    switch (elem) {
+    case Elem::F32: fillFn = fillTyped<float>;   checkFn = checkTyped<float>;   break;
+    case Elem::F64: fillFn = fillTyped<double>;  checkFn = checkTyped<double>;  break;
+    case Elem::I32: fillFn = fillTyped<int32_t>; checkFn = checkTyped<int32_t>; break;
+    case Elem::I64: fillFn = fillTyped<int64_t>; checkFn = checkTyped<int64_t>; break;
+    }
+    fillFn(data, n, skeleton);
+    alignas(8) unsigned char out[8] = {};
+
+    auto t0 = std::chrono::steady_clock::now();
+    if (skeleton == "reduce")    parallax_reduce(k0, data, n, esz, out);
+    else if (skeleton == "scan") parallax_scan(k0, k1, data, n, esz);
+    else                         parallax_sort(k0, data, n, esz);
+    auto t1 = std::chrono::steady_clock::now();
+
+    if (!checkFn(data, n, out, skeleton)) return -1;
+    return std::chrono::duration<double, std::nano>(t1 - t0).count();
+}
+
+int main(int argc, const char** argv) {
+    cl::HideUnrelatedOptions(TuneCategory);
+    cl::ParseCommandLineOptions(argc, argv,
+        "parallax-tune: time skeleton variants on this device and write a tuning database\n");
+
+    std::vector<unsigned> locals(LocalSizes.begin(), LocalSizes.end());
+    if (locals.empty()) locals = {64, 128, 256, 512, 1024};
+    std::vector<unsigned> sizes(SizesLog2.begin(), SizesLog2.end());
+    if (sizes.empty()) sizes = {12, 16, 20, 22};
+    std::vector<std::string> skeletons(Skeletons.begin(), Skeletons.end());
+    if (skeletons.empty()) skeletons = {"reduce", "scan", "sort"};
+    std::vector<std::string> elems(Elems.begin(), Elems.end());
+    if (elems.empty()) elems = {"f32", "f64", "i32", "i64"};
+
+    std::ofstream db(OutputPath);
+    if (!db) {
+        errs() << "[ParallaxTune] cannot write " << OutputPath << "\n";
+        return 1;
+    }
+    db << "# parallax-tune 1\n";
+    db << "# skeleton\telem\tlog2_n\tlocal_size\tns_per_elem\n";
+
+    unsigned rows = 0;
+    for (const std::string& skeleton : skeletons) {
+        if (skeleton != "reduce" && skeleton != "scan" && skeleton != "sort") {
+            errs() << "[ParallaxTune] unknown skeleton '" << skeleton << "'\n";
+            continue;
+        }
+        for (const std::string& en : elems) {
+            Elem elem;
+            size_t esz;
+            if (!parseElem(en, elem, esz)) {
+                errs() << "[ParallaxTune] unknown element type '" << en << "'\n";
+                continue;
+            }
+            for (unsigned lg : sizes) {
+                if (lg > 24) continue;  // keeps the ones-input exact in f32
+                const size_t n = size_t(1) << lg;
+                void* data = parallax_arena_alloc(n * esz, 16);
+                if (!data) {
+                    errs() << "[ParallaxTune] no device arena for 2^" << lg << " elements\n";
+                    continue;
+                }
+                unsigned best_local = 0;
+                double best_ns = 0;
+                for (unsigned local : locals) {
+                    SPIRVGenerator g0, g1;
+                    g0.set_target_vulkan_version(1, 2);
+                    g1.set_target_vulkan_version(1, 2);
+                    g0.set_local_size(local);
+                    g1.set_local_size(local);
+                    std::vector<uint32_t> w0 = skeleton == "reduce" ? g0.generate_reduce_kernel(elem)
+                                             : skeleton == "scan"   ? g0.generate_scan_kernel(elem)
+                                                                    : g0.generate_sort_kernel(elem);
+                    std::vector<uint32_t> w1;
+                    if (skeleton == "scan") w1 = g1.generate_scan_add_kernel(elem);
+                    parallax_kernel_t k0 = parallax_kernel_load(w0.data(), w0.size());
+                    parallax_kernel_t k1 = w1.empty() ? nullptr : parallax_kernel_load(w1.data(), w1.size());
+                    if (!k0 || (!w1.empty() && !k1)) {
+                        errs() << "[ParallaxTune] " << skeleton << "/" << en << " LocalSize " << local
+                               << ": kernel did not load\n";
+                        freeKernel(k0);
+                        freeKernel(k1);
+                        continue;
+                    }
+                    double ns = runOnce(skeleton, elem, esz, n, k0, k1, data);  // warm-up + check
+                    for (unsigned r = 0; ns >= 0 && r < Reps; ++r) {
+                        double t = runOnce(skeleton, elem, esz, n, k0, k1, data);
+                        ns = t < 0 ? t : (r == 0 ? t : std::min(ns, t));
+                    }
+                    freeKernel(k0);
+                    freeKernel(k1);
+                    if (ns < 0) {
+                        errs() << "[ParallaxTune] " << skeleton << "/" << en << " LocalSize " << local
+                               << " 2^" << lg << ": wrong result, skipped\n";
+                        continue;
+                    }
+                    outs() << skeleton << "/" << en << " 2^" << lg << " LocalSize " << local << ": "
+                           << format("%.3f", ns / double(n)) << " ns/elem\n";
+                    if (!best_local || ns < best_ns) { best_local = local; best_ns = ns; }
+                }
+                parallax_arena_free(data);
+                if (!best_local) continue;
+                char per_elem[32];
+                std::snprintf(per_elem, sizeof(per_elem), "%.4f", best_ns / double(n));
+                db << skeleton << '\t' << en << '\t' << lg << '\t' << best_local << '\t'
+                   << per_elem << '\n';
+                ++rows;
+            }
+        }
+    }
+    errs() << "[ParallaxTune] wrote " << rows << " row(s) to " << OutputPath << "\n";
+    return rows ? 0 : 1;
+}